@@ -0,0 +1,21 @@
+#ifndef FDS_CONFIG_H__
+#define FDS_CONFIG_H__
+
+/* FDS configuration of the application, found before the one of the SDK on the include path.
+ *
+ * FDS_VIRTUAL_PAGES is set in the project defines (Keil and armgcc/Makefile) and the flash regions of the
+ * .sct and .ld files end below the FDS pages at the top of flash, change all of them together. The pages
+ * hold the history blocks (see HISTORY_LOG_MAX_BLOCKS), the records of the peer manager, the configuration,
+ * the fault record and the event recorder copy (HISTORY_LOG_FDS_SHARED_PAGES), and the swap page. */
+
+#define FDS_OP_QUEUE_SIZE           (4)                                 /**< Operations FDS can queue. */
+#define FDS_CHUNK_QUEUE_SIZE        (8)                                 /**< Record chunks FDS can buffer. */
+#define FDS_MAX_USERS               (8)                                 /**< Peer manager, flash scheduler, configuration, history, fault record and event recorder. */
+
+#ifndef FDS_VIRTUAL_PAGES
+#define FDS_VIRTUAL_PAGES           (6)                                 /**< Flash pages used by FDS, the swap page included. */
+#endif
+
+#define FDS_VIRTUAL_PAGE_SIZE       (1024)                              /**< Size of a virtual page (in words), one flash page. */
+
+#endif // FDS_CONFIG_H__
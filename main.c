@@ -26,7 +26,6 @@
 #include "app_error.h"
 #include "ble_hci.h"
 #include "ble_advdata.h"
-#include "ble_advertising.h"
 #include "ble_conn_params.h"
 #include "softdevice_handler.h"
 #include "app_timer.h"
@@ -41,25 +40,43 @@
 #include "fds.h"
 #include "peer_manager.h"
 #include "ble_conn_state.h"
+#include "app_config.h"
+#include "app_time.h"
+#include "history_log.h"
+#include "flash_sched.h"
+#include "fault_record.h"
+#include "sample_queue.h"
+#include "ble_dispatch.h"
+#include "power_mgr.h"
+#include "energy_model.h"
+#include "sensor_pipeline.h"
+#include "cycle_prof.h"
+#include "bin_log.h"
+#include "app_stats.h"
+#include "latency_trace.h"
+#include "ram_usage.h"
+#include "adv_ctrl.h"
+#include "adv_policy.h"
+#include "time_sync.h"
+#include "sdc_frame.h"
+#include "link_bench.h"
+#include "evt_record.h"
 
 
 #define IS_SRVC_CHANGED_CHARACT_PRESENT 0                                           /**< Include the service_changed characteristic. If not enabled, the server's database cannot be changed for the lifetime of the device. */
 
 #define CENTRAL_LINK_COUNT              0                                           /**<number of central links used by the application. When changing this number remember to adjust the RAM settings*/
-#define PERIPHERAL_LINK_COUNT           1                                           /**<number of peripheral links used by the application. When changing this number remember to adjust the RAM settings*/
+#define PERIPHERAL_LINK_COUNT           BLE_SDC_MAX_LINKS                           /**<number of peripheral links used by the application, one per client the service tracks. When changing this number remember to adjust the RAM settings (host/ram_layout)*/
 
 #define DEVICE_NAME                     "ParkLett"                                  /**< Name of device. Will be included in the advertising data. */
+#define APP_ADV_DIRECTED_BURSTS         1                                           /**< High duty directed bursts (1.28 s each) to the lost gateway after a disconnect. */
+#define APP_ADV_WHITELIST_INTERVAL      MSEC_TO_UNITS(40, UNIT_0_625_MS)            /**< Advertising interval for bonded gateways only (40 ms). */
+#define APP_ADV_WHITELIST_TIMEOUT       10                                          /**< Time advertising for bonded gateways only before open advertising (in seconds). */
 #define SDC_SERVICE_UUID_TYPE           BLE_UUID_TYPE_VENDOR_BEGIN                  /**< UUID type for the Nordic UART Service (vendor specific). */
 
-#define APP_ADV_INTERVAL                480                                         /**< The advertising interval (in units of 0.625 ms. This value corresponds to 300 ms). */
-#define APP_ADV_TIMEOUT_IN_SECONDS      20                                          /**< The advertising timeout (in units of seconds). */
-
-#define APP_TIMER_PRESCALER             0                                           /**< Value of the RTC1 PRESCALER register. */
-#define APP_TIMER_OP_QUEUE_SIZE         4                                           /**< Size of timer operation queues. */
-
-#define MIN_CONN_INTERVAL               MSEC_TO_UNITS(20, UNIT_1_25_MS)             /**< Minimum acceptable connection interval (20 ms), Connection interval uses 1.25 ms units. */
-#define MAX_CONN_INTERVAL               MSEC_TO_UNITS(75, UNIT_1_25_MS)             /**< Maximum acceptable connection interval (75 ms), Connection interval uses 1.25 ms units. */
-#define SLAVE_LATENCY                   0                                           /**< Slave latency. */
+#define MIN_CONN_INTERVAL               MSEC_TO_UNITS(APP_CONN_INTERVAL_MIN_MS, UNIT_1_25_MS)  /**< Minimum acceptable connection interval (20 ms), Connection interval uses 1.25 ms units. */
+#define MAX_CONN_INTERVAL               MSEC_TO_UNITS(APP_CONN_INTERVAL_MAX_MS, UNIT_1_25_MS)  /**< Maximum acceptable connection interval (75 ms), Connection interval uses 1.25 ms units. */
+#define SLAVE_LATENCY                   APP_SLAVE_LATENCY                           /**< Slave latency. */
 #define CONN_SUP_TIMEOUT                MSEC_TO_UNITS(4000, UNIT_10_MS)             /**< Connection supervisory timeout (4 seconds), Supervision Timeout uses 10 ms units. */
 #define FIRST_CONN_PARAMS_UPDATE_DELAY  APP_TIMER_TICKS(5000, APP_TIMER_PRESCALER)  /**< Time from initiating event (connect or start of notification) to first time sd_ble_gap_conn_param_update is called (5 seconds). */
 #define NEXT_CONN_PARAMS_UPDATE_DELAY   APP_TIMER_TICKS(30000, APP_TIMER_PRESCALER) /**< Time between each call to sd_ble_gap_conn_param_update after the first call (30 seconds). */
@@ -79,25 +96,96 @@
 #define UART_TX_BUF_SIZE                256                                         /**< UART TX buffer size. */
 #define UART_RX_BUF_SIZE                256                                         /**< UART RX buffer size. */
 
-#define SAMPLES_IN_BUFFER               30                                          /**< Setting the number of samples the saadc is getting before sending the result. */
 #define BATTERY_SAMPLES                 1
+#define SAMPLE_BUFFER_COUNT             SAMPLE_QUEUE_SIZE                           /**< SAADC buffers, one is converting while the others wait for the main loop. */
+
+#define SDC_CMD_CONFIG_SET              0x01                                        /**< Control command: set a configuration parameter. Format: opcode, param, value (uint16 LE). */
+#define SDC_CMD_CONFIG_RESET            0x02                                        /**< Control command: restore the factory configuration. Format: opcode. */
+#define SDC_CMD_DIAG_SELECT             0x03                                        /**< Control command: select the page returned by the diagnostics characteristic. Format: opcode, page, argument (section of the profile page, stage of the latency page, entry of the dispatch page). */
+#define SDC_CMD_STATS_RESET             0x04                                        /**< Control command: clear the runtime counters. Format: opcode. */
+#define SDC_CMD_TIME_SYNC               0x05                                        /**< Control command: set the time. Format: opcode, Unix time in ms (uint64 LE). */
+#define SDC_CMD_HISTORY_READ            0x06                                        /**< Control command: send the history blocks overlapping a time range on the history stream. Format: opcode, from, to (uint32 LE, seconds of app_time_synced_now()). */
+#define SDC_CMD_LINK_BENCH              0x07                                        /**< Control command: run the link throughput benchmark, results on DIAG_PAGE_BENCH. Format: opcode, duration in seconds (0 stops it). */
+#define SDC_CMD_EVT_RECORD              0x08                                        /**< Control command: control the event recorder, read out on DIAG_PAGE_EVENTS. Format: opcode, action (SDC_EVT_RECORD_*). */
+
+#define SDC_EVT_RECORD_RESUME           0                                           /**< SDC_CMD_EVT_RECORD action: record again. */
+#define SDC_EVT_RECORD_PAUSE            1                                           /**< SDC_CMD_EVT_RECORD action: stop recording, before reading the ring. */
+#define SDC_EVT_RECORD_SAVE             2                                           /**< SDC_CMD_EVT_RECORD action: copy the ring to flash. */
+#define DIAG_EVENTS_ARG_FLASH           0x80                                        /**< DIAG_PAGE_EVENTS argument bit: read the flash copy instead of the ring. */
+#define SDC_BULK_TX_RESERVE             2                                           /**< TX buffers of every link kept free of history frames for the live streams. */
+
+/* Pages of the diagnostics characteristic. */
+typedef enum
+{
+    DIAG_PAGE_FAULT,                                                                /**< Last fault record, see fault_record_encode(). */
+    DIAG_PAGE_POWER,                                                                /**< Power state and time in each state, see power_mgr_encode(). */
+    DIAG_PAGE_ENERGY,                                                               /**< Estimated average current and battery life, see energy_model_encode(). */
+    DIAG_PAGE_PROFILE,                                                              /**< Durations of one profiled section, see cycle_prof_encode(). Empty without CYCLE_PROF_ENABLED. */
+    DIAG_PAGE_STATS,                                                                /**< Runtime counters, see app_stats_encode(). */
+    DIAG_PAGE_LATENCY,                                                              /**< Latency of one stage from SAADC to air, see latency_trace_encode(). */
+    DIAG_PAGE_RAM,                                                                  /**< RAM start, SoftDevice RAM start and stack high-water mark, see ram_usage_encode(). */
+    DIAG_PAGE_ADVERTISING,                                                          /**< Advertising mode, interval and time and events per mode, see adv_ctrl_encode(). */
+    DIAG_PAGE_TIME,                                                                 /**< Time synchronization state and drift estimate, see time_sync_encode(). */
+    DIAG_PAGE_LINKS,                                                                /**< Connections, their notification state and TX buffers, see ble_sdc_links_encode(). */
+    DIAG_PAGE_BENCH,                                                                /**< Link benchmark result of one entry of the link table, see link_bench_encode(). */
+    DIAG_PAGE_EVENTS,                                                               /**< Recorded SoftDevice events, one chunk (argument bits 6-0) of the ring or flash copy, see evt_record_encode(). */
+    DIAG_PAGE_DISPATCH,                                                             /**< Calls and cycles of one entry of the BLE dispatch table, see ble_dispatch_encode(). */
+    DIAG_PAGE_COUNT
+} diag_page_t;
 
 static ble_sdc_t                        m_sdc;                                      /**< Structure to identify the Send Data Custom service. */
-static uint16_t                         m_conn_handle = BLE_CONN_HANDLE_INVALID;    /**< Handle of the current connection. */
+static uint16_t                         m_conn_handle = BLE_CONN_HANDLE_INVALID;    /**< Handle of the latest connection, the one the Connection Parameters module negotiates (it follows a single link). */
+static uint8_t                          m_link_count = PERIPHERAL_LINK_COUNT;       /**< Peripheral links enabled in the SoftDevice, 1 if the RAM start is too low for PERIPHERAL_LINK_COUNT. */
+static uint8_t                          m_conn_count;                               /**< Connections up. */
+static uint8_t                          m_trace_link = BLE_SDC_LINK_NONE;           /**< Entry of m_sdc.links the latency trace follows. */
 static ble_uuid_t                       m_adv_uuids[] = {{BLE_UUID_SDC_SERVICE, SDC_SERVICE_UUID_TYPE}};  /**< Universally unique service identifier. */
-static nrf_saadc_value_t                m_adc_buf[SAMPLES_IN_BUFFER];                 /**< Data buffer saadc. */
+static nrf_saadc_value_t                m_adc_buf[SAMPLE_BUFFER_COUNT][SAMPLES_IN_BUFFER]; /**< Data buffers saadc. */
+static sample_queue_t                   m_ready_queue;                              /**< Completed buffers, from the SAADC interrupt to the main loop. */
+static sample_queue_t                   m_free_queue;                               /**< Processed buffers, from the main loop back to the SAADC interrupt. */
 static uint32_t                         m_buffer_bat;
+static bool                             m_buffer_bat_valid;                         /**< m_buffer_bat holds a measurement. Not set yet, the SAADC driver owns RESULT.PTR, so get_battery_low_warning() can not run. */
+static uint32_t                         m_notifications_sent;                       /**< Notifications accepted by the SoftDevice. */
 static const nrf_drv_timer_t            m_timer = NRF_DRV_TIMER_INSTANCE(1);        /**< Timer Instance to Timer 1. */
 static nrf_ppi_channel_t                m_ppi_channel;                              /**< Structure to identify the ppi channel setup. */
-
-uint8_t                                 m_old_value = 0;                              /**< To stabilize the sensor value due to its irregular behavior */
+static diag_page_t                      m_diag_page = DIAG_PAGE_FAULT;              /**< Page returned by the diagnostics characteristic. */
+static uint8_t                          m_diag_arg;                                 /**< Argument of the selected page. */
+static uint32_t                         m_sample_done_us;                           /**< Completion time of the buffer being processed. */
+static sdc_frame_mux_t                  m_frames;                                   /**< Frames waiting for a TX buffer, per stream. Only used by the main loop. */
+static volatile bool                    m_frames_flush_pending;                     /**< TX buffers were freed, the main loop sends the queued frames. */
+static volatile bool                    m_battery_warning_pending;                  /**< A client subscribed, the main loop sends it the battery warning. */
+static uint32_t                         m_value_stamps[SDC_FRAME_QUEUE_SIZE][2];    /**< DONE and FILTER stamps of the value frames, by slot of the value queue, for the latency trace. */
+static history_log_cursor_t             m_history_cursor;                           /**< History transfer in progress. */
+static volatile bool                    m_history_reading;
+static volatile bool                    m_history_requested;                        /**< A transfer of m_history_range was requested. */
+static bool                             m_bulk_active;                              /**< POWER_EVT_BULK_START was raised for a history transfer or the link benchmark. */
+static uint32_t                         m_history_range[2];                         /**< From and to of the requested transfer (in seconds). Written by the BLE event handler, copied by the main loop in a critical region. */
+static bool                             m_link_lost;                                /**< The last connection ended in a supervision timeout. */
+static bool                             m_adv_started;                              /**< Advertising has been started since boot. */
+static volatile bool                    m_occupancy_changed;                        /**< A presence check saw the occupancy change. */
+static ble_gap_addr_t                   m_peer_addr;                                /**< Identity address of the last bonded peer, target of directed advertising. */
+static bool                             m_peer_addr_valid;
+static ble_gap_addr_t                 * m_whitelist_addrs[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+static ble_gap_irk_t                  * m_whitelist_irks[BLE_GAP_WHITELIST_IRK_MAX_COUNT];
+static ble_gap_whitelist_t              m_whitelist;                                /**< Bonded peers, filled in by the peer manager. */
 
 /* Forward decleration of enable/disable saadc trough ppi functions. */
 void saadc_sampling_event_enable(void);                                     
 void saadc_sampling_event_disable(void);
 
-static void get_battery_low_warning(void);
+/*static void get_battery_low_warning(void);*/
 static void send_battery_low_warning(void);
+static uint16_t ble_dispatch_stats_encode(uint8_t index, uint8_t * p_buf, uint16_t buf_len);
+
+
+/**@brief Function for handling errors. Overrides the weak handler of the SDK.
+ *
+ * @details The error is saved as a fault record, it is committed to flash and reported over BLE after the reset.
+ */
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t * p_file_name)
+{
+    fault_record_save(error_code, line_num, p_file_name, FAULT_RECORD_PC(), FAULT_RECORD_LR());
+    NVIC_SystemReset();
+}
 
 
 /**@brief Function for assert macro callback.
@@ -139,51 +227,396 @@ static void gap_params_init(void)
     APP_ERROR_CHECK(err_code);
 }
 
-/* Data handler dummy for initializing the Send Data Custom service in services_init() */
-static void sdc_data_handler(ble_sdc_t * p_sdc, uint8_t * p_data, uint16_t length)
+/* Returns the interval of the connection events of all links together (in ms), 0 if not connected. */
+static uint32_t conn_interval_combined_ms(void)
 {
-  
+    uint32_t events_per_min = 0;
+    uint8_t  i;
+
+    for (i = 0; i < BLE_SDC_MAX_LINKS; i++)
+    {
+        if ((m_sdc.links[i].conn_handle != BLE_CONN_HANDLE_INVALID) && (m_sdc.links[i].conn_interval_ms != 0))
+        {
+            events_per_min += 60000 / m_sdc.links[i].conn_interval_ms;
+        }
+    }
+    return (events_per_min == 0) ? 0 : (60000 / events_per_min);
 }
 
-/**@brief Function for initializing services that will be used by the application.
- */
-static void services_init(void)
+/* Function for estimating the average current and battery life from the activity since boot. */
+static void energy_estimate_get(energy_estimate_t * p_estimate)
 {
-    uint32_t       err_code;
-    ble_sdc_init_t sdc_init;
-    
-    memset(&sdc_init, 0, sizeof(sdc_init)); // Function for setting the given struct to zeros (or any other given value). 
+    static const energy_profile_t profile = ENERGY_PROFILE_DEFAULT;
+    energy_activity_t             activity;
+    flash_sched_stats_t           flash_stats;
+    adv_ctrl_stats_t              adv_stats;
+    uint8_t                       state;
+
+    memset(&activity, 0, sizeof(activity));
+    for (state = 0; state < POWER_STATE_COUNT; state++)
+    {
+        activity.time_in_state_ms[state] = power_mgr_time_in_state_get((power_state_t)state);
+    }
+    flash_sched_stats_get(&flash_stats);
+    adv_ctrl_stats_get(&adv_stats);
+
+    activity.check_ms            = power_mgr_check_time_get();
+    activity.adv_events          = adv_stats.events[ADV_CTRL_MODE_WHITELIST] + adv_stats.events[ADV_CTRL_MODE_OPEN];
+    activity.adv_directed_events = adv_stats.events[ADV_CTRL_MODE_DIRECTED];
+    activity.conn_interval_ms    = conn_interval_combined_ms();
+    activity.notifications       = m_notifications_sent;
+    activity.flash_words         = flash_stats.words_written;
+    activity.flash_page_erases   = flash_stats.gc_runs;
+
+    energy_model_estimate(&profile, &m_app_config, &activity, p_estimate);
+}
 
-    sdc_init.data_handler = sdc_data_handler; // Setting the handler part of the sdc_init struct to be the dummy handler implemented above.
-    
-    err_code = ble_sdc_init(&m_sdc, &sdc_init); // Initializing the Send Data Custom service with the given structs.
-    APP_ERROR_CHECK(err_code);
+/* Returns true for the send errors that only mean the value could not go out right now. */
+static bool sdc_send_err_is_transient(uint32_t err_code)
+{
+    return (err_code == NRF_SUCCESS)
+           || (err_code == NRF_ERROR_INVALID_STATE)
+           || (err_code == BLE_ERROR_NO_TX_PACKETS)
+           || (err_code == BLE_ERROR_GATTS_SYS_ATTR_MISSING);
+}
+
+/* Picks the link the latency trace follows when it has none: the first subscribed link without notifications
+ * in flight, so its TX complete counts match the FIFO from the start. */
+static void trace_link_select(void)
+{
+    uint8_t i;
+
+    if (m_trace_link != BLE_SDC_LINK_NONE)
+    {
+        return;
+    }
+    for (i = 0; i < BLE_SDC_MAX_LINKS; i++)
+    {
+        if ((m_sdc.links[i].conn_handle != BLE_CONN_HANDLE_INVALID)
+            && m_sdc.links[i].is_notification_enabled
+            && (m_sdc.links[i].tx_free == m_sdc.links[i].tx_count))
+        {
+            m_trace_link = i;
+            return;
+        }
+    }
+}
+
+/* Function for sending data to the clients of the Send Data Custom Service, once for all of them. Counts the
+ * notifications for the energy estimate and the results for app_stats. *p_traced is set if the data went
+ * onto the link the latency trace follows. */
+static uint32_t sdc_data_send(uint8_t * p_data, uint16_t length, bool * p_traced)
+{
+    uint8_t links;
+
+    trace_link_select();
+
+    CYCLE_PROF_START(CYCLE_PROF_SDC_DATA_SEND);
+    uint32_t err_code = ble_sdc_data_send(&m_sdc, p_data, length, &links);
+    CYCLE_PROF_END(CYCLE_PROF_SDC_DATA_SEND);
+
+    app_stats_send_result(err_code);
+    *p_traced = (m_trace_link != BLE_SDC_LINK_NONE) && ((links & (1 << m_trace_link)) != 0);
+    while (links != 0)
+    {
+        m_notifications_sent += links & 1;
+        links >>= 1;
+    }
+    return err_code;
 }
 
+/* Returns true if a notification of history frames only may take a TX buffer: every subscribed link keeps
+ * SDC_BULK_TX_RESERVE buffers for the live streams, so a value never waits behind a burst of history. */
+static bool bulk_tx_allowed(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < BLE_SDC_MAX_LINKS; i++)
+    {
+        if ((m_sdc.links[i].conn_handle != BLE_CONN_HANDLE_INVALID)
+            && m_sdc.links[i].is_notification_enabled
+            && (m_sdc.links[i].tx_free <= SDC_BULK_TX_RESERVE))
+        {
+            return false;
+        }
+    }
+    return true;
+}
 
-/* Handler for Send Data Custom Service on BLE events. */
-void ble_sdc_on_ble_evt(ble_sdc_t * p_sdc, ble_evt_t * p_ble_evt)
+/* Tops up the history stream with the next bytes of the transfer. An empty frame ends it. Runs in the main
+ * loop, as the writes to the history. */
+static void history_frames_fill(void)
 {
-    if ((p_sdc == NULL) || (p_ble_evt == NULL))
+    uint8_t  payload[SDC_FRAME_MAX_PAYLOAD];
+    uint16_t len;
+
+    while (m_history_reading && (sdc_frame_room(&m_frames, SDC_STREAM_HISTORY) > 0))
+    {
+        len = history_log_read(&m_history_cursor, payload, sizeof(payload));
+        (void)sdc_frame_put(&m_frames, SDC_STREAM_HISTORY, payload, (uint8_t)len);
+        m_history_reading = (len != 0);
+    }
+}
+
+/* Function for sending the queued frames, as many to a notification as fit, until the SoftDevice has no TX
+ * buffers left. Called by the main loop after queuing frames and when TX complete set m_frames_flush_pending,
+ * so the notifications run with the SAADC interrupt and the BLE events enabled. */
+static void frames_flush(void)
+{
+    uint8_t            data[SDC_FRAME_MAX_NOTIF_LEN];
+    uint16_t           len;
+    uint32_t           err_code;
+    uint8_t            stream;
+    bool               bulk_only;
+    bool               traced;
+    sdc_frame_packed_t packed;
+
+    for (;;)
+    {
+        len = sdc_frame_pack(&m_frames, data, sizeof(data), &packed);
+        if (len == 0)
+        {
+            return;
+        }
+        bulk_only = true;
+        for (stream = 0; stream < SDC_STREAM_HISTORY; stream++)
+        {
+            bulk_only = bulk_only && (packed.counts[stream] == 0);
+        }
+        if (bulk_only && !bulk_tx_allowed())
+        {
+            return;
+        }
+
+        err_code = sdc_data_send(data, len, &traced);
+        if (err_code != NRF_SUCCESS)
+        {
+            if (!sdc_send_err_is_transient(err_code))
+            {
+                APP_ERROR_HANDLER(err_code);
+            }
+            if (err_code != BLE_ERROR_NO_TX_PACKETS)
+            {
+                // Nobody to send to, old values are of no use to the next client.
+                sdc_frame_clear(&m_frames);
+                m_history_reading = false;
+            }
+            // Otherwise the frames wait for TX complete.
+            return;
+        }
+
+        if (traced)
+        {
+            // A notification is traced with its oldest value.
+            if (packed.counts[SDC_STREAM_VALUE] > 0)
+            {
+                uint8_t slot = m_frames.queues[SDC_STREAM_VALUE].head;
+
+                latency_trace_sent(m_value_stamps[slot][0], m_value_stamps[slot][1], (uint32_t)app_time_us_get());
+            }
+            else
+            {
+                latency_trace_untracked_sent();
+            }
+        }
+        sdc_frame_commit(&m_frames, &packed);
+    }
+}
+
+/* Function for queuing a frame and sending what fits. Returns false if the queue of the stream was full. */
+static bool frame_send(sdc_stream_t stream, uint8_t const * p_payload, uint8_t len)
+{
+    bool queued = sdc_frame_put(&m_frames, stream, p_payload, len);
+
+    if (!queued)
+    {
+        APP_STATS_INC(APP_STATS_FRAMES_DROPPED);
+    }
+    frames_flush();
+    return queued;
+}
+
+/* Data handler for commands written to the control characteristic of the Send Data Custom service. */
+static void sdc_data_handler(ble_sdc_t * p_sdc, uint8_t * p_data, uint16_t length)
+{
+    if (length == 0)
     {
         return;
     }
 
-    switch (p_ble_evt->header.evt_id)
+    switch (p_data[0])
     {
-        case BLE_GAP_EVT_CONNECTED:
-            on_connect(p_sdc, p_ble_evt);
+        case SDC_CMD_CONFIG_SET:
+            if (length == 4)
+            {
+                // Invalid parameters are ignored, the client can read back the result by other means.
+                (void)app_config_set((app_config_param_t)p_data[1], uint16_decode(&p_data[2]));
+            }
             break;
 
-        case BLE_GAP_EVT_DISCONNECTED:
-            on_disconnect(p_sdc, p_ble_evt);
-            saadc_sampling_event_disable();
+        case SDC_CMD_CONFIG_RESET:
+            (void)app_config_reset();
+            break;
+
+        case SDC_CMD_DIAG_SELECT:
+            if ((length >= 2) && (p_data[1] < DIAG_PAGE_COUNT))
+            {
+                m_diag_page = (diag_page_t)p_data[1];
+            }
+            if (length == 3)
+            {
+                m_diag_arg = p_data[2];
+            }
+            break;
+
+        case SDC_CMD_STATS_RESET:
+            app_stats_reset();
             break;
 
-        case BLE_GATTS_EVT_WRITE:
-            on_write(p_sdc, p_ble_evt);
-            send_battery_low_warning();
-            saadc_sampling_event_enable();
+        case SDC_CMD_TIME_SYNC:
+            if (length == 9)
+            {
+                // Times before 2000 are ignored.
+                (void)app_time_sync(((uint64_t)uint32_decode(&p_data[5]) << 32) | uint32_decode(&p_data[1]));
+            }
+            break;
+
+        case SDC_CMD_HISTORY_READ:
+            if (length == 9)
+            {
+                // Started by the main loop. A new request restarts the transfer, the client finds the start of
+                // the first block by its magic.
+                m_history_range[0]  = uint32_decode(&p_data[1]);
+                m_history_range[1]  = uint32_decode(&p_data[5]);
+                m_history_requested = true;
+            }
+            break;
+
+        case SDC_CMD_LINK_BENCH:
+            if (length == 2)
+            {
+                // Refused without subscribers, DIAG_PAGE_BENCH then still shows the previous result.
+                (void)link_bench_start(p_sdc, p_data[1]);
+            }
+            break;
+
+        case SDC_CMD_EVT_RECORD:
+            if (length == 2)
+            {
+                if (p_data[1] == SDC_EVT_RECORD_SAVE)
+                {
+                    // Refused while the previous copy is written.
+                    (void)evt_record_save();
+                }
+                else
+                {
+                    evt_record_pause(p_data[1] == SDC_EVT_RECORD_PAUSE);
+                }
+            }
+            break;
+
+        default:
+            // Unknown command.
+            break;
+    }
+}
+
+/* Handler for reads of the diagnostics characteristic. The first byte is the page. */
+static void sdc_diag_handler(ble_sdc_t * p_sdc, uint8_t * p_data, uint16_t * p_length)
+{
+    uint16_t          len = 0;
+    energy_estimate_t estimate;
+
+    p_data[0] = m_diag_page;
+
+    switch (m_diag_page)
+    {
+        case DIAG_PAGE_FAULT:
+            len = fault_record_encode(fault_record_last(), &p_data[1], *p_length - 1);
+            break;
+
+        case DIAG_PAGE_POWER:
+            len = power_mgr_encode(&p_data[1], *p_length - 1);
+            break;
+
+        case DIAG_PAGE_ENERGY:
+            energy_estimate_get(&estimate);
+            len = energy_model_encode(&estimate, &p_data[1], *p_length - 1);
+            break;
+
+#if CYCLE_PROF_ENABLED
+        case DIAG_PAGE_PROFILE:
+            len = cycle_prof_encode((cycle_prof_section_t)m_diag_arg, &p_data[1], *p_length - 1);
+            break;
+#endif
+
+        case DIAG_PAGE_STATS:
+            len = app_stats_encode(app_time_now(), &p_data[1], *p_length - 1);
+            break;
+
+        case DIAG_PAGE_LATENCY:
+            len = latency_trace_encode((latency_stage_t)m_diag_arg, &p_data[1], *p_length - 1);
+            break;
+
+        case DIAG_PAGE_RAM:
+            len = ram_usage_encode(&p_data[1], *p_length - 1);
+            break;
+
+        case DIAG_PAGE_ADVERTISING:
+            len = adv_ctrl_encode(&p_data[1], *p_length - 1);
+            break;
+
+        case DIAG_PAGE_TIME:
+            // Read in the BLE event handler, like the writes of the control command.
+            len = time_sync_encode(app_time_ms_get(), &p_data[1], *p_length - 1);
+            break;
+
+        case DIAG_PAGE_LINKS:
+            len = ble_sdc_links_encode(p_sdc, &p_data[1], *p_length - 1);
+            break;
+
+        case DIAG_PAGE_BENCH:
+            len = link_bench_encode(m_diag_arg, &p_data[1], *p_length - 1);
+            break;
+
+        case DIAG_PAGE_EVENTS:
+            len = evt_record_encode((m_diag_arg & DIAG_EVENTS_ARG_FLASH) ? EVT_RECORD_SOURCE_FLASH : EVT_RECORD_SOURCE_RAM,
+                                    m_diag_arg & ~DIAG_EVENTS_ARG_FLASH, &p_data[1], *p_length - 1);
+            break;
+
+        case DIAG_PAGE_DISPATCH:
+            len = ble_dispatch_stats_encode(m_diag_arg, &p_data[1], *p_length - 1);
+            break;
+
+        default:
+            break;
+    }
+
+    *p_length = len + 1;
+}
+
+/* Handler for Send Data Custom Service events. Sampling runs while at least one client has notifications
+ * enabled. */
+static void sdc_evt_handler(ble_sdc_t * p_sdc, ble_sdc_evt_type_t evt_type, uint8_t link)
+{
+    UNUSED_PARAMETER(link);
+
+    switch (evt_type)
+    {
+        case BLE_SDC_EVT_NOTIFICATION_ENABLED:
+            // Clients already subscribed get the warning and the current value again. The frame queue
+            // belongs to the main loop.
+            m_battery_warning_pending = true;
+            power_mgr_on_evt(POWER_EVT_NOTIFY_ENABLED);
+            // A new subscriber gets the current value instead of waiting for the next report.
+            sensor_pipeline_report_now();
+            break;
+
+        case BLE_SDC_EVT_NOTIFICATION_DISABLED:
+            if (ble_sdc_subscriber_count(p_sdc) == 0)
+            {
+                power_mgr_on_evt(POWER_EVT_NOTIFY_DISABLED);
+            }
             break;
 
         default:
@@ -192,6 +625,24 @@ void ble_sdc_on_ble_evt(ble_sdc_t * p_sdc, ble_evt_t * p_ble_evt)
     }
 }
 
+/**@brief Function for initializing services that will be used by the application.
+ */
+static void services_init(void)
+{
+    uint32_t       err_code;
+    ble_sdc_init_t sdc_init;
+    
+    memset(&sdc_init, 0, sizeof(sdc_init)); // Function for setting the given struct to zeros (or any other given value). 
+
+    sdc_init.data_handler = sdc_data_handler; // Setting the handler part of the sdc_init struct to be the dummy handler implemented above.
+    sdc_init.diag_handler = sdc_diag_handler;
+    sdc_init.evt_handler  = sdc_evt_handler;
+    
+    err_code = ble_sdc_init(&m_sdc, &sdc_init); // Initializing the Send Data Custom service with the given structs.
+    APP_ERROR_CHECK(err_code);
+}
+
+
 /* Function for handling connection failed parametres. Results in disconnect. */
 static void on_conn_params_evt(ble_conn_params_evt_t * p_evt)
 {
@@ -209,8 +660,9 @@ static void on_conn_params_evt(ble_conn_params_evt_t * p_evt)
 // For use in (Pairing/Bonding).
 static void sys_evt_dispatch(uint32_t sys_evt)
 {
+    EVT_RECORD_SYS(sys_evt);
+    flash_sched_on_sys_evt(sys_evt);
     fs_sys_event_handler(sys_evt);
-    ble_advertising_on_sys_evt(sys_evt);
 }
 
 /**@brief Function for handling errors from the Connection Parameters module.
@@ -250,19 +702,26 @@ static void conn_params_init(void)
  *
  * @details This function will be called for advertising events which are passed to the application.
  *
- * @param[in] ble_adv_evt  Advertising event.
+ * @param[in] evt   Advertising event.
+ * @param[in] mode  Mode advertising is in.
  */
-static void on_adv_evt(ble_adv_evt_t ble_adv_evt)
+static void on_adv_evt(adv_ctrl_evt_t evt, adv_ctrl_mode_t mode)
 {
-    uint32_t err_code;
-    
-    switch (ble_adv_evt)
+    switch (evt)
     {
-        case BLE_ADV_EVT_SLOW:  // Advertising event slow.
+        case ADV_CTRL_EVT_STARTED:
+            if (m_adv_started)
+            {
+                APP_STATS_INC(APP_STATS_ADV_RESTARTS);
+            }
+            m_adv_started = true;
+            BIN_LOG("advertising, mode %u level %u", mode, adv_policy_level_get());
+            break;
+        case ADV_CTRL_EVT_MODE_CHANGED:
+            BIN_LOG("advertising, mode %u level %u", mode, adv_policy_level_get());
             break;
-        case BLE_ADV_EVT_IDLE: // When advertising times out.
-            err_code = ble_advertising_start(BLE_ADV_MODE_SLOW); // Restart advertising.
-            APP_ERROR_CHECK(err_code);
+        case ADV_CTRL_EVT_IDLE: // When advertising times out.
+            power_mgr_on_evt(POWER_EVT_ADV_TIMEOUT); // Advertising is restarted after the deep idle time.
             break;
         default:
             // Do nothing
@@ -282,13 +741,60 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
         case BLE_GAP_EVT_CONNECTED:
             //get_battery_low_warning();
             m_conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
-            NRF_GPIO->OUT = (1<<6);               // Pin for enabling power to sensor.
-            
+            m_conn_count++;
+            power_mgr_on_evt(POWER_EVT_CONNECTED);
+            adv_policy_on_connected();
+            history_log_event(app_time_synced_now(), HISTORY_EVENT_CONNECTED);
+            BIN_LOG("connected, handle %u interval %u ms, %u links",
+                    m_conn_handle,
+                    (p_ble_evt->evt.gap_evt.params.connected.conn_params.max_conn_interval * 5) / 4,
+                    m_conn_count);
+            APP_STATS_INC(APP_STATS_CONNECTIONS);
+            if (m_link_lost)
+            {
+                APP_STATS_INC(APP_STATS_RECONNECTS);
+            }
             break;
             
         case BLE_GAP_EVT_DISCONNECTED:
-            m_conn_handle = BLE_CONN_HANDLE_INVALID;
-            NRF_GPIO->OUT = (0<<6);               // Pin for disabling power to sensor.
+            if (p_ble_evt->evt.gap_evt.conn_handle == m_conn_handle)
+            {
+                m_conn_handle = BLE_CONN_HANDLE_INVALID;
+            }
+            if (m_conn_count > 0)
+            {
+                m_conn_count--;
+            }
+            // The device stays connected while another client holds a link.
+            if (m_conn_count == 0)
+            {
+                power_mgr_on_evt(POWER_EVT_DISCONNECTED);
+            }
+            history_log_event(app_time_synced_now(), HISTORY_EVENT_DISCONNECTED);
+            BIN_LOG("disconnected, reason 0x%02x, %u links", p_ble_evt->evt.gap_evt.params.disconnected.reason, m_conn_count);
+            m_link_lost = (p_ble_evt->evt.gap_evt.params.disconnected.reason == BLE_HCI_CONNECTION_TIMEOUT);
+            // Runs before the service frees the entry. Another link is picked at the next send.
+            if ((m_trace_link != BLE_SDC_LINK_NONE)
+                && (p_ble_evt->evt.gap_evt.conn_handle == m_sdc.links[m_trace_link].conn_handle))
+            {
+                latency_trace_flush();
+                m_trace_link = BLE_SDC_LINK_NONE;
+            }
+            break;
+
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+            BIN_LOG("connection interval %u ms, handle %u",
+                    (p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params.max_conn_interval * 5) / 4,
+                    p_ble_evt->evt.gap_evt.conn_handle);
+            break;
+
+        case BLE_EVT_TX_COMPLETE:
+            // The latency FIFO follows one link, TX complete counts of the others do not belong to it.
+            if ((m_trace_link != BLE_SDC_LINK_NONE)
+                && (p_ble_evt->evt.common_evt.conn_handle == m_sdc.links[m_trace_link].conn_handle))
+            {
+                latency_trace_tx_complete(p_ble_evt->evt.common_evt.params.tx_complete.count, (uint32_t)app_time_us_get());
+            }
             break;
 
         default:
@@ -298,23 +804,59 @@ static void on_ble_evt(ble_evt_t * p_ble_evt)
 }
 
 
+/* Passes BLE events to the Send Data Custom Service. */
+static void sdc_on_ble_evt(ble_evt_t * p_ble_evt)
+{
+    ble_sdc_on_ble_evt(&m_sdc, p_ble_evt);
+
+    // The service has counted the TX buffers back in, the main loop sends the queued frames.
+    if (p_ble_evt->header.evt_id == BLE_EVT_TX_COMPLETE)
+    {
+        m_frames_flush_pending = true;
+    }
+    link_bench_on_ble_evt(p_ble_evt);
+}
+
+/* Subscriptions of the modules to SoftDevice events, in the order they are called. */
+static const ble_dispatch_entry_t m_ble_dispatch_table[] =
+{
+    BLE_DISPATCH_ENTRY(BLE_GAP_EVT_BASE,    BLE_GAP_EVT_LAST,    ble_conn_state_on_ble_evt),   // Connection State module (Pairing/Bonding required).
+    BLE_DISPATCH_ENTRY(BLE_EVT_BASE,        BLE_GATTS_EVT_LAST,  pm_ble_evt_handler),          // Peer Manager, sets the CCCDs of bonded peers before the services see the connection.
+    BLE_DISPATCH_ENTRY(BLE_GAP_EVT_BASE,    BLE_GAP_EVT_LAST,    ble_conn_params_on_ble_evt),  // Connection parametres event.
+    BLE_DISPATCH_ENTRY(BLE_GATTS_EVT_BASE,  BLE_GATTS_EVT_LAST,  ble_conn_params_on_ble_evt),
+    BLE_DISPATCH_ENTRY(BLE_EVT_BASE,        BLE_GAP_EVT_LAST,    on_ble_evt),                  // On BLE event, TX complete included.
+    BLE_DISPATCH_ENTRY(BLE_EVT_BASE,        BLE_GAP_EVT_LAST,    sdc_on_ble_evt),              // Send Data Custom Service, TX complete included.
+    BLE_DISPATCH_ENTRY(BLE_GATTS_EVT_BASE,  BLE_GATTS_EVT_LAST,  sdc_on_ble_evt),
+    BLE_DISPATCH_ENTRY(BLE_GAP_EVT_BASE,    BLE_GAP_EVT_LAST,    adv_ctrl_on_ble_evt),         // Advertising.
+};
+
+#define BLE_DISPATCH_TABLE_SIZE         (sizeof(m_ble_dispatch_table) / sizeof(m_ble_dispatch_table[0]))
+
+static ble_dispatch_stats_t             m_ble_dispatch_stats[BLE_DISPATCH_TABLE_SIZE];  /**< Calls and cycles per table entry, read on DIAG_PAGE_DISPATCH. */
+
+
+/* Serializes the counters of one entry of the dispatch table, for the diagnostics characteristic. */
+static uint16_t ble_dispatch_stats_encode(uint8_t index, uint8_t * p_buf, uint16_t buf_len)
+{
+    return ble_dispatch_encode(m_ble_dispatch_table, m_ble_dispatch_stats, BLE_DISPATCH_TABLE_SIZE, index, p_buf, buf_len);
+}
+
+
 /**@brief Function for dispatching a SoftDevice event to all modules with a SoftDevice 
  *        event handler.
  *
  * @details This function is called from the SoftDevice event interrupt handler after a 
- *          SoftDevice event has been received.
+ *          SoftDevice event has been received. Only the modules subscribed to the event are called.
  *
  * @param[in] p_ble_evt  SoftDevice event.
  */
 static void ble_evt_dispatch(ble_evt_t * p_ble_evt)
 {
-    ble_conn_state_on_ble_evt(p_ble_evt);    // Forward BLE events to the Connection State module (Pairing/Bonding required).
-    ble_conn_params_on_ble_evt(p_ble_evt);   // Connection parametres event.
-    on_ble_evt(p_ble_evt);                   // On BLE event.
-    ble_sdc_on_ble_evt(&m_sdc, p_ble_evt);   // Send Data Custom Service.
-    ble_advertising_on_ble_evt(p_ble_evt);   // Advertising.
-    pm_ble_evt_handler(p_ble_evt);           // Forward BLE events to the Peer Manager (Pairing/Bonding required).
-
+    CYCLE_PROF_START(CYCLE_PROF_BLE_EVT_DISPATCH);
+    // Recorded as the modules get it, host/evt_replay feeds the stream back in.
+    EVT_RECORD_BLE(p_ble_evt);
+    ble_dispatch(m_ble_dispatch_table, m_ble_dispatch_stats, BLE_DISPATCH_TABLE_SIZE, p_ble_evt);
+    CYCLE_PROF_END(CYCLE_PROF_BLE_EVT_DISPATCH);
 }
 
 
@@ -325,6 +867,7 @@ static void ble_evt_dispatch(ble_evt_t * p_ble_evt)
 static void ble_stack_init(void)
 {
     uint32_t err_code;
+    uint32_t app_ram_base;
     
     // Initialize SoftDevice.
     SOFTDEVICE_HANDLER_INIT(NRF_CLOCK_LFCLKSRC_XTAL_20_PPM, NULL);
@@ -335,10 +878,25 @@ static void ble_stack_init(void)
                                                     &ble_enable_params);
     APP_ERROR_CHECK(err_code);
         
-    //Check the ram settings against the used number of links
-    CHECK_RAM_START_ADDR(CENTRAL_LINK_COUNT,PERIPHERAL_LINK_COUNT);
-    // Enable BLE stack.
-    err_code = softdevice_enable(&ble_enable_params);
+    // Enable BLE stack. Same as softdevice_enable(), but keeps the RAM start the SoftDevice asks for. It
+    // depends on the links, MTU, vendor UUIDs and attribute table in ble_enable_params and replaces the
+    // fixed table of CHECK_RAM_START_ADDR(). host/ram_layout moves the linked RAM start to it.
+    app_ram_base = ram_usage_app_ram_start();
+    err_code = sd_ble_enable(&ble_enable_params, &app_ram_base);
+    ram_usage_sd_ram_start_set(app_ram_base);
+    if (app_ram_base != ram_usage_app_ram_start())
+    {
+        BIN_LOG("RAM start 0x%08x, SoftDevice needs 0x%08x", ram_usage_app_ram_start(), app_ram_base);
+    }
+    if ((err_code == NRF_ERROR_NO_MEM) && (PERIPHERAL_LINK_COUNT > 1))
+    {
+        // Every link takes SoftDevice RAM. Until the linked RAM start is moved up the device runs with one
+        // link, the RAM page reports the start needed for all of them.
+        ble_enable_params.gap_enable_params.periph_conn_count = 1;
+        app_ram_base = ram_usage_app_ram_start();
+        err_code     = sd_ble_enable(&ble_enable_params, &app_ram_base);
+        m_link_count = 1;
+    }
     APP_ERROR_CHECK(err_code);
     
     // Subscribe for BLE events.
@@ -358,7 +916,7 @@ static void advertising_init(void)
     ble_advdata_t advdata;
     ble_advdata_t scanrsp;
 
-    // Build advertising data struct to pass into @ref ble_advertising_init.
+    // Build advertising data struct to pass into @ref ble_advdata_set.
     memset(&advdata, 0, sizeof(advdata));
     advdata.name_type          = BLE_ADVDATA_FULL_NAME;
     advdata.include_appearance = false;
@@ -368,13 +926,22 @@ static void advertising_init(void)
     scanrsp.uuids_complete.uuid_cnt = sizeof(m_adv_uuids) / sizeof(m_adv_uuids[0]);
     scanrsp.uuids_complete.p_uuids  = m_adv_uuids;
 
-    ble_adv_modes_config_t options = {0};
-    options.ble_adv_fast_enabled  = BLE_ADV_FAST_DISABLED;  // FAST ADVERTISING disabled.
-    options.ble_adv_slow_enabled  = BLE_ADV_SLOW_ENABLED;   // ENABLE SLOW ADVERTISING
-    options.ble_adv_slow_interval = APP_ADV_INTERVAL;
-    options.ble_adv_slow_timeout  = APP_ADV_TIMEOUT_IN_SECONDS;
+    err_code = ble_advdata_set(&advdata, &scanrsp);
+    APP_ERROR_CHECK(err_code);
 
-    err_code = ble_advertising_init(&advdata, &scanrsp, &options, on_adv_evt, NULL);
+    // Directed bursts to the lost gateway, then bonded gateways only, then open advertising backing off
+    // while the occupancy is stable.
+    adv_policy_init(&m_app_config);
+
+    adv_ctrl_config_t options;
+    memset(&options, 0, sizeof(options));
+    options.directed_bursts    = APP_ADV_DIRECTED_BURSTS;
+    options.whitelist_interval = APP_ADV_WHITELIST_INTERVAL;
+    options.whitelist_timeout  = APP_ADV_WHITELIST_TIMEOUT;
+    options.open_step          = adv_policy_open_step;
+    options.link_count         = m_link_count;
+
+    err_code = adv_ctrl_init(&options, on_adv_evt);
     APP_ERROR_CHECK(err_code);
 }
 
@@ -388,10 +955,66 @@ static void power_manage(void)
     APP_ERROR_CHECK(err_code);
 }
 
+/* Rebuilds the whitelist from the bonded peers and passes it to the advertising module. */
+static void adv_peers_update(void)
+{
+    pm_peer_id_t peer_ids[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+    pm_peer_id_t peer_id;
+    uint8_t      peer_count = 0;
+    ret_code_t   err_code;
+
+    peer_id = pm_next_peer_id_get(PM_PEER_ID_INVALID);
+    while ((peer_id != PM_PEER_ID_INVALID) && (peer_count < BLE_GAP_WHITELIST_ADDR_MAX_COUNT))
+    {
+        peer_ids[peer_count++] = peer_id;
+        peer_id = pm_next_peer_id_get(peer_id);
+    }
+
+    m_whitelist.addr_count = BLE_GAP_WHITELIST_ADDR_MAX_COUNT;
+    m_whitelist.irk_count  = BLE_GAP_WHITELIST_IRK_MAX_COUNT;
+    m_whitelist.pp_addrs   = m_whitelist_addrs;
+    m_whitelist.pp_irks    = m_whitelist_irks;
+
+    err_code = pm_whitelist_create(peer_ids, peer_count, &m_whitelist);
+    APP_ERROR_CHECK(err_code);
+
+    adv_ctrl_peers_set(m_peer_addr_valid ? &m_peer_addr : NULL, &m_whitelist);
+}
+
+/* Takes the identity address of a bonded peer as the target of directed advertising. */
+static void adv_peer_set(pm_peer_id_t peer_id)
+{
+    pm_peer_data_bonding_t bonding_data;
+
+    if (pm_peer_data_bonding_load(peer_id, &bonding_data) == NRF_SUCCESS)
+    {
+        m_peer_addr       = bonding_data.peer_id.id_addr_info;
+        m_peer_addr_valid = true;
+    }
+}
+
 // Handler for the peer manager.
 static void pm_evt_handler(pm_evt_t const * p_evt)
 {
+    switch (p_evt->evt_id)
+    {
+        case PM_EVT_BONDED_PEER_CONNECTED:
+            adv_peer_set(p_evt->peer_id);
+            adv_peers_update();
+            break;
+
+        case PM_EVT_CONN_SEC_SUCCEEDED:
+            // A new bond: the gateway joins the whitelist.
+            if (p_evt->params.conn_sec_succeeded.procedure == PM_LINK_SECURED_PROCEDURE_BONDING)
+            {
+                adv_peer_set(p_evt->peer_id);
+                adv_peers_update();
+            }
+            break;
 
+        default:
+            break;
+    }
 }
 
 // Initialzing the peer manager for pairing/bonding.
@@ -432,7 +1055,8 @@ static void peer_manager_init(bool erase_bonds)
 /* Dummy for handling Timer events. */
 void timer_handler(nrf_timer_event_t event_type, void* p_context)
 {
-        
+    UNUSED_PARAMETER(event_type);
+    UNUSED_PARAMETER(p_context);
 }
 /* Timer and ppi initializing function. */
 void saadc_sampling_event_init(void)
@@ -452,10 +1076,9 @@ void saadc_sampling_event_init(void)
     err_code = nrf_drv_timer_init(&m_timer, &config, timer_handler);
     APP_ERROR_CHECK(err_code);
     
-     /*setup m_timer for compare event every 6ms thus resulting that the saadc is sampling at this interval.  */
-    uint32_t ticks = nrf_drv_timer_ms_to_ticks(&m_timer, 6);
+     /*setup m_timer for compare event every sample period (6ms by default) thus resulting that the saadc is sampling at this interval.  */
+    uint32_t ticks = nrf_drv_timer_ms_to_ticks(&m_timer, m_app_config.sample_period_ms);
     nrf_drv_timer_extended_compare(&m_timer, NRF_TIMER_CC_CHANNEL0, ticks, NRF_TIMER_SHORT_COMPARE0_CLEAR_MASK, false);
-    nrf_drv_timer_enable(&m_timer);
     
     uint32_t timer_compare_event_addr = nrf_drv_timer_compare_event_address_get(&m_timer, NRF_TIMER_CC_CHANNEL0);
     uint32_t saadc_sample_event_addr = nrf_drv_saadc_task_address_get(NRF_SAADC_TASK_SAMPLE);
@@ -469,9 +1092,10 @@ void saadc_sampling_event_init(void)
     
 }
 
-/* Enable saadc with ppi. */
+/* Enable saadc with ppi. The timer only runs while sampling, it keeps the high frequency clock on. */
 void saadc_sampling_event_enable(void)
 {
+    nrf_drv_timer_enable(&m_timer);
     ret_code_t err_code = nrf_drv_ppi_channel_enable(m_ppi_channel);
     APP_ERROR_CHECK(err_code);
 }
@@ -481,47 +1105,206 @@ void saadc_sampling_event_disable(void)
 {
     ret_code_t err_code = nrf_drv_ppi_channel_disable(m_ppi_channel);
     APP_ERROR_CHECK(err_code);
+    nrf_drv_timer_disable(&m_timer);
+}
+
+/* Switches the sensor supply. Called by the power manager. */
+static void sensor_power_set(bool on)
+{
+    if (on)
+    {
+        NRF_GPIO->OUTSET = (1<<6);            // Pin for enabling power to sensor.
+    }
+    else
+    {
+        NRF_GPIO->OUTCLR = (1<<6);            // Pin for disabling power to sensor.
+    }
+}
+
+/* Switches sampling. Called by the power manager. */
+static void sampling_set(bool on)
+{
+    if (on)
+    {
+        saadc_sampling_event_enable();
+    }
+    else
+    {
+        saadc_sampling_event_disable();
+    }
+}
+
+/* Starts advertising after deep idle. Called by the power manager. Bonded gateways connect to open
+ * advertising as well, the whitelist mode is only for the reconnect after a disconnect. */
+static uint32_t advertising_start(void)
+{
+    return adv_ctrl_start(ADV_CTRL_MODE_OPEN);
+}
+
+/* Called by the power manager at the end of a presence check. Restarts open advertising with the burst if the
+ * occupancy changed. The directed and whitelist modes run on, the open mode starts with the burst after them. */
+static void presence_check_done(void)
+{
+    uint32_t err_code;
+
+    if (!m_occupancy_changed)
+    {
+        return;
+    }
+    m_occupancy_changed = false;
+    BIN_LOG("occupancy changed, occupied %u", adv_policy_occupied());
+
+    if (power_mgr_state_get() == POWER_STATE_DEEP_IDLE)
+    {
+        power_mgr_on_evt(POWER_EVT_WAKE);
+    }
+    else if (adv_ctrl_mode_get() == ADV_CTRL_MODE_OPEN)
+    {
+        err_code = adv_ctrl_stop();
+        APP_ERROR_CHECK(err_code);
+        err_code = adv_ctrl_start(ADV_CTRL_MODE_OPEN);
+        APP_ERROR_CHECK(err_code);
+    }
 }
 
-/* Handler for saadc events. */
+/* Resources switched by the power manager. */
+static const power_mgr_resources_t m_power_resources =
+{
+    .sensor_power_set  = sensor_power_set,
+    .sampling_set      = sampling_set,
+    .advertising_start = advertising_start,
+    .check_done        = presence_check_done
+};
+
+/* Handler for saadc events. Only hands the completed buffer to the main loop. */
 void saadc_event_handler(nrf_drv_saadc_evt_t const * p_event)
 {
+    CYCLE_PROF_START(CYCLE_PROF_SAADC_ISR);
+
     if (p_event->type == NRF_DRV_SAADC_EVT_DONE) {
         uint32_t err_code;
-        uint8_t data_to_send[1];
-        uint16_t value = 0;
+        sample_block_t free_block;
+        nrf_saadc_value_t * p_next = p_event->data.done.p_buffer;
         
-        err_code = nrf_drv_saadc_buffer_convert(p_event->data.done.p_buffer,SAMPLES_IN_BUFFER);
-        APP_ERROR_CHECK(err_code);
-        
-        int i;
-        for (i = 0; i<SAMPLES_IN_BUFFER; i++) 
+        if (sample_queue_pop(&m_free_queue, &free_block))
         {
-            value = value + p_event->data.done.p_buffer[i];
+            p_next = free_block.p_samples;
+            // There are no more buffers than queue slots, so the ready queue can not be full here.
+            (void)sample_queue_push(&m_ready_queue, p_event->data.done.p_buffer, p_event->data.done.size, (uint32_t)app_time_us_get());
+        }
+        else
+        {
+            // All buffers wait for the main loop, drop this one and sample into it again.
+            APP_STATS_INC(APP_STATS_ADC_OVERRUNS);
+            BIN_LOG("saadc overrun");
         }
-        value = value/SAMPLES_IN_BUFFER;
         
-        if (value <= 254) {
-                if ( value > m_old_value ){
-                    m_old_value = value;
-                    data_to_send[0] = value;
-                    err_code = ble_sdc_data_send(&m_sdc, data_to_send, 1);
-                    APP_ERROR_CHECK(err_code);
-                }
-                else if ( (value <= m_old_value) && (value >= 25) ) {
-                    data_to_send[0] = m_old_value;
-                    err_code = ble_sdc_data_send(&m_sdc, data_to_send, 1);
-                    APP_ERROR_CHECK(err_code);
-                }
-                else if ( (value <= m_old_value) && (value < 25) ) {
-                    m_old_value = 0;
-                    data_to_send[0] = value;
-                    err_code = ble_sdc_data_send(&m_sdc, data_to_send, 1);
-                    APP_ERROR_CHECK(err_code);
-                }
+        err_code = nrf_drv_saadc_buffer_convert(p_next, m_app_config.samples_in_buffer);
+        APP_ERROR_CHECK(err_code);
+    }
+
+    CYCLE_PROF_END(CYCLE_PROF_SAADC_ISR);
+}
+
+/* Returns the local time (in ms) of the buffer being processed, m_sample_done_us extended to 64 bits. */
+static uint64_t sample_done_ms_get(void)
+{
+    uint64_t now_us = app_time_us_get();
+
+    return (now_us - (uint32_t)((uint32_t)now_us - m_sample_done_us)) / 1000;
+}
+
+/* Sends a value from the sensor pipeline to the client, with the timestamp of its buffer. */
+static void pipeline_value_send(uint8_t value)
+{
+    uint32_t filter_us = (uint32_t)app_time_us_get();
+    uint8_t  data[3];
+    uint8_t  slot;
+
+    // Values of presence checks only decide about advertising, there is no link to send them on.
+    if (power_mgr_check_active())
+    {
+        return;
+    }
+
+    data[0] = value;
+    (void)uint16_encode(app_time_stamp(sample_done_ms_get()), &data[1]);
+
+    // The value is filtered and encoded once for all clients.
+    if (sdc_frame_put(&m_frames, SDC_STREAM_VALUE, data, sizeof(data)))
+    {
+        slot = (m_frames.queues[SDC_STREAM_VALUE].head + m_frames.queues[SDC_STREAM_VALUE].count - 1) % SDC_FRAME_QUEUE_SIZE;
+        m_value_stamps[slot][0] = m_sample_done_us;
+        m_value_stamps[slot][1] = filter_us;
+    }
+    else
+    {
+        // Values wait while the links are busy, until the queue is full, app_stats counts the ones lost.
+        APP_STATS_INC(APP_STATS_FRAMES_DROPPED);
+    }
+    frames_flush();
+}
+
+/* Stores a value from the sensor pipeline in the history and passes it to the advertising policy. */
+static void pipeline_value_log(uint8_t value)
+{
+    // Every value counts for the advertising policy, not only the reported ones.
+    if (adv_policy_on_value(value) && power_mgr_check_active())
+    {
+        m_occupancy_changed = true;
+    }
+    history_log_sample(app_time_synced_now(), value);
+}
+
+/* Sends the statistics summary of a window to the client. */
+static void pipeline_summary_send(window_stats_summary_t const * p_summary)
+{
+    uint8_t data[2 + WINDOW_STATS_ENCODED_LEN];
+
+    if (power_mgr_check_active())
+    {
+        return;
+    }
+
+    // Stamped with the end of the window.
+    (void)uint16_encode(app_time_stamp(sample_done_ms_get()), &data[0]);
+    (void)window_stats_encode(p_summary, &data[2], sizeof(data) - 2);
+
+    (void)frame_send(SDC_STREAM_SUMMARY, data, sizeof(data));
+}
+
+/* Backend of the sensor pipeline on the device. */
+static const sensor_hal_t m_sensor_hal =
+{
+    .value_send   = pipeline_value_send,
+    .value_log    = pipeline_value_log,
+    .summary_send = pipeline_summary_send
+};
+
+/* Function for passing the completed buffers to the sensor pipeline. Runs in the main loop. */
+static void sample_process(void)
+{
+    sample_block_t block;
+    
+    while (sample_queue_pop(&m_ready_queue, &block))
+    {
+        APP_STATS_INC(APP_STATS_ADC_BUFFERS);
+        if (sample_queue_depth(&m_ready_queue) > 0)
+        {
+            APP_STATS_INC(APP_STATS_ADC_BUFFERS_LATE);
         }
+
+        m_sample_done_us = block.timestamp_us;
+
+        CYCLE_PROF_START(CYCLE_PROF_SAMPLE_PROCESS);
+        sensor_pipeline_process(block.p_samples, block.count);
+        CYCLE_PROF_END(CYCLE_PROF_SAMPLE_PROCESS);
+        
+        // The buffer can be reused by the SAADC as soon as it has been read.
+        (void)sample_queue_push(&m_free_queue, block.p_samples, 0, 0);
     }
 }
+
 /* Configuring function for saadc. */
 static void saadc_configure(void)
 {   
@@ -556,14 +1339,24 @@ static void saadc_configure(void)
     ret_code_t err_code = nrf_drv_saadc_init(&config_init, saadc_event_handler);
     APP_ERROR_CHECK(err_code);
     
+    // The first buffer goes to the SAADC, the others wait in the free queue.
+    sample_queue_init(&m_ready_queue);
+    sample_queue_init(&m_free_queue);
+    int i;
+    for (i = 1; i < SAMPLE_BUFFER_COUNT; i++)
+    {
+        (void)sample_queue_push(&m_free_queue, m_adc_buf[i], 0, 0);
+    }
+    
     err_code = nrf_drv_saadc_channel_init(0,&config);
     APP_ERROR_CHECK(err_code);
 
-    err_code = nrf_drv_saadc_buffer_convert(m_adc_buf,SAMPLES_IN_BUFFER);
+    err_code = nrf_drv_saadc_buffer_convert(m_adc_buf[0],m_app_config.samples_in_buffer);
     APP_ERROR_CHECK(err_code);
     
     /*err_code = nrf_drv_saadc_channel_init(1,&config_bat);
     APP_ERROR_CHECK(err_code);*/
+    UNUSED_VARIABLE(config_bat);
 
 }
 
@@ -582,12 +1375,81 @@ static void saadc_configure(void)
     
 }*/
 
+/* Function for starting a requested history transfer and feeding the history stream. */
+static void history_transfer_process(void)
+{
+    bool     requested;
+    uint32_t from = 0;
+    uint32_t to   = 0;
+
+    // A new request must not change the range halfway through the copy.
+    CRITICAL_REGION_ENTER();
+    requested = m_history_requested;
+    if (requested)
+    {
+        from                = m_history_range[0];
+        to                  = m_history_range[1];
+        m_history_requested = false;
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (requested)
+    {
+        history_log_read_start(&m_history_cursor, from, to);
+        m_history_reading = true;
+    }
+    if (m_history_reading)
+    {
+        history_frames_fill();
+        frames_flush();
+    }
+}
+
+/* Function for sending the frames the BLE event handler left to the main loop. The link benchmark takes the
+ * TX buffers the frames leave. */
+static void frames_process(void)
+{
+    if (m_battery_warning_pending)
+    {
+        m_battery_warning_pending = false;
+        send_battery_low_warning();
+    }
+    if (m_frames_flush_pending)
+    {
+        m_frames_flush_pending = false;
+        frames_flush();
+    }
+    link_bench_process();
+}
+
+/* Function for raising the bulk transfer events of the power manager while a history transfer or the link
+ * benchmark runs, so sampling pauses for them. Runs in the main loop, the BLE event handler and the timers
+ * raise their events at a higher priority. */
+static void bulk_transfer_update(void)
+{
+    link_bench_state_t bench  = link_bench_state();
+    bool               active = m_history_reading
+                                || (bench == LINK_BENCH_STATE_RUNNING)
+                                || (bench == LINK_BENCH_STATE_DRAINING);
+
+    if (active == m_bulk_active)
+    {
+        return;
+    }
+    m_bulk_active = active;
+
+    CRITICAL_REGION_ENTER();
+    power_mgr_on_evt(active ? POWER_EVT_BULK_START : POWER_EVT_BULK_END);
+    CRITICAL_REGION_EXIT();
+}
+
 static void send_battery_low_warning(void) {
-    uint32_t err_code;
-    if (m_buffer_bat < 255) {
-        uint8_t data_to_send[1] = {'E'};
-        err_code = ble_sdc_data_send(&m_sdc, data_to_send, 1);
-        APP_ERROR_CHECK(err_code);
+    // Without a measurement every subscription would get a warning, and the history a false event.
+    if (m_buffer_bat_valid && (m_buffer_bat < 255)) {
+        uint8_t data_to_send[3] = {HISTORY_EVENT_BATTERY_LOW};
+        (void)uint16_encode(app_time_stamp(app_time_ms_get()), &data_to_send[1]);
+        (void)frame_send(SDC_STREAM_EVENT, data_to_send, sizeof(data_to_send));
+        history_log_event(app_time_synced_now(), HISTORY_EVENT_BATTERY_LOW);
     }
 }
 
@@ -595,26 +1457,65 @@ static void send_battery_low_warning(void) {
 int main(void)
 {
     uint32_t err_code;
-    bool erase_bonds;
+    bool erase_bonds = false;
     
+    ram_usage_init();
+    // Picks up the fault left by the previous run, before anything else can fail.
+    err_code = fault_record_init();
+    APP_ERROR_CHECK(err_code);
+#if CYCLE_PROF_ENABLED
+    cycle_prof_init();
+#endif
+    latency_trace_init();
+    bin_log_init();
+    BIN_LOG("boot, reset reason 0x%08x", fault_record_reset_reason());
     APP_TIMER_INIT(APP_TIMER_PRESCALER, APP_TIMER_OP_QUEUE_SIZE, false); 
+    err_code = app_time_init();
+    APP_ERROR_CHECK(err_code);
+    // Keeps the events that led to a fault reset.
+    err_code = evt_record_init(fault_record_reset_reason());
+    APP_ERROR_CHECK(err_code);
+    err_code = power_mgr_init(&m_power_resources);
+    APP_ERROR_CHECK(err_code);
     ble_stack_init();
+    
+    // The configuration and history are read from FDS, which is initialized by the peer manager.
+    err_code = flash_sched_init();
+    APP_ERROR_CHECK(err_code);
+    err_code = app_config_init();
+    APP_ERROR_CHECK(err_code);
+    err_code = history_log_init();
+    APP_ERROR_CHECK(err_code);
+    peer_manager_init(erase_bonds);
+    while (!app_config_is_loaded())
+    {
+        power_manage();
+    }
+    history_log_event(app_time_synced_now(), HISTORY_EVENT_BOOT);
+    
     gap_params_init();
     services_init();
     advertising_init();
     conn_params_init();
-    peer_manager_init(erase_bonds);
+    sensor_pipeline_init(&m_sensor_hal, &m_app_config);
     saadc_configure();
     saadc_sampling_event_init();
     
     NRF_GPIO->DIR = (1<<6);
     NRF_GPIO->OUT = (0<<6);
     
-    err_code = ble_advertising_start(BLE_ADV_MODE_SLOW);
+    // The bonds are loaded together with the configuration.
+    adv_peers_update();
+    err_code = adv_ctrl_start(ADV_CTRL_MODE_WHITELIST);
     APP_ERROR_CHECK(err_code);
     
     for (;;)
     {
+        sample_process();
+        history_log_process();
+        history_transfer_process();
+        frames_process();
+        bulk_transfer_update();
         power_manage();
         
     }
@@ -0,0 +1,320 @@
+#include "adv_ctrl.h"
+#include <string.h>
+#include "sdk_common.h"
+#include "app_error.h"
+#include "app_time.h"
+
+#define ADV_INTERVAL_UNIT_US        625                                 /**< Unit of the advertising interval (in us). */
+
+static adv_ctrl_config_t        m_config;
+static adv_ctrl_evt_handler_t   m_evt_handler;
+static adv_ctrl_mode_t          m_mode = ADV_CTRL_MODE_IDLE;
+static uint16_t                 m_interval;                             /**< Interval of the running mode, 0 for high duty. */
+static uint64_t                 m_mode_started_ms;                      /**< app_time when the running mode started. */
+static uint8_t                  m_bursts_left;                          /**< Directed bursts still to go. */
+static uint8_t                  m_links;                                /**< Connections up. */
+static ble_gap_addr_t           m_peer_addr;
+static bool                     m_peer_addr_valid;
+static ble_gap_whitelist_t    * mp_whitelist;
+static adv_ctrl_stats_t         m_stats;                                /**< Counters, the running mode excluded. */
+
+
+/* Returns the advertising events of a mode that ran for the given time at the given interval. */
+static uint32_t mode_events(uint16_t interval, uint64_t elapsed_ms)
+{
+    uint64_t period_us = (interval == 0) ? ADV_CTRL_HIGH_DUTY_INTERVAL_US
+                                         : ((uint64_t)interval * ADV_INTERVAL_UNIT_US + ADV_CTRL_ADV_DELAY_US);
+
+    // The first event goes out right at the start.
+    return (uint32_t)((elapsed_ms * 1000) / period_us) + 1;
+}
+
+/* Switches to a mode, adding the time and events of the running one to the counters. */
+static void mode_set(adv_ctrl_mode_t mode, uint16_t interval)
+{
+    uint64_t now = app_time_ms_get();
+
+    if (m_mode != ADV_CTRL_MODE_IDLE)
+    {
+        m_stats.time_ms[m_mode] += now - m_mode_started_ms;
+        m_stats.events[m_mode]  += mode_events(m_interval, now - m_mode_started_ms);
+    }
+    if (mode != ADV_CTRL_MODE_IDLE)
+    {
+        m_stats.starts[mode]++;
+    }
+
+    m_mode            = mode;
+    m_interval        = interval;
+    m_mode_started_ms = now;
+}
+
+static bool addr_equal(ble_gap_addr_t const * p_a, ble_gap_addr_t const * p_b)
+{
+    return (p_a->addr_type == p_b->addr_type) && (memcmp(p_a->addr, p_b->addr, BLE_GAP_ADDR_LEN) == 0);
+}
+
+/* Returns the first mode from the given one that has peers to advertise to. */
+static adv_ctrl_mode_t mode_usable(adv_ctrl_mode_t mode)
+{
+    if ((mode == ADV_CTRL_MODE_DIRECTED) && (!m_peer_addr_valid || (m_bursts_left == 0)))
+    {
+        mode = ADV_CTRL_MODE_WHITELIST;
+    }
+    if ((mode == ADV_CTRL_MODE_WHITELIST)
+        && ((mp_whitelist == NULL)
+            || ((mp_whitelist->addr_count == 0) && (mp_whitelist->irk_count == 0))
+            || (m_config.whitelist_timeout == 0)))
+    {
+        mode = ADV_CTRL_MODE_OPEN;
+    }
+    return mode;
+}
+
+/* Gets the parameters of the open mode. Returns false if open advertising is to stop. */
+static bool open_params_get(bool timed_out, uint16_t * p_interval, uint16_t * p_timeout)
+{
+    if (m_config.open_step != NULL)
+    {
+        return m_config.open_step(timed_out, p_interval, p_timeout);
+    }
+
+    *p_interval = m_config.open_interval;
+    *p_timeout  = m_config.open_timeout;
+    return !timed_out;
+}
+
+/* Starts advertising in the given mode, or the next usable one. timed_out is set when the open mode timed
+ * out and starts again if its policy says so. */
+static uint32_t mode_start(adv_ctrl_mode_t mode, adv_ctrl_evt_t evt, bool timed_out)
+{
+    ble_gap_adv_params_t params;
+    uint32_t             err_code;
+
+    mode = mode_usable(mode);
+
+    memset(&params, 0, sizeof(params));
+    switch (mode)
+    {
+        case ADV_CTRL_MODE_DIRECTED:
+            // High duty: interval and timeout are set by the SoftDevice.
+            params.type        = BLE_GAP_ADV_TYPE_ADV_DIRECT_IND;
+            params.p_peer_addr = &m_peer_addr;
+            params.fp          = BLE_GAP_ADV_FP_ANY;
+            m_bursts_left--;
+            break;
+
+        case ADV_CTRL_MODE_WHITELIST:
+            // Scan requests are answered for anyone, so the device stays visible.
+            params.type        = BLE_GAP_ADV_TYPE_ADV_IND;
+            params.fp          = BLE_GAP_ADV_FP_FILTER_CONNREQ;
+            params.p_whitelist = mp_whitelist;
+            params.interval    = m_config.whitelist_interval;
+            params.timeout     = m_config.whitelist_timeout;
+            break;
+
+        case ADV_CTRL_MODE_OPEN:
+            params.type = BLE_GAP_ADV_TYPE_ADV_IND;
+            params.fp   = BLE_GAP_ADV_FP_ANY;
+            if (!open_params_get(timed_out, &params.interval, &params.timeout))
+            {
+                mode_set(ADV_CTRL_MODE_IDLE, 0);
+                if (m_evt_handler != NULL)
+                {
+                    m_evt_handler(ADV_CTRL_EVT_IDLE, ADV_CTRL_MODE_IDLE);
+                }
+                return NRF_SUCCESS;
+            }
+            break;
+
+        default:
+            return NRF_ERROR_INVALID_PARAM;
+    }
+
+    err_code = sd_ble_gap_adv_start(&params);
+    VERIFY_SUCCESS(err_code);
+
+    mode_set(mode, params.interval);
+    if (m_evt_handler != NULL)
+    {
+        m_evt_handler(evt, mode);
+    }
+    return NRF_SUCCESS;
+}
+
+/* Moves on to the next mode after a timeout. */
+static void on_adv_timeout(void)
+{
+    uint32_t        err_code;
+    adv_ctrl_mode_t next;
+
+    switch (m_mode)
+    {
+        case ADV_CTRL_MODE_DIRECTED:
+            next = ADV_CTRL_MODE_DIRECTED;
+            break;
+
+        case ADV_CTRL_MODE_WHITELIST:
+        case ADV_CTRL_MODE_OPEN:
+            next = ADV_CTRL_MODE_OPEN;
+            break;
+
+        default:
+            return;
+    }
+
+    err_code = mode_start(next, ADV_CTRL_EVT_MODE_CHANGED, (m_mode == ADV_CTRL_MODE_OPEN));
+    APP_ERROR_CHECK(err_code);
+}
+
+uint32_t adv_ctrl_init(adv_ctrl_config_t const * p_config, adv_ctrl_evt_handler_t evt_handler)
+{
+    VERIFY_PARAM_NOT_NULL(p_config);
+
+    if (((p_config->open_step == NULL)
+         && ((p_config->open_interval < BLE_GAP_ADV_INTERVAL_MIN) || (p_config->open_interval > BLE_GAP_ADV_INTERVAL_MAX)))
+        || ((p_config->whitelist_timeout != 0)
+            && ((p_config->whitelist_interval < BLE_GAP_ADV_INTERVAL_MIN)
+                || (p_config->whitelist_interval > BLE_GAP_ADV_INTERVAL_MAX))))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    m_config          = *p_config;
+    m_evt_handler     = evt_handler;
+    m_mode            = ADV_CTRL_MODE_IDLE;
+    m_links           = 0;
+    if (m_config.link_count == 0)
+    {
+        m_config.link_count = 1;
+    }
+    m_peer_addr_valid = false;
+    mp_whitelist      = NULL;
+    memset(&m_stats, 0, sizeof(m_stats));
+    return NRF_SUCCESS;
+}
+
+void adv_ctrl_peers_set(ble_gap_addr_t const * p_peer_addr, ble_gap_whitelist_t * p_whitelist)
+{
+    m_peer_addr_valid = (p_peer_addr != NULL);
+    if (p_peer_addr != NULL)
+    {
+        m_peer_addr = *p_peer_addr;
+    }
+    mp_whitelist = p_whitelist;
+}
+
+uint32_t adv_ctrl_start(adv_ctrl_mode_t mode)
+{
+    if (m_mode != ADV_CTRL_MODE_IDLE)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    m_bursts_left = m_config.directed_bursts;
+    return mode_start(mode, ADV_CTRL_EVT_STARTED, false);
+}
+
+uint32_t adv_ctrl_stop(void)
+{
+    uint32_t err_code;
+
+    if (m_mode == ADV_CTRL_MODE_IDLE)
+    {
+        return NRF_SUCCESS;
+    }
+    err_code = sd_ble_gap_adv_stop();
+    mode_set(ADV_CTRL_MODE_IDLE, 0);
+    return err_code;
+}
+
+adv_ctrl_mode_t adv_ctrl_mode_get(void)
+{
+    return m_mode;
+}
+
+void adv_ctrl_on_ble_evt(ble_evt_t * p_ble_evt)
+{
+    uint32_t        err_code;
+    adv_ctrl_mode_t mode;
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            // The SoftDevice stops advertising when a connection is made.
+            mode_set(ADV_CTRL_MODE_IDLE, 0);
+            m_links++;
+            if (m_links < m_config.link_count)
+            {
+                // Bonded gateways get the free link first, unless the gateway is the peer that just connected.
+                mode = (m_peer_addr_valid && addr_equal(&p_ble_evt->evt.gap_evt.params.connected.peer_addr, &m_peer_addr))
+                       ? ADV_CTRL_MODE_OPEN : ADV_CTRL_MODE_WHITELIST;
+                err_code = mode_start(mode, ADV_CTRL_EVT_STARTED, false);
+                APP_ERROR_CHECK(err_code);
+            }
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            if (m_links > 0)
+            {
+                m_links--;
+            }
+            // With other links up advertising may be running for the free ones, the lost peer goes first.
+            if (m_mode != ADV_CTRL_MODE_IDLE)
+            {
+                (void)adv_ctrl_stop();
+            }
+            err_code = adv_ctrl_start(ADV_CTRL_MODE_DIRECTED);
+            APP_ERROR_CHECK(err_code);
+            break;
+
+        case BLE_GAP_EVT_TIMEOUT:
+            if (p_ble_evt->evt.gap_evt.params.timeout.src == BLE_GAP_TIMEOUT_SRC_ADVERTISING)
+            {
+                on_adv_timeout();
+            }
+            break;
+
+        default:
+            // No implementation needed.
+            break;
+    }
+}
+
+void adv_ctrl_stats_get(adv_ctrl_stats_t * p_stats)
+{
+    uint64_t elapsed_ms;
+
+    *p_stats = m_stats;
+    if (m_mode != ADV_CTRL_MODE_IDLE)
+    {
+        elapsed_ms = app_time_ms_get() - m_mode_started_ms;
+        p_stats->time_ms[m_mode] += elapsed_ms;
+        p_stats->events[m_mode]  += mode_events(m_interval, elapsed_ms);
+    }
+}
+
+uint16_t adv_ctrl_encode(uint8_t * p_buf, uint16_t buf_len)
+{
+    adv_ctrl_stats_t stats;
+    uint16_t         len = 0;
+    uint32_t         interval_10ms;
+    uint8_t          mode;
+
+    if ((p_buf == NULL) || (buf_len < ADV_CTRL_ENCODED_LEN))
+    {
+        return 0;
+    }
+
+    adv_ctrl_stats_get(&stats);
+    interval_10ms = ((uint32_t)m_interval * ADV_INTERVAL_UNIT_US) / 10000;
+
+    p_buf[len++] = m_mode;
+    p_buf[len++] = (uint8_t)MIN(interval_10ms, UINT8_MAX);
+    for (mode = ADV_CTRL_MODE_DIRECTED; mode < ADV_CTRL_MODE_COUNT; mode++)
+    {
+        len += uint32_encode((uint32_t)(stats.time_ms[mode] / 1000), &p_buf[len]);
+        len += uint32_encode(stats.events[mode], &p_buf[len]);
+        len += uint16_encode((uint16_t)MIN(stats.starts[mode], UINT16_MAX), &p_buf[len]);
+    }
+    return len;
+}
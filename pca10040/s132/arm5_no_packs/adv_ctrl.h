@@ -0,0 +1,100 @@
+#ifndef ADV_CTRL_H__
+#define ADV_CTRL_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+
+/* Advertising sequence for fast reconnection of bonded gateways.
+ *
+ * After a disconnect the lost peer is first called back with high duty directed advertising (1.28 s per
+ * burst), then bonded peers get undirected advertising with a whitelist on the connection requests, and
+ * only then everybody gets slow open advertising. At boot the sequence starts with the whitelist. Modes
+ * without peers to advertise to are skipped, so a device without bonds advertises open right away. The open
+ * mode takes its interval and timeout either from the configuration or step by step from a policy, see
+ * adv_ctrl_open_step_t. When it times out for good the handler gets ADV_CTRL_EVT_IDLE.
+ *
+ * Time and advertising events are counted per mode for the energy estimate. Events are derived from the time
+ * in a mode and its interval, with the mean random delay the controller adds to each undirected event.
+ *
+ * Directed advertising goes to the identity address of the peer, so it only works for gateways using a
+ * public or static address. The whitelist takes IRKs as well.
+ *
+ * With more than one link advertising goes on after a connection while links are free: with the whitelist
+ * first unless the last peer just connected, so a phone holding a link does not lock out the gateway. */
+
+#define ADV_CTRL_HIGH_DUTY_INTERVAL_US  3750                            /**< Interval of high duty directed advertising, fixed by the SoftDevice. */
+#define ADV_CTRL_HIGH_DUTY_DURATION_MS  1280                            /**< Length of a high duty directed burst, fixed by the SoftDevice. */
+#define ADV_CTRL_ADV_DELAY_US           5000                            /**< Mean random delay added to each undirected advertising event. */
+#define ADV_CTRL_ENCODED_LEN            (2 + (ADV_CTRL_MODE_COUNT - 1) * 10)    /**< Size of adv_ctrl_encode() output (in bytes). */
+
+typedef enum
+{
+    ADV_CTRL_MODE_IDLE,                 /**< Not advertising. */
+    ADV_CTRL_MODE_DIRECTED,             /**< High duty directed advertising to the last peer. */
+    ADV_CTRL_MODE_WHITELIST,            /**< Connections only from bonded peers. */
+    ADV_CTRL_MODE_OPEN,                 /**< Connections from anyone. */
+    ADV_CTRL_MODE_COUNT
+} adv_ctrl_mode_t;
+
+typedef enum
+{
+    ADV_CTRL_EVT_STARTED,               /**< Advertising started, after boot, a disconnect or idle. */
+    ADV_CTRL_EVT_MODE_CHANGED,          /**< The previous mode timed out and the next one started. */
+    ADV_CTRL_EVT_IDLE                   /**< The open mode timed out, advertising stopped. */
+} adv_ctrl_evt_t;
+
+typedef void (*adv_ctrl_evt_handler_t)(adv_ctrl_evt_t evt, adv_ctrl_mode_t mode);
+
+/* Supplies the interval (in units of 0.625 ms) and timeout (in seconds, 0 for none) of the open mode. Called
+ * when the open mode starts, and with timed_out when it has timed out. Returning false stops advertising. */
+typedef bool (*adv_ctrl_open_step_t)(bool timed_out, uint16_t * p_interval, uint16_t * p_timeout);
+
+typedef struct
+{
+    uint8_t  directed_bursts;           /**< High duty bursts after a disconnect, 0 to skip directed advertising. */
+    uint16_t whitelist_interval;        /**< Interval of the whitelist mode (in units of 0.625 ms). */
+    uint16_t whitelist_timeout;         /**< Time in the whitelist mode (in seconds), 0 to skip it. */
+    uint16_t open_interval;             /**< Interval of the open mode (in units of 0.625 ms). */
+    uint16_t open_timeout;              /**< Time in the open mode (in seconds), 0 to advertise until connected. */
+    adv_ctrl_open_step_t open_step;     /**< Policy for the open mode, NULL for open_interval and open_timeout. */
+    uint8_t  link_count;                /**< Peripheral links enabled in the SoftDevice, 0 is taken as 1. */
+} adv_ctrl_config_t;
+
+/* Time and events per mode, the running mode included. The ADV_CTRL_MODE_IDLE entries are not used. */
+typedef struct
+{
+    uint64_t time_ms[ADV_CTRL_MODE_COUNT];
+    uint32_t events[ADV_CTRL_MODE_COUNT];
+    uint32_t starts[ADV_CTRL_MODE_COUNT];       /**< Times the mode was started. */
+} adv_ctrl_stats_t;
+
+/* Function for initializing the module. Advertising data must be set with ble_advdata_set(). */
+uint32_t adv_ctrl_init(adv_ctrl_config_t const * p_config, adv_ctrl_evt_handler_t evt_handler);
+
+/* Function for setting the peers advertised to. p_peer_addr is the target of directed advertising, NULL if
+ * the last peer is not bonded. p_whitelist must stay valid, NULL or empty for no whitelist mode. */
+void adv_ctrl_peers_set(ble_gap_addr_t const * p_peer_addr, ble_gap_whitelist_t * p_whitelist);
+
+/* Function for starting the sequence at the given mode. */
+uint32_t adv_ctrl_start(adv_ctrl_mode_t mode);
+
+/* Function for stopping advertising. */
+uint32_t adv_ctrl_stop(void);
+
+/* Returns the current mode. */
+adv_ctrl_mode_t adv_ctrl_mode_get(void);
+
+/* Function for passing GAP events to the module. Starts directed advertising on disconnect, and advertising
+ * for the free links on connect. */
+void adv_ctrl_on_ble_evt(ble_evt_t * p_ble_evt);
+
+/* Function for reading the counters. */
+void adv_ctrl_stats_get(adv_ctrl_stats_t * p_stats);
+
+/* Function for serializing the counters: mode, interval in use (uint8 in units of 10 ms, saturated), then per
+ * mode from ADV_CTRL_MODE_DIRECTED the time (in s), the events (uint32 LE) and the starts (uint16 LE).
+ * Returns the number of bytes written, 0 if the buffer is too small. */
+uint16_t adv_ctrl_encode(uint8_t * p_buf, uint16_t buf_len);
+
+#endif // ADV_CTRL_H__
@@ -0,0 +1,92 @@
+#include "adv_policy.h"
+#include <stddef.h>
+
+#define ADV_POLICY_LEVEL_MAX        16                                  /**< Bounds the doubling, the ceiling is reached long before. */
+
+static app_config_t const *     mp_config;
+static uint8_t                  m_level;
+static bool                     m_occupied;
+static bool                     m_occupied_valid;                       /**< A value has been seen since boot. */
+
+
+/* Returns the interval of a back-off level, clamped to the floor and ceiling (in units of 0.625 ms). */
+static uint16_t level_interval(uint8_t level)
+{
+    uint32_t interval;
+
+    if (level == ADV_POLICY_LEVEL_BURST)
+    {
+        return mp_config->adv_floor_interval;
+    }
+
+    interval = (uint32_t)mp_config->adv_interval << (level - ADV_POLICY_LEVEL_START);
+    if (interval > mp_config->adv_ceiling_interval)
+    {
+        interval = mp_config->adv_ceiling_interval;
+    }
+    if (interval < mp_config->adv_floor_interval)
+    {
+        interval = mp_config->adv_floor_interval;
+    }
+    return (uint16_t)interval;
+}
+
+/* Returns true if the level advertises at the ceiling, the back-off can not go further. */
+static bool level_is_ceiling(uint8_t level)
+{
+    return (level != ADV_POLICY_LEVEL_BURST)
+           && ((level_interval(level) >= mp_config->adv_ceiling_interval) || (level >= ADV_POLICY_LEVEL_MAX));
+}
+
+void adv_policy_init(app_config_t const * p_config)
+{
+    mp_config        = p_config;
+    m_level          = ADV_POLICY_LEVEL_START;
+    m_occupied       = false;
+    m_occupied_valid = false;
+}
+
+bool adv_policy_on_value(uint8_t value)
+{
+    bool occupied = (value >= mp_config->release_level);
+    bool changed  = m_occupied_valid && (occupied != m_occupied);
+
+    m_occupied       = occupied;
+    m_occupied_valid = true;
+    if (changed)
+    {
+        m_level = ADV_POLICY_LEVEL_BURST;
+    }
+    return changed;
+}
+
+void adv_policy_on_connected(void)
+{
+    m_level = ADV_POLICY_LEVEL_START;
+}
+
+bool adv_policy_open_step(bool timed_out, uint16_t * p_interval, uint16_t * p_timeout)
+{
+    if (timed_out)
+    {
+        if (level_is_ceiling(m_level))
+        {
+            return false;
+        }
+        m_level++;
+    }
+
+    *p_interval = level_interval(m_level);
+    *p_timeout  = (m_level == ADV_POLICY_LEVEL_BURST) ? mp_config->adv_burst_timeout : mp_config->adv_timeout;
+    return true;
+}
+
+uint8_t adv_policy_level_get(void)
+{
+    return m_level;
+}
+
+bool adv_policy_occupied(void)
+{
+    return m_occupied;
+}
@@ -0,0 +1,43 @@
+#ifndef ADV_POLICY_H__
+#define ADV_POLICY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_config.h"
+
+/* Advertising policy: interval and timeout of the open advertising mode.
+ *
+ * When the occupancy changes the open mode starts with a burst at adv_floor_interval for adv_burst_timeout.
+ * While the occupancy is stable the interval backs off: adv_interval for adv_timeout, then doubled every
+ * adv_timeout until it reaches adv_ceiling_interval. When the ceiling level times out advertising stops
+ * for the deep idle time of the power manager and resumes at the ceiling. A connection resets the back-off
+ * to adv_interval.
+ *
+ * The occupancy is taken from the values reported by the sensor pipeline: occupied while the value is at
+ * or above release_level. The module has no SDK dependencies and reads the configuration on every step. */
+
+#define ADV_POLICY_LEVEL_BURST      0                                   /**< Level of the burst after an occupancy change. */
+#define ADV_POLICY_LEVEL_START      1                                   /**< Level at adv_interval, the start of the back-off. */
+
+/* Function for initializing the policy at the start of the back-off. */
+void adv_policy_init(app_config_t const * p_config);
+
+/* Function for passing a value of the sensor pipeline. Returns true if the occupancy changed, the next
+ * open mode then starts with the burst. The first value only sets the occupancy. */
+bool adv_policy_on_value(uint8_t value);
+
+/* Function for resetting the back-off to its start, called on connection. */
+void adv_policy_on_connected(void);
+
+/* Function for getting the parameters of the open mode, see adv_ctrl_open_step_t. With timed_out the
+ * current level has timed out and the next one is returned. Returns false when the ceiling level has
+ * timed out, the level then stays at the ceiling. */
+bool adv_policy_open_step(bool timed_out, uint16_t * p_interval, uint16_t * p_timeout);
+
+/* Returns the current level, ADV_POLICY_LEVEL_BURST or the number of back-off steps plus one. */
+uint8_t adv_policy_level_get(void);
+
+/* Returns the occupancy from the last value. */
+bool adv_policy_occupied(void);
+
+#endif // ADV_POLICY_H__
@@ -0,0 +1,232 @@
+#include "app_config.h"
+#include <string.h>
+#include "sdk_common.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "crc16.h"
+#include "fds.h"
+#include "flash_sched.h"
+
+#define APP_CONFIG_WRITE_DELAY  APP_TIMER_TICKS(APP_CONFIG_WRITE_DELAY_MS, APP_TIMER_PRESCALER) /**< Coalescing delay for flash writes (in ticks). */
+
+app_config_t                    m_app_config = APP_CONFIG_DEFAULTS;     /**< Active configuration. */
+
+static app_config_t             m_stored;                               /**< Copy of what is currently in flash, used to skip redundant writes. */
+static app_config_record_t      m_record;                               /**< Record being written. Must stay valid until FDS reports completion. */
+static fds_record_chunk_t       m_chunk;                                /**< Chunk describing m_record. */
+static bool                     m_loaded;                               /**< The boot load has completed. */
+static bool                     m_write_in_progress;                    /**< A write has been queued and not completed yet. */
+static bool                     m_write_pending;                        /**< A new write is needed once the current one completes. */
+APP_TIMER_DEF(m_write_timer_id);                                        /**< Coalescing timer for flash writes. */
+
+
+/* Reads the record from flash into m_app_config, falling back to the defaults. */
+static void config_load(void)
+{
+    fds_record_desc_t  desc;
+    fds_find_token_t   token;
+    fds_flash_record_t flash_record;
+
+    memset(&token, 0, sizeof(token));
+
+    m_app_config = m_app_config_default;
+
+    if (fds_record_find(APP_CONFIG_FILE_ID, APP_CONFIG_RECORD_KEY, &desc, &token) == FDS_SUCCESS)
+    {
+        if (fds_record_open(&desc, &flash_record) == FDS_SUCCESS)
+        {
+            (void)app_config_record_parse((uint8_t const *)flash_record.p_data,
+                                          flash_record.p_header->tl.length_words * sizeof(uint32_t),
+                                          &m_app_config);
+            (void)fds_record_close(&desc);
+        }
+    }
+
+    m_stored = m_app_config;
+}
+
+static void config_flush(void);
+
+/* Handler for completion of the configuration write. */
+static void config_write_handler(flash_sched_evt_t const * p_evt)
+{
+    uint32_t err_code;
+
+    m_write_in_progress = false;
+    if (p_evt->result == FDS_SUCCESS)
+    {
+        m_stored = m_record.config;
+    }
+    else
+    {
+        // Try again after the coalescing delay.
+        err_code = app_timer_start(m_write_timer_id, APP_CONFIG_WRITE_DELAY, NULL);
+        APP_ERROR_CHECK(err_code);
+    }
+
+    if (m_write_pending)
+    {
+        m_write_pending = false;
+        config_flush();
+    }
+}
+
+/* Writes m_app_config to flash unless it matches what is already stored. */
+static void config_flush(void)
+{
+    uint32_t err_code;
+
+    if (m_write_in_progress)
+    {
+        m_write_pending = true;
+        return;
+    }
+    if (memcmp(&m_stored, &m_app_config, sizeof(app_config_t)) == 0)
+    {
+        return;
+    }
+
+    m_record.header.version  = APP_CONFIG_VERSION;
+    m_record.header.length   = sizeof(app_config_t);
+    m_record.header.reserved = 0;
+    m_record.config          = m_app_config;
+    m_record.header.crc      = crc16_compute((uint8_t const *)&m_record.config, sizeof(app_config_t), NULL);
+
+    m_chunk.p_data       = &m_record;
+    m_chunk.length_words = BYTES_TO_WORDS(sizeof(m_record));
+
+    // Set before queuing, the handler may run before flash_sched_write() returns.
+    m_write_in_progress = true;
+    err_code = flash_sched_write(FLASH_SCHED_JOB_REPLACE,
+                                 APP_CONFIG_FILE_ID,
+                                 APP_CONFIG_RECORD_KEY,
+                                 &m_chunk,
+                                 config_write_handler,
+                                 NULL);
+    if (err_code != NRF_SUCCESS)
+    {
+        // Scheduler queue full, try again after the coalescing delay.
+        m_write_in_progress = false;
+        err_code = app_timer_start(m_write_timer_id, APP_CONFIG_WRITE_DELAY, NULL);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+/* Handler for the coalescing timer. */
+static void write_timeout_handler(void * p_context)
+{
+    UNUSED_PARAMETER(p_context);
+    config_flush();
+}
+
+/* Handler for FDS events. Writes are completed through the flash scheduler. */
+static void fds_evt_handler(fds_evt_t const * const p_evt)
+{
+    if (p_evt->id == FDS_EVT_INIT)
+    {
+        if (p_evt->result == FDS_SUCCESS)
+        {
+            config_load();
+        }
+        m_loaded = true;
+    }
+}
+
+uint32_t app_config_init(void)
+{
+    uint32_t err_code;
+
+    err_code = app_timer_create(&m_write_timer_id, APP_TIMER_MODE_SINGLE_SHOT, write_timeout_handler);
+    VERIFY_SUCCESS(err_code);
+
+    return fds_register(fds_evt_handler);
+}
+
+bool app_config_is_loaded(void)
+{
+    return m_loaded;
+}
+
+uint32_t app_config_set(app_config_param_t param, uint16_t value)
+{
+    if (!app_config_param_is_valid(param, value))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    switch (param)
+    {
+        case APP_CONFIG_PARAM_ADV_INTERVAL:
+            m_app_config.adv_interval = value;
+            break;
+        case APP_CONFIG_PARAM_ADV_TIMEOUT:
+            m_app_config.adv_timeout = value;
+            break;
+        case APP_CONFIG_PARAM_SAMPLE_PERIOD:
+            m_app_config.sample_period_ms = value;
+            break;
+        case APP_CONFIG_PARAM_SAMPLES:
+            m_app_config.samples_in_buffer = value;
+            break;
+        case APP_CONFIG_PARAM_VALUE_MAX:
+            if (value <= m_app_config.release_level)
+            {
+                return NRF_ERROR_INVALID_PARAM;
+            }
+            m_app_config.value_max = (uint8_t)value;
+            break;
+        case APP_CONFIG_PARAM_RELEASE_LEVEL:
+            if (value >= m_app_config.value_max)
+            {
+                return NRF_ERROR_INVALID_PARAM;
+            }
+            m_app_config.release_level = (uint8_t)value;
+            break;
+        case APP_CONFIG_PARAM_ADV_FLOOR:
+            if (value > m_app_config.adv_ceiling_interval)
+            {
+                return NRF_ERROR_INVALID_PARAM;
+            }
+            m_app_config.adv_floor_interval = value;
+            break;
+        case APP_CONFIG_PARAM_ADV_CEILING:
+            if (value < m_app_config.adv_floor_interval)
+            {
+                return NRF_ERROR_INVALID_PARAM;
+            }
+            m_app_config.adv_ceiling_interval = value;
+            break;
+        case APP_CONFIG_PARAM_ADV_BURST:
+            m_app_config.adv_burst_timeout = value;
+            break;
+        case APP_CONFIG_PARAM_REPORT_MODES:
+            m_app_config.report_modes = (uint8_t)value;
+            break;
+        case APP_CONFIG_PARAM_REPORT_DEADBAND:
+            m_app_config.report_deadband = (uint8_t)value;
+            break;
+        case APP_CONFIG_PARAM_REPORT_PERIOD:
+            m_app_config.report_period_s = value;
+            break;
+        case APP_CONFIG_PARAM_REPORT_HEARTBEAT:
+            m_app_config.report_heartbeat_s = value;
+            break;
+        case APP_CONFIG_PARAM_SUMMARY_WINDOW:
+            m_app_config.summary_window_s = value;
+            break;
+        default:
+            return NRF_ERROR_INVALID_PARAM;
+    }
+
+    // Restarting the timer coalesces a burst of changes into a single flash write.
+    (void)app_timer_stop(m_write_timer_id);
+    return app_timer_start(m_write_timer_id, APP_CONFIG_WRITE_DELAY, NULL);
+}
+
+uint32_t app_config_reset(void)
+{
+    m_app_config = m_app_config_default;
+
+    (void)app_timer_stop(m_write_timer_id);
+    return app_timer_start(m_write_timer_id, APP_CONFIG_WRITE_DELAY, NULL);
+}
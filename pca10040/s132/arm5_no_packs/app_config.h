@@ -0,0 +1,153 @@
+#ifndef APP_CONFIG_H__
+#define APP_CONFIG_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Build-time settings shared by the application modules. */
+#define APP_TIMER_PRESCALER                 0                                       /**< Value of the RTC1 PRESCALER register. */
+#define APP_TIMER_OP_QUEUE_SIZE             4                                       /**< Size of timer operation queues. */
+
+#define SAMPLES_IN_BUFFER                   30                                      /**< Capacity of a saadc buffer, upper bound for the samples_in_buffer setting. */
+
+#define APP_CONN_INTERVAL_MIN_MS            20                                      /**< Minimum acceptable connection interval (in ms). */
+#define APP_CONN_INTERVAL_MAX_MS            75                                      /**< Maximum acceptable connection interval (in ms). */
+#define APP_SLAVE_LATENCY                   0                                       /**< Slave latency. */
+
+/* Factory defaults, used when no valid configuration record is found in flash. */
+#define APP_CONFIG_DEFAULT_ADV_INTERVAL     480                                     /**< The advertising interval (in units of 0.625 ms. This value corresponds to 300 ms). */
+#define APP_CONFIG_DEFAULT_ADV_TIMEOUT      20                                      /**< The advertising timeout (in units of seconds). */
+#define APP_CONFIG_DEFAULT_ADV_FLOOR        32                                      /**< Advertising interval of the burst after an occupancy change (in units of 0.625 ms, 20 ms). */
+#define APP_CONFIG_DEFAULT_ADV_CEILING      3200                                    /**< Longest advertising interval of the back-off (in units of 0.625 ms, 2 s). */
+#define APP_CONFIG_DEFAULT_ADV_BURST        5                                       /**< Length of the burst after an occupancy change (in seconds). */
+#define APP_CONFIG_DEFAULT_SAMPLE_PERIOD    6                                       /**< Time between two saadc samples (in ms). */
+#define APP_CONFIG_DEFAULT_SAMPLES          SAMPLES_IN_BUFFER                       /**< Number of samples averaged into one sensor value. */
+#define APP_CONFIG_DEFAULT_VALUE_MAX        254                                     /**< Averaged values above this are treated as invalid and dropped. */
+#define APP_CONFIG_DEFAULT_RELEASE_LEVEL    25                                      /**< Below this level the held peak is released. */
+#define APP_CONFIG_DEFAULT_REPORT_MODES     (APP_REPORT_THRESHOLD | APP_REPORT_CHANGE | APP_REPORT_HEARTBEAT) /**< Report policy, see APP_REPORT_THRESHOLD. */
+#define APP_CONFIG_DEFAULT_REPORT_DEADBAND  10                                      /**< Change from the last report below which values are not reported. Above the noise of a free bay. */
+#define APP_CONFIG_DEFAULT_REPORT_PERIOD    60                                      /**< Period of the peak summaries (in seconds). */
+#define APP_CONFIG_DEFAULT_REPORT_HEARTBEAT 60                                      /**< Longest time without a report (in seconds). */
+#define APP_CONFIG_DEFAULT_SUMMARY_WINDOW   300                                     /**< Window of the statistics summaries (in seconds). */
+
+/* Report modes, combined in report_modes. With none set every value is reported. */
+#define APP_REPORT_THRESHOLD                0x01                                    /**< Report when the value crosses release_level, the client sees every occupancy change. */
+#define APP_REPORT_CHANGE                   0x02                                    /**< Report when the value moved more than report_deadband from the last report. */
+#define APP_REPORT_PERIODIC                 0x04                                    /**< Report the peak of every report_period_s. */
+#define APP_REPORT_HEARTBEAT                0x08                                    /**< Report the value after report_heartbeat_s without a report. */
+#define APP_REPORT_MODES_ALL                0x0F
+
+#define APP_CONFIG_VERSION                  4                                       /**< Layout version of app_config_t. Bump when appending fields. */
+#define APP_CONFIG_FILE_ID                  0x1000                                  /**< FDS file holding the configuration record. */
+#define APP_CONFIG_RECORD_KEY               0x0001                                  /**< FDS key of the configuration record. */
+#define APP_CONFIG_WRITE_DELAY_MS           10000                                   /**< Quiet time after the last change before the record is written to flash. */
+
+/* Identifiers of the parameters that can be changed at runtime. */
+typedef enum
+{
+    APP_CONFIG_PARAM_ADV_INTERVAL,      /**< Advertising interval, applied on the next advertising step. */
+    APP_CONFIG_PARAM_ADV_TIMEOUT,       /**< Advertising timeout, applied on the next advertising step. */
+    APP_CONFIG_PARAM_SAMPLE_PERIOD,     /**< Sampling period. The SAADC timer takes it on the next reset, the length of presence checks and the buffer times of the sensor pipeline immediately. */
+    APP_CONFIG_PARAM_SAMPLES,           /**< Samples per value, applied on the next saadc buffer. */
+    APP_CONFIG_PARAM_VALUE_MAX,         /**< Maximum valid value, applied immediately. */
+    APP_CONFIG_PARAM_RELEASE_LEVEL,     /**< Peak release level, applied immediately. */
+    APP_CONFIG_PARAM_ADV_FLOOR,         /**< Burst advertising interval, applied on the next advertising step. */
+    APP_CONFIG_PARAM_ADV_CEILING,       /**< Longest advertising interval, applied on the next advertising step. */
+    APP_CONFIG_PARAM_ADV_BURST,         /**< Burst length, applied on the next burst. */
+    APP_CONFIG_PARAM_REPORT_MODES,      /**< Report policy, applied immediately. */
+    APP_CONFIG_PARAM_REPORT_DEADBAND,   /**< Report deadband, applied immediately. */
+    APP_CONFIG_PARAM_REPORT_PERIOD,     /**< Summary period, applied at the end of the running period. */
+    APP_CONFIG_PARAM_REPORT_HEARTBEAT,  /**< Heartbeat time, applied immediately. */
+    APP_CONFIG_PARAM_SUMMARY_WINDOW,    /**< Statistics summary window, 0 to disable, applied at the end of the running window. */
+    APP_CONFIG_PARAM_COUNT
+} app_config_param_t;
+
+/* Configuration block. Fields may only be appended, so older records can be upgraded in place. */
+typedef struct
+{
+    uint16_t adv_interval;              /**< Advertising interval at the start of the back-off (in units of 0.625 ms). */
+    uint16_t adv_timeout;               /**< Time at each back-off level (in seconds). */
+    uint16_t sample_period_ms;          /**< Time between two saadc samples (in ms). Read by the SAADC timer at boot only, by power_mgr and sensor_pipeline on every use. */
+    uint16_t samples_in_buffer;         /**< Number of samples averaged into one value. */
+    uint8_t  value_max;                 /**< Highest valid averaged value. */
+    uint8_t  release_level;             /**< Level below which the held peak is released. */
+    uint16_t reserved;                  /**< Keeps the block word aligned. */
+    uint16_t adv_floor_interval;        /**< Advertising interval of the burst (in units of 0.625 ms). Added in version 2. */
+    uint16_t adv_ceiling_interval;      /**< Longest advertising interval of the back-off (in units of 0.625 ms). Added in version 2. */
+    uint16_t adv_burst_timeout;         /**< Length of the burst (in seconds). Added in version 2. */
+    uint16_t reserved_2;                /**< Keeps the block word aligned. */
+    uint8_t  report_modes;              /**< APP_REPORT_ flags, 0 to report every value. Added in version 3. */
+    uint8_t  report_deadband;           /**< Change from the last report that is reported with APP_REPORT_CHANGE. Added in version 3. */
+    uint16_t report_period_s;           /**< Period of the APP_REPORT_PERIODIC summaries (in seconds). Added in version 3. */
+    uint16_t report_heartbeat_s;        /**< Time without a report after which APP_REPORT_HEARTBEAT reports (in seconds). Added in version 3. */
+    uint16_t reserved_3;                /**< Keeps the block word aligned. */
+    uint16_t summary_window_s;          /**< Window of the statistics summaries (in seconds), 0 to disable them. Added in version 4. */
+    uint16_t reserved_4;                /**< Keeps the block word aligned. */
+} app_config_t;
+
+/* Header stored in front of the configuration block. */
+typedef struct
+{
+    uint16_t version;                   /**< APP_CONFIG_VERSION of the firmware that wrote the record. */
+    uint16_t length;                    /**< Size of the stored configuration block (in bytes). */
+    uint16_t crc;                       /**< CRC16 of the stored configuration block. */
+    uint16_t reserved;                  /**< Keeps the block word aligned. */
+} app_config_header_t;
+
+/* Configuration record as stored in flash. */
+typedef struct
+{
+    app_config_header_t header;
+    app_config_t        config;
+} app_config_record_t;
+
+/* Initializer for app_config_t with the factory defaults. */
+#define APP_CONFIG_DEFAULTS                                         \
+{                                                                   \
+    .adv_interval         = APP_CONFIG_DEFAULT_ADV_INTERVAL,        \
+    .adv_timeout          = APP_CONFIG_DEFAULT_ADV_TIMEOUT,         \
+    .sample_period_ms     = APP_CONFIG_DEFAULT_SAMPLE_PERIOD,       \
+    .samples_in_buffer    = APP_CONFIG_DEFAULT_SAMPLES,             \
+    .value_max            = APP_CONFIG_DEFAULT_VALUE_MAX,           \
+    .release_level        = APP_CONFIG_DEFAULT_RELEASE_LEVEL,       \
+    .reserved             = 0,                                      \
+    .adv_floor_interval   = APP_CONFIG_DEFAULT_ADV_FLOOR,           \
+    .adv_ceiling_interval = APP_CONFIG_DEFAULT_ADV_CEILING,         \
+    .adv_burst_timeout    = APP_CONFIG_DEFAULT_ADV_BURST,           \
+    .reserved_2           = 0,                                      \
+    .report_modes         = APP_CONFIG_DEFAULT_REPORT_MODES,        \
+    .report_deadband      = APP_CONFIG_DEFAULT_REPORT_DEADBAND,     \
+    .report_period_s      = APP_CONFIG_DEFAULT_REPORT_PERIOD,       \
+    .report_heartbeat_s   = APP_CONFIG_DEFAULT_REPORT_HEARTBEAT,    \
+    .reserved_3           = 0,                                      \
+    .summary_window_s     = APP_CONFIG_DEFAULT_SUMMARY_WINDOW,      \
+    .reserved_4           = 0                                       \
+}
+
+/* Active configuration. Loaded once at boot, read directly by the sampling code. */
+extern app_config_t m_app_config;
+
+/* Factory defaults. */
+extern const app_config_t m_app_config_default;
+
+/* Function for registering with FDS. Must be called before fds_init() (done by pm_init()). */
+uint32_t app_config_init(void);
+
+/* Returns true once the stored configuration (or the defaults) has been loaded. */
+bool app_config_is_loaded(void);
+
+/* Function for changing a parameter. The change is written to flash after APP_CONFIG_WRITE_DELAY_MS without further changes. */
+uint32_t app_config_set(app_config_param_t param, uint16_t value);
+
+/* Function for restoring the factory defaults. */
+uint32_t app_config_reset(void);
+
+/* Function for checking the range of a parameter. */
+bool app_config_param_is_valid(app_config_param_t param, uint16_t value);
+
+/* Function for validating a stored record and upgrading it into p_config. Returns false if defaults must be used.
+ * Implemented with app_config_param_is_valid() in app_config_record.c, which only depends on crc16 so it can
+ * also be built on the host (host/app_config_check). */
+bool app_config_record_parse(uint8_t const * p_record, uint32_t record_len, app_config_t * p_config);
+
+#endif // APP_CONFIG_H__
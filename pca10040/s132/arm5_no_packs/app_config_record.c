@@ -0,0 +1,105 @@
+#include "app_config.h"
+#include <string.h>
+#include "sdk_common.h"
+#include "crc16.h"
+
+const app_config_t              m_app_config_default = APP_CONFIG_DEFAULTS; /**< Factory defaults. */
+
+
+bool app_config_param_is_valid(app_config_param_t param, uint16_t value)
+{
+    switch (param)
+    {
+        case APP_CONFIG_PARAM_ADV_INTERVAL:
+            return (value >= 0x0020) && (value <= 0x4000);
+        case APP_CONFIG_PARAM_ADV_TIMEOUT:
+            return (value >= 1) && (value <= 180);
+        case APP_CONFIG_PARAM_SAMPLE_PERIOD:
+            return (value >= 1) && (value <= 1000);
+        case APP_CONFIG_PARAM_SAMPLES:
+            return (value >= 1) && (value <= SAMPLES_IN_BUFFER);
+        case APP_CONFIG_PARAM_VALUE_MAX:
+            return (value >= 1) && (value <= 255);
+        case APP_CONFIG_PARAM_RELEASE_LEVEL:
+            return (value <= 255);
+        case APP_CONFIG_PARAM_ADV_FLOOR:
+        case APP_CONFIG_PARAM_ADV_CEILING:
+            return (value >= 0x0020) && (value <= 0x4000);
+        case APP_CONFIG_PARAM_ADV_BURST:
+            return (value >= 1) && (value <= 180);
+        case APP_CONFIG_PARAM_REPORT_MODES:
+            return (value <= APP_REPORT_MODES_ALL);
+        case APP_CONFIG_PARAM_REPORT_DEADBAND:
+            return (value <= 255);
+        case APP_CONFIG_PARAM_REPORT_PERIOD:
+        case APP_CONFIG_PARAM_REPORT_HEARTBEAT:
+            return (value >= 1) && (value <= 3600);
+        case APP_CONFIG_PARAM_SUMMARY_WINDOW:
+            return (value <= 3600);
+        default:
+            return false;
+    }
+}
+
+/* Consistency check of a complete configuration block. */
+static bool config_is_valid(app_config_t const * p_config)
+{
+    return app_config_param_is_valid(APP_CONFIG_PARAM_ADV_INTERVAL,  p_config->adv_interval)
+        && app_config_param_is_valid(APP_CONFIG_PARAM_ADV_TIMEOUT,   p_config->adv_timeout)
+        && app_config_param_is_valid(APP_CONFIG_PARAM_SAMPLE_PERIOD, p_config->sample_period_ms)
+        && app_config_param_is_valid(APP_CONFIG_PARAM_SAMPLES,       p_config->samples_in_buffer)
+        && app_config_param_is_valid(APP_CONFIG_PARAM_VALUE_MAX,     p_config->value_max)
+        && (p_config->release_level < p_config->value_max)
+        && app_config_param_is_valid(APP_CONFIG_PARAM_ADV_FLOOR,     p_config->adv_floor_interval)
+        && app_config_param_is_valid(APP_CONFIG_PARAM_ADV_CEILING,   p_config->adv_ceiling_interval)
+        && app_config_param_is_valid(APP_CONFIG_PARAM_ADV_BURST,     p_config->adv_burst_timeout)
+        && (p_config->adv_floor_interval <= p_config->adv_ceiling_interval)
+        && app_config_param_is_valid(APP_CONFIG_PARAM_REPORT_MODES,     p_config->report_modes)
+        && app_config_param_is_valid(APP_CONFIG_PARAM_REPORT_PERIOD,    p_config->report_period_s)
+        && app_config_param_is_valid(APP_CONFIG_PARAM_REPORT_HEARTBEAT, p_config->report_heartbeat_s)
+        && app_config_param_is_valid(APP_CONFIG_PARAM_SUMMARY_WINDOW,   p_config->summary_window_s);
+}
+
+bool app_config_record_parse(uint8_t const * p_record, uint32_t record_len, app_config_t * p_config)
+{
+    app_config_header_t header;
+    app_config_t        config;
+
+    if ((p_record == NULL) || (p_config == NULL) || (record_len < sizeof(header)))
+    {
+        return false;
+    }
+
+    memcpy(&header, p_record, sizeof(header));
+
+    // Records from newer firmware can not be interpreted safely.
+    if ((header.version == 0) || (header.version > APP_CONFIG_VERSION))
+    {
+        return false;
+    }
+    if (header.length > (record_len - sizeof(header)))
+    {
+        return false;
+    }
+    if ((header.version == APP_CONFIG_VERSION) && (header.length != sizeof(app_config_t)))
+    {
+        return false;
+    }
+    if (crc16_compute(p_record + sizeof(header), header.length, NULL) != header.crc)
+    {
+        return false;
+    }
+
+    // Older layouts are a prefix of the current one, missing fields keep their defaults.
+    config = m_app_config_default;
+    memcpy(&config, p_record + sizeof(header), MIN(header.length, sizeof(app_config_t)));
+
+    if (!config_is_valid(&config))
+    {
+        return false;
+    }
+
+    *p_config = config;
+    return true;
+}
+
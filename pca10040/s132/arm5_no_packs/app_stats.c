@@ -0,0 +1,62 @@
+#include "app_stats.h"
+#include <string.h>
+#include "sdk_common.h"
+#include "ble.h"
+
+uint32_t m_app_stats[APP_STATS_COUNT];
+
+
+void app_stats_send_result(uint32_t err_code)
+{
+    switch (err_code)
+    {
+        case NRF_SUCCESS:
+            APP_STATS_INC(APP_STATS_SENDS_OK);
+            break;
+
+        case NRF_ERROR_INVALID_STATE:
+            APP_STATS_INC(APP_STATS_SEND_ERR_INVALID_STATE);
+            break;
+
+        case BLE_ERROR_NO_TX_PACKETS:
+            APP_STATS_INC(APP_STATS_SEND_ERR_NO_TX_PACKETS);
+            break;
+
+        case BLE_ERROR_GATTS_SYS_ATTR_MISSING:
+            APP_STATS_INC(APP_STATS_SEND_ERR_SYS_ATTR_MISSING);
+            break;
+
+        default:
+            APP_STATS_INC(APP_STATS_SEND_ERR_OTHER);
+            break;
+    }
+}
+
+uint32_t app_stats_get(app_stats_counter_t counter)
+{
+    return (counter < APP_STATS_COUNT) ? m_app_stats[counter] : 0;
+}
+
+void app_stats_reset(void)
+{
+    memset(m_app_stats, 0, sizeof(m_app_stats));
+}
+
+uint16_t app_stats_encode(uint32_t uptime_s, uint8_t * p_buf, uint16_t buf_len)
+{
+    uint16_t len = 0;
+    uint32_t i;
+
+    if ((p_buf == NULL) || (buf_len < APP_STATS_ENCODED_LEN))
+    {
+        return 0;
+    }
+
+    p_buf[len++] = APP_STATS_VERSION;
+    len += uint32_encode(uptime_s, &p_buf[len]);
+    for (i = 0; i < APP_STATS_COUNT; i++)
+    {
+        len += uint32_encode(m_app_stats[i], &p_buf[len]);
+    }
+    return len;
+}
@@ -0,0 +1,54 @@
+#ifndef APP_STATS_H__
+#define APP_STATS_H__
+
+#include <stdint.h>
+
+/* Runtime counters for the field: notification throughput and errors, sampling and link events.
+ *
+ * APP_STATS_INC() is an atomic increment (LDREX/STREX on the Cortex-M4), so counters can be bumped from the
+ * SAADC interrupt, the SoftDevice event handler and the main loop without a critical region. The block is
+ * read over the diagnostics characteristic and cleared with a control command. */
+
+#define APP_STATS_VERSION           1                                   /**< Version of the serialized format. */
+#define APP_STATS_ENCODED_LEN       (5 + 4 * APP_STATS_COUNT)           /**< Size of a serialized block (in bytes). */
+
+/* Counters. Only append, the client decodes them by position. */
+typedef enum
+{
+    APP_STATS_SENDS_OK,                 /**< Notifications accepted by sd_ble_gatts_hvx. */
+    APP_STATS_SEND_ERR_INVALID_STATE,   /**< Not connected or notifications disabled. */
+    APP_STATS_SEND_ERR_NO_TX_PACKETS,   /**< SoftDevice TX buffers full, the frames wait for TX complete. */
+    APP_STATS_SEND_ERR_SYS_ATTR_MISSING,/**< System attributes of the peer not set yet. */
+    APP_STATS_SEND_ERR_OTHER,
+    APP_STATS_ADC_BUFFERS,              /**< SAADC buffers processed. */
+    APP_STATS_ADC_BUFFERS_LATE,         /**< Buffers that waited in the queue while the next one completed. */
+    APP_STATS_ADC_OVERRUNS,             /**< Buffers dropped because the main loop fell behind. */
+    APP_STATS_CONNECTIONS,
+    APP_STATS_RECONNECTS,               /**< Connections following a supervision timeout. */
+    APP_STATS_ADV_RESTARTS,             /**< Advertising starts other than the first after boot. */
+    APP_STATS_FRAMES_DROPPED,           /**< Frames not queued because the queue of their stream was full. */
+    APP_STATS_COUNT
+} app_stats_counter_t;
+
+extern uint32_t m_app_stats[APP_STATS_COUNT];
+
+#if defined(__GNUC__) || defined(__CC_ARM)
+#define APP_STATS_INC(counter)      ((void)__sync_fetch_and_add(&m_app_stats[(counter)], 1))
+#else
+#define APP_STATS_INC(counter)      ((void)m_app_stats[(counter)]++)
+#endif
+
+/* Function for counting the result of a notification. */
+void app_stats_send_result(uint32_t err_code);
+
+/* Returns the value of a counter. */
+uint32_t app_stats_get(app_stats_counter_t counter);
+
+/* Function for clearing all counters. */
+void app_stats_reset(void);
+
+/* Function for serializing the counters: version, uptime_s, then the counters in enum order, all uint32 LE
+ * except the version byte. Returns the number of bytes written, 0 if the buffer is too small. */
+uint16_t app_stats_encode(uint32_t uptime_s, uint8_t * p_buf, uint16_t buf_len);
+
+#endif // APP_STATS_H__
@@ -0,0 +1,107 @@
+#include "app_time.h"
+#include "sdk_common.h"
+#include "app_util_platform.h"
+#include "app_timer.h"
+#include "app_config.h"
+#include "time_sync.h"
+
+#define APP_TIME_TICKS_PER_SECOND   (APP_TIMER_CLOCK_FREQ / (APP_TIMER_PRESCALER + 1))             /**< RTC ticks per second. */
+#define APP_TIME_WRAP_INTERVAL      APP_TIMER_TICKS(60000, APP_TIMER_PRESCALER)                     /**< The 24 bit counter must be read at least once per wrap (512 s at prescaler 0). */
+
+static uint64_t m_ticks;                                                                            /**< Ticks accumulated up to m_last_counter. */
+static uint32_t m_last_counter;                                                                     /**< RTC counter value at the last update. */
+APP_TIMER_DEF(m_wrap_timer_id);                                                                     /**< Keeps the accumulator ahead of counter wrap-around. */
+
+
+static uint64_t ticks_update(void)
+{
+    uint32_t counter;
+    uint32_t diff;
+    uint64_t ticks;
+
+    CRITICAL_REGION_ENTER();
+    (void)app_timer_cnt_get(&counter);
+    (void)app_timer_cnt_diff_compute(counter, m_last_counter, &diff);
+    m_last_counter = counter;
+    m_ticks       += diff;
+    ticks          = m_ticks;
+    CRITICAL_REGION_EXIT();
+
+    return ticks;
+}
+
+/* Handler for the wrap timer. */
+static void wrap_timeout_handler(void * p_context)
+{
+    UNUSED_PARAMETER(p_context);
+    (void)ticks_update();
+}
+
+uint32_t app_time_init(void)
+{
+    uint32_t err_code;
+
+    err_code = app_timer_cnt_get(&m_last_counter);
+    VERIFY_SUCCESS(err_code);
+
+    time_sync_init();
+
+    err_code = app_timer_create(&m_wrap_timer_id, APP_TIMER_MODE_REPEATED, wrap_timeout_handler);
+    VERIFY_SUCCESS(err_code);
+
+    return app_timer_start(m_wrap_timer_id, APP_TIME_WRAP_INTERVAL, NULL);
+}
+
+uint64_t app_time_ticks_get(void)
+{
+    return ticks_update();
+}
+
+uint32_t app_time_now(void)
+{
+    return (uint32_t)(ticks_update() / APP_TIME_TICKS_PER_SECOND);
+}
+
+uint64_t app_time_ms_get(void)
+{
+    return (ticks_update() * 1000) / APP_TIME_TICKS_PER_SECOND;
+}
+
+uint64_t app_time_us_get(void)
+{
+    return (ticks_update() * 1000000) / APP_TIME_TICKS_PER_SECOND;
+}
+
+bool app_time_sync(uint64_t epoch_ms)
+{
+    bool     accepted;
+    uint64_t local_ms = app_time_ms_get();
+
+    CRITICAL_REGION_ENTER();
+    accepted = time_sync_on_sync(local_ms, epoch_ms);
+    CRITICAL_REGION_EXIT();
+
+    return accepted;
+}
+
+uint64_t app_time_epoch_ms(uint64_t local_ms)
+{
+    uint64_t epoch_ms;
+
+    // The model is updated from BLE events, which can interrupt the main loop.
+    CRITICAL_REGION_ENTER();
+    epoch_ms = time_sync_epoch_ms(local_ms);
+    CRITICAL_REGION_EXIT();
+
+    return epoch_ms;
+}
+
+uint32_t app_time_synced_now(void)
+{
+    return (uint32_t)(app_time_epoch_ms(app_time_ms_get()) / 1000);
+}
+
+uint16_t app_time_stamp(uint64_t local_ms)
+{
+    return (uint16_t)app_time_epoch_ms(local_ms);
+}
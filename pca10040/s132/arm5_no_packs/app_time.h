@@ -0,0 +1,42 @@
+#ifndef APP_TIME_H__
+#define APP_TIME_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Time base for the application, built on the RTC1 counter used by app_timer.
+ *
+ * The central can set the time with app_time_sync(), time_sync then maps the local time to the central's
+ * and corrects the drift of the crystal. Records and notifications carry the synchronized time. */
+
+/* Function for starting the time base. Must be called after APP_TIMER_INIT(). */
+uint32_t app_time_init(void);
+
+/* Returns the number of RTC ticks since app_time_init(). */
+uint64_t app_time_ticks_get(void);
+
+/* Returns the number of seconds since app_time_init(). */
+uint32_t app_time_now(void);
+
+/* Returns the number of milliseconds since app_time_init(). */
+uint64_t app_time_ms_get(void);
+
+/* Returns the number of microseconds since app_time_init(), in steps of one RTC tick. */
+uint64_t app_time_us_get(void);
+
+/* Function for passing a time write of the central (Unix time in ms). Returns false if it was rejected. */
+bool app_time_sync(uint64_t epoch_ms);
+
+/* Returns the synchronized time in ms at local time local_ms (from app_time_ms_get()), see
+ * time_sync_epoch_ms(). */
+uint64_t app_time_epoch_ms(uint64_t local_ms);
+
+/* Returns the time of records (in seconds): Unix time once synchronized, the time since app_time_init()
+ * before. */
+uint32_t app_time_synced_now(void);
+
+/* Returns the compact timestamp of local time local_ms: the low 16 bits of its synchronized time in ms. The
+ * receiver takes the latest time before reception with these bits, which is right for delays below 65 s. */
+uint16_t app_time_stamp(uint64_t local_ms);
+
+#endif // APP_TIME_H__
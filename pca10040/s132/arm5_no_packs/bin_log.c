@@ -0,0 +1,48 @@
+#include "bin_log.h"
+#include "nrf.h"
+#include "app_util_platform.h"
+#include "SEGGER_RTT.h"
+
+#define RECORD_TIME_MASK            0x00FFFFFF                          /**< RTC counters are 24 bits. */
+
+static uint8_t                  m_buffer[BIN_LOG_BUFFER_SIZE];
+static uint32_t                 m_dropped;
+
+
+void bin_log_init(void)
+{
+    (void)SEGGER_RTT_ConfigUpBuffer(BIN_LOG_RTT_CHANNEL, "BinLog", m_buffer, sizeof(m_buffer), SEGGER_RTT_MODE_NO_BLOCK_SKIP);
+}
+
+void bin_log_write(char const * p_fmt, uint32_t nargs, uint32_t const * p_args)
+{
+    uint32_t record[2 + BIN_LOG_MAX_ARGS];
+    uint32_t len;
+    uint32_t i;
+
+    if (nargs > BIN_LOG_MAX_ARGS)
+    {
+        nargs = BIN_LOG_MAX_ARGS;
+    }
+
+    record[0] = (uint32_t)(uintptr_t)p_fmt;
+    record[1] = (nargs << 24) | (NRF_RTC1->COUNTER & RECORD_TIME_MASK);
+    for (i = 0; i < nargs; i++)
+    {
+        record[2 + i] = p_args[i];
+    }
+    len = (2 + nargs) * sizeof(uint32_t);
+
+    // Skip mode writes the whole record or nothing, the lock keeps records of different contexts apart.
+    CRITICAL_REGION_ENTER();
+    if (SEGGER_RTT_WriteNoLock(BIN_LOG_RTT_CHANNEL, record, len) != len)
+    {
+        m_dropped++;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+uint32_t bin_log_dropped_get(void)
+{
+    return m_dropped;
+}
@@ -0,0 +1,62 @@
+#ifndef BIN_LOG_H__
+#define BIN_LOG_H__
+
+#include <stdint.h>
+
+/* Binary logging over SEGGER RTT with deferred formatting.
+ *
+ * BIN_LOG() writes one record holding the address of the format string, a time stamp and the raw
+ * arguments into a dedicated RTT up channel. No formatting takes place on the device: the strings are kept
+ * in the .bin_log_fmt section, which the GCC linker script marks INFO so it takes no flash, and
+ * host/bin_log_decode expands the records using that section of the ELF file. With the ARM compiler the
+ * section is placed in flash like other constant data, the decoder handles both.
+ *
+ * Arguments must be integers (cast pointers to uint32_t), at most BIN_LOG_MAX_ARGS of them. A record is
+ * written inside a critical region, so BIN_LOG() can be used from the SAADC interrupt, the SoftDevice
+ * event handler and the main loop alike. When the channel is full the record is dropped and counted.
+ *
+ * Record layout, little endian words:
+ *   format string address, (argument count << 24) | RTC1 counter, arguments. */
+
+#ifndef BIN_LOG_ENABLED
+#define BIN_LOG_ENABLED             1                                   /**< Build the log calls into the code. */
+#endif
+
+#define BIN_LOG_RTT_CHANNEL         1                                   /**< RTT up channel of the records, channel 0 is left to text output. */
+#define BIN_LOG_BUFFER_SIZE         1024                                /**< Size of the RTT channel buffer (in bytes). */
+#define BIN_LOG_MAX_ARGS            4                                   /**< Arguments per record. */
+
+#if defined(__GNUC__) || defined(__CC_ARM)
+#define BIN_LOG_FMT_SECTION         __attribute__((section(".bin_log_fmt"), used))
+#else
+#define BIN_LOG_FMT_SECTION
+#endif
+
+#define BIN_LOG_NARGS(...)          BIN_LOG_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)
+#define BIN_LOG_NARGS_(_0, _1, _2, _3, _4, n, ...)  n
+
+#if BIN_LOG_ENABLED
+
+#define BIN_LOG(fmt, ...)                                                                       \
+    do                                                                                          \
+    {                                                                                           \
+        static char const bin_log_fmt[] BIN_LOG_FMT_SECTION = fmt;                              \
+        bin_log_write(bin_log_fmt, BIN_LOG_NARGS(__VA_ARGS__), (uint32_t const []){0, ##__VA_ARGS__} + 1); \
+    } while (0)
+
+#else
+
+#define BIN_LOG(fmt, ...)           do {} while (0)
+
+#endif // BIN_LOG_ENABLED
+
+/* Function for setting up the RTT channel. */
+void bin_log_init(void);
+
+/* Function for writing a record. Called by BIN_LOG(). */
+void bin_log_write(char const * p_fmt, uint32_t nargs, uint32_t const * p_args);
+
+/* Returns the number of records dropped because the RTT channel was full. */
+uint32_t bin_log_dropped_get(void);
+
+#endif // BIN_LOG_H__
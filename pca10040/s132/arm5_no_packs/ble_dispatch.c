@@ -0,0 +1,62 @@
+#include "ble_dispatch.h"
+#include "sdk_common.h"
+
+#if BLE_DISPATCH_CYCLE_COUNT
+#define CYCLES_GET()                cycle_prof_now()
+#else
+#define CYCLES_GET()                0
+#endif
+
+
+void ble_dispatch(ble_dispatch_entry_t const * p_table,
+                  ble_dispatch_stats_t       * p_stats,
+                  uint32_t                     count,
+                  ble_evt_t                  * p_ble_evt)
+{
+    uint16_t evt_id = p_ble_evt->header.evt_id;
+    uint32_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        if ((evt_id < p_table[i].evt_first) || (evt_id > p_table[i].evt_last))
+        {
+            continue;
+        }
+
+        uint32_t start = CYCLES_GET();
+        p_table[i].handler(p_ble_evt);
+        uint32_t cycles = CYCLES_GET() - start;
+
+        p_stats[i].calls++;
+        p_stats[i].cycles_sum += cycles;
+        if (cycles > p_stats[i].cycles_max)
+        {
+            p_stats[i].cycles_max = cycles;
+        }
+    }
+}
+
+uint16_t ble_dispatch_encode(ble_dispatch_entry_t const * p_table,
+                             ble_dispatch_stats_t const * p_stats,
+                             uint32_t                     count,
+                             uint8_t                      index,
+                             uint8_t                    * p_buf,
+                             uint16_t                     buf_len)
+{
+    uint16_t len = 0;
+
+    if ((index >= count) || (p_buf == NULL) || (buf_len < BLE_DISPATCH_ENCODED_LEN))
+    {
+        return 0;
+    }
+
+    p_buf[len++] = index;
+    p_buf[len++] = CYCLE_PROF_UNIT_CYCLES;
+    len += uint16_encode(p_table[index].evt_first, &p_buf[len]);
+    len += uint16_encode(p_table[index].evt_last,  &p_buf[len]);
+    len += uint32_encode(p_stats[index].calls,      &p_buf[len]);
+    len += uint32_encode(p_stats[index].cycles_max, &p_buf[len]);
+    len += uint32_encode((p_stats[index].calls > 0) ? (uint32_t)(p_stats[index].cycles_sum / p_stats[index].calls) : 0,
+                         &p_buf[len]);
+    return len;
+}
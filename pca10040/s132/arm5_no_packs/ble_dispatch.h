@@ -0,0 +1,64 @@
+#ifndef BLE_DISPATCH_H__
+#define BLE_DISPATCH_H__
+
+#include <stdint.h>
+#include "ble.h"
+#include "cycle_prof.h"
+
+/* Table-driven dispatcher for SoftDevice BLE events.
+ *
+ * Each module subscribes to one or more ranges of event IDs in a const table built at compile time. An event
+ * is passed only to the entries whose range contains it, in table order, so the entries of a module with
+ * several ranges must be kept next to each other to keep the order between modules.
+ *
+ * Every call is timed with cycle_prof_now(), in CPU cycles on the nRF52 (the counter is started by
+ * cycle_prof_init()) and in nanoseconds on the host. Set BLE_DISPATCH_CYCLE_COUNT to 0 to leave this out, it
+ * is left out with the profiling. */
+
+#ifndef BLE_DISPATCH_CYCLE_COUNT
+#define BLE_DISPATCH_CYCLE_COUNT    CYCLE_PROF_ENABLED                  /**< Count the cycles spent in each handler. */
+#endif
+
+#if BLE_DISPATCH_CYCLE_COUNT && !CYCLE_PROF_ENABLED
+#error "BLE_DISPATCH_CYCLE_COUNT needs cycle_prof_now(), built with CYCLE_PROF_ENABLED"
+#endif
+
+#define BLE_DISPATCH_ENCODED_LEN    18                                  /**< Size of a serialized table entry (in bytes). */
+
+typedef void (*ble_dispatch_handler_t)(ble_evt_t * p_ble_evt);
+
+/* Subscription of a handler to the event IDs evt_first..evt_last (inclusive). */
+typedef struct
+{
+    uint16_t               evt_first;
+    uint16_t               evt_last;
+    ble_dispatch_handler_t handler;
+} ble_dispatch_entry_t;
+
+#define BLE_DISPATCH_ENTRY(first, last, handler)    {(first), (last), (handler)}
+
+/* Counters of one table entry. */
+typedef struct
+{
+    uint32_t calls;
+    uint32_t cycles_max;                /**< Longest call (in the unit given by CYCLE_PROF_UNIT_CYCLES). */
+    uint64_t cycles_sum;                /**< Divide by calls for the mean. */
+} ble_dispatch_stats_t;
+
+/* Function for passing an event to the subscribed handlers. p_stats has one element per table entry. */
+void ble_dispatch(ble_dispatch_entry_t const * p_table,
+                  ble_dispatch_stats_t       * p_stats,
+                  uint32_t                     count,
+                  ble_evt_t                  * p_ble_evt);
+
+/* Function for serializing the counters of table entry index: index, unit, first and last event ID (uint16
+ * LE), calls, longest and mean call (uint32 LE). Returns the number of bytes written, 0 if the buffer is too
+ * small or index is past the table. */
+uint16_t ble_dispatch_encode(ble_dispatch_entry_t const * p_table,
+                             ble_dispatch_stats_t const * p_stats,
+                             uint32_t                     count,
+                             uint8_t                      index,
+                             uint8_t                    * p_buf,
+                             uint16_t                     buf_len);
+
+#endif // BLE_DISPATCH_H__
@@ -3,9 +3,11 @@
 #include "ble_srv_common.h"
 #include "ble_sensor_data_custom.h"
 #include "sdk_common.h"
+#include "app_error.h"
 
-//#define BLE_UUID_NUS_TX_CHARACTERISTIC 0x0002                      /**< The UUID of the TX Characteristic. */
+#define BLE_UUID_NUS_TX_CHARACTERISTIC 0x0002                      /**< The UUID of the TX Characteristic. */
 #define BLE_UUID_NUS_RX_CHARACTERISTIC 0x0003                      /**< The UUID of the RX Characteristic. */
+#define BLE_UUID_SDC_DIAG_CHARACTERISTIC 0x0004                    /**< The UUID of the diagnostics Characteristic. */
 
 #define BLE_SDC_MAX_RX_CHAR_LEN        BLE_SDC_MAX_DATA_LEN        /**< Maximum length of the RX Characteristic (in bytes). */
 #define BLE_SDC_MAX_TX_CHAR_LEN        BLE_SDC_MAX_DATA_LEN        /**< Maximum length of the TX Characteristic (in bytes). */
@@ -15,38 +17,115 @@
 // New UUID for the SDC service
 #define SDC_BASE_UUID                  {{0xEA, 0xBA, 0x6F, 0x60, 0xEC, 0x25, 0x11, 0xE5, 0xA7, 0x61, 0x00, 0x02, 0xA5, 0xD5, 0xC5, 0x1B}}
 
-/* Connection handler when connecting with service. */
-void on_connect(ble_sdc_t * p_sdc, ble_evt_t * p_ble_evt)
+/* Returns the link of a connection, NULL if it is not tracked. */
+static ble_sdc_link_t * link_get(ble_sdc_t * p_sdc, uint16_t conn_handle)
 {
-    p_sdc->conn_handle = p_ble_evt->evt.gap_evt.conn_handle;
+    uint8_t link = ble_sdc_link_find(p_sdc, conn_handle);
+
+    return (link == BLE_SDC_LINK_NONE) ? NULL : &p_sdc->links[link];
+}
+
+/* Passes a change of the notification state of a link to the application. */
+static void link_evt_raise(ble_sdc_t * p_sdc, ble_sdc_link_t const * p_link)
+{
+    if (p_sdc->evt_handler != NULL)
+    {
+        p_sdc->evt_handler(p_sdc,
+                           p_link->is_notification_enabled ? BLE_SDC_EVT_NOTIFICATION_ENABLED
+                                                           : BLE_SDC_EVT_NOTIFICATION_DISABLED,
+                           (uint8_t)(p_link - p_sdc->links));
+    }
+}
+
+/* Picks up the CCCD value set by the peer manager for a bonded client. The client does not write it again
+ * when it reconnects, so no write event would start the notifications. */
+static void cccd_sync(ble_sdc_t * p_sdc, ble_sdc_link_t * p_link)
+{
+    uint8_t           cccd[BLE_CCCD_VALUE_LEN];
+    ble_gatts_value_t value;
+    bool              enabled;
+
+    memset(&value, 0, sizeof(value));
+    value.len     = sizeof(cccd);
+    value.p_value = cccd;
+
+    // Fails with BLE_ERROR_GATTS_SYS_ATTR_MISSING until the system attributes are set.
+    if ((sd_ble_gatts_value_get(p_link->conn_handle, p_sdc->rx_handles.cccd_handle, &value) != NRF_SUCCESS)
+        || (value.len != BLE_CCCD_VALUE_LEN))
+    {
+        return;
+    }
+
+    enabled = ble_srv_is_notification_enabled(cccd);
+    if (enabled != p_link->is_notification_enabled)
+    {
+        p_link->is_notification_enabled = enabled;
+        link_evt_raise(p_sdc, p_link);
+    }
+}
+
+/* Connection handler when connecting with service. Takes a free entry of the link table, a connection
+ * beyond BLE_SDC_MAX_LINKS gets no notifications. */
+static void on_connect(ble_sdc_t * p_sdc, ble_evt_t * p_ble_evt)
+{
+    ble_sdc_link_t * p_link = link_get(p_sdc, BLE_CONN_HANDLE_INVALID);
+    uint8_t          tx_count;
+
+    if (p_link == NULL)
+    {
+        return;
+    }
+
+    memset(p_link, 0, sizeof(ble_sdc_link_t));
+    p_link->conn_handle      = p_ble_evt->evt.gap_evt.conn_handle;
+    p_link->att_mtu          = GATT_MTU_SIZE_DEFAULT;
+    p_link->conn_interval_ms = (p_ble_evt->evt.gap_evt.params.connected.conn_params.max_conn_interval * 5) / 4;
+
+    // The TX buffers are per link, their count depends on the bandwidth configuration.
+    if (sd_ble_tx_packet_count_get(p_link->conn_handle, &tx_count) != NRF_SUCCESS)
+    {
+        tx_count = 1;
+    }
+    p_link->tx_count = tx_count;
+    p_link->tx_free  = tx_count;
+
+    cccd_sync(p_sdc, p_link);
 }
 
 /* Connection handler when disconnecting from service */
-void on_disconnect(ble_sdc_t * p_sdc, ble_evt_t * p_ble_evt)
+static void on_disconnect(ble_sdc_t * p_sdc, ble_evt_t * p_ble_evt)
 {
-    UNUSED_PARAMETER(p_ble_evt);
-    p_sdc->conn_handle = BLE_CONN_HANDLE_INVALID;
+    ble_sdc_link_t * p_link = link_get(p_sdc, p_ble_evt->evt.gap_evt.conn_handle);
+
+    if (p_link == NULL)
+    {
+        return;
+    }
+
+    p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+    if (p_link->is_notification_enabled)
+    {
+        p_link->is_notification_enabled = false;
+        link_evt_raise(p_sdc, p_link);
+    }
 }
 
 /* Connection handler when receiving write request from applicaton/client */
-void on_write(ble_sdc_t * p_sdc, ble_evt_t * p_ble_evt)
+static void on_write(ble_sdc_t * p_sdc, ble_evt_t * p_ble_evt)
 {
     ble_gatts_evt_write_t * p_evt_write = &p_ble_evt->evt.gatts_evt.params.write;
+    ble_sdc_link_t        * p_link      = link_get(p_sdc, p_ble_evt->evt.gatts_evt.conn_handle);
 
     if (
         (p_evt_write->handle == p_sdc->rx_handles.cccd_handle)
         &&
         (p_evt_write->len == 2)
+        &&
+        (p_link != NULL)
        )
     {
-        if (ble_srv_is_notification_enabled(p_evt_write->data))
-        {
-            p_sdc->is_notification_enabled = true;
-        }
-        else
-        {
-            p_sdc->is_notification_enabled = false;
-        }
+        p_link->is_notification_enabled = ble_srv_is_notification_enabled(p_evt_write->data);
+        link_evt_raise(p_sdc, p_link);
     }
     else if (
              (p_evt_write->handle == p_sdc->tx_handles.value_handle)
@@ -62,6 +141,103 @@ void on_write(ble_sdc_t * p_sdc, ble_evt_t * p_ble_evt)
     }
 }
 
+/* Handler for read authorization requests, fills in the diagnostics characteristic. */
+static void on_rw_authorize_request(ble_sdc_t * p_sdc, ble_evt_t * p_ble_evt)
+{
+    ble_gatts_evt_rw_authorize_request_t * p_req = &p_ble_evt->evt.gatts_evt.params.authorize_request;
+    ble_gatts_rw_authorize_reply_params_t  reply;
+    uint8_t                                page[BLE_SDC_MAX_DIAG_LEN];
+    uint16_t                               length = sizeof(page);
+    uint32_t                               err_code;
+
+    if (
+        (p_req->type != BLE_GATTS_AUTHORIZE_TYPE_READ)
+        ||
+        (p_req->request.read.handle != p_sdc->diag_handles.value_handle)
+       )
+    {
+        return;
+    }
+
+    memset(&reply, 0, sizeof(reply));
+    reply.type                    = BLE_GATTS_AUTHORIZE_TYPE_READ;
+    reply.params.read.gatt_status = BLE_GATT_STATUS_SUCCESS;
+
+    // The page is filled in at the start of a read, read blob requests continue from the stored value.
+    if ((p_req->request.read.offset == 0) && (p_sdc->diag_handler != NULL))
+    {
+        p_sdc->diag_handler(p_sdc, page, &length);
+        reply.params.read.update = 1;
+        reply.params.read.len    = length;
+        reply.params.read.p_data = page;
+    }
+
+    err_code = sd_ble_gatts_rw_authorize_reply(p_ble_evt->evt.gatts_evt.conn_handle, &reply);
+    if ((err_code != NRF_SUCCESS) && (err_code != NRF_ERROR_INVALID_STATE))
+    {
+        APP_ERROR_HANDLER(err_code);
+    }
+}
+
+/* Handler for Send Data Custom Service on BLE events. */
+void ble_sdc_on_ble_evt(ble_sdc_t * p_sdc, ble_evt_t * p_ble_evt)
+{
+    ble_sdc_link_t * p_link;
+
+    if ((p_sdc == NULL) || (p_ble_evt == NULL))
+    {
+        return;
+    }
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            on_connect(p_sdc, p_ble_evt);
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            on_disconnect(p_sdc, p_ble_evt);
+            break;
+
+        case BLE_GAP_EVT_CONN_SEC_UPDATE:
+            // The peer manager may set the system attributes once the link is encrypted.
+            p_link = link_get(p_sdc, p_ble_evt->evt.gap_evt.conn_handle);
+            if (p_link != NULL)
+            {
+                cccd_sync(p_sdc, p_link);
+            }
+            break;
+
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+            p_link = link_get(p_sdc, p_ble_evt->evt.gap_evt.conn_handle);
+            if (p_link != NULL)
+            {
+                p_link->conn_interval_ms = (p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params.max_conn_interval * 5) / 4;
+            }
+            break;
+
+        case BLE_EVT_TX_COMPLETE:
+            p_link = link_get(p_sdc, p_ble_evt->evt.common_evt.conn_handle);
+            if (p_link != NULL)
+            {
+                p_link->tx_free = MIN(p_link->tx_free + p_ble_evt->evt.common_evt.params.tx_complete.count, p_link->tx_count);
+            }
+            break;
+
+        case BLE_GATTS_EVT_WRITE:
+            on_write(p_sdc, p_ble_evt);
+            break;
+
+        case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
+            on_rw_authorize_request(p_sdc, p_ble_evt);
+            break;
+
+        default:
+            // No implementation needed.
+            break;
+    }
+}
+
 /* Function for adding write characteristic and attributes to the service */
 static uint32_t rx_char_add(ble_sdc_t * p_sdc, const ble_sdc_init_t * p_sdc_init)
 {
@@ -72,6 +248,8 @@ static uint32_t rx_char_add(ble_sdc_t * p_sdc, const ble_sdc_init_t * p_sdc_init
     ble_uuid_t          ble_uuid;
     ble_gatts_attr_md_t attr_md;
 
+    UNUSED_PARAMETER(p_sdc_init);
+
     memset(&cccd_md, 0, sizeof(cccd_md));
     BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.read_perm);
     BLE_GAP_CONN_SEC_MODE_SET_OPEN(&cccd_md.write_perm);
@@ -112,20 +290,113 @@ static uint32_t rx_char_add(ble_sdc_t * p_sdc, const ble_sdc_init_t * p_sdc_init
 
 }
 
+/* Function for adding the control characteristic the client writes commands to. */
+static uint32_t tx_char_add(ble_sdc_t * p_sdc, const ble_sdc_init_t * p_sdc_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    UNUSED_PARAMETER(p_sdc_init);
+
+    memset(&char_md, 0, sizeof(char_md));
+
+    char_md.char_props.write         = 1;
+    char_md.char_props.write_wo_resp = 1;
+    char_md.p_char_user_desc         = NULL;
+    char_md.p_char_pf                = NULL;
+    char_md.p_user_desc_md           = NULL;
+    char_md.p_cccd_md                = NULL;
+    char_md.p_sccd_md                = NULL;
+
+    ble_uuid.type = p_sdc->uuid_type;
+    ble_uuid.uuid = BLE_UUID_NUS_TX_CHARACTERISTIC;
+
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_ENC_NO_MITM(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_ENC_NO_MITM(&attr_md.write_perm);
+
+    attr_md.vloc    = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth = 0;
+    attr_md.wr_auth = 0;
+    attr_md.vlen    = 1;
+
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid    = &ble_uuid;
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.init_len  = 1;
+    attr_char_value.init_offs = 0;
+    attr_char_value.max_len   = BLE_SDC_MAX_TX_CHAR_LEN;
+
+    return sd_ble_gatts_characteristic_add(p_sdc->service_handle,&char_md,&attr_char_value,&p_sdc->tx_handles);
+}
+
+/* Function for adding the diagnostics characteristic, filled in by the application on every read. */
+static uint32_t diag_char_add(ble_sdc_t * p_sdc, const ble_sdc_init_t * p_sdc_init)
+{
+    ble_gatts_char_md_t char_md;
+    ble_gatts_attr_t    attr_char_value;
+    ble_uuid_t          ble_uuid;
+    ble_gatts_attr_md_t attr_md;
+
+    UNUSED_PARAMETER(p_sdc_init);
+
+    memset(&char_md, 0, sizeof(char_md));
+
+    char_md.char_props.read  = 1;
+    char_md.p_char_user_desc = NULL;
+    char_md.p_char_pf        = NULL;
+    char_md.p_user_desc_md   = NULL;
+    char_md.p_cccd_md        = NULL;
+    char_md.p_sccd_md        = NULL;
+
+    ble_uuid.type = p_sdc->uuid_type;
+    ble_uuid.uuid = BLE_UUID_SDC_DIAG_CHARACTERISTIC;
+
+    memset(&attr_md, 0, sizeof(attr_md));
+
+    BLE_GAP_CONN_SEC_MODE_SET_ENC_NO_MITM(&attr_md.read_perm);
+    BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(&attr_md.write_perm);
+
+    attr_md.vloc    = BLE_GATTS_VLOC_STACK;
+    attr_md.rd_auth = 1;
+    attr_md.wr_auth = 0;
+    attr_md.vlen    = 1;
+
+    memset(&attr_char_value, 0, sizeof(attr_char_value));
+
+    attr_char_value.p_uuid    = &ble_uuid;
+    attr_char_value.p_attr_md = &attr_md;
+    attr_char_value.init_len  = 1;
+    attr_char_value.init_offs = 0;
+    attr_char_value.max_len   = BLE_SDC_MAX_DIAG_LEN;
+
+    return sd_ble_gatts_characteristic_add(p_sdc->service_handle,&char_md,&attr_char_value,&p_sdc->diag_handles);
+}
+
 /* Function for initializing the Send Data Custom service. */
 uint32_t ble_sdc_init(ble_sdc_t * p_sdc, const ble_sdc_init_t * p_sdc_init)
 {
     uint32_t      err_code;
     ble_uuid_t    ble_uuid;
     ble_uuid128_t sdc_base_uuid = SDC_BASE_UUID;
+    uint8_t       i;
 
     VERIFY_PARAM_NOT_NULL(p_sdc);
     VERIFY_PARAM_NOT_NULL(p_sdc_init);
 
     // Initialize the service structure.
-    p_sdc->conn_handle             = BLE_CONN_HANDLE_INVALID;
+    memset(p_sdc->links, 0, sizeof(p_sdc->links));
+    for (i = 0; i < BLE_SDC_MAX_LINKS; i++)
+    {
+        p_sdc->links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
     p_sdc->data_handler            = p_sdc_init->data_handler;
-    p_sdc->is_notification_enabled = false;
+    p_sdc->diag_handler            = p_sdc_init->diag_handler;
+    p_sdc->evt_handler             = p_sdc_init->evt_handler;
 
     /**@snippet [Adding proprietary Service to S110 SoftDevice] */
     // Add a custom base UUID.
@@ -144,19 +415,33 @@ uint32_t ble_sdc_init(ble_sdc_t * p_sdc, const ble_sdc_init_t * p_sdc_init)
     err_code = rx_char_add(p_sdc, p_sdc_init);
     VERIFY_SUCCESS(err_code);
 
+    // Add the TX Characteristic.
+    err_code = tx_char_add(p_sdc, p_sdc_init);
+    VERIFY_SUCCESS(err_code);
+
+    // Add the diagnostics Characteristic.
+    err_code = diag_char_add(p_sdc, p_sdc_init);
+    VERIFY_SUCCESS(err_code);
+
     return NRF_SUCCESS;
 }
 
-/* Function for sending data. */ 
-uint32_t ble_sdc_data_send(ble_sdc_t * p_sdc, uint8_t * p_string, uint16_t length)
+/* Function for sending data to every client with notifications enabled. */
+uint32_t ble_sdc_data_send(ble_sdc_t * p_sdc, uint8_t * p_string, uint16_t length, uint8_t * p_links)
 {
     ble_gatts_hvx_params_t hvx_params;
+    ble_sdc_link_t       * p_link;
+    uint32_t               err_code = NRF_ERROR_INVALID_STATE;
+    uint32_t               link_err_code;
+    uint16_t               hvx_len;
+    uint8_t                queued   = 0;
+    uint8_t                i;
 
     VERIFY_PARAM_NOT_NULL(p_sdc);
 
-    if ((p_sdc->conn_handle == BLE_CONN_HANDLE_INVALID) || (!p_sdc->is_notification_enabled))
+    if (p_links != NULL)
     {
-        return NRF_ERROR_INVALID_STATE;
+        *p_links = 0;
     }
 
     if (length > BLE_SDC_MAX_DATA_LEN)
@@ -168,9 +453,121 @@ uint32_t ble_sdc_data_send(ble_sdc_t * p_sdc, uint8_t * p_string, uint16_t lengt
 
     hvx_params.handle = p_sdc->rx_handles.value_handle;
     hvx_params.p_data = p_string;
-    hvx_params.p_len  = &length;
+    hvx_params.p_len  = &hvx_len;
     hvx_params.type   = BLE_GATT_HVX_NOTIFICATION;
 
-    return sd_ble_gatts_hvx(p_sdc->conn_handle, &hvx_params);
+    for (i = 0; i < BLE_SDC_MAX_LINKS; i++)
+    {
+        p_link = &p_sdc->links[i];
+        if ((p_link->conn_handle == BLE_CONN_HANDLE_INVALID) || !p_link->is_notification_enabled)
+        {
+            continue;
+        }
+
+        if (length > p_link->att_mtu - 3)
+        {
+            link_err_code = NRF_ERROR_DATA_SIZE;
+        }
+        else if (p_link->tx_free == 0)
+        {
+            // The SoftDevice would refuse it, the call is saved.
+            link_err_code = BLE_ERROR_NO_TX_PACKETS;
+        }
+        else
+        {
+            hvx_len       = length; // The SoftDevice writes back the length sent.
+            link_err_code = sd_ble_gatts_hvx(p_link->conn_handle, &hvx_params);
+        }
+
+        if (link_err_code == NRF_SUCCESS)
+        {
+            p_link->tx_free--;
+            p_link->sent++;
+            queued |= (uint8_t)(1 << i);
+        }
+        else
+        {
+            if (link_err_code == BLE_ERROR_NO_TX_PACKETS)
+            {
+                p_link->tx_free = 0;
+            }
+            p_link->dropped++;
+            err_code = link_err_code;
+        }
+    }
+
+    if (p_links != NULL)
+    {
+        *p_links = queued;
+    }
+    return (queued != 0) ? NRF_SUCCESS : err_code;
+}
+
+uint8_t ble_sdc_link_find(ble_sdc_t const * p_sdc, uint16_t conn_handle)
+{
+    uint8_t i;
+
+    for (i = 0; i < BLE_SDC_MAX_LINKS; i++)
+    {
+        if (p_sdc->links[i].conn_handle == conn_handle)
+        {
+            return i;
+        }
+    }
+    return BLE_SDC_LINK_NONE;
+}
+
+uint8_t ble_sdc_subscriber_count(ble_sdc_t const * p_sdc)
+{
+    uint8_t count = 0;
+    uint8_t i;
+
+    for (i = 0; i < BLE_SDC_MAX_LINKS; i++)
+    {
+        if ((p_sdc->links[i].conn_handle != BLE_CONN_HANDLE_INVALID) && p_sdc->links[i].is_notification_enabled)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+uint16_t ble_sdc_links_encode(ble_sdc_t const * p_sdc, uint8_t * p_buf, uint16_t buf_len)
+{
+    ble_sdc_link_t const * p_link;
+    uint16_t               len   = 1;
+    uint8_t                count = 0;
+    uint8_t                i;
+
+    for (i = 0; i < BLE_SDC_MAX_LINKS; i++)
+    {
+        if (p_sdc->links[i].conn_handle != BLE_CONN_HANDLE_INVALID)
+        {
+            count++;
+        }
+    }
+    if ((p_buf == NULL) || (buf_len < 1 + count * BLE_SDC_LINK_ENCODED_LEN))
+    {
+        return 0;
+    }
+
+    p_buf[0] = count;
+    for (i = 0; i < BLE_SDC_MAX_LINKS; i++)
+    {
+        p_link = &p_sdc->links[i];
+        if (p_link->conn_handle == BLE_CONN_HANDLE_INVALID)
+        {
+            continue;
+        }
+        len += uint16_encode(p_link->conn_handle, &p_buf[len]);
+        p_buf[len++] = p_link->is_notification_enabled ? 0x01 : 0x00;
+        len += uint16_encode(p_link->att_mtu, &p_buf[len]);
+        len += uint16_encode(p_link->conn_interval_ms, &p_buf[len]);
+        p_buf[len++] = p_link->tx_free;
+        p_buf[len++] = p_link->tx_count;
+        len += uint32_encode(p_link->sent, &p_buf[len]);
+        len += uint32_encode(p_link->dropped, &p_buf[len]);
+    }
+    return len;
 }
-/** @} */
+/** @} */
\ No newline at end of file
@@ -1,3 +1,6 @@
+#ifndef BLE_SENSOR_DATA_CUSTOM_H__
+#define BLE_SENSOR_DATA_CUSTOM_H__
+
 #include "ble.h"
 #include "ble_srv_common.h"
 #include <stdint.h>
@@ -5,20 +8,52 @@
 
 #define BLE_UUID_SDC_SERVICE 0x0001                      /**< The UUID of the SDC Service. */
 #define BLE_SDC_MAX_DATA_LEN (GATT_MTU_SIZE_DEFAULT - 3) /**< Maximum length of data (in bytes) */
+#define BLE_SDC_MAX_DIAG_LEN 64                          /**< Maximum length of a diagnostics page (in bytes), read with read blob requests. */
+#ifndef BLE_SDC_MAX_LINKS
+#define BLE_SDC_MAX_LINKS    2                           /**< Connections the service tracks, the gateway and a maintenance phone. */
+#endif
+#define BLE_SDC_LINK_NONE    0xFF                        /**< No entry of ble_sdc_t::links. */
+#define BLE_SDC_LINK_ENCODED_LEN 17                      /**< Size of one link in ble_sdc_links_encode() output (in bytes). */
 
 
 
 // Sensor Data Custom -> sdc
 typedef struct ble_sdc_s ble_sdc_t;
 typedef void (*ble_sdc_data_handler_t) (ble_sdc_t * p_sdc, uint8_t * p_data, uint16_t length);
+/* Fills in the diagnostics page when the client reads it. *p_length holds the buffer size on entry. */
+typedef void (*ble_sdc_diag_handler_t) (ble_sdc_t * p_sdc, uint8_t * p_data, uint16_t * p_length);
+
+/* Service events passed to the application. */
+typedef enum
+{
+    BLE_SDC_EVT_NOTIFICATION_ENABLED,    /**< The client enabled notifications of sensor data. */
+    BLE_SDC_EVT_NOTIFICATION_DISABLED    /**< The client disabled notifications, or disconnected with them enabled. */
+} ble_sdc_evt_type_t;
+
+/* Handler for service events. link is the entry of ble_sdc_t::links the event is about. */
+typedef void (*ble_sdc_evt_handler_t) (ble_sdc_t * p_sdc, ble_sdc_evt_type_t evt_type, uint8_t link);
 
 
 typedef struct
 {
     ble_sdc_data_handler_t data_handler; /**< Event handler to be called for handling received data. */
+    ble_sdc_diag_handler_t diag_handler; /**< Handler to be called for filling in the diagnostics characteristic. */
+    ble_sdc_evt_handler_t  evt_handler;  /**< Handler to be called for service events. */
 } ble_sdc_init_t;
 
 
+/* State of the service on one connection. */
+typedef struct
+{
+    uint16_t conn_handle;                             /**< Handle of the connection, BLE_CONN_HANDLE_INVALID for a free entry. */
+    bool     is_notification_enabled;                 /**< The peer enabled notifications of the RX characteristic. */
+    uint16_t att_mtu;                                 /**< ATT MTU of the link. GATT_MTU_SIZE_DEFAULT, S132 v2 does not negotiate a larger one. */
+    uint16_t conn_interval_ms;                        /**< Connection interval (max of the connection parameters). */
+    uint8_t  tx_count;                                /**< Application TX buffers of the link, from sd_ble_tx_packet_count_get(). */
+    uint8_t  tx_free;                                 /**< TX buffers not holding a notification, refilled on BLE_EVT_TX_COMPLETE. */
+    uint32_t sent;                                    /**< Notifications queued on the link. */
+    uint32_t dropped;                                 /**< Notifications not queued, mostly for lack of a free TX buffer. */
+} ble_sdc_link_t;
 
 struct ble_sdc_s
 {
@@ -26,26 +61,39 @@ struct ble_sdc_s
     uint16_t                 service_handle;          /**< Handle of service (as provided by the SoftDevice). */
     ble_gatts_char_handles_t tx_handles;              /**< Handles related to the TX characteristic (as provided by the SoftDevice). */
     ble_gatts_char_handles_t rx_handles;              /**< Handles related to the RX characteristic (as provided by the SoftDevice). */
-    uint16_t                 conn_handle;             /**< Handle of the current connection (as provided by the SoftDevice). BLE_CONN_HANDLE_INVALID if not in a connection. */
-    bool                     is_notification_enabled; /**< Variable to indicate if the peer has enabled notification of the RX characteristic.*/
+    ble_gatts_char_handles_t diag_handles;            /**< Handles related to the diagnostics characteristic (as provided by the SoftDevice). */
+    ble_sdc_link_t           links[BLE_SDC_MAX_LINKS]; /**< Per connection state. */
     ble_sdc_data_handler_t   data_handler;            /**< Event handler to be called for handling received data. */
+    ble_sdc_diag_handler_t   diag_handler;            /**< Handler to be called for filling in the diagnostics characteristic. */
+    ble_sdc_evt_handler_t    evt_handler;             /**< Handler to be called for service events. */
 };
 
-/* Connection handler when connecting with service. */
-void on_connect(ble_sdc_t * p_sdc, ble_evt_t * p_ble_evt);
-/* Connection handler when disconnecting from service */
-void on_disconnect(ble_sdc_t * p_sdc, ble_evt_t * p_ble_evt);
-/* Connection handler when receiving write request from applicaton/client */
-void on_write(ble_sdc_t * p_sdc, ble_evt_t * p_ble_evt);
-
 /* Function for initializing the Send Data Custom service. */
 uint32_t ble_sdc_init(ble_sdc_t * p_sdc, const ble_sdc_init_t * p_sdc_init);
 
-/* Handler for Send Data Custom Service on BLE events. Implemented in main.c */
+/* Handler for Send Data Custom Service on BLE events. Handles common (TX complete), GAP and GATTS events. */
 void ble_sdc_on_ble_evt(ble_sdc_t * p_sdc, ble_evt_t * p_ble_evt);
 
-/* Function for sending data. */
-uint32_t ble_sdc_data_send(ble_sdc_t * p_sdc, uint8_t * p_string, uint16_t length);
+/* Function for sending data to every client with notifications enabled. The same buffer is queued on each
+ * link. Links without a free TX buffer are skipped without calling the SoftDevice and count a drop, so a slow
+ * link loses its own copies and does not hold back the others. Returns NRF_SUCCESS if the data was queued on
+ * at least one link, NRF_ERROR_INVALID_STATE if no client has notifications enabled, else the error of the
+ * last link tried. *p_links, if not NULL, gets bit i set for each links[i] the data was queued on. */
+uint32_t ble_sdc_data_send(ble_sdc_t * p_sdc, uint8_t * p_string, uint16_t length, uint8_t * p_links);
+
+/* Returns the index of the link with the given connection handle, BLE_SDC_LINK_NONE if not tracked.
+ * BLE_CONN_HANDLE_INVALID finds a free entry. */
+uint8_t ble_sdc_link_find(ble_sdc_t const * p_sdc, uint16_t conn_handle);
+
+/* Returns the number of clients with notifications enabled. */
+uint8_t ble_sdc_subscriber_count(ble_sdc_t const * p_sdc);
+
+/* Function for serializing the link table: the number of links, then per link the connection handle
+ * (uint16 LE), flags (bit 0 notifications enabled), ATT MTU and connection interval in ms (uint16 LE),
+ * free and total TX buffers, sent and dropped notifications (uint32 LE). Free entries are skipped. Returns
+ * the number of bytes written, 0 if the buffer is too small. */
+uint16_t ble_sdc_links_encode(ble_sdc_t const * p_sdc, uint8_t * p_buf, uint16_t buf_len);
 
 /** @} */
 
+#endif // BLE_SENSOR_DATA_CUSTOM_H__
@@ -0,0 +1,127 @@
+#include "cycle_prof.h"
+
+#if CYCLE_PROF_ENABLED
+
+#include <string.h>
+#if defined(__arm__)
+#include "nrf.h"
+#else
+#include <time.h>
+#endif
+
+static cycle_prof_stats_t       m_stats[CYCLE_PROF_SECTION_COUNT];
+
+
+uint32_t cycle_prof_now(void)
+{
+#if defined(__arm__)
+    return DWT->CYCCNT;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec);
+#endif
+}
+
+void cycle_prof_init(void)
+{
+#if defined(__arm__)
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL        |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+    cycle_prof_reset();
+}
+
+void cycle_prof_reset(void)
+{
+    uint32_t i;
+
+    memset(m_stats, 0, sizeof(m_stats));
+    for (i = 0; i < CYCLE_PROF_SECTION_COUNT; i++)
+    {
+        m_stats[i].min = UINT32_MAX;
+    }
+}
+
+/* Returns the histogram bin of a duration: floor(log2(duration)), capped to the last bin. */
+static uint32_t hist_bin(uint32_t duration)
+{
+    uint32_t bin = 0;
+
+    while ((duration > 1) && (bin < CYCLE_PROF_HIST_BINS - 1))
+    {
+        duration >>= 1;
+        bin++;
+    }
+    return bin;
+}
+
+void cycle_prof_record(cycle_prof_section_t section, uint32_t duration)
+{
+    cycle_prof_stats_t * p_stats;
+
+    if (section >= CYCLE_PROF_SECTION_COUNT)
+    {
+        return;
+    }
+    p_stats = &m_stats[section];
+
+    p_stats->count++;
+    p_stats->sum += duration;
+    if (duration < p_stats->min)
+    {
+        p_stats->min = duration;
+    }
+    if (duration > p_stats->max)
+    {
+        p_stats->max = duration;
+    }
+    p_stats->hist[hist_bin(duration)]++;
+}
+
+void cycle_prof_stats_get(cycle_prof_section_t section, cycle_prof_stats_t * p_stats)
+{
+    if (section < CYCLE_PROF_SECTION_COUNT)
+    {
+        *p_stats = m_stats[section];
+    }
+}
+
+static uint16_t u32_put(uint32_t value, uint8_t * p_buf)
+{
+    p_buf[0] = (uint8_t)value;
+    p_buf[1] = (uint8_t)(value >> 8);
+    p_buf[2] = (uint8_t)(value >> 16);
+    p_buf[3] = (uint8_t)(value >> 24);
+    return 4;
+}
+
+uint16_t cycle_prof_encode(cycle_prof_section_t section, uint8_t * p_buf, uint16_t buf_len)
+{
+    cycle_prof_stats_t const * p_stats;
+    uint16_t                   len = 0;
+    uint32_t                   i;
+
+    if ((section >= CYCLE_PROF_SECTION_COUNT) || (p_buf == NULL) || (buf_len < CYCLE_PROF_ENCODED_LEN))
+    {
+        return 0;
+    }
+    p_stats = &m_stats[section];
+
+    p_buf[len++] = (uint8_t)section;
+    p_buf[len++] = CYCLE_PROF_UNIT_CYCLES;
+    len += u32_put(p_stats->count, &p_buf[len]);
+    len += u32_put((p_stats->count > 0) ? p_stats->min : 0, &p_buf[len]);
+    len += u32_put(p_stats->max, &p_buf[len]);
+    len += u32_put((p_stats->count > 0) ? (uint32_t)(p_stats->sum / p_stats->count) : 0, &p_buf[len]);
+
+    for (i = 0; i < CYCLE_PROF_HIST_BINS; i++)
+    {
+        uint32_t bin = (p_stats->hist[i] > UINT16_MAX) ? UINT16_MAX : p_stats->hist[i];
+        p_buf[len++] = (uint8_t)bin;
+        p_buf[len++] = (uint8_t)(bin >> 8);
+    }
+    return len;
+}
+
+#endif // CYCLE_PROF_ENABLED
@@ -0,0 +1,81 @@
+#ifndef CYCLE_PROF_H__
+#define CYCLE_PROF_H__
+
+#include <stdint.h>
+
+/* Cycle profiling of interrupt handlers and hot paths.
+ *
+ * A section is timed by placing CYCLE_PROF_START() and CYCLE_PROF_END() with the same id around it, in the
+ * same block. Each section keeps the count, min, max, mean and a log2 histogram of its durations. On the
+ * nRF52 durations are read from the DWT cycle counter (CPU cycles); on other targets, so the host tools
+ * can share the instrumented code, from the monotonic clock (nanoseconds).
+ *
+ * Set CYCLE_PROF_ENABLED to 0 to compile the macros out completely, together with the counters, the functions
+ * and the diagnostics page that reads them. A section must only be recorded from one interrupt priority, the
+ * counters are not updated atomically. */
+
+#ifndef CYCLE_PROF_ENABLED
+#define CYCLE_PROF_ENABLED          1                                   /**< Build the profiling into the instrumented code. */
+#endif
+
+#define CYCLE_PROF_HIST_BINS        16                                  /**< Bin n counts durations in [2^n, 2^(n+1)), the last one everything above. */
+#define CYCLE_PROF_ENCODED_LEN      (18 + 2 * CYCLE_PROF_HIST_BINS)     /**< Size of a serialized section (in bytes). */
+
+#if defined(__arm__)
+#define CYCLE_PROF_UNIT_CYCLES      1                                   /**< Durations are in CPU cycles. */
+#else
+#define CYCLE_PROF_UNIT_CYCLES      0                                   /**< Durations are in nanoseconds. */
+#endif
+
+/* Instrumented sections. */
+typedef enum
+{
+    CYCLE_PROF_SAADC_ISR,               /**< saadc_event_handler(). */
+    CYCLE_PROF_BLE_EVT_DISPATCH,        /**< ble_evt_dispatch(). */
+    CYCLE_PROF_SDC_DATA_SEND,           /**< ble_sdc_data_send() of the queued frames, in the main loop. */
+    CYCLE_PROF_SAMPLE_PROCESS,          /**< sensor_pipeline_process() on one buffer. */
+    CYCLE_PROF_SECTION_COUNT
+} cycle_prof_section_t;
+
+/* Counters of one section. */
+typedef struct
+{
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;                       /**< Divide by count for the mean. */
+    uint32_t hist[CYCLE_PROF_HIST_BINS];
+} cycle_prof_stats_t;
+
+#if CYCLE_PROF_ENABLED
+
+/* Returns the current time stamp, in the unit given by CYCLE_PROF_UNIT_CYCLES. */
+uint32_t cycle_prof_now(void);
+
+#define CYCLE_PROF_START(id)        uint32_t cycle_prof_start_##id = cycle_prof_now()
+#define CYCLE_PROF_END(id)          cycle_prof_record((id), cycle_prof_now() - cycle_prof_start_##id)
+
+/* Function for starting the cycle counter and clearing the counters. */
+void cycle_prof_init(void);
+
+/* Function for adding a duration to a section. Called by CYCLE_PROF_END(). */
+void cycle_prof_record(cycle_prof_section_t section, uint32_t duration);
+
+/* Function for reading the counters of a section. */
+void cycle_prof_stats_get(cycle_prof_section_t section, cycle_prof_stats_t * p_stats);
+
+/* Function for clearing the counters of all sections. */
+void cycle_prof_reset(void);
+
+/* Function for serializing a section: id, unit, count, min, max, mean (uint32 LE) and the histogram with
+ * bins saturated to uint16. Returns the number of bytes written, 0 if the buffer is too small. */
+uint16_t cycle_prof_encode(cycle_prof_section_t section, uint8_t * p_buf, uint16_t buf_len);
+
+#else
+
+#define CYCLE_PROF_START(id)
+#define CYCLE_PROF_END(id)
+
+#endif // CYCLE_PROF_ENABLED
+
+#endif // CYCLE_PROF_H__
@@ -0,0 +1,116 @@
+#include "energy_model.h"
+#include <stddef.h>
+#include <string.h>
+
+#define ADV_INTERVAL_UNIT_US        625                                 /**< Unit of app_config_t adv_interval (in us). */
+
+
+void energy_model_estimate(energy_profile_t const  * p_profile,
+                           app_config_t const      * p_config,
+                           energy_activity_t const * p_activity,
+                           energy_estimate_t       * p_estimate)
+{
+    uint64_t const * p_time = p_activity->time_in_state_ms;
+    uint64_t connected_ms;
+    uint64_t sampling_ms;
+    uint64_t adv_period_us;
+    uint64_t conn_interval_ms;
+    uint64_t events;
+    uint8_t  state;
+    uint8_t  item;
+
+    memset(p_estimate, 0, sizeof(energy_estimate_t));
+
+    for (state = 0; state < POWER_STATE_COUNT; state++)
+    {
+        p_estimate->period_ms += p_time[state];
+    }
+    connected_ms = p_time[POWER_STATE_CONNECTED_IDLE]
+                 + p_time[POWER_STATE_SAMPLING]
+                 + p_time[POWER_STATE_BULK_TRANSFER];
+    sampling_ms  = p_time[POWER_STATE_SAMPLING] + p_activity->check_ms;
+
+    // uA * ms = nC.
+    p_estimate->charge_nc[ENERGY_ITEM_SLEEP] = (uint64_t)p_profile->sleep_ua * p_estimate->period_ms;
+
+    if ((p_activity->adv_events != 0) || (p_activity->adv_directed_events != 0))
+    {
+        p_estimate->charge_nc[ENERGY_ITEM_ADVERTISING] = (uint64_t)p_activity->adv_events * p_profile->adv_event_nc
+                                                       + (uint64_t)p_activity->adv_directed_events * p_profile->adv_directed_nc;
+    }
+    else
+    {
+        adv_period_us = (uint64_t)p_config->adv_interval * ADV_INTERVAL_UNIT_US + ENERGY_ADV_DELAY_MS * 1000;
+        events        = (p_time[POWER_STATE_ADVERTISING] * 1000) / adv_period_us;
+        p_estimate->charge_nc[ENERGY_ITEM_ADVERTISING] = events * p_profile->adv_event_nc;
+    }
+
+    conn_interval_ms = (p_activity->conn_interval_ms != 0) ? p_activity->conn_interval_ms : APP_CONN_INTERVAL_MAX_MS;
+    events           = connected_ms / (conn_interval_ms * (APP_SLAVE_LATENCY + 1));
+    p_estimate->charge_nc[ENERGY_ITEM_CONNECTION] = events * p_profile->conn_event_nc
+                                                  + (uint64_t)p_activity->notifications * p_profile->notification_nc;
+
+    if (p_config->sample_period_ms != 0)
+    {
+        events = sampling_ms / p_config->sample_period_ms;
+        p_estimate->charge_nc[ENERGY_ITEM_SAADC] = events * p_profile->saadc_sample_nc;
+    }
+    p_estimate->charge_nc[ENERGY_ITEM_HFCLK] = (uint64_t)p_profile->hfclk_ua * sampling_ms;
+
+    p_estimate->charge_nc[ENERGY_ITEM_FLASH] = (uint64_t)p_activity->flash_words * p_profile->flash_word_nc
+                                             + (uint64_t)p_activity->flash_page_erases * p_profile->flash_page_erase_nc;
+
+    p_estimate->charge_nc[ENERGY_ITEM_SENSOR] = (uint64_t)p_profile->sensor_ua * (connected_ms + p_activity->check_ms);
+
+    for (item = 0; item < ENERGY_ITEM_COUNT; item++)
+    {
+        p_estimate->total_nc += p_estimate->charge_nc[item];
+    }
+
+    if (p_estimate->period_ms == 0)
+    {
+        p_estimate->battery_life_h = UINT32_MAX;
+        return;
+    }
+
+    p_estimate->average_ua = (uint32_t)(p_estimate->total_nc / p_estimate->period_ms);
+    if (p_estimate->average_ua == 0)
+    {
+        p_estimate->battery_life_h = UINT32_MAX;
+    }
+    else
+    {
+        // mAh * 1000 / uA = h.
+        p_estimate->battery_life_h = (uint32_t)(((uint64_t)p_profile->battery_mah * 1000) / p_estimate->average_ua);
+    }
+}
+
+/* Little endian, the SDK encoders are not available on the host. */
+static uint16_t u32_put(uint32_t value, uint8_t * p_buf)
+{
+    p_buf[0] = (uint8_t)value;
+    p_buf[1] = (uint8_t)(value >> 8);
+    p_buf[2] = (uint8_t)(value >> 16);
+    p_buf[3] = (uint8_t)(value >> 24);
+    return 4;
+}
+
+uint16_t energy_model_encode(energy_estimate_t const * p_estimate, uint8_t * p_buf, uint16_t buf_len)
+{
+    uint16_t len = 0;
+    uint8_t  item;
+
+    if ((p_estimate == NULL) || (p_buf == NULL) || (buf_len < (2 + ENERGY_ITEM_COUNT) * 4))
+    {
+        return 0;
+    }
+
+    len += u32_put(p_estimate->average_ua, &p_buf[len]);
+    len += u32_put(p_estimate->battery_life_h, &p_buf[len]);
+    for (item = 0; item < ENERGY_ITEM_COUNT; item++)
+    {
+        uint64_t charge_uc = p_estimate->charge_nc[item] / 1000;
+        len += u32_put((charge_uc > UINT32_MAX) ? UINT32_MAX : (uint32_t)charge_uc, &p_buf[len]);
+    }
+    return len;
+}
@@ -0,0 +1,110 @@
+#ifndef ENERGY_MODEL_H__
+#define ENERGY_MODEL_H__
+
+#include <stdint.h>
+#include "app_config.h"
+#include "power_mgr.h"
+
+/* Charge model for estimating the average current and battery life of a configuration.
+ *
+ * The model counts operations (advertising events, connection events, SAADC conversions, flash writes) from
+ * the configuration and an activity profile, and multiplies them by per-operation charge figures. Continuous
+ * consumers (sleep current, HFCLK for the sampling timer, sensor supply) are multiplied by the time they are on.
+ * The activity profile is either measured on the device (power_mgr time in state, adv_ctrl event counters) or
+ * taken from a trace. Without counted advertising events they are derived from the time advertising at
+ * adv_interval.
+ *
+ * The module only depends on app_config.h and power_mgr.h, which have no SDK dependencies, so host tools use
+ * the same configuration and state definitions as the firmware. Charge is in nC, current in uA. */
+
+/* Default charge figures for the nRF52832 at 0 dBm, DC/DC off. Replace with measurements where available. */
+#define ENERGY_ADV_EVENT_NC         15000                               /**< Connectable advertising event on three channels. */
+#define ENERGY_ADV_DIRECTED_NC      6000                                /**< High duty directed advertising event, no scan requests to listen for. */
+#define ENERGY_ADV_DELAY_MS         5                                   /**< Mean random delay added to each advertising interval. */
+#define ENERGY_CONN_EVENT_NC        6000                                /**< Connection event without payload. */
+#define ENERGY_NOTIFICATION_NC      1500                                /**< Added to a connection event for one notification. */
+#define ENERGY_SAADC_SAMPLE_NC      45                                  /**< One SAADC conversion, 40 us acquisition included. */
+#define ENERGY_HFCLK_UA             400                                 /**< HFCLK and TIMER1 while sampling. */
+#define ENERGY_FLASH_WORD_NC        300                                 /**< Writing one flash word. */
+#define ENERGY_FLASH_PAGE_ERASE_NC  640000                              /**< Erasing one flash page (garbage collection). */
+#define ENERGY_SLEEP_UA             3                                   /**< System ON idle with RTC running. */
+#define ENERGY_SENSOR_UA            0                                   /**< Sensor supply while powered. Board specific, set from a measurement. */
+#define ENERGY_BATTERY_MAH          230                                 /**< Usable battery capacity (CR2032). */
+
+/* Charge figures used by the model. */
+typedef struct
+{
+    uint32_t adv_event_nc;
+    uint32_t adv_directed_nc;
+    uint32_t conn_event_nc;
+    uint32_t notification_nc;
+    uint32_t saadc_sample_nc;
+    uint32_t hfclk_ua;
+    uint32_t flash_word_nc;
+    uint32_t flash_page_erase_nc;
+    uint32_t sleep_ua;
+    uint32_t sensor_ua;
+    uint32_t battery_mah;
+} energy_profile_t;
+
+#define ENERGY_PROFILE_DEFAULT                                                                  \
+{                                                                                               \
+    .adv_event_nc        = ENERGY_ADV_EVENT_NC,                                                 \
+    .adv_directed_nc     = ENERGY_ADV_DIRECTED_NC,                                              \
+    .conn_event_nc       = ENERGY_CONN_EVENT_NC,                                                \
+    .notification_nc     = ENERGY_NOTIFICATION_NC,                                              \
+    .saadc_sample_nc     = ENERGY_SAADC_SAMPLE_NC,                                              \
+    .hfclk_ua            = ENERGY_HFCLK_UA,                                                     \
+    .flash_word_nc       = ENERGY_FLASH_WORD_NC,                                                \
+    .flash_page_erase_nc = ENERGY_FLASH_PAGE_ERASE_NC,                                          \
+    .sleep_ua            = ENERGY_SLEEP_UA,                                                     \
+    .sensor_ua           = ENERGY_SENSOR_UA,                                                    \
+    .battery_mah         = ENERGY_BATTERY_MAH                                                   \
+}
+
+/* What the device did over a period of time. */
+typedef struct
+{
+    uint64_t time_in_state_ms[POWER_STATE_COUNT];
+    uint64_t check_ms;                  /**< Time in presence checks, sensor and sampling on outside the connected states. */
+    uint32_t adv_events;                /**< Undirected advertising events, 0 to derive them from the time advertising. */
+    uint32_t adv_directed_events;       /**< High duty directed advertising events. */
+    uint32_t conn_interval_ms;          /**< Connection interval in use, 0 for APP_CONN_INTERVAL_MAX_MS. */
+    uint32_t notifications;             /**< Notifications sent. */
+    uint32_t flash_words;               /**< Flash words written. */
+    uint32_t flash_page_erases;         /**< Flash pages erased. */
+} energy_activity_t;
+
+/* Charge per consumer over the period of the activity profile (in nC). */
+typedef enum
+{
+    ENERGY_ITEM_SLEEP,
+    ENERGY_ITEM_ADVERTISING,
+    ENERGY_ITEM_CONNECTION,
+    ENERGY_ITEM_SAADC,
+    ENERGY_ITEM_HFCLK,
+    ENERGY_ITEM_FLASH,
+    ENERGY_ITEM_SENSOR,
+    ENERGY_ITEM_COUNT
+} energy_item_t;
+
+typedef struct
+{
+    uint64_t charge_nc[ENERGY_ITEM_COUNT];
+    uint64_t total_nc;
+    uint64_t period_ms;
+    uint32_t average_ua;                /**< Average current over the period. */
+    uint32_t battery_life_h;            /**< Battery life at the average current, UINT32_MAX if there is no drain. */
+} energy_estimate_t;
+
+/* Function for estimating the charge used by the activity with the given configuration. */
+void energy_model_estimate(energy_profile_t const  * p_profile,
+                           app_config_t const      * p_config,
+                           energy_activity_t const * p_activity,
+                           energy_estimate_t       * p_estimate);
+
+/* Function for serializing an estimate: average current (uA), battery life (h), then the charge of each
+ * item (uC), all uint32 LE. Returns the number of bytes written, 0 if the buffer is too small. */
+uint16_t energy_model_encode(energy_estimate_t const * p_estimate, uint8_t * p_buf, uint16_t buf_len);
+
+#endif // ENERGY_MODEL_H__
@@ -0,0 +1,338 @@
+#include "evt_codec.h"
+#include <stddef.h>
+#include <string.h>
+
+#define EVT_CODEC_BLE_BODY_LEN      4                                   /**< Event ID and connection handle. */
+
+
+static uint16_t u16_put(uint16_t value, uint8_t * p_buf)
+{
+    p_buf[0] = (uint8_t)value;
+    p_buf[1] = (uint8_t)(value >> 8);
+    return 2;
+}
+
+static uint16_t u32_put(uint32_t value, uint8_t * p_buf)
+{
+    p_buf[0] = (uint8_t)value;
+    p_buf[1] = (uint8_t)(value >> 8);
+    p_buf[2] = (uint8_t)(value >> 16);
+    p_buf[3] = (uint8_t)(value >> 24);
+    return 4;
+}
+
+static uint16_t u16_get(uint8_t const * p_buf)
+{
+    return (uint16_t)(p_buf[0] | (p_buf[1] << 8));
+}
+
+static uint32_t u32_get(uint8_t const * p_buf)
+{
+    return p_buf[0] | ((uint32_t)p_buf[1] << 8) | ((uint32_t)p_buf[2] << 16) | ((uint32_t)p_buf[3] << 24);
+}
+
+static uint16_t conn_params_put(ble_gap_conn_params_t const * p_params, uint8_t * p_buf)
+{
+    uint16_t len = 0;
+
+    len += u16_put(p_params->min_conn_interval, &p_buf[len]);
+    len += u16_put(p_params->max_conn_interval, &p_buf[len]);
+    len += u16_put(p_params->slave_latency,     &p_buf[len]);
+    len += u16_put(p_params->conn_sup_timeout,  &p_buf[len]);
+    return len;
+}
+
+static uint16_t conn_params_get(uint8_t const * p_buf, ble_gap_conn_params_t * p_params)
+{
+    p_params->min_conn_interval = u16_get(&p_buf[0]);
+    p_params->max_conn_interval = u16_get(&p_buf[2]);
+    p_params->slave_latency     = u16_get(&p_buf[4]);
+    p_params->conn_sup_timeout  = u16_get(&p_buf[6]);
+    return 8;
+}
+
+static uint16_t write_put(ble_gatts_evt_write_t const * p_write, uint8_t * p_buf)
+{
+    uint16_t len      = 0;
+    uint16_t data_len = (p_write->len > EVT_CODEC_MAX_DATA) ? EVT_CODEC_MAX_DATA : p_write->len;
+
+    len += u16_put(p_write->handle, &p_buf[len]);
+    len += u16_put(p_write->uuid.uuid, &p_buf[len]);
+    p_buf[len++] = p_write->uuid.type;
+    p_buf[len++] = p_write->op;
+    len += u16_put(p_write->offset, &p_buf[len]);
+    len += u16_put(data_len, &p_buf[len]);
+    memcpy(&p_buf[len], p_write->data, data_len);
+    return len + data_len;
+}
+
+/* Returns the bytes taken, 0 if body_len does not hold the write. */
+static uint16_t write_get(uint8_t const * p_buf, uint16_t body_len, ble_gatts_evt_write_t * p_write)
+{
+    uint16_t data_len;
+
+    if (body_len < 10)
+    {
+        return 0;
+    }
+    data_len = u16_get(&p_buf[8]);
+    if ((data_len > EVT_CODEC_MAX_DATA) || (body_len < 10 + data_len))
+    {
+        return 0;
+    }
+
+    p_write->handle    = u16_get(&p_buf[0]);
+    p_write->uuid.uuid = u16_get(&p_buf[2]);
+    p_write->uuid.type = p_buf[4];
+    p_write->op        = p_buf[5];
+    p_write->offset    = u16_get(&p_buf[6]);
+    p_write->len       = data_len;
+    memcpy(p_write->data, &p_buf[10], data_len);
+    return 10 + data_len;
+}
+
+static uint16_t header_put(evt_codec_type_t type, uint8_t body_len, uint32_t delta_us, uint8_t * p_buf)
+{
+    p_buf[0] = (uint8_t)type;
+    p_buf[1] = body_len;
+    (void)u32_put(delta_us, &p_buf[2]);
+    return EVT_CODEC_HEADER_LEN;
+}
+
+uint16_t evt_codec_ble_encode(ble_evt_t const * p_ble_evt, uint32_t delta_us, uint8_t * p_buf, uint16_t buf_len)
+{
+    uint8_t         body[EVT_CODEC_MAX_LEN - EVT_CODEC_HEADER_LEN];
+    uint16_t        len    = 0;
+    uint16_t        evt_id = p_ble_evt->header.evt_id;
+    ble_gap_evt_t   const * p_gap   = &p_ble_evt->evt.gap_evt;
+    ble_gatts_evt_t const * p_gatts = &p_ble_evt->evt.gatts_evt;
+
+    len += u16_put(evt_id, &body[len]);
+    // The connection handle comes first in the common, GAP and GATTS events alike.
+    len += u16_put(p_ble_evt->evt.common_evt.conn_handle, &body[len]);
+
+    switch (evt_id)
+    {
+        case BLE_EVT_TX_COMPLETE:
+            body[len++] = p_ble_evt->evt.common_evt.params.tx_complete.count;
+            break;
+
+        case BLE_GAP_EVT_CONNECTED:
+            body[len++] = p_gap->params.connected.peer_addr.addr_type;
+            memcpy(&body[len], p_gap->params.connected.peer_addr.addr, BLE_GAP_ADDR_LEN);
+            len += BLE_GAP_ADDR_LEN;
+            body[len++] = p_gap->params.connected.role;
+            len += conn_params_put(&p_gap->params.connected.conn_params, &body[len]);
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            body[len++] = p_gap->params.disconnected.reason;
+            break;
+
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+            len += conn_params_put(&p_gap->params.conn_param_update.conn_params, &body[len]);
+            break;
+
+        case BLE_GAP_EVT_CONN_SEC_UPDATE:
+            body[len++] = p_gap->params.conn_sec_update.conn_sec.sec_mode.sm;
+            body[len++] = p_gap->params.conn_sec_update.conn_sec.sec_mode.lv;
+            body[len++] = p_gap->params.conn_sec_update.conn_sec.encr_key_size;
+            break;
+
+        case BLE_GAP_EVT_TIMEOUT:
+            body[len++] = p_gap->params.timeout.src;
+            break;
+
+        case BLE_GATTS_EVT_WRITE:
+            len += write_put(&p_gatts->params.write, &body[len]);
+            break;
+
+        case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
+            body[len++] = p_gatts->params.authorize_request.type;
+            if (p_gatts->params.authorize_request.type == BLE_GATTS_AUTHORIZE_TYPE_WRITE)
+            {
+                len += write_put(&p_gatts->params.authorize_request.request.write, &body[len]);
+            }
+            else
+            {
+                len += u16_put(p_gatts->params.authorize_request.request.read.handle,    &body[len]);
+                len += u16_put(p_gatts->params.authorize_request.request.read.uuid.uuid, &body[len]);
+                body[len++] = p_gatts->params.authorize_request.request.read.uuid.type;
+                len += u16_put(p_gatts->params.authorize_request.request.read.offset,    &body[len]);
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if ((p_buf == NULL) || (buf_len < EVT_CODEC_HEADER_LEN + len))
+    {
+        return 0;
+    }
+    (void)header_put(EVT_CODEC_TYPE_BLE, (uint8_t)len, delta_us, p_buf);
+    memcpy(&p_buf[EVT_CODEC_HEADER_LEN], body, len);
+
+    return EVT_CODEC_HEADER_LEN + len;
+}
+
+uint16_t evt_codec_value_encode(evt_codec_type_t type, uint32_t value, uint32_t delta_us, uint8_t * p_buf, uint16_t buf_len)
+{
+    if ((p_buf == NULL) || (buf_len < EVT_CODEC_HEADER_LEN + 4))
+    {
+        return 0;
+    }
+    (void)header_put(type, 4, delta_us, p_buf);
+    return EVT_CODEC_HEADER_LEN + u32_put(value, &p_buf[EVT_CODEC_HEADER_LEN]);
+}
+
+uint16_t evt_codec_record_len(uint8_t const * p_buf, uint16_t len)
+{
+    uint16_t record_len;
+
+    if ((len < EVT_CODEC_HEADER_LEN) || (p_buf[0] == EVT_CODEC_TYPE_END) || (p_buf[0] > EVT_CODEC_TYPE_BOOT))
+    {
+        return 0;
+    }
+    record_len = EVT_CODEC_HEADER_LEN + p_buf[1];
+    return ((record_len <= len) && (record_len <= EVT_CODEC_MAX_LEN)) ? record_len : 0;
+}
+
+bool evt_codec_next(uint8_t const * p_buf, uint16_t len, uint16_t * p_pos, evt_codec_item_t * p_item)
+{
+    uint16_t          pos = *p_pos;
+    uint16_t          record_len;
+    uint16_t          body_len;
+    uint16_t          used;
+    uint8_t const   * p_body;
+    ble_evt_t       * p_evt = evt_codec_ble_evt(p_item);
+    ble_gap_evt_t   * p_gap = &p_evt->evt.gap_evt;
+    ble_gatts_evt_t * p_gatts = &p_evt->evt.gatts_evt;
+
+    if ((p_buf == NULL) || (pos >= len))
+    {
+        return false;
+    }
+    record_len = evt_codec_record_len(&p_buf[pos], len - pos);
+    if (record_len == 0)
+    {
+        return false;
+    }
+
+    p_body   = &p_buf[pos + EVT_CODEC_HEADER_LEN];
+    body_len = record_len - EVT_CODEC_HEADER_LEN;
+    memset(p_item, 0, sizeof(evt_codec_item_t));
+    p_item->type     = (evt_codec_type_t)p_buf[pos];
+    p_item->delta_us = u32_get(&p_buf[pos + 2]);
+
+    if (p_item->type != EVT_CODEC_TYPE_BLE)
+    {
+        if (body_len != 4)
+        {
+            return false;
+        }
+        p_item->value = u32_get(p_body);
+        *p_pos        = pos + record_len;
+        return true;
+    }
+
+    if (body_len < EVT_CODEC_BLE_BODY_LEN)
+    {
+        return false;
+    }
+    p_evt->header.evt_id              = u16_get(&p_body[0]);
+    p_evt->header.evt_len             = sizeof(ble_evt_t);
+    p_evt->evt.common_evt.conn_handle = u16_get(&p_body[2]);
+    p_body   += EVT_CODEC_BLE_BODY_LEN;
+    body_len -= EVT_CODEC_BLE_BODY_LEN;
+    used      = 0;
+
+    switch (p_evt->header.evt_id)
+    {
+        case BLE_EVT_TX_COMPLETE:
+            if (body_len >= 1)
+            {
+                p_evt->evt.common_evt.params.tx_complete.count = p_body[0];
+                used = 1;
+            }
+            break;
+
+        case BLE_GAP_EVT_CONNECTED:
+            if (body_len >= 16)
+            {
+                p_gap->params.connected.peer_addr.addr_type = p_body[0];
+                memcpy(p_gap->params.connected.peer_addr.addr, &p_body[1], BLE_GAP_ADDR_LEN);
+                p_gap->params.connected.role = p_body[7];
+                used = 8 + conn_params_get(&p_body[8], &p_gap->params.connected.conn_params);
+            }
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            if (body_len >= 1)
+            {
+                p_gap->params.disconnected.reason = p_body[0];
+                used = 1;
+            }
+            break;
+
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+            if (body_len >= 8)
+            {
+                used = conn_params_get(p_body, &p_gap->params.conn_param_update.conn_params);
+            }
+            break;
+
+        case BLE_GAP_EVT_CONN_SEC_UPDATE:
+            if (body_len >= 3)
+            {
+                p_gap->params.conn_sec_update.conn_sec.sec_mode.sm   = p_body[0];
+                p_gap->params.conn_sec_update.conn_sec.sec_mode.lv   = p_body[1];
+                p_gap->params.conn_sec_update.conn_sec.encr_key_size = p_body[2];
+                used = 3;
+            }
+            break;
+
+        case BLE_GAP_EVT_TIMEOUT:
+            if (body_len >= 1)
+            {
+                p_gap->params.timeout.src = p_body[0];
+                used = 1;
+            }
+            break;
+
+        case BLE_GATTS_EVT_WRITE:
+            used = write_get(p_body, body_len, &p_gatts->params.write);
+            break;
+
+        case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
+            if (body_len < 1)
+            {
+                break;
+            }
+            p_gatts->params.authorize_request.type = p_body[0];
+            if (p_body[0] == BLE_GATTS_AUTHORIZE_TYPE_WRITE)
+            {
+                used = write_get(&p_body[1], body_len - 1, &p_gatts->params.authorize_request.request.write);
+                used = (used == 0) ? 0 : (used + 1);
+            }
+            else if (body_len >= 8)
+            {
+                p_gatts->params.authorize_request.request.read.handle    = u16_get(&p_body[1]);
+                p_gatts->params.authorize_request.request.read.uuid.uuid = u16_get(&p_body[3]);
+                p_gatts->params.authorize_request.request.read.uuid.type = p_body[5];
+                p_gatts->params.authorize_request.request.read.offset    = u16_get(&p_body[6]);
+                used = 8;
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    if (used != body_len)
+    {
+        return false;
+    }
+    *p_pos = pos + record_len;
+    return true;
+}
@@ -0,0 +1,63 @@
+#ifndef EVT_CODEC_H__
+#define EVT_CODEC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+
+/* Serialized format of recorded SoftDevice events.
+ *
+ * Records follow each other without padding, a type of 0 ends the stream:
+ *
+ *   byte 0     type (evt_codec_type_t)
+ *   byte 1     length of the body
+ *   byte 2..5  time since the previous record (uint32 LE, in us, saturated)
+ *   byte 6..   body
+ *
+ * A BLE event body holds the event ID and connection handle (uint16 LE) and the parameters the application
+ * handlers look at, field by field, so the stream does not depend on the struct layout of the compiler or
+ * SoftDevice version: connection parameters, peer address, disconnect reason, security level, timeout
+ * source, TX complete count, and handle, UUID, operation, offset and data of writes and authorization
+ * requests. Write data is cut to EVT_CODEC_MAX_DATA bytes. Other events keep their ID and handle only.
+ *
+ * A system event body is the event (uint32 LE), a boot body the reset reason (uint32 LE). The codec has no
+ * SDK dependencies beyond ble.h, host/evt_replay uses it with the simulator's. */
+
+#define EVT_CODEC_HEADER_LEN        6
+#define EVT_CODEC_MAX_DATA          (GATT_MTU_SIZE_DEFAULT - 3)         /**< Write data kept per record (in bytes). */
+#define EVT_CODEC_MAX_LEN           (EVT_CODEC_HEADER_LEN + 15 + EVT_CODEC_MAX_DATA)  /**< Longest record (in bytes). */
+#define EVT_CODEC_EVT_BUF_WORDS     ((sizeof(ble_evt_t) + EVT_CODEC_MAX_DATA + 3) / 4)
+
+typedef enum
+{
+    EVT_CODEC_TYPE_END,                 /**< End of the stream, also the padding of a flash copy. */
+    EVT_CODEC_TYPE_BLE,                 /**< BLE event. */
+    EVT_CODEC_TYPE_SYS,                 /**< System event. */
+    EVT_CODEC_TYPE_BOOT                 /**< Device start. Times before it belong to the previous run. */
+} evt_codec_type_t;
+
+/* A decoded record. */
+typedef struct
+{
+    evt_codec_type_t type;
+    uint32_t         delta_us;
+    uint32_t         value;             /**< System event or reset reason. */
+    uint32_t         evt_buf[EVT_CODEC_EVT_BUF_WORDS];   /**< BLE event, word aligned like the SoftDevice's. See evt_codec_ble_evt(). */
+} evt_codec_item_t;
+
+#define evt_codec_ble_evt(p_item)   ((ble_evt_t *)(p_item)->evt_buf)
+
+/* Function for serializing a BLE event. Returns the record length, 0 if the buffer is too small. */
+uint16_t evt_codec_ble_encode(ble_evt_t const * p_ble_evt, uint32_t delta_us, uint8_t * p_buf, uint16_t buf_len);
+
+/* Function for serializing a system event or a boot. Returns the record length, 0 if the buffer is too small. */
+uint16_t evt_codec_value_encode(evt_codec_type_t type, uint32_t value, uint32_t delta_us, uint8_t * p_buf, uint16_t buf_len);
+
+/* Returns the length of the record at p_buf, 0 at the end of the stream or if fewer than len bytes hold it. */
+uint16_t evt_codec_record_len(uint8_t const * p_buf, uint16_t len);
+
+/* Function for decoding the next record of a stream. *p_pos starts at 0. Returns false at the end of the
+ * stream or if the rest of it is malformed. */
+bool evt_codec_next(uint8_t const * p_buf, uint16_t len, uint16_t * p_pos, evt_codec_item_t * p_item);
+
+#endif // EVT_CODEC_H__
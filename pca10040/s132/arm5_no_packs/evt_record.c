@@ -0,0 +1,319 @@
+#include "evt_record.h"
+#include <string.h>
+#include "sdk_common.h"
+#include "nrf.h"
+#include "app_util_platform.h"
+#include "fds.h"
+#include "flash_sched.h"
+#include "app_time.h"
+#include "evt_codec.h"
+
+#define EVT_RECORD_MAGIC            0xE7EC0DE0                          /**< Marks a valid ring in no-init RAM. */
+#define EVT_RECORD_FAULT_RESETS     (POWER_RESETREAS_SREQ_Msk | POWER_RESETREAS_DOG_Msk | POWER_RESETREAS_LOCKUP_Msk)
+
+#if defined(__CC_ARM)
+#define EVT_RECORD_NOINIT           __attribute__((section(".bss.noinit"), zero_init))
+#elif defined(__GNUC__)
+#define EVT_RECORD_NOINIT           __attribute__((section(".noinit")))
+#else
+#define EVT_RECORD_NOINIT
+#endif
+
+/* Layout of the no-init RAM ring. The data is word aligned, it is written to flash as is. */
+typedef struct
+{
+    uint32_t magic;
+    uint16_t tail;                      /**< Oldest record. */
+    uint16_t used;
+    uint8_t  data[EVT_RECORD_BUFFER_SIZE];
+} evt_record_ring_t;
+
+STATIC_ASSERT((EVT_RECORD_BUFFER_SIZE % 4) == 0);
+
+static evt_record_ring_t        m_ring EVT_RECORD_NOINIT;               /**< Survives the reset done by app_error_handler(). */
+
+static uint64_t                 m_last_us;                              /**< Time of the last record. */
+static bool                     m_paused;
+static bool                     m_saving;                               /**< A copy is being written, the ring must not change. */
+static bool                     m_save_pending;                         /**< The ring came through a fault reset, copy it once FDS is up. */
+static evt_record_stats_t       m_stats;
+static fds_record_chunk_t       m_chunk;
+
+
+static uint8_t ring_byte(uint16_t offset)
+{
+    return m_ring.data[(m_ring.tail + offset) % EVT_RECORD_BUFFER_SIZE];
+}
+
+/* Function for copying len bytes of the ring, starting offset bytes after the oldest record. */
+static void ring_read(uint16_t offset, uint8_t * p_buf, uint16_t len)
+{
+    uint16_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        p_buf[i] = ring_byte(offset + i);
+    }
+}
+
+/* Function for appending a record, dropping the oldest ones until it fits. */
+static void ring_put(uint8_t const * p_record, uint16_t len)
+{
+    uint16_t pos;
+    uint16_t i;
+
+    if ((len == 0) || (len > EVT_RECORD_BUFFER_SIZE))
+    {
+        return;
+    }
+
+    while (m_ring.used + len > EVT_RECORD_BUFFER_SIZE)
+    {
+        uint16_t oldest_len = EVT_CODEC_HEADER_LEN + ring_byte(1);
+
+        m_ring.tail  = (m_ring.tail + oldest_len) % EVT_RECORD_BUFFER_SIZE;
+        m_ring.used -= oldest_len;
+        m_stats.overwritten++;
+    }
+
+    pos = (m_ring.tail + m_ring.used) % EVT_RECORD_BUFFER_SIZE;
+    for (i = 0; i < len; i++)
+    {
+        m_ring.data[(pos + i) % EVT_RECORD_BUFFER_SIZE] = p_record[i];
+    }
+    m_ring.used += len;
+    m_stats.records++;
+}
+
+static void reverse(uint16_t first, uint16_t end)
+{
+    while ((first + 1) < end)
+    {
+        uint8_t tmp = m_ring.data[first];
+
+        m_ring.data[first] = m_ring.data[--end];
+        m_ring.data[end]   = tmp;
+        first++;
+    }
+}
+
+/* Function for rotating the ring so the oldest record starts the buffer, and ending the stream after the
+ * newest one. */
+static void ring_linearize(void)
+{
+    reverse(0, m_ring.tail);
+    reverse(m_ring.tail, EVT_RECORD_BUFFER_SIZE);
+    reverse(0, EVT_RECORD_BUFFER_SIZE);
+    m_ring.tail = 0;
+    memset(&m_ring.data[m_ring.used], EVT_CODEC_TYPE_END, EVT_RECORD_BUFFER_SIZE - m_ring.used);
+}
+
+static bool ring_is_valid(void)
+{
+    return (m_ring.magic == EVT_RECORD_MAGIC)
+        && (m_ring.tail < EVT_RECORD_BUFFER_SIZE)
+        && (m_ring.used <= EVT_RECORD_BUFFER_SIZE);
+}
+
+static uint32_t delta_get(void)
+{
+    uint64_t now   = app_time_us_get();
+    uint64_t delta = now - m_last_us;
+
+    m_last_us = now;
+    return (delta > UINT32_MAX) ? UINT32_MAX : (uint32_t)delta;
+}
+
+static bool is_recording(void)
+{
+    if (m_paused || m_saving)
+    {
+        m_stats.skipped++;
+        return false;
+    }
+    return true;
+}
+
+void evt_record_ble(ble_evt_t const * p_ble_evt)
+{
+    uint8_t  record[EVT_CODEC_MAX_LEN];
+    uint16_t len;
+
+    if (is_recording())
+    {
+        len = evt_codec_ble_encode(p_ble_evt, delta_get(), record, sizeof(record));
+        ring_put(record, len);
+    }
+}
+
+void evt_record_sys(uint32_t sys_evt)
+{
+    uint8_t  record[EVT_CODEC_MAX_LEN];
+    uint16_t len;
+
+    if (is_recording())
+    {
+        len = evt_codec_value_encode(EVT_CODEC_TYPE_SYS, sys_evt, delta_get(), record, sizeof(record));
+        ring_put(record, len);
+    }
+}
+
+void evt_record_pause(bool pause)
+{
+    m_paused = pause;
+}
+
+/* Handler for completion of the flash copy. */
+static void copy_write_handler(flash_sched_evt_t const * p_evt)
+{
+    if (p_evt->result == FDS_SUCCESS)
+    {
+        m_stats.saves++;
+    }
+    m_saving = false;
+}
+
+uint32_t evt_record_save(void)
+{
+    uint32_t err_code;
+
+    if (m_saving)
+    {
+        return NRF_ERROR_BUSY;
+    }
+
+    // Events come from the SoftDevice interrupt, the copy at boot is started from the FDS handler.
+    CRITICAL_REGION_ENTER();
+    ring_linearize();
+    m_saving = true;
+    CRITICAL_REGION_EXIT();
+
+    // The boot record keeps the ring from being empty.
+    m_chunk.p_data       = m_ring.data;
+    m_chunk.length_words = BYTES_TO_WORDS(MAX(m_ring.used, 1));
+
+    err_code = flash_sched_write(FLASH_SCHED_JOB_REPLACE,
+                                 EVT_RECORD_FILE_ID,
+                                 EVT_RECORD_RECORD_KEY,
+                                 &m_chunk,
+                                 copy_write_handler,
+                                 NULL);
+    if (err_code != NRF_SUCCESS)
+    {
+        m_saving = false;
+    }
+    return err_code;
+}
+
+/* Handler for FDS events. */
+static void fds_evt_handler(fds_evt_t const * const p_evt)
+{
+    if ((p_evt->id == FDS_EVT_INIT) && (p_evt->result == FDS_SUCCESS) && m_save_pending)
+    {
+        // On failure the events are still in RAM until the ring wraps.
+        m_save_pending = false;
+        (void)evt_record_save();
+    }
+}
+
+uint32_t evt_record_init(uint32_t reset_reason)
+{
+    uint8_t  record[EVT_CODEC_MAX_LEN];
+    uint16_t len;
+
+    if (ring_is_valid())
+    {
+        m_save_pending = ((reset_reason & EVT_RECORD_FAULT_RESETS) != 0);
+    }
+    else
+    {
+        m_ring.magic = EVT_RECORD_MAGIC;
+        m_ring.tail  = 0;
+        m_ring.used  = 0;
+    }
+
+    // Times of the previous run do not carry over.
+    m_last_us = app_time_us_get();
+    len       = evt_codec_value_encode(EVT_CODEC_TYPE_BOOT, reset_reason, 0, record, sizeof(record));
+    ring_put(record, len);
+
+    return fds_register(fds_evt_handler);
+}
+
+void evt_record_stats_get(evt_record_stats_t * p_stats)
+{
+    *p_stats        = m_stats;
+    p_stats->used   = m_ring.used;
+    p_stats->paused = m_paused;
+}
+
+/* Returns the length of the stream in the flash copy and points *pp_data at it, 0 if there is none. */
+static uint16_t flash_copy_find(fds_record_desc_t * p_desc, uint8_t const ** pp_data)
+{
+    fds_find_token_t   token;
+    fds_flash_record_t flash_record;
+    uint16_t           len = 0;
+    uint16_t           record_len;
+    uint16_t           size;
+
+    memset(&token, 0, sizeof(token));
+    if ((fds_record_find(EVT_RECORD_FILE_ID, EVT_RECORD_RECORD_KEY, p_desc, &token) != FDS_SUCCESS)
+        || (fds_record_open(p_desc, &flash_record) != FDS_SUCCESS))
+    {
+        return 0;
+    }
+
+    *pp_data = (uint8_t const *)flash_record.p_data;
+    size     = (uint16_t)MIN(flash_record.p_header->tl.length_words * sizeof(uint32_t), EVT_RECORD_BUFFER_SIZE);
+    while ((record_len = evt_codec_record_len(&(*pp_data)[len], size - len)) != 0)
+    {
+        len += record_len;
+    }
+    return len;
+}
+
+uint16_t evt_record_encode(evt_record_source_t source, uint8_t chunk, uint8_t * p_buf, uint16_t buf_len)
+{
+    uint16_t          len    = 0;
+    uint16_t          total  = 0;
+    uint16_t          offset = (uint16_t)chunk * EVT_RECORD_CHUNK_LEN;
+    uint16_t          count  = 0;
+    uint8_t const   * p_data = NULL;
+    fds_record_desc_t desc;
+
+    if ((p_buf == NULL) || (buf_len < EVT_RECORD_ENCODED_LEN))
+    {
+        return 0;
+    }
+
+    if (source == EVT_RECORD_SOURCE_FLASH)
+    {
+        total = flash_copy_find(&desc, &p_data);
+    }
+    else
+    {
+        total = m_ring.used;
+    }
+    if (offset < total)
+    {
+        count = MIN(total - offset, EVT_RECORD_CHUNK_LEN);
+    }
+
+    p_buf[len++] = (uint8_t)source;
+    len += uint16_encode(total,  &p_buf[len]);
+    len += uint16_encode(offset, &p_buf[len]);
+    if (source == EVT_RECORD_SOURCE_FLASH)
+    {
+        if (p_data != NULL)
+        {
+            memcpy(&p_buf[len], &p_data[offset], count);
+            (void)fds_record_close(&desc);
+        }
+    }
+    else
+    {
+        ring_read(offset, &p_buf[len], count);
+    }
+
+    return len + count;
+}
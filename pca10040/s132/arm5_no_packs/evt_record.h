@@ -0,0 +1,89 @@
+#ifndef EVT_RECORD_H__
+#define EVT_RECORD_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+
+/* Recorder of the SoftDevice event stream, for replaying field issues on the host (host/evt_replay).
+ *
+ * ble_evt_dispatch() and sys_evt_dispatch() hand every event to the recorder before the modules see it. The
+ * events are serialized with evt_codec into a ring in no-init RAM, the oldest records make room for new
+ * ones. The ring survives the reset of app_error_handler(): a boot record marks the start of each run and
+ * the events that led to a fault stay in front of it. After such a reset the ring is copied to flash through
+ * the flash scheduler, a copy can also be asked for with evt_record_save(), and it survives power loss. The
+ * copy takes EVT_RECORD_BUFFER_SIZE bytes of FDS space, twice while it is replaced, out of the
+ * HISTORY_LOG_FDS_SHARED_PAGES the history leaves to the other FDS users.
+ *
+ * The recorder runs in the SoftDevice event handler, the diagnostics page that reads it out too. A client
+ * pauses the recording while it reads the ring chunk by chunk, so its own reads do not move it.
+ *
+ * GCC places the ring in .noinit like the fault record, see fault_record.h for the ARM compiler. Set
+ * EVT_RECORD_ENABLED to 0 to leave the recorder out. */
+
+#ifndef EVT_RECORD_ENABLED
+#define EVT_RECORD_ENABLED          1                                   /**< Record the SoftDevice events. */
+#endif
+
+#define EVT_RECORD_BUFFER_SIZE      1024                                /**< Size of the ring (in bytes). Multiple of 4. */
+#define EVT_RECORD_FILE_ID          0x1003                              /**< FDS file holding the flash copy. */
+#define EVT_RECORD_RECORD_KEY       0x0001                              /**< FDS key of the flash copy. */
+#define EVT_RECORD_CHUNK_LEN        48                                  /**< Stream bytes per evt_record_encode() call. */
+#define EVT_RECORD_ENCODED_LEN      (5 + EVT_RECORD_CHUNK_LEN)          /**< Maximum size of a serialized chunk (in bytes). */
+
+/* Streams evt_record_encode() reads from. */
+typedef enum
+{
+    EVT_RECORD_SOURCE_RAM,              /**< The ring being recorded. */
+    EVT_RECORD_SOURCE_FLASH             /**< The last copy written to flash. */
+} evt_record_source_t;
+
+typedef struct
+{
+    uint32_t records;                   /**< Records written since boot. */
+    uint32_t overwritten;               /**< Oldest records dropped to make room. */
+    uint32_t skipped;                   /**< Events not recorded while paused or saving. */
+    uint32_t saves;                     /**< Copies written to flash. */
+    uint16_t used;                      /**< Bytes of the ring in use. */
+    bool     paused;
+} evt_record_stats_t;
+
+#if EVT_RECORD_ENABLED
+
+#define EVT_RECORD_BLE(p_ble_evt)   evt_record_ble(p_ble_evt)
+#define EVT_RECORD_SYS(sys_evt)     evt_record_sys(sys_evt)
+
+#else
+
+#define EVT_RECORD_BLE(p_ble_evt)   do {} while (0)
+#define EVT_RECORD_SYS(sys_evt)     do {} while (0)
+
+#endif // EVT_RECORD_ENABLED
+
+/* Function for picking up the ring left by the previous run and writing the boot record. reset_reason is
+ * RESETREAS, see fault_record_reset_reason(). Must be called after app_time_init(), before the SoftDevice is
+ * enabled and before fds_init() (done by pm_init()). */
+uint32_t evt_record_init(uint32_t reset_reason);
+
+/* Function for recording a BLE event. Called by EVT_RECORD_BLE(). */
+void evt_record_ble(ble_evt_t const * p_ble_evt);
+
+/* Function for recording a system event. Called by EVT_RECORD_SYS(). */
+void evt_record_sys(uint32_t sys_evt);
+
+/* Function for pausing or resuming the recording. */
+void evt_record_pause(bool pause);
+
+/* Function for copying the ring to flash. Recording pauses until the copy is written. Returns
+ * NRF_ERROR_BUSY while a copy is being written. */
+uint32_t evt_record_save(void);
+
+/* Function for reading the counters. */
+void evt_record_stats_get(evt_record_stats_t * p_stats);
+
+/* Function for serializing a chunk of a stream, oldest record first: source, stream length and offset of
+ * the chunk (uint16 LE), then up to EVT_RECORD_CHUNK_LEN stream bytes starting at chunk * EVT_RECORD_CHUNK_LEN.
+ * Returns the number of bytes written, 0 if the buffer is too small. */
+uint16_t evt_record_encode(evt_record_source_t source, uint8_t chunk, uint8_t * p_buf, uint16_t buf_len);
+
+#endif // EVT_RECORD_H__
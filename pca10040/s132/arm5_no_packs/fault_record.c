@@ -0,0 +1,158 @@
+#include "fault_record.h"
+#include <string.h>
+#include "sdk_common.h"
+#include "nrf.h"
+#include "app_error.h"
+#include "crc16.h"
+#include "fds.h"
+#include "flash_sched.h"
+#include "app_time.h"
+
+#define FAULT_RECORD_MAGIC          0xFA017EC0                          /**< Marks a valid record in no-init RAM. */
+
+#if defined(__CC_ARM)
+#define FAULT_RECORD_NOINIT         __attribute__((section(".bss.noinit"), zero_init))
+#elif defined(__GNUC__)
+#define FAULT_RECORD_NOINIT         __attribute__((section(".noinit")))
+#else
+#define FAULT_RECORD_NOINIT
+#endif
+
+/* Layout of the no-init RAM copy. */
+typedef struct
+{
+    uint32_t       magic;
+    fault_record_t record;
+    uint16_t       crc;                 /**< CRC16 of record. */
+} fault_record_noinit_t;
+
+static fault_record_noinit_t    m_noinit FAULT_RECORD_NOINIT;           /**< Survives the reset done by app_error_handler(). */
+
+static fault_record_t           m_last;                                 /**< Last fault, from no-init RAM or flash. */
+static bool                     m_last_valid;
+static bool                     m_commit_pending;                       /**< m_last came from no-init RAM and is not in flash yet. */
+static fault_record_t           m_write_buf;                            /**< Record being written. Must stay valid until the write completes. */
+static fds_record_chunk_t       m_chunk;
+static uint32_t                 m_reset_reason;
+
+
+void fault_record_save(uint32_t error_code, uint32_t line, uint8_t const * p_file, uint32_t pc, uint32_t lr)
+{
+    uint32_t len = 0;
+
+    memset(&m_noinit, 0, sizeof(m_noinit));
+
+    m_noinit.record.error_code = error_code;
+    m_noinit.record.line       = line;
+    m_noinit.record.pc         = pc;
+    m_noinit.record.lr         = lr;
+    m_noinit.record.uptime_s   = app_time_now();
+
+    if (p_file != NULL)
+    {
+        len = strlen((char const *)p_file);
+        // The end of the path holds the file name.
+        if (len > FAULT_RECORD_FILE_LEN)
+        {
+            p_file += len - FAULT_RECORD_FILE_LEN;
+            len     = FAULT_RECORD_FILE_LEN;
+        }
+        memcpy(m_noinit.record.file, p_file, len);
+    }
+    m_noinit.record.file_len = (uint8_t)len;
+
+    m_noinit.crc   = crc16_compute((uint8_t const *)&m_noinit.record, sizeof(fault_record_t), NULL);
+    m_noinit.magic = FAULT_RECORD_MAGIC;
+}
+
+/* Handler for completion of the record write. */
+static void record_write_handler(flash_sched_evt_t const * p_evt)
+{
+    // On failure the record is still kept in RAM for this run and reported over BLE.
+    UNUSED_PARAMETER(p_evt);
+}
+
+/* Loads the stored record and commits a new one if the previous run ended in a fault. */
+static void record_load_and_commit(void)
+{
+    uint32_t           err_code;
+    fds_record_desc_t  desc;
+    fds_find_token_t   token;
+    fds_flash_record_t flash_record;
+    fault_record_t     stored;
+    bool               stored_valid = false;
+
+    memset(&token, 0, sizeof(token));
+
+    if (fds_record_find(FAULT_RECORD_FILE_ID, FAULT_RECORD_RECORD_KEY, &desc, &token) == FDS_SUCCESS)
+    {
+        if (fds_record_open(&desc, &flash_record) == FDS_SUCCESS)
+        {
+            if (flash_record.p_header->tl.length_words == BYTES_TO_WORDS(sizeof(fault_record_t)))
+            {
+                memcpy(&stored, flash_record.p_data, sizeof(fault_record_t));
+                stored_valid = true;
+            }
+            (void)fds_record_close(&desc);
+        }
+    }
+
+    if (!m_commit_pending)
+    {
+        m_last       = stored;
+        m_last_valid = stored_valid;
+        return;
+    }
+
+    m_last.fault_count = stored_valid ? (stored.fault_count + 1) : 1;
+    m_write_buf        = m_last;
+
+    m_chunk.p_data       = &m_write_buf;
+    m_chunk.length_words = BYTES_TO_WORDS(sizeof(fault_record_t));
+
+    err_code = flash_sched_write(FLASH_SCHED_JOB_REPLACE,
+                                 FAULT_RECORD_FILE_ID,
+                                 FAULT_RECORD_RECORD_KEY,
+                                 &m_chunk,
+                                 record_write_handler,
+                                 NULL);
+    APP_ERROR_CHECK(err_code);
+    m_commit_pending = false;
+}
+
+/* Handler for FDS events. */
+static void fds_evt_handler(fds_evt_t const * const p_evt)
+{
+    if ((p_evt->id == FDS_EVT_INIT) && (p_evt->result == FDS_SUCCESS))
+    {
+        record_load_and_commit();
+    }
+}
+
+uint32_t fault_record_init(void)
+{
+    m_reset_reason = NRF_POWER->RESETREAS;
+    NRF_POWER->RESETREAS = m_reset_reason; // Write 1 to clear.
+
+    if ((m_noinit.magic == FAULT_RECORD_MAGIC)
+        && (m_noinit.crc == crc16_compute((uint8_t const *)&m_noinit.record, sizeof(fault_record_t), NULL)))
+    {
+        m_last              = m_noinit.record;
+        m_last.reset_reason = m_reset_reason;
+        m_last_valid        = true;
+        m_commit_pending    = true;
+    }
+    m_noinit.magic = 0;
+
+    return fds_register(fds_evt_handler);
+}
+
+fault_record_t const * fault_record_last(void)
+{
+    return m_last_valid ? &m_last : NULL;
+}
+
+uint32_t fault_record_reset_reason(void)
+{
+    return m_reset_reason;
+}
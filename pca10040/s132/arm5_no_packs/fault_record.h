@@ -0,0 +1,69 @@
+#ifndef FAULT_RECORD_H__
+#define FAULT_RECORD_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Persistent record of the last fatal error.
+ *
+ * app_error_handler() saves the error into a RAM section that is not initialized at startup, and resets.
+ * On the next boot the record is committed to flash through the flash scheduler and kept for the
+ * diagnostics characteristic, together with the reset reason.
+ *
+ * GCC places the RAM copy in .noinit (see ble_app_uart_gcc_nrf52.ld). The ARM compiler places it in
+ * .bss.noinit, which ble_app_uart_s132_pca10040.sct puts in an UNINIT execution region at the end of RAM. */
+
+#define FAULT_RECORD_FILE_ID        0x1002                              /**< FDS file holding the fault record. */
+#define FAULT_RECORD_RECORD_KEY     0x0001                              /**< FDS key of the fault record. */
+#define FAULT_RECORD_FILE_LEN       20                                  /**< Characters kept of the source file name (the end of it). */
+#define FAULT_RECORD_VERSION        1                                   /**< Version of the serialized format. */
+#define FAULT_RECORD_ENCODED_HDR_LEN 29                                 /**< Size of a serialized record without the file name (in bytes). */
+#define FAULT_RECORD_ENCODED_LEN    (FAULT_RECORD_ENCODED_HDR_LEN + FAULT_RECORD_FILE_LEN) /**< Maximum size of a serialized record (in bytes). */
+
+#if defined(__CC_ARM)
+#define FAULT_RECORD_PC()           __current_pc()
+#define FAULT_RECORD_LR()           __return_address()
+#elif defined(__GNUC__) && defined(__arm__)
+#define FAULT_RECORD_PC()           ({ uint32_t pc; __asm volatile ("mov %0, pc" : "=r" (pc)); pc; })
+#define FAULT_RECORD_LR()           ((uint32_t)__builtin_return_address(0))
+#else
+#define FAULT_RECORD_PC()           0
+#define FAULT_RECORD_LR()           0
+#endif
+
+typedef struct
+{
+    uint32_t error_code;                /**< Error code passed to app_error_handler(). */
+    uint32_t line;                      /**< Line of the failing check. */
+    uint32_t pc;                        /**< Program counter in app_error_handler(). */
+    uint32_t lr;                        /**< Return address of app_error_handler(), points into the failing function. */
+    uint32_t uptime_s;                  /**< Seconds since boot when the error happened. */
+    uint32_t reset_reason;              /**< RESETREAS of the boot that committed the record. */
+    uint16_t fault_count;               /**< Number of faults recorded since the flash was erased. */
+    uint8_t  file_len;                  /**< Used characters of file. */
+    char     file[FAULT_RECORD_FILE_LEN];/**< End of the source file name, not terminated. */
+} fault_record_t;
+
+/* Function for reading the reset reason and picking up a record left by the previous run.
+ * Must be called before the SoftDevice is enabled and before fds_init() (done by pm_init()). */
+uint32_t fault_record_init(void);
+
+/* Function for saving a fault into no-init RAM. Called from app_error_handler() right before the reset. */
+void fault_record_save(uint32_t error_code, uint32_t line, uint8_t const * p_file, uint32_t pc, uint32_t lr);
+
+/* Returns the last recorded fault, or NULL if there is none. */
+fault_record_t const * fault_record_last(void);
+
+/* Returns the reset reason of the current boot (POWER->RESETREAS). */
+uint32_t fault_record_reset_reason(void);
+
+/* Function for serializing a record. Returns the number of bytes written, 0 if the buffer is too small. */
+uint16_t fault_record_encode(fault_record_t const * p_record, uint8_t * p_buf, uint16_t buf_len);
+
+/* Function for parsing a serialized record. Returns false if the data is malformed.
+ *
+ * The serialization is in fault_record_codec.c, which has no other dependencies so it can also be built on
+ * the host (host/fault_record_check). */
+bool fault_record_decode(uint8_t const * p_buf, uint16_t len, fault_record_t * p_record);
+
+#endif // FAULT_RECORD_H__
@@ -0,0 +1,74 @@
+#include "fault_record.h"
+#include <string.h>
+#include "sdk_common.h"
+
+#define FAULT_RECORD_FLAG_VALID     0x01                                /**< Serialized flag: a fault has been recorded. */
+
+
+uint16_t fault_record_encode(fault_record_t const * p_record, uint8_t * p_buf, uint16_t buf_len)
+{
+    uint16_t len  = 0;
+    uint8_t  file_len;
+
+    if ((p_buf == NULL) || (buf_len < FAULT_RECORD_ENCODED_LEN))
+    {
+        return 0;
+    }
+
+    if (p_record == NULL)
+    {
+        memset(p_buf, 0, FAULT_RECORD_ENCODED_HDR_LEN);
+        p_buf[0] = FAULT_RECORD_VERSION;
+        return FAULT_RECORD_ENCODED_HDR_LEN;
+    }
+
+    file_len = MIN(p_record->file_len, FAULT_RECORD_FILE_LEN);
+
+    p_buf[len++] = FAULT_RECORD_VERSION;
+    p_buf[len++] = FAULT_RECORD_FLAG_VALID;
+    len += uint32_encode(p_record->error_code,   &p_buf[len]);
+    len += uint32_encode(p_record->line,         &p_buf[len]);
+    len += uint32_encode(p_record->pc,           &p_buf[len]);
+    len += uint32_encode(p_record->lr,           &p_buf[len]);
+    len += uint32_encode(p_record->uptime_s,     &p_buf[len]);
+    len += uint32_encode(p_record->reset_reason, &p_buf[len]);
+    len += uint16_encode(p_record->fault_count,  &p_buf[len]);
+    p_buf[len++] = file_len;
+    memcpy(&p_buf[len], p_record->file, file_len);
+
+    return len + file_len;
+}
+
+bool fault_record_decode(uint8_t const * p_buf, uint16_t len, fault_record_t * p_record)
+{
+    uint16_t pos = 2;
+    uint8_t  file_len;
+
+    if ((p_buf == NULL) || (p_record == NULL) || (len < FAULT_RECORD_ENCODED_HDR_LEN) || (p_buf[0] != FAULT_RECORD_VERSION))
+    {
+        return false;
+    }
+    if ((p_buf[1] & FAULT_RECORD_FLAG_VALID) == 0)
+    {
+        return false;
+    }
+    // The length of the file name ends the header.
+    file_len = p_buf[FAULT_RECORD_ENCODED_HDR_LEN - 1];
+    if ((file_len > FAULT_RECORD_FILE_LEN) || (len < FAULT_RECORD_ENCODED_HDR_LEN + file_len))
+    {
+        return false;
+    }
+
+    memset(p_record, 0, sizeof(fault_record_t));
+    p_record->error_code   = uint32_decode(&p_buf[pos]); pos += 4;
+    p_record->line         = uint32_decode(&p_buf[pos]); pos += 4;
+    p_record->pc           = uint32_decode(&p_buf[pos]); pos += 4;
+    p_record->lr           = uint32_decode(&p_buf[pos]); pos += 4;
+    p_record->uptime_s     = uint32_decode(&p_buf[pos]); pos += 4;
+    p_record->reset_reason = uint32_decode(&p_buf[pos]); pos += 4;
+    p_record->fault_count  = uint16_decode(&p_buf[pos]); pos += 2;
+    p_record->file_len     = p_buf[pos++];
+    memcpy(p_record->file, &p_buf[pos], p_record->file_len);
+
+    return true;
+}
@@ -0,0 +1,479 @@
+#include "flash_sched.h"
+#include <string.h>
+#include "sdk_common.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_util_platform.h"
+#include "nrf_soc.h"
+#include "ble_radio_notification.h"
+#include "app_config.h"
+#include "app_time.h"
+
+#define FLASH_SCHED_MAX_DEFER   APP_TIMER_TICKS(FLASH_SCHED_MAX_DEFER_MS, APP_TIMER_PRESCALER)  /**< Defer timeout (in ticks). */
+
+typedef struct
+{
+    flash_sched_job_type_t     type;
+    uint16_t                   file_id;
+    uint16_t                   key;
+    uint32_t                   record_id;           /**< Record to delete, or the record written. */
+    fds_record_chunk_t const * p_chunk;
+    flash_sched_handler_t      handler;
+    void                     * p_context;
+    uint64_t                   queued_at;           /**< app_time ticks when the job was queued. */
+    uint8_t                    retries;
+} flash_sched_job_t;
+
+static flash_sched_job_t        m_queue[FLASH_SCHED_QUEUE_SIZE];        /**< Job FIFO, the head job is the one handed to FDS. */
+static uint8_t                  m_head;
+static uint8_t                  m_count;
+static bool                     m_fds_ready;                            /**< FDS has been initialized. */
+static bool                     m_running;                              /**< The head job has been handed to FDS. */
+static bool                     m_gc_running;                           /**< Garbage collection started because flash was full. */
+static bool                     m_radio_active;                         /**< Radio state from the radio notification signal. */
+static bool                     m_defer_timer_running;
+static flash_sched_stats_t      m_stats;
+APP_TIMER_DEF(m_defer_timer_id);                                        /**< Bounds how long a job waits for an idle radio window. */
+
+
+/* Hands the head job to FDS. Returns the FDS result. */
+static ret_code_t job_start(flash_sched_job_t * p_job)
+{
+    ret_code_t        err_code;
+    fds_record_t      record;
+    fds_record_desc_t desc;
+    fds_find_token_t  token;
+
+    memset(&record, 0, sizeof(record));
+    record.file_id         = p_job->file_id;
+    record.key             = p_job->key;
+    record.data.p_chunks   = p_job->p_chunk;
+    record.data.num_chunks = 1;
+
+    switch (p_job->type)
+    {
+        case FLASH_SCHED_JOB_APPEND:
+            err_code = fds_record_write(&desc, &record);
+            break;
+
+        case FLASH_SCHED_JOB_REPLACE:
+            memset(&token, 0, sizeof(token));
+            if (fds_record_find(p_job->file_id, p_job->key, &desc, &token) == FDS_SUCCESS)
+            {
+                err_code = fds_record_update(&desc, &record);
+            }
+            else
+            {
+                err_code = fds_record_write(&desc, &record);
+            }
+            break;
+
+        case FLASH_SCHED_JOB_DELETE:
+            err_code = fds_descriptor_from_rec_id(&desc, p_job->record_id);
+            if (err_code == FDS_SUCCESS)
+            {
+                err_code = fds_record_delete(&desc);
+            }
+            break;
+
+        case FLASH_SCHED_JOB_GC:
+        default:
+            err_code = fds_gc();
+            break;
+    }
+
+    return err_code;
+}
+
+/* Removes the head job, updates the counters and reports the result to the job owner. */
+static void job_finish(ret_code_t result, uint32_t record_id)
+{
+    flash_sched_job_t job;
+    flash_sched_evt_t evt;
+    uint32_t          latency;
+
+    CRITICAL_REGION_ENTER();
+    job       = m_queue[m_head];
+    m_head    = (m_head + 1) % FLASH_SCHED_QUEUE_SIZE;
+    m_count--;
+    m_running = false;
+    CRITICAL_REGION_EXIT();
+
+    latency = (uint32_t)(app_time_ticks_get() - job.queued_at);
+
+    m_stats.queue_depth  = m_count;
+    m_stats.latency_last = latency;
+    m_stats.latency_max  = MAX(m_stats.latency_max, latency);
+    if (result == FDS_SUCCESS)
+    {
+        m_stats.jobs_completed++;
+        m_stats.latency_sum += latency;
+        if ((job.type == FLASH_SCHED_JOB_APPEND) || (job.type == FLASH_SCHED_JOB_REPLACE))
+        {
+            m_stats.words_written += job.p_chunk->length_words;
+        }
+    }
+    else
+    {
+        m_stats.jobs_failed++;
+    }
+
+    if (job.handler != NULL)
+    {
+        evt.type      = job.type;
+        evt.result    = result;
+        evt.file_id   = job.file_id;
+        evt.key       = job.key;
+        evt.record_id = (job.type == FLASH_SCHED_JOB_DELETE) ? job.record_id : record_id;
+        evt.p_context = job.p_context;
+        job.handler(&evt);
+    }
+}
+
+/* Starts the defer timer unless it is running already. */
+static void defer_timer_start(void)
+{
+    uint32_t err_code;
+    bool     start;
+
+    CRITICAL_REGION_ENTER();
+    start                 = !m_defer_timer_running;
+    m_defer_timer_running = true;
+    CRITICAL_REGION_EXIT();
+
+    if (start)
+    {
+        err_code = app_timer_start(m_defer_timer_id, FLASH_SCHED_MAX_DEFER, NULL);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+/* Stops the defer timer if it is running. */
+static void defer_timer_stop(void)
+{
+    bool stop;
+
+    CRITICAL_REGION_ENTER();
+    stop                  = m_defer_timer_running;
+    m_defer_timer_running = false;
+    CRITICAL_REGION_EXIT();
+
+    if (stop)
+    {
+        (void)app_timer_stop(m_defer_timer_id);
+    }
+}
+
+/* Hands the next job to FDS if the radio is idle, or when forced by the defer timeout.
+ *
+ * Called from the main loop and from the FDS, timer and radio notification interrupts. The head job is claimed
+ * (m_running set) in one critical region before it is handed to FDS, so only one caller starts it, and its
+ * FDS event is recognized even if it arrives before fds_record_write() returns. */
+static void job_submit(bool force)
+{
+    ret_code_t err_code;
+    bool       ready;
+    bool       defer;
+
+    for (;;)
+    {
+        CRITICAL_REGION_ENTER();
+        ready = m_fds_ready && !m_running && !m_gc_running && (m_count > 0);
+        defer = ready && m_radio_active && !force;
+        if (ready && !defer)
+        {
+            m_running = true;
+        }
+        CRITICAL_REGION_EXIT();
+
+        if (!ready)
+        {
+            return;
+        }
+        if (defer)
+        {
+            defer_timer_start();
+            return;
+        }
+
+        defer_timer_stop();
+
+        err_code = job_start(&m_queue[m_head]);
+
+        if (err_code == FDS_SUCCESS)
+        {
+            if (m_queue[m_head].type == FLASH_SCHED_JOB_GC)
+            {
+                m_stats.gc_runs++;
+            }
+            return;
+        }
+        if ((err_code == FDS_ERR_NO_SPACE_IN_FLASH) && (m_queue[m_head].retries < FLASH_SCHED_MAX_RETRIES))
+        {
+            // Reclaim the space of deleted and updated records, then try again. The claim moves to the
+            // garbage collection, its FDS_EVT_GC releases it. The attempt after it is a retry: when flash
+            // holds only live records the collection frees nothing, and the job fails instead of collecting
+            // again and again.
+            m_queue[m_head].retries++;
+            m_stats.retries++;
+
+            CRITICAL_REGION_ENTER();
+            m_gc_running = true;
+            m_running    = false;
+            CRITICAL_REGION_EXIT();
+
+            if (fds_gc() == FDS_SUCCESS)
+            {
+                m_stats.gc_runs++;
+                return;
+            }
+
+            CRITICAL_REGION_ENTER();
+            m_gc_running = false;
+            m_running    = true;
+            CRITICAL_REGION_EXIT();
+        }
+        if (err_code == FDS_ERR_NO_SPACE_IN_QUEUES)
+        {
+            // FDS is busy with other users. Their FDS events retry the job, the defer timer bounds the wait if
+            // none come.
+            CRITICAL_REGION_ENTER();
+            m_running = false;
+            CRITICAL_REGION_EXIT();
+            defer_timer_start();
+            return;
+        }
+
+        // The job can not be carried out, report it and move on to the next one.
+        job_finish(err_code, 0);
+    }
+}
+
+/* Handler for the defer timeout. */
+static void defer_timeout_handler(void * p_context)
+{
+    UNUSED_PARAMETER(p_context);
+
+    m_defer_timer_running = false;
+    if (m_count > 0)
+    {
+        m_stats.deferred_submits++;
+    }
+    job_submit(true);
+}
+
+/* Handler for the radio notification signal. */
+static void radio_notification_handler(bool radio_active)
+{
+    m_radio_active = radio_active;
+
+    if (!radio_active)
+    {
+        job_submit(false);
+    }
+}
+
+/* Completes or retries the running job. */
+static void job_result(ret_code_t result, uint32_t record_id)
+{
+    flash_sched_job_t * p_job = &m_queue[m_head];
+
+    if ((result != FDS_SUCCESS) && (p_job->retries < FLASH_SCHED_MAX_RETRIES))
+    {
+        p_job->retries++;
+        m_stats.retries++;
+        m_running = false;
+    }
+    else
+    {
+        job_finish(result, record_id);
+    }
+
+    job_submit(false);
+}
+
+/* Handler for FDS events. */
+static void fds_evt_handler(fds_evt_t const * const p_evt)
+{
+    flash_sched_job_t const * p_job = &m_queue[m_head];
+
+    switch (p_evt->id)
+    {
+        case FDS_EVT_INIT:
+            m_fds_ready = (p_evt->result == FDS_SUCCESS);
+            break;
+
+        case FDS_EVT_WRITE:
+        case FDS_EVT_UPDATE:
+            // Other FDS users (the peer manager) get their events here as well.
+            if (m_running
+                && ((p_job->type == FLASH_SCHED_JOB_APPEND) || (p_job->type == FLASH_SCHED_JOB_REPLACE))
+                && (p_evt->write.file_id == p_job->file_id)
+                && (p_evt->write.record_key == p_job->key))
+            {
+                job_result(p_evt->result, p_evt->write.record_id);
+            }
+            break;
+
+        case FDS_EVT_DEL_RECORD:
+            if (m_running
+                && (p_job->type == FLASH_SCHED_JOB_DELETE)
+                && (p_evt->del.record_id == p_job->record_id))
+            {
+                job_result(p_evt->result, p_evt->del.record_id);
+            }
+            break;
+
+        case FDS_EVT_GC:
+            if (m_gc_running)
+            {
+                // The job that needed the space is tried again below, its retry was counted when the
+                // collection started. If the collection failed or freed too little, the job fails once its
+                // retries are used up.
+                m_gc_running = false;
+            }
+            else if (m_running && (p_job->type == FLASH_SCHED_JOB_GC))
+            {
+                job_result(p_evt->result, 0);
+            }
+            break;
+
+        default:
+            // No implementation needed.
+            break;
+    }
+
+    // Any completed FDS operation, ours or another user's, frees a slot in the FDS queue.
+    job_submit(false);
+}
+
+/* Adds a job to the queue, or merges it into a pending replace job for the same record. */
+static uint32_t job_queue(flash_sched_job_t const * p_new)
+{
+    uint32_t err_code = NRF_SUCCESS;
+    uint8_t  i;
+    bool     merged   = false;
+
+    CRITICAL_REGION_ENTER();
+    if (p_new->type == FLASH_SCHED_JOB_REPLACE)
+    {
+        // The running job is already in FDS, only jobs behind it can be merged.
+        for (i = (m_running ? 1 : 0); i < m_count; i++)
+        {
+            flash_sched_job_t * p_job = &m_queue[(m_head + i) % FLASH_SCHED_QUEUE_SIZE];
+
+            if ((p_job->type == FLASH_SCHED_JOB_REPLACE)
+                && (p_job->file_id == p_new->file_id)
+                && (p_job->key == p_new->key))
+            {
+                p_job->p_chunk   = p_new->p_chunk;
+                p_job->handler   = p_new->handler;
+                p_job->p_context = p_new->p_context;
+                merged = true;
+                break;
+            }
+        }
+    }
+
+    if (merged)
+    {
+        m_stats.jobs_coalesced++;
+    }
+    else if (m_count == FLASH_SCHED_QUEUE_SIZE)
+    {
+        m_stats.jobs_rejected++;
+        err_code = NRF_ERROR_NO_MEM;
+    }
+    else
+    {
+        m_queue[(m_head + m_count) % FLASH_SCHED_QUEUE_SIZE] = *p_new;
+        m_count++;
+        m_stats.queue_depth     = m_count;
+        m_stats.queue_depth_max = MAX(m_stats.queue_depth_max, m_count);
+    }
+    CRITICAL_REGION_EXIT();
+
+    if (err_code == NRF_SUCCESS)
+    {
+        job_submit(false);
+    }
+    return err_code;
+}
+
+uint32_t flash_sched_init(void)
+{
+    uint32_t err_code;
+
+    err_code = app_timer_create(&m_defer_timer_id, APP_TIMER_MODE_SINGLE_SHOT, defer_timeout_handler);
+    VERIFY_SUCCESS(err_code);
+
+    err_code = ble_radio_notification_init(APP_IRQ_PRIORITY_LOW,
+                                           NRF_RADIO_NOTIFICATION_DISTANCE_800US,
+                                           radio_notification_handler);
+    VERIFY_SUCCESS(err_code);
+
+    return fds_register(fds_evt_handler);
+}
+
+uint32_t flash_sched_write(flash_sched_job_type_t     type,
+                           uint16_t                   file_id,
+                           uint16_t                   key,
+                           fds_record_chunk_t const * p_chunk,
+                           flash_sched_handler_t      handler,
+                           void                     * p_context)
+{
+    flash_sched_job_t job;
+
+    VERIFY_PARAM_NOT_NULL(p_chunk);
+
+    if ((type != FLASH_SCHED_JOB_APPEND) && (type != FLASH_SCHED_JOB_REPLACE))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    memset(&job, 0, sizeof(job));
+    job.type      = type;
+    job.file_id   = file_id;
+    job.key       = key;
+    job.p_chunk   = p_chunk;
+    job.handler   = handler;
+    job.p_context = p_context;
+    job.queued_at = app_time_ticks_get();
+
+    return job_queue(&job);
+}
+
+uint32_t flash_sched_delete(uint32_t record_id, flash_sched_handler_t handler, void * p_context)
+{
+    flash_sched_job_t job;
+
+    memset(&job, 0, sizeof(job));
+    job.type      = FLASH_SCHED_JOB_DELETE;
+    job.record_id = record_id;
+    job.handler   = handler;
+    job.p_context = p_context;
+    job.queued_at = app_time_ticks_get();
+
+    return job_queue(&job);
+}
+
+void flash_sched_on_sys_evt(uint32_t sys_evt)
+{
+    if (sys_evt == NRF_EVT_FLASH_OPERATION_ERROR)
+    {
+        // fstorage retries on its own, the FDS result tells whether the job as a whole failed.
+        m_stats.flash_errors++;
+    }
+}
+
+bool flash_sched_radio_is_active(void)
+{
+    return m_radio_active;
+}
+
+void flash_sched_stats_get(flash_sched_stats_t * p_stats)
+{
+    CRITICAL_REGION_ENTER();
+    *p_stats = m_stats;
+    CRITICAL_REGION_EXIT();
+}
@@ -0,0 +1,83 @@
+#ifndef FLASH_SCHED_H__
+#define FLASH_SCHED_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "fds.h"
+
+/* Flash job scheduler on top of FDS.
+ *
+ * Jobs are queued and handed to FDS one at a time, right after the radio goes idle, so flash operations land
+ * between connection events instead of competing with them. Failed jobs are retried in a later idle window. A
+ * job that finds flash full starts a garbage collection and is retried after it, so with flash full of live
+ * records it fails after FLASH_SCHED_MAX_RETRIES collections. Pending replace jobs for the same record are
+ * coalesced, only the latest data is written. */
+
+#define FLASH_SCHED_QUEUE_SIZE      8                                   /**< Maximum number of queued jobs. */
+#define FLASH_SCHED_MAX_RETRIES     3                                   /**< Attempts after the first before a job is reported as failed. */
+#define FLASH_SCHED_MAX_DEFER_MS    500                                 /**< Jobs are submitted after this time even if no idle radio window was seen. */
+
+typedef enum
+{
+    FLASH_SCHED_JOB_APPEND,             /**< Write a new record. */
+    FLASH_SCHED_JOB_REPLACE,            /**< Update the record with the given key, or write it if it does not exist. */
+    FLASH_SCHED_JOB_DELETE,             /**< Delete the record with the given record ID. */
+    FLASH_SCHED_JOB_GC                  /**< Run garbage collection. Queued internally when flash is full. */
+} flash_sched_job_type_t;
+
+/* Completion event passed to the job owner. */
+typedef struct
+{
+    flash_sched_job_type_t type;
+    ret_code_t             result;      /**< FDS_SUCCESS, or the error of the last attempt. */
+    uint16_t               file_id;
+    uint16_t               key;
+    uint32_t               record_id;   /**< Record written or deleted. */
+    void                 * p_context;   /**< Context given when the job was queued. */
+} flash_sched_evt_t;
+
+typedef void (*flash_sched_handler_t)(flash_sched_evt_t const * p_evt);
+
+/* Queue and latency counters. Latencies are from queuing to completion (in RTC ticks). */
+typedef struct
+{
+    uint8_t  queue_depth;               /**< Jobs currently queued, the running one included. */
+    uint8_t  queue_depth_max;           /**< Highest queue depth seen. */
+    uint32_t jobs_completed;
+    uint32_t jobs_failed;               /**< Jobs given up after FLASH_SCHED_MAX_RETRIES. */
+    uint32_t jobs_coalesced;            /**< Replace jobs merged into a pending one. */
+    uint32_t jobs_rejected;             /**< Jobs not queued because the queue was full. */
+    uint32_t retries;
+    uint32_t flash_errors;              /**< NRF_EVT_FLASH_OPERATION_ERROR events from the SoftDevice. */
+    uint32_t deferred_submits;          /**< Jobs submitted on the defer timeout instead of an idle radio window. */
+    uint32_t words_written;             /**< Flash words written by completed append and replace jobs. */
+    uint32_t gc_runs;                   /**< Garbage collections started, each erases at least one page. */
+    uint32_t latency_last;
+    uint32_t latency_max;
+    uint64_t latency_sum;               /**< Divide by jobs_completed for the mean. */
+} flash_sched_stats_t;
+
+/* Function for initializing the scheduler. Must be called before fds_init() (done by pm_init()). */
+uint32_t flash_sched_init(void);
+
+/* Function for queuing a write. p_chunk and the data it points to must stay valid until the handler is called. */
+uint32_t flash_sched_write(flash_sched_job_type_t     type,
+                           uint16_t                   file_id,
+                           uint16_t                   key,
+                           fds_record_chunk_t const * p_chunk,
+                           flash_sched_handler_t      handler,
+                           void                     * p_context);
+
+/* Function for queuing the deletion of a record. */
+uint32_t flash_sched_delete(uint32_t record_id, flash_sched_handler_t handler, void * p_context);
+
+/* Function for passing system events to the scheduler. Called from sys_evt_dispatch(). */
+void flash_sched_on_sys_evt(uint32_t sys_evt);
+
+/* Returns true while the radio is active according to the radio notification signal. */
+bool flash_sched_radio_is_active(void);
+
+/* Function for reading the counters. */
+void flash_sched_stats_get(flash_sched_stats_t * p_stats);
+
+#endif // FLASH_SCHED_H__
@@ -0,0 +1,253 @@
+#include "history_codec.h"
+#include <string.h>
+
+/* Bytes used by the block once the pending run is written. */
+static uint32_t committed_len(history_encoder_t const * p_enc)
+{
+    return p_enc->block.header.data_len + ((p_enc->run != 0) ? 1 : 0);
+}
+
+static void run_flush(history_encoder_t * p_enc)
+{
+    if (p_enc->run != 0)
+    {
+        p_enc->block.data[p_enc->block.header.data_len++] = HISTORY_TOKEN_RUN | (p_enc->run - 1);
+        p_enc->run = 0;
+    }
+}
+
+static uint8_t varint_len(uint32_t value)
+{
+    uint8_t len = 1;
+
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        len++;
+    }
+    return len;
+}
+
+static void varint_put(history_encoder_t * p_enc, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        p_enc->block.data[p_enc->block.header.data_len++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    p_enc->block.data[p_enc->block.header.data_len++] = (uint8_t)value;
+}
+
+void history_encoder_start(history_encoder_t * p_enc, uint16_t seq, uint32_t t_base, uint16_t period_s, uint8_t value)
+{
+    memset(p_enc, 0, sizeof(history_encoder_t));
+    memset(p_enc->block.data, 0xFF, sizeof(p_enc->block.data));
+
+    p_enc->block.header.magic       = HISTORY_BLOCK_MAGIC;
+    p_enc->block.header.seq         = seq;
+    p_enc->block.header.t_base      = t_base;
+    p_enc->block.header.period_s    = period_s;
+    p_enc->block.header.slot_count  = 1;
+    p_enc->block.header.first_value = value;
+    p_enc->last_value               = value;
+}
+
+bool history_encoder_put(history_encoder_t * p_enc, uint8_t value)
+{
+    int16_t delta = (int16_t)value - (int16_t)p_enc->last_value;
+
+    if (p_enc->block.header.slot_count == UINT16_MAX)
+    {
+        return false;
+    }
+
+    if (delta == 0)
+    {
+        // Extending a run is free, starting one costs a token.
+        if ((p_enc->run == 0) || (p_enc->run == HISTORY_TOKEN_RUN_MAX))
+        {
+            if (committed_len(p_enc) + 1 > HISTORY_BLOCK_DATA_SIZE)
+            {
+                return false;
+            }
+            run_flush(p_enc);
+        }
+        p_enc->run++;
+    }
+    else if ((delta >= -64) && (delta <= 63))
+    {
+        if (committed_len(p_enc) + 1 > HISTORY_BLOCK_DATA_SIZE)
+        {
+            return false;
+        }
+        run_flush(p_enc);
+        p_enc->block.data[p_enc->block.header.data_len++] = (uint8_t)((delta << 1) ^ (delta >> 15)) & HISTORY_TOKEN_DELTA_MAX;
+    }
+    else
+    {
+        if (committed_len(p_enc) + 2 > HISTORY_BLOCK_DATA_SIZE)
+        {
+            return false;
+        }
+        run_flush(p_enc);
+        p_enc->block.data[p_enc->block.header.data_len++] = HISTORY_TOKEN_ABS;
+        p_enc->block.data[p_enc->block.header.data_len++] = value;
+    }
+
+    p_enc->block.header.slot_count++;
+    p_enc->last_value = value;
+    return true;
+}
+
+bool history_encoder_gap(history_encoder_t * p_enc, uint32_t slots)
+{
+    if (slots == 0)
+    {
+        return true;
+    }
+    if ((uint32_t)p_enc->block.header.slot_count + slots > UINT16_MAX)
+    {
+        return false;
+    }
+    if (committed_len(p_enc) + 1 + varint_len(slots) > HISTORY_BLOCK_DATA_SIZE)
+    {
+        return false;
+    }
+
+    run_flush(p_enc);
+    p_enc->block.data[p_enc->block.header.data_len++] = HISTORY_TOKEN_GAP;
+    varint_put(p_enc, slots);
+    p_enc->block.header.slot_count += slots;
+    return true;
+}
+
+bool history_encoder_event(history_encoder_t * p_enc, uint8_t code)
+{
+    if (committed_len(p_enc) + 2 > HISTORY_BLOCK_DATA_SIZE)
+    {
+        return false;
+    }
+
+    run_flush(p_enc);
+    p_enc->block.data[p_enc->block.header.data_len++] = HISTORY_TOKEN_EVENT;
+    p_enc->block.data[p_enc->block.header.data_len++] = code;
+    return true;
+}
+
+uint16_t history_encoder_finish(history_encoder_t * p_enc)
+{
+    run_flush(p_enc);
+    return sizeof(history_block_header_t) + p_enc->block.header.data_len;
+}
+
+uint32_t history_block_end(history_block_header_t const * p_header)
+{
+    return p_header->t_base + (uint32_t)p_header->slot_count * p_header->period_s;
+}
+
+bool history_block_is_valid(history_block_t const * p_block, uint32_t len)
+{
+    if ((p_block == NULL) || (len < sizeof(history_block_header_t)))
+    {
+        return false;
+    }
+
+    return (p_block->header.magic == HISTORY_BLOCK_MAGIC)
+        && (p_block->header.period_s != 0)
+        && (p_block->header.slot_count != 0)
+        && (p_block->header.data_len <= HISTORY_BLOCK_DATA_SIZE)
+        && (sizeof(history_block_header_t) + p_block->header.data_len <= len);
+}
+
+void history_decoder_init(history_decoder_t * p_dec, history_block_t const * p_block)
+{
+    memset(p_dec, 0, sizeof(history_decoder_t));
+    p_dec->p_block = p_block;
+    p_dec->value   = p_block->header.first_value;
+}
+
+bool history_decoder_next(history_decoder_t * p_dec, history_item_t * p_item)
+{
+    history_block_header_t const * p_header = &p_dec->p_block->header;
+    uint8_t const                * p_data   = p_dec->p_block->data;
+    uint8_t                        token;
+
+    if (!p_dec->first_done)
+    {
+        p_dec->first_done = true;
+        p_dec->slot       = 1;
+        p_item->type      = HISTORY_ITEM_SAMPLE;
+        p_item->time      = p_header->t_base;
+        p_item->slots     = 1;
+        p_item->value     = p_dec->value;
+        return true;
+    }
+
+    if (p_dec->pos >= p_header->data_len)
+    {
+        return false;
+    }
+
+    token         = p_data[p_dec->pos++];
+    p_item->time  = p_header->t_base + p_dec->slot * p_header->period_s;
+    p_item->slots = 1;
+
+    if (token <= HISTORY_TOKEN_DELTA_MAX)
+    {
+        p_dec->value  += (int8_t)((token >> 1) ^ -(token & 1));
+        p_item->type   = HISTORY_ITEM_SAMPLE;
+        p_item->value  = p_dec->value;
+        p_dec->slot++;
+    }
+    else if (token < HISTORY_TOKEN_ABS)
+    {
+        p_item->type   = HISTORY_ITEM_SAMPLE;
+        p_item->slots  = (token & 0x3F) + 1;
+        p_item->value  = p_dec->value;
+        p_dec->slot   += p_item->slots;
+    }
+    else if ((token == HISTORY_TOKEN_ABS) && (p_dec->pos < p_header->data_len))
+    {
+        p_dec->value   = p_data[p_dec->pos++];
+        p_item->type   = HISTORY_ITEM_SAMPLE;
+        p_item->value  = p_dec->value;
+        p_dec->slot++;
+    }
+    else if (token == HISTORY_TOKEN_GAP)
+    {
+        uint32_t slots = 0;
+        uint8_t  shift = 0;
+        uint8_t  byte;
+
+        do
+        {
+            if ((p_dec->pos >= p_header->data_len) || (shift > 28))
+            {
+                return false;
+            }
+            byte   = p_data[p_dec->pos++];
+            slots |= (uint32_t)(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+
+        p_item->type   = HISTORY_ITEM_GAP;
+        p_item->slots  = slots;
+        p_item->value  = 0;
+        p_dec->slot   += slots;
+    }
+    else if ((token == HISTORY_TOKEN_EVENT) && (p_dec->pos < p_header->data_len))
+    {
+        // Events belong to the slot written last.
+        p_item->type   = HISTORY_ITEM_EVENT;
+        p_item->time  -= p_header->period_s;
+        p_item->slots  = 0;
+        p_item->value  = p_data[p_dec->pos++];
+    }
+    else
+    {
+        // Unknown token or truncated block.
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,111 @@
+#ifndef HISTORY_CODEC_H__
+#define HISTORY_CODEC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* On-flash block format for the occupancy history.
+ *
+ * A block covers a run of fixed length time slots starting at t_base. The first slot value is kept in the
+ * header, every following slot is encoded relative to the previous one:
+ *
+ *   0x00-0x7F  DELTA  zigzag encoded difference to the previous value (-64..63), one slot.
+ *   0x80-0xBF  RUN    (token & 0x3F) + 1 slots with an unchanged value.
+ *   0xC0       ABS    followed by the absolute value, one slot.
+ *   0xC1       GAP    followed by a varint slot count, slots without samples (sensor off).
+ *   0xC2       EVENT  followed by an event code, attached to the current slot. Does not advance time.
+ *
+ * The header holds the time span of the block, so a time range query only needs the headers to seek.
+ * The codec has no SDK dependencies, so dumps of the history file can be decoded on the host. */
+
+#define HISTORY_BLOCK_SIZE          256                                 /**< Size of one block, header included (in bytes). Multiple of 4. */
+#define HISTORY_BLOCK_MAGIC         0x4853                              /**< "HS", marks a history block. */
+#define HISTORY_BLOCK_DATA_SIZE     (HISTORY_BLOCK_SIZE - sizeof(history_block_header_t))
+
+#define HISTORY_TOKEN_DELTA_MAX     0x7F
+#define HISTORY_TOKEN_RUN           0x80
+#define HISTORY_TOKEN_RUN_MAX       64                                  /**< Slots covered by a single RUN token. */
+#define HISTORY_TOKEN_ABS           0xC0
+#define HISTORY_TOKEN_GAP           0xC1
+#define HISTORY_TOKEN_EVENT         0xC2
+
+/* Header stored in front of the encoded slots. */
+typedef struct
+{
+    uint16_t magic;                     /**< HISTORY_BLOCK_MAGIC. */
+    uint16_t seq;                       /**< Sequence number, increments for every block written. */
+    uint32_t t_base;                    /**< Time of the first slot (in seconds). */
+    uint16_t period_s;                  /**< Length of one slot (in seconds). */
+    uint16_t slot_count;                /**< Number of slots covered by the block, gaps included. */
+    uint8_t  first_value;               /**< Value of the first slot. */
+    uint8_t  data_len;                  /**< Number of used bytes after the header. */
+    uint16_t reserved;
+} history_block_header_t;
+
+typedef struct
+{
+    history_block_header_t header;
+    uint8_t                data[HISTORY_BLOCK_SIZE - sizeof(history_block_header_t)];
+} history_block_t;
+
+/* Encoder state for the block currently being filled. */
+typedef struct
+{
+    history_block_t block;              /**< Block under construction. */
+    uint8_t         last_value;         /**< Value of the previous slot. */
+    uint8_t         run;                /**< Unchanged slots not yet written as a RUN token. */
+} history_encoder_t;
+
+typedef enum
+{
+    HISTORY_ITEM_SAMPLE,                /**< A slot with a value. */
+    HISTORY_ITEM_GAP,                   /**< Slots without samples, value holds nothing. */
+    HISTORY_ITEM_EVENT                  /**< An event, value holds the event code. */
+} history_item_type_t;
+
+typedef struct
+{
+    history_item_type_t type;
+    uint32_t            time;           /**< Start time of the slot(s) (in seconds). */
+    uint32_t            slots;          /**< Number of slots covered by the item. */
+    uint8_t             value;          /**< Slot value or event code. */
+} history_item_t;
+
+/* Decoder state, walks the items of one block. */
+typedef struct
+{
+    history_block_t const * p_block;
+    uint16_t                pos;        /**< Read position in the data area. */
+    uint32_t                slot;       /**< Index of the next slot. */
+    uint8_t                 value;      /**< Value of the previous slot. */
+    bool                    first_done; /**< The header value has been returned. */
+} history_decoder_t;
+
+/* Function for starting a new block with value as its first slot. */
+void history_encoder_start(history_encoder_t * p_enc, uint16_t seq, uint32_t t_base, uint16_t period_s, uint8_t value);
+
+/* Function for appending one slot. Returns false if the block is full, the slot is then not stored. */
+bool history_encoder_put(history_encoder_t * p_enc, uint8_t value);
+
+/* Function for appending slots without samples. Returns false if the block is full. */
+bool history_encoder_gap(history_encoder_t * p_enc, uint32_t slots);
+
+/* Function for attaching an event to the current slot. Returns false if the block is full. */
+bool history_encoder_event(history_encoder_t * p_enc, uint8_t code);
+
+/* Function for closing the block. Returns the number of bytes to store, header included. */
+uint16_t history_encoder_finish(history_encoder_t * p_enc);
+
+/* Returns the time just after the last slot of a block. */
+uint32_t history_block_end(history_block_header_t const * p_header);
+
+/* Function for checking that a buffer holds a block that can be decoded. */
+bool history_block_is_valid(history_block_t const * p_block, uint32_t len);
+
+/* Function for starting to decode a block. */
+void history_decoder_init(history_decoder_t * p_dec, history_block_t const * p_block);
+
+/* Function for fetching the next item. Returns false at the end of the block. */
+bool history_decoder_next(history_decoder_t * p_dec, history_item_t * p_item);
+
+#endif // HISTORY_CODEC_H__
@@ -0,0 +1,564 @@
+#include "history_log.h"
+#include <string.h>
+#include "sdk_common.h"
+#include "app_error.h"
+#include "app_util_platform.h"
+#include "fds.h"
+#include "flash_sched.h"
+
+#define HISTORY_LOG_WRITE_BUFFERS   2                                   /**< Closed blocks that can wait for FDS at the same time. */
+
+// FDS_VIRTUAL_PAGES must leave the history at least a page, the index counts blocks in a byte.
+STATIC_ASSERT((HISTORY_LOG_MAX_BLOCKS > 0) && (HISTORY_LOG_MAX_BLOCKS <= UINT8_MAX));
+
+/* RAM index entry, one per block in flash. */
+typedef struct
+{
+    uint32_t t_base;                    /**< Time of the first slot of the block. */
+    uint32_t t_end;                     /**< Time just after the last slot of the block. */
+    uint32_t record_id;                 /**< FDS record holding the block. */
+    uint16_t seq;                       /**< Sequence number of the block. */
+} history_index_entry_t;
+
+/* Event waiting for the main loop. */
+typedef struct
+{
+    uint32_t        now;
+    history_event_t event;
+} history_event_entry_t;
+
+/* Write completion waiting for the main loop. */
+typedef struct
+{
+    uint32_t record_id;
+    bool     success;
+} history_write_result_t;
+
+static history_index_entry_t    m_index[HISTORY_LOG_MAX_BLOCKS];        /**< Blocks in flash, oldest first. */
+static uint8_t                  m_index_count;
+static history_encoder_t        m_enc;                                  /**< Block being filled. */
+static bool                     m_enc_active;
+static uint16_t                 m_next_seq;
+static bool                     m_ready;                                /**< FDS is initialized and the index is built. */
+
+static bool                     m_slot_pending;                         /**< A slot value is being collected. */
+static uint32_t                 m_slot_time;                            /**< Start time of the slot being collected. */
+static uint8_t                  m_slot_value;                           /**< Peak value of the slot being collected. */
+
+static history_block_t          m_write_buf[HISTORY_LOG_WRITE_BUFFERS]; /**< Closed blocks. Must stay valid until FDS reports completion. */
+static fds_record_chunk_t       m_write_chunk[HISTORY_LOG_WRITE_BUFFERS];
+static uint8_t                  m_write_head;                           /**< Oldest closed block. */
+static uint8_t                  m_write_count;                          /**< Number of closed blocks queued for writing. */
+static uint32_t                 m_dropped_blocks;                       /**< Blocks lost because FDS could not keep up. */
+
+// Filled from interrupt context under a critical region, emptied by history_log_process().
+static history_event_entry_t    m_event_queue[HISTORY_LOG_EVENT_QUEUE_SIZE];
+static uint8_t                  m_event_head;                           /**< Oldest queued event. */
+static uint8_t                  m_event_count;
+static history_write_result_t   m_write_result[HISTORY_LOG_WRITE_BUFFERS]; /**< Completions, in the order of m_write_buf. */
+static uint8_t                  m_write_result_head;                    /**< Oldest completion. */
+static uint8_t                  m_write_result_count;
+static volatile bool            m_init_pending;                         /**< FDS is initialized, the index is to be built. */
+
+static history_encoder_t        m_scratch;                              /**< Snapshot of m_enc used by queries and transfers. */
+
+
+/* Serial number comparison, robust against wrap-around of seq. */
+static bool seq_is_before(uint16_t a, uint16_t b)
+{
+    return (int16_t)(a - b) < 0;
+}
+
+static void index_insert(history_block_header_t const * p_header, uint32_t record_id)
+{
+    uint8_t i;
+
+    if (m_index_count == HISTORY_LOG_MAX_BLOCKS)
+    {
+        // Only happens when the limit was lowered, forget the oldest.
+        memmove(&m_index[0], &m_index[1], (m_index_count - 1) * sizeof(history_index_entry_t));
+        m_index_count--;
+    }
+
+    i = m_index_count;
+    while ((i > 0) && seq_is_before(p_header->seq, m_index[i - 1].seq))
+    {
+        m_index[i] = m_index[i - 1];
+        i--;
+    }
+
+    m_index[i].t_base    = p_header->t_base;
+    m_index[i].t_end     = history_block_end(p_header);
+    m_index[i].record_id = record_id;
+    m_index[i].seq       = p_header->seq;
+    m_index_count++;
+}
+
+/* Builds the RAM index from the block headers in flash. */
+static void index_build(void)
+{
+    fds_record_desc_t  desc;
+    fds_find_token_t   token;
+    fds_flash_record_t flash_record;
+
+    memset(&token, 0, sizeof(token));
+    m_index_count = 0;
+
+    while (fds_record_find(HISTORY_LOG_FILE_ID, HISTORY_LOG_RECORD_KEY, &desc, &token) == FDS_SUCCESS)
+    {
+        if (fds_record_open(&desc, &flash_record) != FDS_SUCCESS)
+        {
+            continue;
+        }
+        if (history_block_is_valid((history_block_t const *)flash_record.p_data,
+                                   flash_record.p_header->tl.length_words * sizeof(uint32_t)))
+        {
+            index_insert(&((history_block_t const *)flash_record.p_data)->header, desc.record_id);
+        }
+        (void)fds_record_close(&desc);
+    }
+
+    m_next_seq = (m_index_count > 0) ? (m_index[m_index_count - 1].seq + 1) : 0;
+}
+
+/* Deletes the oldest block so a new one fits within HISTORY_LOG_MAX_BLOCKS. */
+static void index_evict(void)
+{
+    // If the delete can not be queued the block stays in flash, but is no longer indexed.
+    (void)flash_sched_delete(m_index[0].record_id, NULL, NULL);
+
+    memmove(&m_index[0], &m_index[1], (m_index_count - 1) * sizeof(history_index_entry_t));
+    m_index_count--;
+}
+
+/* Handler for completion of a block write. Blocks complete in the order they were queued, the buffer stays
+ * in m_write_buf until history_log_process() moves the block to the index. */
+static void block_write_handler(flash_sched_evt_t const * p_evt)
+{
+    uint8_t idx;
+
+    CRITICAL_REGION_ENTER();
+    idx = (m_write_result_head + m_write_result_count) % HISTORY_LOG_WRITE_BUFFERS;
+    m_write_result[idx].record_id = p_evt->record_id;
+    m_write_result[idx].success   = (p_evt->result == FDS_SUCCESS);
+    m_write_result_count++;
+    CRITICAL_REGION_EXIT();
+}
+
+/* Moves the written blocks from the write buffers to the index. */
+static void block_write_complete(void)
+{
+    history_write_result_t result;
+    bool                   pending = true;
+
+    while (pending)
+    {
+        CRITICAL_REGION_ENTER();
+        pending = (m_write_result_count > 0);
+        if (pending)
+        {
+            result               = m_write_result[m_write_result_head];
+            m_write_result_head  = (m_write_result_head + 1) % HISTORY_LOG_WRITE_BUFFERS;
+            m_write_result_count--;
+        }
+        CRITICAL_REGION_EXIT();
+
+        if (!pending)
+        {
+            return;
+        }
+        if (result.success)
+        {
+            index_insert(&m_write_buf[m_write_head].header, result.record_id);
+        }
+        else
+        {
+            m_dropped_blocks++;
+        }
+        m_write_head = (m_write_head + 1) % HISTORY_LOG_WRITE_BUFFERS;
+        m_write_count--;
+    }
+}
+
+/* Closes the current block and queues it for writing. */
+static void block_store(void)
+{
+    uint8_t  idx;
+    uint16_t len;
+
+    if (!m_enc_active)
+    {
+        return;
+    }
+    m_enc_active = false;
+
+    if (m_write_count == HISTORY_LOG_WRITE_BUFFERS)
+    {
+        m_dropped_blocks++;
+        return;
+    }
+
+    len = history_encoder_finish(&m_enc);
+    idx = (m_write_head + m_write_count) % HISTORY_LOG_WRITE_BUFFERS;
+
+    m_write_buf[idx]                = m_enc.block;
+    m_write_chunk[idx].p_data       = &m_write_buf[idx];
+    m_write_chunk[idx].length_words = BYTES_TO_WORDS(len);
+
+    while ((m_index_count > 0) && (m_index_count + m_write_count >= HISTORY_LOG_MAX_BLOCKS))
+    {
+        index_evict();
+    }
+
+    m_write_count++;
+    if (flash_sched_write(FLASH_SCHED_JOB_APPEND,
+                          HISTORY_LOG_FILE_ID,
+                          HISTORY_LOG_RECORD_KEY,
+                          &m_write_chunk[idx],
+                          block_write_handler,
+                          NULL) != NRF_SUCCESS)
+    {
+        m_write_count--;
+        m_dropped_blocks++;
+    }
+}
+
+/* Adds a completed slot to the current block, starting a new block when needed. */
+static void slot_commit(uint32_t slot_time, uint8_t value)
+{
+    if (m_enc_active)
+    {
+        uint32_t block_end = history_block_end(&m_enc.block.header);
+
+        if ((slot_time >= block_end)
+            && history_encoder_gap(&m_enc, (slot_time - block_end) / HISTORY_LOG_PERIOD_S)
+            && history_encoder_put(&m_enc, value))
+        {
+            return;
+        }
+        block_store();
+    }
+
+    history_encoder_start(&m_enc, m_next_seq++, slot_time, HISTORY_LOG_PERIOD_S, value);
+    m_enc_active = true;
+}
+
+/* Handler for FDS events. Writes are completed through the flash scheduler. */
+static void fds_evt_handler(fds_evt_t const * const p_evt)
+{
+    if ((p_evt->id == FDS_EVT_INIT) && (p_evt->result == FDS_SUCCESS))
+    {
+        m_init_pending = true;
+    }
+}
+
+/* Adds an event to the history, in the main loop. */
+static void event_store(uint32_t now, history_event_t event)
+{
+    if (m_slot_pending)
+    {
+        slot_commit(m_slot_time, m_slot_value);
+        m_slot_pending = false;
+    }
+    else if (!m_enc_active)
+    {
+        slot_commit(now - (now % HISTORY_LOG_PERIOD_S), 0);
+    }
+
+    if (!history_encoder_event(&m_enc, (uint8_t)event))
+    {
+        block_store();
+        slot_commit(now - (now % HISTORY_LOG_PERIOD_S), m_enc.last_value);
+        (void)history_encoder_event(&m_enc, (uint8_t)event);
+    }
+}
+
+uint32_t history_log_init(void)
+{
+    return fds_register(fds_evt_handler);
+}
+
+void history_log_process(void)
+{
+    history_event_entry_t entry;
+    bool                  pending = true;
+
+    // Blocks written before the index is built are found in flash by index_build().
+    block_write_complete();
+    if (m_init_pending)
+    {
+        m_init_pending = false;
+        index_build();
+        m_ready = true;
+    }
+
+    while (pending)
+    {
+        CRITICAL_REGION_ENTER();
+        pending = (m_event_count > 0);
+        if (pending)
+        {
+            entry        = m_event_queue[m_event_head];
+            m_event_head = (m_event_head + 1) % HISTORY_LOG_EVENT_QUEUE_SIZE;
+            m_event_count--;
+        }
+        CRITICAL_REGION_EXIT();
+
+        if (pending)
+        {
+            event_store(entry.now, entry.event);
+        }
+    }
+}
+
+void history_log_sample(uint32_t now, uint8_t value)
+{
+    uint32_t slot_time = now - (now % HISTORY_LOG_PERIOD_S);
+
+    history_log_process();
+
+    if (m_slot_pending)
+    {
+        if (slot_time == m_slot_time)
+        {
+            m_slot_value = MAX(m_slot_value, value);
+            return;
+        }
+        slot_commit(m_slot_time, m_slot_value);
+        if (slot_time < m_slot_time)
+        {
+            // The time base was moved back, start over in a new block.
+            block_store();
+        }
+    }
+
+    m_slot_pending = true;
+    m_slot_time    = slot_time;
+    m_slot_value   = value;
+}
+
+void history_log_event(uint32_t now, history_event_t event)
+{
+    uint8_t idx;
+
+    CRITICAL_REGION_ENTER();
+    if (m_event_count < HISTORY_LOG_EVENT_QUEUE_SIZE)
+    {
+        idx = (m_event_head + m_event_count) % HISTORY_LOG_EVENT_QUEUE_SIZE;
+        m_event_queue[idx].now   = now;
+        m_event_queue[idx].event = event;
+        m_event_count++;
+    }
+    CRITICAL_REGION_EXIT();
+}
+
+/* Reports the items of one block that fall within [t_from, t_to). */
+static void block_query(history_block_t const * p_block,
+                        uint32_t                t_from,
+                        uint32_t                t_to,
+                        history_log_handler_t   handler,
+                        void                  * p_context)
+{
+    history_decoder_t decoder;
+    history_item_t    item;
+
+    history_decoder_init(&decoder, p_block);
+
+    while (history_decoder_next(&decoder, &item))
+    {
+        if (item.time >= t_to)
+        {
+            return;
+        }
+        if ((item.time + MAX(item.slots, 1) * p_block->header.period_s) > t_from)
+        {
+            handler(&item, p_context);
+        }
+    }
+}
+
+uint32_t history_log_query(uint32_t t_from, uint32_t t_to, history_log_handler_t handler, void * p_context)
+{
+    fds_record_desc_t  desc;
+    fds_flash_record_t flash_record;
+    uint8_t            i;
+
+    VERIFY_PARAM_NOT_NULL(handler);
+
+    if (!m_ready)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    for (i = 0; i < m_index_count; i++)
+    {
+        if (m_index[i].t_end <= t_from)
+        {
+            continue;
+        }
+        if (m_index[i].t_base >= t_to)
+        {
+            break;
+        }
+        if (fds_descriptor_from_rec_id(&desc, m_index[i].record_id) != FDS_SUCCESS)
+        {
+            continue;
+        }
+        if (fds_record_open(&desc, &flash_record) == FDS_SUCCESS)
+        {
+            block_query((history_block_t const *)flash_record.p_data, t_from, t_to, handler, p_context);
+            (void)fds_record_close(&desc);
+        }
+    }
+
+    if (m_enc_active && (m_enc.block.header.t_base < t_to))
+    {
+        m_scratch = m_enc;
+        (void)history_encoder_finish(&m_scratch);
+        block_query(&m_scratch.block, t_from, t_to, handler, p_context);
+    }
+
+    if (m_slot_pending && (m_slot_time >= t_from) && (m_slot_time < t_to))
+    {
+        history_item_t item;
+
+        item.type  = HISTORY_ITEM_SAMPLE;
+        item.time  = m_slot_time;
+        item.slots = 1;
+        item.value = m_slot_value;
+        handler(&item, p_context);
+    }
+
+    return NRF_SUCCESS;
+}
+
+void history_log_read_start(history_log_cursor_t * p_cursor, uint32_t t_from, uint32_t t_to)
+{
+    memset(p_cursor, 0, sizeof(history_log_cursor_t));
+    p_cursor->t_from = t_from;
+    p_cursor->t_to   = t_to;
+
+    // The oldest block there is.
+    if (m_index_count > 0)
+    {
+        p_cursor->seq = m_index[0].seq;
+    }
+    else if (m_write_count > 0)
+    {
+        p_cursor->seq = m_write_buf[m_write_head].header.seq;
+    }
+    else if (m_enc_active)
+    {
+        p_cursor->seq = m_enc.block.header.seq;
+    }
+    else
+    {
+        p_cursor->seq = m_next_seq;
+    }
+}
+
+/* Returns true if the block covers a part of the transfer range and is not before the cursor. */
+static bool block_is_next(history_log_cursor_t const * p_cursor, uint16_t seq, uint32_t t_base, uint32_t t_end)
+{
+    return !seq_is_before(seq, p_cursor->seq) && (t_end > p_cursor->t_from) && (t_base < p_cursor->t_to);
+}
+
+/* Copies bytes of a block from the cursor position, the padding excluded. */
+static uint16_t block_read(history_log_cursor_t * p_cursor, history_block_t const * p_block, uint8_t * p_buf, uint16_t len)
+{
+    uint16_t block_len = sizeof(history_block_header_t) + p_block->header.data_len;
+
+    if (p_block->header.seq != p_cursor->seq)
+    {
+        p_cursor->seq    = p_block->header.seq;
+        p_cursor->offset = 0;
+    }
+    if (p_cursor->offset >= block_len)
+    {
+        return 0;
+    }
+
+    len = MIN(len, block_len - p_cursor->offset);
+    memcpy(p_buf, (uint8_t const *)p_block + p_cursor->offset, len);
+    p_cursor->offset += len;
+
+    return len;
+}
+
+uint16_t history_log_read(history_log_cursor_t * p_cursor, uint8_t * p_buf, uint16_t len)
+{
+    fds_record_desc_t  desc;
+    fds_flash_record_t flash_record;
+    uint16_t           count = 0;
+    uint16_t           copied;
+    uint8_t            i;
+
+    if (!m_ready)
+    {
+        p_cursor->done = true;
+    }
+
+    while (!p_cursor->done && (count < len))
+    {
+        copied = 0;
+
+        if (p_cursor->snapshot)
+        {
+            copied = block_read(p_cursor, &m_scratch.block, &p_buf[count], len - count);
+            p_cursor->done = (copied == 0);
+            count += copied;
+            continue;
+        }
+
+        // Blocks in flash, then closed blocks waiting for flash, then the one being filled, by seq.
+        for (i = 0; i < m_index_count; i++)
+        {
+            if (block_is_next(p_cursor, m_index[i].seq, m_index[i].t_base, m_index[i].t_end)
+                && (fds_descriptor_from_rec_id(&desc, m_index[i].record_id) == FDS_SUCCESS)
+                && (fds_record_open(&desc, &flash_record) == FDS_SUCCESS))
+            {
+                copied = block_read(p_cursor, (history_block_t const *)flash_record.p_data, &p_buf[count], len - count);
+                (void)fds_record_close(&desc);
+                break;
+            }
+        }
+        if (i == m_index_count)
+        {
+            history_block_t const * p_block = NULL;
+
+            for (i = 0; (i < m_write_count) && (p_block == NULL); i++)
+            {
+                history_block_t const * p_closed = &m_write_buf[(m_write_head + i) % HISTORY_LOG_WRITE_BUFFERS];
+
+                if (block_is_next(p_cursor, p_closed->header.seq, p_closed->header.t_base, history_block_end(&p_closed->header)))
+                {
+                    p_block = p_closed;
+                }
+            }
+            if ((p_block == NULL) && m_enc_active
+                && block_is_next(p_cursor, m_enc.block.header.seq, m_enc.block.header.t_base, history_block_end(&m_enc.block.header)))
+            {
+                m_scratch = m_enc;
+                (void)history_encoder_finish(&m_scratch);
+                p_cursor->snapshot = true;
+                continue;
+            }
+            if (p_block == NULL)
+            {
+                p_cursor->done = true;
+                break;
+            }
+            copied = block_read(p_cursor, p_block, &p_buf[count], len - count);
+        }
+
+        if (copied == 0)
+        {
+            // End of the block.
+            p_cursor->seq++;
+            p_cursor->offset = 0;
+        }
+        count += copied;
+    }
+
+    return count;
+}
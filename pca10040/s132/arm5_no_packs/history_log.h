@@ -0,0 +1,83 @@
+#ifndef HISTORY_LOG_H__
+#define HISTORY_LOG_H__
+
+#include <stdint.h>
+#include "fds.h"
+#include "history_codec.h"
+
+/* Long-term occupancy history, stored in FDS as blocks in the history_codec format.
+ *
+ * Samples are reduced to one value per slot (the peak of the slot), so a static bay costs one RUN token per
+ * HISTORY_TOKEN_RUN_MAX slots. HISTORY_LOG_MAX_BLOCKS follows from FDS_VIRTUAL_PAGES: the history gets the
+ * pages left after the swap page and the HISTORY_LOG_FDS_SHARED_PAGES of the other FDS users, less the room of
+ * one block, so the newest block fits while the deleted oldest one waits for garbage collection. The other
+ * users never run out of space because of the history.
+ *
+ * The device passes app_time_synced_now() as the time: seconds since boot until the central sets the time,
+ * Unix time after, so t_base at or above TIME_SYNC_EPOCH_MIN_S marks a block in Unix time. The jump at the
+ * first synchronization starts a new block.
+ *
+ * The history belongs to the main loop. Events may be added from any context, they are queued and applied
+ * by history_log_process(), like the FDS initialization and the write completions of the flash scheduler.
+ * All other functions must be called from the main loop. */
+
+#define HISTORY_LOG_FILE_ID         0x1001                              /**< FDS file holding the history blocks. */
+#define HISTORY_LOG_RECORD_KEY      0x0001                              /**< FDS key shared by all history blocks, they are told apart by seq. */
+#define HISTORY_LOG_PERIOD_S        10                                  /**< Slot length (in seconds). */
+#define HISTORY_LOG_FDS_SHARED_PAGES 2                                  /**< FDS pages of the peer manager, the configuration, the fault record and the event recorder copy. */
+#define HISTORY_LOG_BLOCKS_PER_PAGE ((FDS_VIRTUAL_PAGE_SIZE - 2) / (3 + HISTORY_BLOCK_SIZE / 4))  /**< Blocks in one page, after the page tag of two words and a record header of three words each. */
+#define HISTORY_LOG_MAX_BLOCKS      ((FDS_VIRTUAL_PAGES - 1 - HISTORY_LOG_FDS_SHARED_PAGES) * HISTORY_LOG_BLOCKS_PER_PAGE - 1)  /**< Blocks kept in flash, the oldest is deleted when exceeded. */
+#define HISTORY_LOG_EVENT_QUEUE_SIZE 8                                  /**< Events waiting for the main loop. */
+
+/* Event codes stored in the history. */
+typedef enum
+{
+    HISTORY_EVENT_BOOT = 1,
+    HISTORY_EVENT_CONNECTED,
+    HISTORY_EVENT_DISCONNECTED,
+    HISTORY_EVENT_BATTERY_LOW
+} history_event_t;
+
+/* Read position of a history transfer, see history_log_read(). */
+typedef struct
+{
+    uint32_t t_from;
+    uint32_t t_to;
+    uint16_t seq;                       /**< Block being read. */
+    uint16_t offset;                    /**< Next byte of the block. */
+    bool     snapshot;                  /**< The block is the snapshot of the one being filled. */
+    bool     done;
+} history_log_cursor_t;
+
+/* Handler called for every item matched by a query. */
+typedef void (*history_log_handler_t)(history_item_t const * p_item, void * p_context);
+
+/* Function for registering with FDS. Must be called before fds_init() (done by pm_init()). */
+uint32_t history_log_init(void);
+
+/* Function for applying the events and flash completions queued from interrupt context. Main loop only,
+ * history_log_sample() calls it too so the events keep their order with the samples. */
+void history_log_process(void);
+
+/* Function for adding a sample. now is in seconds. */
+void history_log_sample(uint32_t now, uint8_t value);
+
+/* Function for adding an event, from any context. now is in seconds. The event is stored by the next
+ * history_log_process(), and lost if HISTORY_LOG_EVENT_QUEUE_SIZE events are already waiting. */
+void history_log_event(uint32_t now, history_event_t event);
+
+/* Function for reading the history between t_from and t_to (in seconds). Blocks outside the range are
+ * skipped using the RAM index, without reading them from flash. */
+uint32_t history_log_query(uint32_t t_from, uint32_t t_to, history_log_handler_t handler, void * p_context);
+
+/* Function for starting a transfer of the blocks overlapping t_from to t_to (in seconds). */
+void history_log_read_start(history_log_cursor_t * p_cursor, uint32_t t_from, uint32_t t_to);
+
+/* Function for reading the next bytes of a transfer: the blocks in the history_codec format, oldest first,
+ * back to back and without padding. Returns the number of bytes copied, 0 at the end of the transfer.
+ * Blocks dropped from flash while the transfer runs are skipped. The block being filled is sent as it was
+ * when the transfer got to it, without the slot being collected. It shares the snapshot with
+ * history_log_query(), so no query may run before that block is read to the end. */
+uint16_t history_log_read(history_log_cursor_t * p_cursor, uint8_t * p_buf, uint16_t len);
+
+#endif // HISTORY_LOG_H__
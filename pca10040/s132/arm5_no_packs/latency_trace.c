@@ -0,0 +1,149 @@
+#include "latency_trace.h"
+#include <stddef.h>
+#include <string.h>
+
+#define INFLIGHT_MASK               (LATENCY_TRACE_INFLIGHT - 1)
+
+/* A notification waiting for TX complete. */
+typedef struct
+{
+    bool     tracked;                   /**< Stamps are valid, false for notifications outside the pipeline. */
+    uint32_t done_us;
+    uint32_t hvx_us;
+} inflight_t;
+
+static latency_stage_stats_t    m_stats[LATENCY_STAGE_COUNT];
+static inflight_t               m_inflight[LATENCY_TRACE_INFLIGHT];
+static uint32_t                 m_head;                                 /**< Free-running count of entered notifications. */
+static uint32_t                 m_tail;                                 /**< Free-running count of completed notifications. */
+static uint32_t                 m_overflows;
+
+
+void latency_trace_init(void)
+{
+    memset(m_stats, 0, sizeof(m_stats));
+    m_head      = 0;
+    m_tail      = 0;
+    m_overflows = 0;
+}
+
+static void record(latency_stage_t stage, uint32_t latency_us)
+{
+    latency_stage_stats_t * p_stats = &m_stats[stage];
+    uint32_t                bin = 0;
+    uint32_t                value = latency_us;
+
+    while ((value > 1) && (bin < LATENCY_HIST_BINS - 1))
+    {
+        value >>= 1;
+        bin++;
+    }
+
+    p_stats->count++;
+    p_stats->sum += latency_us;
+    if (latency_us > p_stats->max)
+    {
+        p_stats->max = latency_us;
+    }
+    p_stats->hist[bin]++;
+}
+
+static void inflight_add(bool tracked, uint32_t done_us, uint32_t hvx_us)
+{
+    inflight_t * p_entry;
+
+    if (m_head - m_tail >= LATENCY_TRACE_INFLIGHT)
+    {
+        // The oldest entry is given up, so the FIFO stays in step with the SoftDevice.
+        m_overflows++;
+        m_tail++;
+    }
+
+    p_entry          = &m_inflight[m_head & INFLIGHT_MASK];
+    p_entry->tracked = tracked;
+    p_entry->done_us = done_us;
+    p_entry->hvx_us  = hvx_us;
+    m_head++;
+}
+
+void latency_trace_sent(uint32_t done_us, uint32_t filter_us, uint32_t hvx_us)
+{
+    record(LATENCY_STAGE_FILTER, filter_us - done_us);
+    record(LATENCY_STAGE_SEND,   hvx_us - filter_us);
+    inflight_add(true, done_us, hvx_us);
+}
+
+void latency_trace_untracked_sent(void)
+{
+    inflight_add(false, 0, 0);
+}
+
+void latency_trace_tx_complete(uint32_t count, uint32_t now_us)
+{
+    while ((count > 0) && (m_tail != m_head))
+    {
+        inflight_t const * p_entry = &m_inflight[m_tail & INFLIGHT_MASK];
+
+        if (p_entry->tracked)
+        {
+            record(LATENCY_STAGE_AIR,   now_us - p_entry->hvx_us);
+            record(LATENCY_STAGE_TOTAL, now_us - p_entry->done_us);
+        }
+        m_tail++;
+        count--;
+    }
+}
+
+void latency_trace_flush(void)
+{
+    m_tail = m_head;
+}
+
+void latency_trace_stats_get(latency_stage_t stage, latency_stage_stats_t * p_stats)
+{
+    if (stage < LATENCY_STAGE_COUNT)
+    {
+        *p_stats = m_stats[stage];
+    }
+}
+
+uint32_t latency_trace_overflows_get(void)
+{
+    return m_overflows;
+}
+
+/* Little endian, the SDK encoders are not available on the host. */
+static uint16_t u32_put(uint32_t value, uint8_t * p_buf)
+{
+    p_buf[0] = (uint8_t)value;
+    p_buf[1] = (uint8_t)(value >> 8);
+    p_buf[2] = (uint8_t)(value >> 16);
+    p_buf[3] = (uint8_t)(value >> 24);
+    return 4;
+}
+
+uint16_t latency_trace_encode(latency_stage_t stage, uint8_t * p_buf, uint16_t buf_len)
+{
+    latency_stage_stats_t const * p_stats;
+    uint16_t                      len = 0;
+    uint32_t                      i;
+
+    if ((stage >= LATENCY_STAGE_COUNT) || (p_buf == NULL) || (buf_len < LATENCY_ENCODED_LEN))
+    {
+        return 0;
+    }
+    p_stats = &m_stats[stage];
+
+    p_buf[len++] = (uint8_t)stage;
+    len += u32_put(p_stats->count, &p_buf[len]);
+    len += u32_put(p_stats->max, &p_buf[len]);
+    len += u32_put((p_stats->count > 0) ? (uint32_t)(p_stats->sum / p_stats->count) : 0, &p_buf[len]);
+
+    for (i = 0; i < LATENCY_HIST_BINS; i++)
+    {
+        uint32_t bin = (p_stats->hist[i] > UINT16_MAX) ? UINT16_MAX : p_stats->hist[i];
+        p_buf[len++] = (uint8_t)bin;
+        p_buf[len++] = (uint8_t)(bin >> 8);
+    }
+    return len;
+}
@@ -0,0 +1,66 @@
+#ifndef LATENCY_TRACE_H__
+#define LATENCY_TRACE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Sample-to-air latency of the reported values, broken down by stage.
+ *
+ * A value is stamped when its SAADC buffer completes (DONE), when the pipeline has filtered it (FILTER) and
+ * when sd_ble_gatts_hvx accepts the notification (HVX). Accepted notifications wait in a FIFO until
+ * BLE_EVT_TX_COMPLETE reports them sent, which gives the last stamp. Notifications not coming from the
+ * pipeline must be entered with latency_trace_untracked_sent() to keep the FIFO in step with the
+ * SoftDevice. The buffer is queued in the SAADC interrupt right after DONE, so DONE covers the enqueue.
+ *
+ * Time stamps are in microseconds from any clock that wraps at 2^32 (on the device app_time, so they
+ * have the RTC resolution of 30.5 us). The module has no SDK dependencies, the host replay uses it too. */
+
+#define LATENCY_TRACE_INFLIGHT      8                                   /**< Notifications tracked between HVX and TX complete. Must be a power of two. */
+#define LATENCY_HIST_BINS           20                                  /**< Bin n counts latencies in [2^n, 2^(n+1)) us, the last one everything above. */
+#define LATENCY_ENCODED_LEN         (13 + 2 * LATENCY_HIST_BINS)        /**< Size of a serialized stage (in bytes). */
+
+/* Stages of the breakdown. */
+typedef enum
+{
+    LATENCY_STAGE_FILTER,               /**< DONE to FILTER: wait in the ready queue and filtering. */
+    LATENCY_STAGE_SEND,                 /**< FILTER to HVX: detection and the call into the SoftDevice. */
+    LATENCY_STAGE_AIR,                  /**< HVX to TX complete: wait for a connection event and the ack. */
+    LATENCY_STAGE_TOTAL,                /**< DONE to TX complete. */
+    LATENCY_STAGE_COUNT
+} latency_stage_t;
+
+/* Counters of one stage. */
+typedef struct
+{
+    uint32_t count;
+    uint32_t max;
+    uint64_t sum;                       /**< Divide by count for the mean. */
+    uint32_t hist[LATENCY_HIST_BINS];
+} latency_stage_stats_t;
+
+/* Function for clearing the counters and the FIFO. */
+void latency_trace_init(void);
+
+/* Function for entering a notification of a pipeline value accepted by the SoftDevice. */
+void latency_trace_sent(uint32_t done_us, uint32_t filter_us, uint32_t hvx_us);
+
+/* Function for entering any other notification accepted by the SoftDevice. */
+void latency_trace_untracked_sent(void);
+
+/* Function for passing BLE_EVT_TX_COMPLETE. count is the number of notifications sent. */
+void latency_trace_tx_complete(uint32_t count, uint32_t now_us);
+
+/* Function for dropping the FIFO when the link goes down, queued notifications are discarded. */
+void latency_trace_flush(void);
+
+/* Function for reading the counters of a stage. */
+void latency_trace_stats_get(latency_stage_t stage, latency_stage_stats_t * p_stats);
+
+/* Returns the number of notifications that could not be tracked because the FIFO was full. */
+uint32_t latency_trace_overflows_get(void);
+
+/* Function for serializing a stage: id, count, max, mean (uint32 LE) and the histogram with bins
+ * saturated to uint16. Returns the number of bytes written, 0 if the buffer is too small. */
+uint16_t latency_trace_encode(latency_stage_t stage, uint8_t * p_buf, uint16_t buf_len);
+
+#endif // LATENCY_TRACE_H__
@@ -0,0 +1,227 @@
+#include "link_bench.h"
+#include <string.h>
+#include "sdk_common.h"
+#include "app_time.h"
+
+#define LINK_BENCH_FILLER           0xA5                                /**< Filler byte after the sequence number and time. */
+
+static ble_sdc_t              * mp_sdc;
+static volatile link_bench_state_t m_state = LINK_BENCH_STATE_IDLE;
+static volatile bool            m_fill_pending;                         /**< The TX buffers are to be refilled by the main loop. */
+static uint8_t                  m_duration_s;
+static uint64_t                 m_start_us;
+static uint64_t                 m_end_us;                               /**< Sending stops at this time. */
+static uint64_t                 m_last_ack_us;
+static uint32_t                 m_seq;                                  /**< Sequence number of the next payload. */
+static link_bench_link_t        m_links[BLE_SDC_MAX_LINKS];             /**< Results by entry of the service link table. */
+
+
+static bool link_is_subscribed(uint8_t link)
+{
+    return (mp_sdc->links[link].conn_handle != BLE_CONN_HANDLE_INVALID) && mp_sdc->links[link].is_notification_enabled;
+}
+
+/* Ends the benchmark once the notifications in flight are sent or their links gone. */
+static void drain_check(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < BLE_SDC_MAX_LINKS; i++)
+    {
+        if (link_is_subscribed(i) && (mp_sdc->links[i].tx_free < mp_sdc->links[i].tx_count))
+        {
+            return;
+        }
+    }
+    m_state = LINK_BENCH_STATE_DONE;
+}
+
+/* Sends payloads until the TX buffers of all subscribed links are full. */
+static void fill(void)
+{
+    uint8_t  data[SDC_FRAME_MAX_NOTIF_LEN];
+    uint8_t  payload[LINK_BENCH_PAYLOAD_LEN];
+    uint16_t len;
+    uint8_t  links;
+    uint8_t  i;
+    uint32_t err_code;
+    uint64_t now = app_time_us_get();
+
+    if (now >= m_end_us)
+    {
+        m_state = LINK_BENCH_STATE_DRAINING;
+        drain_check();
+        return;
+    }
+
+    memset(payload, LINK_BENCH_FILLER, sizeof(payload));
+    (void)uint32_encode((uint32_t)now, &payload[4]);
+
+    do
+    {
+        (void)uint32_encode(m_seq, &payload[0]);
+        len      = sdc_frame_encode(SDC_STREAM_BENCH, (uint8_t)m_seq, payload, sizeof(payload), data);
+        err_code = ble_sdc_data_send(mp_sdc, data, len, &links);
+
+        for (i = 0; i < BLE_SDC_MAX_LINKS; i++)
+        {
+            if ((links & (1 << i)) != 0)
+            {
+                m_links[i].conn_handle = mp_sdc->links[i].conn_handle;
+                m_links[i].sent++;
+            }
+            else if (link_is_subscribed(i))
+            {
+                m_links[i].stalls++;
+            }
+        }
+        if (err_code == NRF_SUCCESS)
+        {
+            m_seq++;
+        }
+    } while (err_code == NRF_SUCCESS);
+
+    if (err_code != BLE_ERROR_NO_TX_PACKETS)
+    {
+        // Nobody left to send to.
+        m_state = LINK_BENCH_STATE_DONE;
+    }
+}
+
+uint32_t link_bench_start(ble_sdc_t * p_sdc, uint8_t duration_s)
+{
+    VERIFY_PARAM_NOT_NULL(p_sdc);
+
+    if (duration_s == 0)
+    {
+        if (m_state == LINK_BENCH_STATE_RUNNING)
+        {
+            m_state = LINK_BENCH_STATE_DRAINING;
+            drain_check();
+        }
+        return NRF_SUCCESS;
+    }
+    if (duration_s > LINK_BENCH_MAX_S)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (ble_sdc_subscriber_count(p_sdc) == 0)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    mp_sdc        = p_sdc;
+    m_duration_s  = duration_s;
+    m_seq         = 0;
+    m_start_us    = app_time_us_get();
+    m_end_us      = m_start_us + duration_s * 1000000ULL;
+    m_last_ack_us = m_start_us;
+    memset(m_links, 0, sizeof(m_links));
+    m_state       = LINK_BENCH_STATE_RUNNING;
+
+    // Filled by the main loop, as after TX complete.
+    m_fill_pending = true;
+    return NRF_SUCCESS;
+}
+
+void link_bench_on_ble_evt(ble_evt_t * p_ble_evt)
+{
+    uint8_t  link;
+    uint32_t count;
+
+    if ((m_state != LINK_BENCH_STATE_RUNNING) && (m_state != LINK_BENCH_STATE_DRAINING))
+    {
+        return;
+    }
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_EVT_TX_COMPLETE:
+            link  = ble_sdc_link_find(mp_sdc, p_ble_evt->evt.common_evt.conn_handle);
+            count = p_ble_evt->evt.common_evt.params.tx_complete.count;
+            if ((link != BLE_SDC_LINK_NONE) && (count > 0))
+            {
+                m_links[link].acked += count;
+                m_links[link].conn_events++;
+                m_links[link].hist[MIN(count, LINK_BENCH_HIST_BINS) - 1]++;
+                m_links[link].max_per_event = (uint8_t)MAX(m_links[link].max_per_event, MIN(count, UINT8_MAX));
+                m_last_ack_us = app_time_us_get();
+            }
+            if (m_state == LINK_BENCH_STATE_RUNNING)
+            {
+                m_fill_pending = true;
+            }
+            else
+            {
+                drain_check();
+            }
+            break;
+
+        case BLE_GAP_EVT_DISCONNECTED:
+            // No TX complete comes for the notifications of a lost link.
+            if (ble_sdc_subscriber_count(mp_sdc) == 0)
+            {
+                m_state = LINK_BENCH_STATE_DONE;
+            }
+            else if (m_state == LINK_BENCH_STATE_DRAINING)
+            {
+                drain_check();
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+void link_bench_process(void)
+{
+    if (!m_fill_pending)
+    {
+        return;
+    }
+    m_fill_pending = false;
+    if (m_state == LINK_BENCH_STATE_RUNNING)
+    {
+        fill();
+    }
+}
+
+link_bench_state_t link_bench_state(void)
+{
+    return m_state;
+}
+
+link_bench_link_t const * link_bench_link_get(uint8_t link)
+{
+    return (link < BLE_SDC_MAX_LINKS) ? &m_links[link] : NULL;
+}
+
+uint16_t link_bench_encode(uint8_t link, uint8_t * p_buf, uint16_t buf_len)
+{
+    uint16_t                  len = 0;
+    uint8_t                   i;
+    link_bench_link_t const * p_link = link_bench_link_get(link);
+
+    if ((p_buf == NULL) || (buf_len < LINK_BENCH_ENCODED_LEN) || (p_link == NULL))
+    {
+        return 0;
+    }
+
+    p_buf[len++] = (uint8_t)m_state;
+    p_buf[len++] = m_duration_s;
+    len += uint32_encode((uint32_t)((m_last_ack_us - m_start_us) / 1000), &p_buf[len]);
+    p_buf[len++] = LINK_BENCH_PAYLOAD_LEN;
+    len += uint16_encode(p_link->conn_handle, &p_buf[len]);
+    len += uint32_encode(p_link->sent,        &p_buf[len]);
+    len += uint32_encode(p_link->acked,       &p_buf[len]);
+    len += uint32_encode(p_link->stalls,      &p_buf[len]);
+    len += uint32_encode(p_link->conn_events, &p_buf[len]);
+    p_buf[len++] = p_link->max_per_event;
+    for (i = 0; i < LINK_BENCH_HIST_BINS; i++)
+    {
+        len += uint16_encode((uint16_t)MIN(p_link->hist[i], UINT16_MAX), &p_buf[len]);
+    }
+
+    return len;
+}
@@ -0,0 +1,73 @@
+#ifndef LINK_BENCH_H__
+#define LINK_BENCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+#include "ble_sensor_data_custom.h"
+#include "sdc_frame.h"
+
+/* Link throughput benchmark.
+ *
+ * Keeps the TX buffers of every subscribed link full of SDC_STREAM_BENCH frames for a given time, refilling
+ * them on each TX complete, and counts per link what the central took: notifications sent, TX buffer stalls
+ * (sends that found its buffers full) and the packets of each TX complete
+ * event, which the SoftDevice reports once per connection event that sent packets. The frames carry a 32-bit
+ * sequence number and the send time, so the client can measure the same from its side. Every payload goes to
+ * all links with room for it, so with several links one that is full skips the sequence numbers the others
+ * take while it stalls.
+ *
+ * The benchmark sends next to the frame queues. TX complete only marks the buffers to be refilled, the main
+ * loop refills them with link_bench_process() after it has sent the queued frames, so values and events
+ * still go first. Once the time is up the notifications in flight are waited for and the result stays
+ * available until the next start. */
+
+#define LINK_BENCH_MAX_S            60                                  /**< Longest benchmark (in seconds). */
+#define LINK_BENCH_HIST_BINS        8                                   /**< Bin n counts connection events with n + 1 packets, the last one everything above. */
+#define LINK_BENCH_PAYLOAD_LEN      SDC_FRAME_MAX_PAYLOAD               /**< Bench payload per notification (in bytes). */
+#define LINK_BENCH_ENCODED_LEN      (7 + 19 + 2 * LINK_BENCH_HIST_BINS) /**< Size of a serialized result (in bytes). */
+
+typedef enum
+{
+    LINK_BENCH_STATE_IDLE,              /**< Never started. */
+    LINK_BENCH_STATE_RUNNING,           /**< Filling the TX buffers. */
+    LINK_BENCH_STATE_DRAINING,          /**< Time is up, waiting for the notifications in flight. */
+    LINK_BENCH_STATE_DONE
+} link_bench_state_t;
+
+/* Result of one link. */
+typedef struct
+{
+    uint16_t conn_handle;
+    uint32_t sent;                      /**< Notifications queued on the link. */
+    uint32_t acked;                     /**< Notifications reported sent by TX complete, values sent meanwhile included. */
+    uint32_t stalls;                    /**< Sends that found the TX buffers of the link full. */
+    uint32_t conn_events;               /**< TX complete events. */
+    uint8_t  max_per_event;             /**< Most packets in one connection event. */
+    uint16_t hist[LINK_BENCH_HIST_BINS];/**< Connection events by packets sent. */
+} link_bench_link_t;
+
+/* Function for starting a benchmark of duration_s seconds (1 to LINK_BENCH_MAX_S) on the subscribed links of
+ * the service, or stopping the running one with 0. Returns NRF_ERROR_INVALID_STATE if nobody is subscribed. */
+uint32_t link_bench_start(ble_sdc_t * p_sdc, uint8_t duration_s);
+
+/* Function for passing BLE events, after the service has seen them. */
+void link_bench_on_ble_evt(ble_evt_t * p_ble_evt);
+
+/* Function for refilling the TX buffers after a start or TX complete. Called by the main loop, after the frame
+ * queues have been sent. */
+void link_bench_process(void);
+
+/* Returns the state of the benchmark. */
+link_bench_state_t link_bench_state(void);
+
+/* Returns the result of the link in the given entry of the service link table. */
+link_bench_link_t const * link_bench_link_get(uint8_t link);
+
+/* Function for serializing the result of one link: state, duration_s, elapsed time in ms (uint32 LE, first
+ * send to last TX complete), payload length, then the connection handle (uint16 LE), sent, acked, stalls,
+ * connection events (uint32 LE), max packets per event and the histogram (uint16 LE, saturated). Returns
+ * the number of bytes written, 0 if the buffer is too small or the link does not exist. */
+uint16_t link_bench_encode(uint8_t link, uint8_t * p_buf, uint16_t buf_len);
+
+#endif // LINK_BENCH_H__
@@ -0,0 +1,366 @@
+#include "power_mgr.h"
+#include <string.h>
+#include "sdk_common.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_config.h"
+#include "app_time.h"
+
+#define POWER_MGR_DEEP_IDLE         APP_TIMER_TICKS(POWER_MGR_DEEP_IDLE_MS, APP_TIMER_PRESCALER)   /**< Deep idle time (in ticks). */
+#define POWER_MGR_CHECK_INTERVAL    APP_TIMER_TICKS(POWER_MGR_CHECK_INTERVAL_MS, APP_TIMER_PRESCALER) /**< Presence check interval (in ticks). */
+#define POWER_MGR_ENCODED_LEN       (1 + POWER_STATE_COUNT * 6)                                     /**< Size of power_mgr_encode() output (in bytes). */
+#define NO_TRANSITION               POWER_STATE_COUNT
+
+/* Resources switched on in a state. */
+typedef struct
+{
+    bool sensor_power;
+    bool sampling;
+    bool advertising;
+} power_state_resources_t;
+
+static const power_state_resources_t m_state_resources[POWER_STATE_COUNT] =
+{
+    [POWER_STATE_DEEP_IDLE]      = {false, false, false},
+    [POWER_STATE_ADVERTISING]    = {false, false, true },
+    [POWER_STATE_CONNECTED_IDLE] = {true,  false, false},
+    [POWER_STATE_SAMPLING]       = {true,  true,  false},
+    [POWER_STATE_BULK_TRANSFER]  = {true,  false, false},
+};
+
+/* Next state for each state and event, NO_TRANSITION if the event is ignored in the state. */
+static const uint8_t m_transitions[POWER_STATE_COUNT][POWER_EVT_COUNT] =
+{
+    [POWER_STATE_DEEP_IDLE] =
+    {
+        [POWER_EVT_ADV_TIMEOUT]     = NO_TRANSITION,
+        [POWER_EVT_IDLE_TIMEOUT]    = POWER_STATE_ADVERTISING,
+        [POWER_EVT_CONNECTED]       = NO_TRANSITION,
+        [POWER_EVT_DISCONNECTED]    = NO_TRANSITION,
+        [POWER_EVT_NOTIFY_ENABLED]  = NO_TRANSITION,
+        [POWER_EVT_NOTIFY_DISABLED] = NO_TRANSITION,
+        [POWER_EVT_BULK_START]      = NO_TRANSITION,
+        [POWER_EVT_BULK_END]        = NO_TRANSITION,
+        [POWER_EVT_WAKE]            = POWER_STATE_ADVERTISING,
+    },
+    [POWER_STATE_ADVERTISING] =
+    {
+        [POWER_EVT_ADV_TIMEOUT]     = POWER_STATE_DEEP_IDLE,
+        [POWER_EVT_IDLE_TIMEOUT]    = NO_TRANSITION,
+        [POWER_EVT_CONNECTED]       = POWER_STATE_CONNECTED_IDLE,
+        [POWER_EVT_DISCONNECTED]    = NO_TRANSITION,
+        [POWER_EVT_NOTIFY_ENABLED]  = NO_TRANSITION,
+        [POWER_EVT_NOTIFY_DISABLED] = NO_TRANSITION,
+        [POWER_EVT_BULK_START]      = NO_TRANSITION,
+        [POWER_EVT_BULK_END]        = NO_TRANSITION,
+        [POWER_EVT_WAKE]            = NO_TRANSITION,
+    },
+    [POWER_STATE_CONNECTED_IDLE] =
+    {
+        [POWER_EVT_ADV_TIMEOUT]     = NO_TRANSITION,
+        [POWER_EVT_IDLE_TIMEOUT]    = NO_TRANSITION,
+        [POWER_EVT_CONNECTED]       = NO_TRANSITION,
+        [POWER_EVT_DISCONNECTED]    = POWER_STATE_ADVERTISING,
+        [POWER_EVT_NOTIFY_ENABLED]  = POWER_STATE_SAMPLING,
+        [POWER_EVT_NOTIFY_DISABLED] = NO_TRANSITION,
+        [POWER_EVT_BULK_START]      = POWER_STATE_BULK_TRANSFER,
+        [POWER_EVT_BULK_END]        = NO_TRANSITION,
+        [POWER_EVT_WAKE]            = NO_TRANSITION,
+    },
+    [POWER_STATE_SAMPLING] =
+    {
+        [POWER_EVT_ADV_TIMEOUT]     = NO_TRANSITION,
+        [POWER_EVT_IDLE_TIMEOUT]    = NO_TRANSITION,
+        [POWER_EVT_CONNECTED]       = NO_TRANSITION,
+        [POWER_EVT_DISCONNECTED]    = POWER_STATE_ADVERTISING,
+        [POWER_EVT_NOTIFY_ENABLED]  = NO_TRANSITION,
+        [POWER_EVT_NOTIFY_DISABLED] = POWER_STATE_CONNECTED_IDLE,
+        [POWER_EVT_BULK_START]      = POWER_STATE_BULK_TRANSFER,
+        [POWER_EVT_BULK_END]        = NO_TRANSITION,
+        [POWER_EVT_WAKE]            = NO_TRANSITION,
+    },
+    [POWER_STATE_BULK_TRANSFER] =
+    {
+        [POWER_EVT_ADV_TIMEOUT]     = NO_TRANSITION,
+        [POWER_EVT_IDLE_TIMEOUT]    = NO_TRANSITION,
+        [POWER_EVT_CONNECTED]       = NO_TRANSITION,
+        [POWER_EVT_DISCONNECTED]    = POWER_STATE_ADVERTISING,
+        [POWER_EVT_NOTIFY_ENABLED]  = NO_TRANSITION,
+        [POWER_EVT_NOTIFY_DISABLED] = NO_TRANSITION,
+        [POWER_EVT_BULK_START]      = NO_TRANSITION,
+        [POWER_EVT_BULK_END]        = POWER_STATE_CONNECTED_IDLE,  // Replaced by the state the transfer interrupted.
+        [POWER_EVT_WAKE]            = NO_TRANSITION,
+    },
+};
+
+static power_mgr_resources_t    m_resources;
+static power_state_t            m_state;
+static power_state_t            m_bulk_return_state;                    /**< State to go back to when the bulk transfer ends. */
+static uint64_t                 m_state_entered_ms;                     /**< app_time when the current state was entered. */
+static uint64_t                 m_time_in_state[POWER_STATE_COUNT];     /**< Time in each state, the current stay excluded (in ms). */
+static uint32_t                 m_entry_count[POWER_STATE_COUNT];
+static uint32_t                 m_ignored_evts;
+static bool                     m_check_active;                         /**< A presence check is laid over the current state. */
+static uint64_t                 m_check_started_ms;                     /**< app_time when the running check started. */
+static uint64_t                 m_check_time_ms;                        /**< Time in presence checks, the running one excluded (in ms). */
+APP_TIMER_DEF(m_idle_timer_id);                                         /**< Ends deep idle. */
+APP_TIMER_DEF(m_check_timer_id);                                        /**< Starts presence checks. */
+APP_TIMER_DEF(m_check_end_timer_id);                                    /**< Ends the running presence check. */
+
+
+/* Returns the resources in use in a state, with or without a presence check laid over it. */
+static power_state_resources_t state_resources(power_state_t state, bool check)
+{
+    power_state_resources_t resources = m_state_resources[state];
+
+    if (check)
+    {
+        resources.sensor_power = true;
+        resources.sampling     = true;
+    }
+    return resources;
+}
+
+/* Switches the sensor resources that differ between two sets. */
+static void resources_apply(power_state_resources_t const * p_from, power_state_resources_t const * p_to)
+{
+    // Stop first, then start, so two states never overlap.
+    if (p_from->sampling && !p_to->sampling)
+    {
+        m_resources.sampling_set(false);
+    }
+    if (p_from->sensor_power && !p_to->sensor_power)
+    {
+        m_resources.sensor_power_set(false);
+    }
+
+    if (!p_from->sensor_power && p_to->sensor_power)
+    {
+        m_resources.sensor_power_set(true);
+    }
+    if (!p_from->sampling && p_to->sampling)
+    {
+        m_resources.sampling_set(true);
+    }
+}
+
+/* Ends the running presence check. With switch_off the sensor resources go back to those of the state. */
+static void check_end(uint64_t now, bool switch_off)
+{
+    power_state_resources_t from = state_resources(m_state, true);
+    power_state_resources_t to   = state_resources(m_state, false);
+
+    if (switch_off)
+    {
+        resources_apply(&from, &to);
+    }
+    m_check_time_ms += now - m_check_started_ms;
+    m_check_active   = false;
+}
+
+/* Handler for the presence check timer. Checks only run in states that leave the sensor off. */
+static void check_timeout_handler(void * p_context)
+{
+    uint32_t                err_code;
+    uint32_t                check_ms;
+    power_state_resources_t from = state_resources(m_state, false);
+    power_state_resources_t to   = state_resources(m_state, true);
+
+    UNUSED_PARAMETER(p_context);
+
+    if (m_check_active || from.sensor_power)
+    {
+        return;
+    }
+
+    m_check_active     = true;
+    m_check_started_ms = app_time_ms_get();
+    resources_apply(&from, &to);
+
+    // One buffer at the configured sampling rate.
+    check_ms = (uint32_t)m_app_config.samples_in_buffer * m_app_config.sample_period_ms + POWER_MGR_CHECK_MARGIN_MS;
+    err_code = app_timer_start(m_check_end_timer_id, APP_TIMER_TICKS(check_ms, APP_TIMER_PRESCALER), NULL);
+    APP_ERROR_CHECK(err_code);
+}
+
+/* Handler for the end of a presence check. */
+static void check_end_timeout_handler(void * p_context)
+{
+    UNUSED_PARAMETER(p_context);
+
+    if (!m_check_active)
+    {
+        return;
+    }
+    check_end(app_time_ms_get(), true);
+    if (m_resources.check_done != NULL)
+    {
+        m_resources.check_done();
+    }
+}
+
+/* Handler for the deep idle timer. */
+static void idle_timeout_handler(void * p_context)
+{
+    UNUSED_PARAMETER(p_context);
+    power_mgr_on_evt(POWER_EVT_IDLE_TIMEOUT);
+}
+
+uint32_t power_mgr_init(power_mgr_resources_t const * p_resources)
+{
+    uint32_t err_code;
+
+    VERIFY_PARAM_NOT_NULL(p_resources);
+
+    m_resources        = *p_resources;
+    m_state            = POWER_STATE_ADVERTISING;
+    m_state_entered_ms = app_time_ms_get();
+    m_entry_count[m_state]++;
+
+    err_code = app_timer_create(&m_idle_timer_id, APP_TIMER_MODE_SINGLE_SHOT, idle_timeout_handler);
+    VERIFY_SUCCESS(err_code);
+    err_code = app_timer_create(&m_check_end_timer_id, APP_TIMER_MODE_SINGLE_SHOT, check_end_timeout_handler);
+    VERIFY_SUCCESS(err_code);
+    err_code = app_timer_create(&m_check_timer_id, APP_TIMER_MODE_REPEATED, check_timeout_handler);
+    VERIFY_SUCCESS(err_code);
+
+    return app_timer_start(m_check_timer_id, POWER_MGR_CHECK_INTERVAL, NULL);
+}
+
+void power_mgr_on_evt(power_evt_t evt)
+{
+    uint32_t                err_code;
+    uint64_t                now;
+    power_state_t           next;
+    bool                    check_after;
+    power_state_resources_t from;
+    power_state_resources_t to;
+
+    if (evt >= POWER_EVT_COUNT)
+    {
+        return;
+    }
+
+    if ((m_state == POWER_STATE_BULK_TRANSFER)
+        && ((evt == POWER_EVT_NOTIFY_ENABLED) || (evt == POWER_EVT_NOTIFY_DISABLED)))
+    {
+        m_bulk_return_state = (evt == POWER_EVT_NOTIFY_ENABLED) ? POWER_STATE_SAMPLING : POWER_STATE_CONNECTED_IDLE;
+        return;
+    }
+
+    next = (power_state_t)m_transitions[m_state][evt];
+    if (next == NO_TRANSITION)
+    {
+        m_ignored_evts++;
+        return;
+    }
+    if ((m_state == POWER_STATE_BULK_TRANSFER) && (evt == POWER_EVT_BULK_END))
+    {
+        next = m_bulk_return_state;
+    }
+    if (next == POWER_STATE_BULK_TRANSFER)
+    {
+        m_bulk_return_state = m_state;
+    }
+
+    now = app_time_ms_get();
+    m_time_in_state[m_state] += now - m_state_entered_ms;
+    m_state_entered_ms        = now;
+    m_entry_count[next]++;
+
+    // A running check goes on unless the new state powers the sensor itself.
+    check_after = m_check_active && !m_state_resources[next].sensor_power;
+    from        = state_resources(m_state, m_check_active);
+    to          = state_resources(next, check_after);
+    if (m_check_active && !check_after)
+    {
+        (void)app_timer_stop(m_check_end_timer_id);
+        check_end(now, false);
+    }
+    if ((m_state == POWER_STATE_DEEP_IDLE) && (evt != POWER_EVT_IDLE_TIMEOUT))
+    {
+        (void)app_timer_stop(m_idle_timer_id);
+    }
+
+    resources_apply(&from, &to);
+    // After a disconnect adv_ctrl restarts advertising itself.
+    if ((m_state == POWER_STATE_DEEP_IDLE) && to.advertising)
+    {
+        err_code = m_resources.advertising_start();
+        APP_ERROR_CHECK(err_code);
+    }
+    m_state = next;
+
+    if (m_state == POWER_STATE_DEEP_IDLE)
+    {
+        err_code = app_timer_start(m_idle_timer_id, POWER_MGR_DEEP_IDLE, NULL);
+        APP_ERROR_CHECK(err_code);
+    }
+}
+
+power_state_t power_mgr_state_get(void)
+{
+    return m_state;
+}
+
+uint64_t power_mgr_time_in_state_get(power_state_t state)
+{
+    uint64_t time;
+
+    if (state >= POWER_STATE_COUNT)
+    {
+        return 0;
+    }
+
+    time = m_time_in_state[state];
+    if (state == m_state)
+    {
+        time += app_time_ms_get() - m_state_entered_ms;
+    }
+    return time;
+}
+
+uint32_t power_mgr_entry_count_get(power_state_t state)
+{
+    return (state < POWER_STATE_COUNT) ? m_entry_count[state] : 0;
+}
+
+uint32_t power_mgr_ignored_evt_count_get(void)
+{
+    return m_ignored_evts;
+}
+
+bool power_mgr_check_active(void)
+{
+    return m_check_active;
+}
+
+uint64_t power_mgr_check_time_get(void)
+{
+    uint64_t time = m_check_time_ms;
+
+    if (m_check_active)
+    {
+        time += app_time_ms_get() - m_check_started_ms;
+    }
+    return time;
+}
+
+uint16_t power_mgr_encode(uint8_t * p_buf, uint16_t buf_len)
+{
+    uint16_t len = 0;
+    uint8_t  state;
+
+    if ((p_buf == NULL) || (buf_len < POWER_MGR_ENCODED_LEN))
+    {
+        return 0;
+    }
+
+    p_buf[len++] = m_state;
+    for (state = 0; state < POWER_STATE_COUNT; state++)
+    {
+        len += uint32_encode((uint32_t)(power_mgr_time_in_state_get((power_state_t)state) / 1000), &p_buf[len]);
+        len += uint16_encode((uint16_t)MIN(m_entry_count[state], UINT16_MAX), &p_buf[len]);
+    }
+    return len;
+}
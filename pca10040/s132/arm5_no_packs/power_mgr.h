@@ -0,0 +1,90 @@
+#ifndef POWER_MGR_H__
+#define POWER_MGR_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Application power state machine.
+ *
+ * The power manager is the only place that switches the sensor supply, the sampling chain (TIMER1, PPI and
+ * SAADC) and advertising on or off. Each state has a fixed set of resources, given by a const table, and
+ * the allowed transitions are given by a second table. Events without a transition from the current state
+ * are counted and ignored.
+ *
+ * Events must be raised from one interrupt priority (APP_IRQ_PRIORITY_LOW: SoftDevice events and app_timer),
+ * or from the main loop inside a critical region. Subscriptions changing during a bulk transfer set the state
+ * it returns to.
+ * Time spent in each state is accumulated for the battery life estimate.
+ *
+ * In the states without sensor supply the sensor is powered and sampled for one buffer every
+ * POWER_MGR_CHECK_INTERVAL_MS, so occupancy changes are seen while no client is connected. A presence check
+ * is laid over the state and does not change it. It ends when the buffer is due, or when the state changes
+ * to one that powers the sensor. */
+
+#define POWER_MGR_DEEP_IDLE_MS      60000                               /**< Time without advertising after an advertising timeout. */
+#define POWER_MGR_CHECK_INTERVAL_MS 30000                               /**< Time between presence checks while the sensor is off. */
+#define POWER_MGR_CHECK_MARGIN_MS   20                                  /**< Added to the time of one sample buffer for the length of a check. */
+
+typedef enum
+{
+    POWER_STATE_DEEP_IDLE,              /**< Nothing running, waiting for the deep idle timer. */
+    POWER_STATE_ADVERTISING,            /**< Advertising, sensor off. */
+    POWER_STATE_CONNECTED_IDLE,         /**< Connected, sensor powered, not sampling. */
+    POWER_STATE_SAMPLING,               /**< Connected, notifications enabled, sampling. */
+    POWER_STATE_BULK_TRANSFER,          /**< Connected, sending bulk data, sampling paused. */
+    POWER_STATE_COUNT
+} power_state_t;
+
+typedef enum
+{
+    POWER_EVT_ADV_TIMEOUT,              /**< Advertising stopped without a connection. */
+    POWER_EVT_IDLE_TIMEOUT,             /**< Deep idle timer expired. Raised internally. */
+    POWER_EVT_CONNECTED,
+    POWER_EVT_DISCONNECTED,
+    POWER_EVT_NOTIFY_ENABLED,           /**< The client enabled notifications of sensor data. */
+    POWER_EVT_NOTIFY_DISABLED,
+    POWER_EVT_BULK_START,
+    POWER_EVT_BULK_END,
+    POWER_EVT_WAKE,                     /**< Ends deep idle early, the occupancy changed. */
+    POWER_EVT_COUNT
+} power_evt_t;
+
+/* Functions switching the resources owned by the power manager. Implemented by the application. */
+typedef struct
+{
+    void     (*sensor_power_set)(bool on);      /**< Sensor supply. */
+    void     (*sampling_set)(bool on);          /**< TIMER1, PPI channel and SAADC sampling. */
+    uint32_t (*advertising_start)(void);        /**< Starts advertising. Stopping is done by connecting or timing out. */
+    void     (*check_done)(void);               /**< Called when a presence check ends on time. May be NULL. */
+} power_mgr_resources_t;
+
+/* Function for initializing the power manager in POWER_STATE_ADVERTISING. Advertising itself is started by
+ * the application at the end of its initialization. */
+uint32_t power_mgr_init(power_mgr_resources_t const * p_resources);
+
+/* Function for raising an event. */
+void power_mgr_on_evt(power_evt_t evt);
+
+/* Returns the current state. */
+power_state_t power_mgr_state_get(void);
+
+/* Returns the time spent in a state since power_mgr_init(), the current stay included (in ms). */
+uint64_t power_mgr_time_in_state_get(power_state_t state);
+
+/* Returns the number of times a state has been entered. */
+uint32_t power_mgr_entry_count_get(power_state_t state);
+
+/* Returns the number of events ignored because they have no transition from the state they came in. */
+uint32_t power_mgr_ignored_evt_count_get(void);
+
+/* Returns true while a presence check is running. */
+bool power_mgr_check_active(void);
+
+/* Returns the time spent in presence checks since power_mgr_init(), the current one included (in ms). */
+uint64_t power_mgr_check_time_get(void);
+
+/* Function for serializing the state and counters: state, then per state the time (in s, uint32 LE) and the
+ * number of entries (uint16 LE). Returns the number of bytes written, 0 if the buffer is too small. */
+uint16_t power_mgr_encode(uint8_t * p_buf, uint16_t buf_len);
+
+#endif // POWER_MGR_H__
@@ -0,0 +1,86 @@
+#include "ram_usage.h"
+#include "sdk_common.h"
+#include "nrf.h"
+
+#if defined(__CC_ARM)
+extern uint32_t Image$$RW_IRAM1$$Base;
+extern uint32_t Image$$RW_IRAM1$$ZI$$Limit;
+extern uint32_t __initial_sp;
+#define RAM_START                   ((uint32_t)(uintptr_t)&Image$$RW_IRAM1$$Base)
+#define STATIC_END                  ((uint32_t)(uintptr_t)&Image$$RW_IRAM1$$ZI$$Limit)
+#define STACK_TOP                   ((uint32_t)(uintptr_t)&__initial_sp)
+#define STACK_LIMIT                 (STACK_TOP - RAM_USAGE_STACK_SIZE)
+#elif defined(__GNUC__)
+extern uint32_t __app_ram_start__;
+extern uint32_t __bss_end__;
+extern uint32_t __StackTop;
+extern uint32_t __StackLimit;
+#define RAM_START                   ((uint32_t)(uintptr_t)&__app_ram_start__)
+#define STATIC_END                  ((uint32_t)(uintptr_t)&__bss_end__)
+#define STACK_TOP                   ((uint32_t)(uintptr_t)&__StackTop)
+#define STACK_LIMIT                 ((uint32_t)(uintptr_t)&__StackLimit)
+#endif
+
+static uint32_t                 m_sd_ram_start;
+
+
+void ram_usage_init(void)
+{
+    volatile uint32_t * p_word = (volatile uint32_t *)(uintptr_t)STACK_LIMIT;
+    volatile uint32_t * p_end  = (volatile uint32_t *)(uintptr_t)(__get_MSP() - RAM_USAGE_PAINT_MARGIN);
+
+    while (p_word < p_end)
+    {
+        *p_word++ = RAM_USAGE_PAINT;
+    }
+}
+
+uint32_t ram_usage_app_ram_start(void)
+{
+    return RAM_START;
+}
+
+void ram_usage_sd_ram_start_set(uint32_t ram_start)
+{
+    m_sd_ram_start = ram_start;
+}
+
+uint32_t ram_usage_sd_ram_start(void)
+{
+    return m_sd_ram_start;
+}
+
+uint32_t ram_usage_stack_size(void)
+{
+    return STACK_TOP - STACK_LIMIT;
+}
+
+uint32_t ram_usage_stack_high_water(void)
+{
+    uint32_t const * p_word = (uint32_t const *)(uintptr_t)STACK_LIMIT;
+    uint32_t const * p_top  = (uint32_t const *)(uintptr_t)STACK_TOP;
+
+    while ((p_word < p_top) && (*p_word == RAM_USAGE_PAINT))
+    {
+        p_word++;
+    }
+    return STACK_TOP - (uint32_t)(uintptr_t)p_word;
+}
+
+uint16_t ram_usage_encode(uint8_t * p_buf, uint16_t buf_len)
+{
+    uint16_t len = 0;
+
+    if ((p_buf == NULL) || (buf_len < RAM_USAGE_ENCODED_LEN))
+    {
+        return 0;
+    }
+
+    len += uint32_encode(RAM_START,                    &p_buf[len]);
+    len += uint32_encode(m_sd_ram_start,               &p_buf[len]);
+    len += uint32_encode(STATIC_END,                   &p_buf[len]);
+    len += uint32_encode(ram_usage_stack_size(),       &p_buf[len]);
+    len += uint32_encode(ram_usage_stack_high_water(), &p_buf[len]);
+    len += uint32_encode((STACK_LIMIT > STATIC_END) ? (STACK_LIMIT - STATIC_END) : 0, &p_buf[len]);
+    return len;
+}
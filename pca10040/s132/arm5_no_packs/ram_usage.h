@@ -0,0 +1,49 @@
+#ifndef RAM_USAGE_H__
+#define RAM_USAGE_H__
+
+#include <stdint.h>
+
+/* RAM layout and stack high-water mark.
+ *
+ * ram_usage_init() paints the free part of the stack with RAM_USAGE_PAINT, the deepest word no longer
+ * holding the pattern gives the stack high-water mark. The SoftDevice reports the lowest application RAM
+ * start it can work with for the enabled configuration (links, MTU, vendor UUIDs, attribute table) from
+ * sd_ble_enable(). That value is kept for the diagnostics page and fed to host/ram_layout, which moves the
+ * RAM start of the linker script and the Keil project to it.
+ *
+ * GCC takes the RAM start from ble_app_uart_gcc_nrf52.ld and the stack and static data bounds from
+ * nrf5x_common.ld. With the ARM compiler (MicroLIB exports __initial_sp) RAM_USAGE_STACK_SIZE must match
+ * Stack_Size of the startup file. */
+
+#define RAM_USAGE_PAINT             0xCDCDCDCD                          /**< Pattern of unused stack. */
+#define RAM_USAGE_PAINT_MARGIN      64                                  /**< Bytes below the stack pointer left unpainted (the frame of ram_usage_init()). */
+#define RAM_USAGE_ENCODED_LEN       24                                  /**< Size of ram_usage_encode() output (in bytes). */
+
+#ifndef RAM_USAGE_STACK_SIZE
+#define RAM_USAGE_STACK_SIZE        2048                                /**< Stack size with the ARM compiler, Stack_Size in arm_startup_nrf52.s. */
+#endif
+
+/* Function for painting the stack. Call first thing in main(). */
+void ram_usage_init(void);
+
+/* Returns the start of application RAM, as linked. */
+uint32_t ram_usage_app_ram_start(void);
+
+/* Function for storing the RAM start requested by sd_ble_enable(). */
+void ram_usage_sd_ram_start_set(uint32_t ram_start);
+
+/* Returns the RAM start requested by the SoftDevice, 0 before it was enabled. */
+uint32_t ram_usage_sd_ram_start(void);
+
+/* Returns the size of the stack (in bytes). */
+uint32_t ram_usage_stack_size(void);
+
+/* Returns the most stack used since boot (in bytes). Scans the painted area, takes a few hundred us. */
+uint32_t ram_usage_stack_high_water(void);
+
+/* Function for serializing app RAM start, SoftDevice RAM start, end of static data, stack size, stack
+ * high-water mark and the gap between static data and stack, all uint32 LE. Returns the number of bytes
+ * written, 0 if the buffer is too small. */
+uint16_t ram_usage_encode(uint8_t * p_buf, uint16_t buf_len);
+
+#endif // RAM_USAGE_H__
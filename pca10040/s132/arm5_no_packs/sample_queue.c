@@ -0,0 +1,63 @@
+#include "sample_queue.h"
+#include <stddef.h>
+
+#define SAMPLE_QUEUE_MASK           (SAMPLE_QUEUE_SIZE - 1)
+
+
+void sample_queue_init(sample_queue_t * p_queue)
+{
+    p_queue->head      = 0;
+    p_queue->tail      = 0;
+    p_queue->depth_max = 0;
+}
+
+bool sample_queue_push(sample_queue_t * p_queue, int16_t * p_samples, uint16_t count, uint32_t timestamp_us)
+{
+    uint32_t head  = p_queue->head;
+    uint32_t depth = head - p_queue->tail;
+    volatile sample_block_t * p_slot;
+
+    if (depth >= SAMPLE_QUEUE_SIZE)
+    {
+        return false;
+    }
+
+    p_slot            = &p_queue->slots[head & SAMPLE_QUEUE_MASK];
+    p_slot->p_samples    = p_samples;
+    p_slot->count        = count;
+    p_slot->timestamp_us = timestamp_us;
+
+    // Publish the slot only after it has been filled in.
+    p_queue->head = head + 1;
+
+    if (depth + 1 > p_queue->depth_max)
+    {
+        p_queue->depth_max = depth + 1;
+    }
+    return true;
+}
+
+bool sample_queue_pop(sample_queue_t * p_queue, sample_block_t * p_block)
+{
+    uint32_t tail = p_queue->tail;
+    volatile sample_block_t * p_slot;
+
+    if (tail == p_queue->head)
+    {
+        return false;
+    }
+
+    p_slot             = &p_queue->slots[tail & SAMPLE_QUEUE_MASK];
+    p_block->p_samples    = p_slot->p_samples;
+    p_block->count        = p_slot->count;
+    p_block->timestamp_us = p_slot->timestamp_us;
+
+    // Hand the slot back only after it has been read.
+    p_queue->tail = tail + 1;
+    return true;
+}
+
+uint32_t sample_queue_depth(sample_queue_t const * p_queue)
+{
+    return p_queue->head - p_queue->tail;
+}
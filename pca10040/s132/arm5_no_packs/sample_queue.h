@@ -0,0 +1,47 @@
+#ifndef SAMPLE_QUEUE_H__
+#define SAMPLE_QUEUE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Lock-free single-producer/single-consumer queue of sample buffers.
+ *
+ * The producer (the SAADC interrupt) only calls sample_queue_push(), the consumer (the main loop) only calls
+ * sample_queue_pop(). Each index is written by one side only and the slots are volatile, so no critical
+ * region is needed on a single core. The queue has no SDK dependencies. */
+
+#define SAMPLE_QUEUE_SIZE           4                                   /**< Capacity of a queue. Must be a power of two. */
+
+#if (SAMPLE_QUEUE_SIZE & (SAMPLE_QUEUE_SIZE - 1)) != 0
+#error "SAMPLE_QUEUE_SIZE must be a power of two."
+#endif
+
+/* A completed buffer of samples. */
+typedef struct
+{
+    int16_t * p_samples;
+    uint16_t  count;                    /**< Number of valid samples in p_samples. */
+    uint32_t  timestamp_us;             /**< Time the buffer completed, for the latency trace. */
+} sample_block_t;
+
+typedef struct
+{
+    sample_block_t    slots[SAMPLE_QUEUE_SIZE];
+    volatile uint32_t head;             /**< Free-running count of pushed blocks. Written by the producer only. */
+    volatile uint32_t tail;             /**< Free-running count of popped blocks. Written by the consumer only. */
+    uint32_t          depth_max;        /**< Highest depth seen by the producer. */
+} sample_queue_t;
+
+/* Function for emptying a queue. Neither side may use the queue meanwhile. */
+void sample_queue_init(sample_queue_t * p_queue);
+
+/* Function for adding a block. Returns false if the queue is full. Producer side only. */
+bool sample_queue_push(sample_queue_t * p_queue, int16_t * p_samples, uint16_t count, uint32_t timestamp_us);
+
+/* Function for taking the oldest block. Returns false if the queue is empty. Consumer side only. */
+bool sample_queue_pop(sample_queue_t * p_queue, sample_block_t * p_block);
+
+/* Returns the number of queued blocks. */
+uint32_t sample_queue_depth(sample_queue_t const * p_queue);
+
+#endif // SAMPLE_QUEUE_H__
@@ -0,0 +1,140 @@
+#include "sdc_frame.h"
+#include <stddef.h>
+#include <string.h>
+
+#define SDC_FRAME_STREAM_SHIFT      5
+#define SDC_FRAME_LEN_MASK          0x1F
+
+
+void sdc_frame_init(sdc_frame_mux_t * p_mux)
+{
+    memset(p_mux, 0, sizeof(sdc_frame_mux_t));
+}
+
+bool sdc_frame_put(sdc_frame_mux_t * p_mux, sdc_stream_t stream, uint8_t const * p_payload, uint8_t len)
+{
+    sdc_frame_queue_t * p_queue;
+    sdc_frame_t       * p_frame;
+
+    if ((stream >= SDC_STREAM_COUNT) || (len > SDC_FRAME_MAX_PAYLOAD))
+    {
+        return false;
+    }
+
+    p_queue = &p_mux->queues[stream];
+    if (p_queue->count == SDC_FRAME_QUEUE_SIZE)
+    {
+        p_queue->next_seq++;
+        p_queue->dropped++;
+        return false;
+    }
+
+    p_frame      = &p_queue->frames[(p_queue->head + p_queue->count) % SDC_FRAME_QUEUE_SIZE];
+    p_frame->len = len;
+    p_frame->seq = p_queue->next_seq++;
+    memcpy(p_frame->payload, p_payload, len);
+    p_queue->count++;
+
+    return true;
+}
+
+uint8_t sdc_frame_room(sdc_frame_mux_t const * p_mux, sdc_stream_t stream)
+{
+    if (stream >= SDC_STREAM_COUNT)
+    {
+        return 0;
+    }
+    return SDC_FRAME_QUEUE_SIZE - p_mux->queues[stream].count;
+}
+
+uint16_t sdc_frame_pack(sdc_frame_mux_t const * p_mux, uint8_t * p_buf, uint16_t buf_len, sdc_frame_packed_t * p_packed)
+{
+    uint16_t len = 0;
+    uint8_t  stream;
+    uint8_t  i;
+
+    memset(p_packed, 0, sizeof(sdc_frame_packed_t));
+
+    for (stream = 0; stream < SDC_STREAM_COUNT; stream++)
+    {
+        sdc_frame_queue_t const * p_queue = &p_mux->queues[stream];
+
+        for (i = 0; i < p_queue->count; i++)
+        {
+            sdc_frame_t const * p_frame = &p_queue->frames[(p_queue->head + i) % SDC_FRAME_QUEUE_SIZE];
+
+            if (len + SDC_FRAME_HEADER_LEN + p_frame->len > buf_len)
+            {
+                // Frames further down must not overtake this one.
+                return len;
+            }
+            len += sdc_frame_encode((sdc_stream_t)stream, p_frame->seq, p_frame->payload, p_frame->len, &p_buf[len]);
+            p_packed->counts[stream]++;
+        }
+    }
+
+    return len;
+}
+
+void sdc_frame_commit(sdc_frame_mux_t * p_mux, sdc_frame_packed_t const * p_packed)
+{
+    uint8_t stream;
+
+    for (stream = 0; stream < SDC_STREAM_COUNT; stream++)
+    {
+        sdc_frame_queue_t * p_queue = &p_mux->queues[stream];
+        uint8_t             count   = p_packed->counts[stream];
+
+        if (count > p_queue->count)
+        {
+            count = p_queue->count;
+        }
+        p_queue->head   = (p_queue->head + count) % SDC_FRAME_QUEUE_SIZE;
+        p_queue->count -= count;
+    }
+}
+
+void sdc_frame_clear(sdc_frame_mux_t * p_mux)
+{
+    uint8_t stream;
+
+    for (stream = 0; stream < SDC_STREAM_COUNT; stream++)
+    {
+        p_mux->queues[stream].head  = 0;
+        p_mux->queues[stream].count = 0;
+    }
+}
+
+uint16_t sdc_frame_encode(sdc_stream_t stream, uint8_t seq, uint8_t const * p_payload, uint8_t len, uint8_t * p_buf)
+{
+    p_buf[0] = (uint8_t)((stream << SDC_FRAME_STREAM_SHIFT) | (len & SDC_FRAME_LEN_MASK));
+    p_buf[1] = seq;
+    memcpy(&p_buf[SDC_FRAME_HEADER_LEN], p_payload, len);
+
+    return SDC_FRAME_HEADER_LEN + len;
+}
+
+bool sdc_frame_next(uint8_t const * p_buf, uint16_t len, uint16_t * p_pos, sdc_frame_view_t * p_frame)
+{
+    uint16_t pos = *p_pos;
+    uint8_t  frame_len;
+
+    if ((p_buf == NULL) || (pos + SDC_FRAME_HEADER_LEN > len))
+    {
+        return false;
+    }
+
+    frame_len = p_buf[pos] & SDC_FRAME_LEN_MASK;
+    if ((frame_len > SDC_FRAME_MAX_PAYLOAD) || (pos + SDC_FRAME_HEADER_LEN + frame_len > len))
+    {
+        return false;
+    }
+
+    p_frame->stream    = (sdc_stream_t)(p_buf[pos] >> SDC_FRAME_STREAM_SHIFT);
+    p_frame->seq       = p_buf[pos + 1];
+    p_frame->len       = frame_len;
+    p_frame->p_payload = &p_buf[pos + SDC_FRAME_HEADER_LEN];
+    *p_pos             = pos + SDC_FRAME_HEADER_LEN + frame_len;
+
+    return true;
+}
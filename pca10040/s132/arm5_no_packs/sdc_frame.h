@@ -0,0 +1,105 @@
+#ifndef SDC_FRAME_H__
+#define SDC_FRAME_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Framing of the notifications of the Send Data Custom service.
+ *
+ * Values, events, summaries and history share the one notifying characteristic. Each notification carries
+ * one or more frames back to back, and the notification length ends the last one:
+ *
+ *   byte 0     stream (bits 7-5) and payload length (bits 4-0)
+ *   byte 1     sequence number, counted per stream, wraps at 256
+ *   byte 2..   payload, at most SDC_FRAME_MAX_PAYLOAD bytes
+ *
+ * The sequence number advances for every frame handed to sdc_frame_put(), also when there is no room for
+ * it, so a client sees a gap for every frame it missed, whether it was dropped on the device or on its link.
+ *
+ * Frames wait in one queue per stream. sdc_frame_pack() takes the streams by priority, the lowest stream
+ * first, each oldest frame first, and fills a notification with as many whole frames as fit. A frame of a
+ * higher priority stream is never left behind for a lower one, so the bulk history only fills what the
+ * live data leaves free. The module has no SDK dependencies, host/sdc_deframe uses it too. */
+
+#define SDC_FRAME_HEADER_LEN        2
+#define SDC_FRAME_MAX_NOTIF_LEN     20                                  /**< Longest notification with the default ATT MTU (in bytes). */
+#define SDC_FRAME_MAX_PAYLOAD       (SDC_FRAME_MAX_NOTIF_LEN - SDC_FRAME_HEADER_LEN)
+#define SDC_FRAME_QUEUE_SIZE        4                                   /**< Frames each stream can hold. */
+
+/* Streams, in order of priority. */
+typedef enum
+{
+    SDC_STREAM_EVENT,                   /**< Device events: event code (see history_event_t), time stamp (uint16 LE). */
+    SDC_STREAM_VALUE,                   /**< Reported values: value, time stamp (uint16 LE). */
+    SDC_STREAM_SUMMARY,                 /**< Window statistics: time stamp (uint16 LE), window_stats_encode(). */
+    SDC_STREAM_HISTORY,                 /**< History transfer: history blocks (history_codec.h) cut into frames, an empty frame ends the transfer. */
+    SDC_STREAM_BENCH,                   /**< Link benchmark: sequence number (uint32 LE), send time in us (uint32 LE), filler. Sent by link_bench, not queued. */
+    SDC_STREAM_COUNT
+} sdc_stream_t;
+
+typedef struct
+{
+    uint8_t len;
+    uint8_t seq;
+    uint8_t payload[SDC_FRAME_MAX_PAYLOAD];
+} sdc_frame_t;
+
+typedef struct
+{
+    sdc_frame_t frames[SDC_FRAME_QUEUE_SIZE];
+    uint8_t     head;                   /**< Oldest frame. */
+    uint8_t     count;
+    uint8_t     next_seq;
+    uint32_t    dropped;                /**< Frames not queued because the queue was full. */
+} sdc_frame_queue_t;
+
+/* Queues of all streams. */
+typedef struct
+{
+    sdc_frame_queue_t queues[SDC_STREAM_COUNT];
+} sdc_frame_mux_t;
+
+/* Frames taken from each stream by sdc_frame_pack(). */
+typedef struct
+{
+    uint8_t counts[SDC_STREAM_COUNT];
+} sdc_frame_packed_t;
+
+/* A frame found by sdc_frame_next(). p_payload points into the notification. */
+typedef struct
+{
+    sdc_stream_t    stream;
+    uint8_t         seq;
+    uint8_t         len;
+    uint8_t const * p_payload;
+} sdc_frame_view_t;
+
+/* Function for emptying the queues and restarting the sequence numbers. */
+void sdc_frame_init(sdc_frame_mux_t * p_mux);
+
+/* Function for queuing a frame. Returns false if the stream is invalid, the payload too long or the queue
+ * full, the sequence number is used up in the last case. */
+bool sdc_frame_put(sdc_frame_mux_t * p_mux, sdc_stream_t stream, uint8_t const * p_payload, uint8_t len);
+
+/* Returns the number of frames the queue of a stream has room for. */
+uint8_t sdc_frame_room(sdc_frame_mux_t const * p_mux, sdc_stream_t stream);
+
+/* Function for building the next notification from the queued frames, without removing them. Returns its
+ * length, 0 if nothing is queued. */
+uint16_t sdc_frame_pack(sdc_frame_mux_t const * p_mux, uint8_t * p_buf, uint16_t buf_len, sdc_frame_packed_t * p_packed);
+
+/* Function for removing the frames of a notification once it was sent. */
+void sdc_frame_commit(sdc_frame_mux_t * p_mux, sdc_frame_packed_t const * p_packed);
+
+/* Function for dropping the queued frames. Sequence numbers carry on. */
+void sdc_frame_clear(sdc_frame_mux_t * p_mux);
+
+/* Function for writing a single frame into p_buf, which must hold SDC_FRAME_HEADER_LEN + len bytes. Returns
+ * the frame length. */
+uint16_t sdc_frame_encode(sdc_stream_t stream, uint8_t seq, uint8_t const * p_payload, uint8_t len, uint8_t * p_buf);
+
+/* Function for walking the frames of a received notification. *p_pos starts at 0. Returns false at the end
+ * of the notification or if the rest of it is malformed. */
+bool sdc_frame_next(uint8_t const * p_buf, uint16_t len, uint16_t * p_pos, sdc_frame_view_t * p_frame);
+
+#endif // SDC_FRAME_H__
@@ -0,0 +1,200 @@
+#include "sensor_pipeline.h"
+#include <stddef.h>
+
+static sensor_hal_t             m_hal;
+static app_config_t const *     mp_config;
+static uint8_t                  m_old_value;                            /**< Held peak, stabilizes the irregular sensor output. */
+static sensor_pipeline_stats_t  m_stats;
+static bool                     m_report_now;                           /**< The next value is reported whatever the modes say. */
+static uint8_t                  m_last_report;                          /**< Last value passed to value_send, the client's view. */
+static uint32_t                 m_since_report_ms;                      /**< Time since the last report. */
+static uint32_t                 m_period_ms;                            /**< Time into the running summary period. */
+static uint8_t                  m_period_peak;                          /**< Peak of the running summary period. */
+static window_stats_t           m_window;                               /**< Statistics of the running summary window. */
+
+
+void sensor_pipeline_init(sensor_hal_t const * p_hal, app_config_t const * p_config)
+{
+    m_hal       = *p_hal;
+    mp_config   = p_config;
+    m_old_value = 0;
+    window_stats_reset(&m_window);
+    sensor_pipeline_report_now();
+}
+
+void sensor_pipeline_report_now(void)
+{
+    m_report_now      = true;
+    m_since_report_ms = 0;
+    m_period_ms       = 0;
+    m_period_peak     = 0;
+}
+
+uint16_t sensor_pipeline_filter(int16_t const * p_samples, uint16_t count)
+{
+    uint16_t value = 0;
+    uint16_t i;
+
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        value = value + p_samples[i];
+    }
+    return value / count;
+}
+
+/* Detection step: holds the peak until the value drops below the release level. Returns the value to report. */
+static uint8_t detect(uint8_t value)
+{
+    if (value > m_old_value)
+    {
+        m_old_value = value;
+        return value;
+    }
+    if (value >= mp_config->release_level)
+    {
+        m_stats.peak_holds++;
+        return m_old_value;
+    }
+    m_old_value = 0;
+    return value;
+}
+
+/* Time covered by one value (in ms). */
+static uint32_t buffer_ms(void)
+{
+    return (uint32_t)mp_config->samples_in_buffer * mp_config->sample_period_ms;
+}
+
+/* Summary step: adds the filtered value to the window and sends the summary at the end of the window. */
+static void summarize(uint8_t value)
+{
+    window_stats_summary_t summary;
+
+    if (mp_config->summary_window_s == 0)
+    {
+        window_stats_reset(&m_window);
+        return;
+    }
+
+    window_stats_add(&m_window, value, buffer_ms(), (value >= mp_config->release_level));
+    if (m_window.duration_ms < (uint32_t)mp_config->summary_window_s * 1000)
+    {
+        return;
+    }
+
+    window_stats_summary(&m_window, &summary);
+    window_stats_reset(&m_window);
+    m_stats.summaries++;
+    if (m_hal.summary_send != NULL)
+    {
+        m_hal.summary_send(&summary);
+    }
+}
+
+/* Report step: decides whether the value goes to the client. Returns the reason, SENSOR_REPORT_COUNT if the
+ * value is not reported, and the value to report in p_report. */
+static sensor_report_t report_decide(uint8_t value, uint8_t * p_report)
+{
+    uint8_t         modes     = mp_config->report_modes;
+    bool            period_end;
+    sensor_report_t reason    = SENSOR_REPORT_COUNT;
+
+    m_since_report_ms += buffer_ms();
+    m_period_ms       += buffer_ms();
+    if (value > m_period_peak)
+    {
+        m_period_peak = value;
+    }
+    period_end = (m_period_ms >= (uint32_t)mp_config->report_period_s * 1000);
+
+    *p_report = value;
+    if (m_report_now || (modes == 0))
+    {
+        reason = SENSOR_REPORT_FORCED;
+    }
+    else if (((modes & APP_REPORT_THRESHOLD) != 0)
+             && ((value >= mp_config->release_level) != (m_last_report >= mp_config->release_level)))
+    {
+        reason = SENSOR_REPORT_THRESHOLD;
+    }
+    else if (((modes & APP_REPORT_CHANGE) != 0)
+             && (((value > m_last_report) ? (value - m_last_report) : (m_last_report - value)) > mp_config->report_deadband))
+    {
+        reason = SENSOR_REPORT_CHANGE;
+    }
+    else if (((modes & APP_REPORT_PERIODIC) != 0) && period_end)
+    {
+        reason    = SENSOR_REPORT_PERIODIC;
+        *p_report = m_period_peak;
+    }
+    else if (((modes & APP_REPORT_HEARTBEAT) != 0)
+             && (m_since_report_ms >= (uint32_t)mp_config->report_heartbeat_s * 1000))
+    {
+        reason = SENSOR_REPORT_HEARTBEAT;
+    }
+
+    // A report of another kind at the end of the period stands in for the summary.
+    if (period_end)
+    {
+        m_period_ms   = 0;
+        m_period_peak = 0;
+    }
+    if (reason != SENSOR_REPORT_COUNT)
+    {
+        m_report_now      = false;
+        m_last_report     = *p_report;
+        m_since_report_ms = 0;
+    }
+    return reason;
+}
+
+void sensor_pipeline_process(int16_t const * p_samples, uint16_t count)
+{
+    uint16_t        value;
+    uint8_t         report;
+    uint8_t         sent;
+    sensor_report_t reason;
+
+    if (count == 0)
+    {
+        return;
+    }
+    m_stats.buffers++;
+
+    value = sensor_pipeline_filter(p_samples, count);
+    if (value > mp_config->value_max)
+    {
+        m_stats.values_invalid++;
+        return;
+    }
+
+    report = detect((uint8_t)value);
+    m_stats.values_reported++;
+
+    reason = report_decide(report, &sent);
+    if (reason != SENSOR_REPORT_COUNT)
+    {
+        m_stats.reports[reason]++;
+        if (m_hal.value_send != NULL)
+        {
+            m_hal.value_send(sent);
+        }
+    }
+    if (m_hal.value_log != NULL)
+    {
+        m_hal.value_log(report);
+    }
+
+    // After the report, so the summary does not delay it.
+    summarize((uint8_t)value);
+}
+
+void sensor_pipeline_stats_get(sensor_pipeline_stats_t * p_stats)
+{
+    *p_stats = m_stats;
+}
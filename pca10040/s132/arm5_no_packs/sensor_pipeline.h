@@ -0,0 +1,70 @@
+#ifndef SENSOR_PIPELINE_H__
+#define SENSOR_PIPELINE_H__
+
+#include <stdint.h>
+#include "app_config.h"
+#include "window_stats.h"
+
+/* Sensor processing: filtering, detection and reporting of the occupancy value.
+ *
+ * The pipeline has no SDK dependencies. The backend feeds it completed sample buffers and receives the
+ * results through sensor_hal_t: on the device the buffers come from the SAADC and the values go to the SDC
+ * service and the history log, on the host (pca10040/s132/host) they come from a trace file.
+ *
+ * Every value goes to value_log. The report step decides which values go to value_send, following the
+ * APP_REPORT_ modes in the configuration: crossings of release_level, changes beyond the deadband, the peak
+ * of each period, and a heartbeat when nothing else was reported. A value is reported when any enabled mode
+ * asks for it. Time is counted in buffers of samples_in_buffer * sample_period_ms, so replays on the host
+ * report the same values as the device.
+ *
+ * Independently of the reports, every valid filtered value is added to a window_stats accumulator. At the
+ * end of each summary_window_s its summary goes to summary_send, time above counting values at or above
+ * release_level. */
+
+/* Why a value was reported. */
+typedef enum
+{
+    SENSOR_REPORT_FORCED,               /**< First value, after sensor_pipeline_report_now(), or no mode set. */
+    SENSOR_REPORT_THRESHOLD,
+    SENSOR_REPORT_CHANGE,
+    SENSOR_REPORT_PERIODIC,
+    SENSOR_REPORT_HEARTBEAT,
+    SENSOR_REPORT_COUNT
+} sensor_report_t;
+
+/* Backend functions receiving the results. */
+typedef struct
+{
+    void (*value_send)(uint8_t value);  /**< Reports a value to the client, as decided by the report step. */
+    void (*value_log)(uint8_t value);   /**< Stores a value in the history. Called for every value. */
+    void (*summary_send)(window_stats_summary_t const * p_summary); /**< Reports the statistics of a window. May be NULL. */
+} sensor_hal_t;
+
+/* Counters, for profiling and for comparing runs. */
+typedef struct
+{
+    uint32_t buffers;                   /**< Buffers processed. */
+    uint32_t values_invalid;            /**< Averages above value_max, dropped. */
+    uint32_t values_reported;           /**< Values out of detection. */
+    uint32_t peak_holds;                /**< Reports of the held peak instead of the current value. */
+    uint32_t reports[SENSOR_REPORT_COUNT];  /**< Values passed to value_send, per reason. */
+    uint32_t summaries;                 /**< Windows passed to summary_send. */
+} sensor_pipeline_stats_t;
+
+/* Function for initializing the pipeline. p_config is read on every buffer, so changes apply immediately. */
+void sensor_pipeline_init(sensor_hal_t const * p_hal, app_config_t const * p_config);
+
+/* Function for processing a completed buffer of samples. */
+void sensor_pipeline_process(int16_t const * p_samples, uint16_t count);
+
+/* Function for reporting the next value whatever the report modes say, and restarting the period and
+ * heartbeat from it. Called when a client enables notifications. */
+void sensor_pipeline_report_now(void);
+
+/* Filtering step: the mean of the buffer. Returns 0 for an empty buffer. */
+uint16_t sensor_pipeline_filter(int16_t const * p_samples, uint16_t count);
+
+/* Function for reading the counters. */
+void sensor_pipeline_stats_get(sensor_pipeline_stats_t * p_stats);
+
+#endif // SENSOR_PIPELINE_H__
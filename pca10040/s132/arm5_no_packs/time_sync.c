@@ -0,0 +1,230 @@
+#include "time_sync.h"
+#include <stddef.h>
+#include <string.h>
+
+/* A write of the central. */
+typedef struct
+{
+    uint64_t local_ms;
+    uint64_t epoch_ms;
+} sync_point_t;
+
+static sync_point_t             m_points[TIME_SYNC_POINTS];             /**< Kept sync points, oldest first. */
+static uint8_t                  m_point_count;
+static uint64_t                 m_base_local_ms;                        /**< Local time of the prediction base. */
+static uint64_t                 m_base_epoch_ms;                        /**< Central time at m_base_local_ms. */
+static time_sync_stats_t        m_stats;
+
+
+void time_sync_init(void)
+{
+    memset(&m_stats, 0, sizeof(m_stats));
+    m_point_count   = 0;
+    m_base_local_ms = 0;
+    m_base_epoch_ms = 0;
+}
+
+bool time_sync_is_synced(void)
+{
+    return m_stats.synced;
+}
+
+uint64_t time_sync_epoch_ms(uint64_t local_ms)
+{
+    int64_t dt;
+
+    if (!m_stats.synced)
+    {
+        return local_ms;
+    }
+    dt = (int64_t)(local_ms - m_base_local_ms);
+    return m_base_epoch_ms + dt + (dt * m_stats.drift_ppb) / 1000000000;
+}
+
+/* Returns how much later than predicted a write arrived, negated: the least delayed write has the largest. */
+static int64_t point_residual(uint64_t local_ms, uint64_t epoch_ms)
+{
+    return (int64_t)(epoch_ms - time_sync_epoch_ms(local_ms));
+}
+
+/* Function for setting the prediction base to the newest point, or to the one before if it is less delayed
+ * and not further back than TIME_SYNC_SPACING_MS, so the drift error does not add up over long gaps. */
+static void base_set(void)
+{
+    sync_point_t const * p_base = &m_points[m_point_count - 1];
+
+    if ((m_point_count >= 2)
+        && ((p_base->local_ms - m_points[m_point_count - 2].local_ms) <= TIME_SYNC_SPACING_MS)
+        && (point_residual(m_points[m_point_count - 2].local_ms, m_points[m_point_count - 2].epoch_ms)
+            > point_residual(p_base->local_ms, p_base->epoch_ms)))
+    {
+        p_base = &m_points[m_point_count - 2];
+    }
+    m_base_local_ms = p_base->local_ms;
+    m_base_epoch_ms = p_base->epoch_ms;
+}
+
+/* Function for fitting a line through the sync points, its slope is the drift. Returns false if there are
+ * too few points, they do not span TIME_SYNC_FIT_MIN_MS yet or the slope is out of range. */
+static bool points_fit(void)
+{
+    sync_point_t const * p_first = &m_points[0];
+    int64_t              n       = m_point_count;
+    int64_t              sum_x   = 0;                                   // Local times after the first point (in s).
+    int64_t              sum_y   = 0;                                   // Central minus local time after the first point (in ms).
+    int64_t              sum_xx  = 0;
+    int64_t              sum_xy  = 0;
+    int64_t              num;
+    int64_t              den;
+    int64_t              drift_ppb;
+    uint8_t              i;
+
+    if ((m_point_count < TIME_SYNC_FIT_MIN_POINTS)
+        || ((m_points[m_point_count - 1].local_ms - p_first->local_ms) < TIME_SYNC_FIT_MIN_MS))
+    {
+        return false;
+    }
+
+    // With x in s and y in ms the sums stay far from overflow over TIME_SYNC_SPAN_MAX_MS.
+    for (i = 0; i < m_point_count; i++)
+    {
+        int64_t dl = (int64_t)(m_points[i].local_ms - p_first->local_ms);
+        int64_t x  = (dl + 500) / 1000;
+        int64_t y  = (int64_t)(m_points[i].epoch_ms - p_first->epoch_ms) - dl;
+
+        sum_x  += x;
+        sum_y  += y;
+        sum_xx += x * x;
+        sum_xy += x * y;
+    }
+
+    num = n * sum_xy - sum_x * sum_y;
+    den = n * sum_xx - sum_x * sum_x;
+    if (den <= 0)
+    {
+        return false;
+    }
+
+    // The slope is in ms per s, a millionth of it is one ppb.
+    drift_ppb = (num * 1000000) / den;
+    if ((drift_ppb > TIME_SYNC_DRIFT_MAX_PPB) || (drift_ppb < -TIME_SYNC_DRIFT_MAX_PPB))
+    {
+        return false;
+    }
+
+    m_stats.drift_ppb = (int32_t)drift_ppb;
+    return true;
+}
+
+/* Function for adding a sync point. Writes closer than TIME_SYNC_SPACING_MS to the point before the newest
+ * compete for the newest point, the least delayed one is kept. With all points taken the inner point with
+ * the closest neighbours is dropped, so the points spread over the whole span. */
+static void point_add(uint64_t local_ms, uint64_t epoch_ms)
+{
+    uint8_t drop;
+    uint8_t i;
+
+    if ((m_point_count >= 2) && ((local_ms - m_points[m_point_count - 2].local_ms) < TIME_SYNC_SPACING_MS))
+    {
+        sync_point_t const * p_newest = &m_points[m_point_count - 1];
+
+        if (point_residual(local_ms, epoch_ms) < point_residual(p_newest->local_ms, p_newest->epoch_ms))
+        {
+            return;
+        }
+        m_point_count--;
+    }
+    if (m_point_count == TIME_SYNC_POINTS)
+    {
+        drop = 1;
+        for (i = 2; i < TIME_SYNC_POINTS - 1; i++)
+        {
+            if ((m_points[i + 1].local_ms - m_points[i - 1].local_ms)
+                < (m_points[drop + 1].local_ms - m_points[drop - 1].local_ms))
+            {
+                drop = i;
+            }
+        }
+        memmove(&m_points[drop], &m_points[drop + 1], (TIME_SYNC_POINTS - 1 - drop) * sizeof(sync_point_t));
+        m_point_count--;
+    }
+    m_points[m_point_count].local_ms = local_ms;
+    m_points[m_point_count].epoch_ms = epoch_ms;
+    m_point_count++;
+
+    while ((m_point_count > 1) && ((local_ms - m_points[0].local_ms) > TIME_SYNC_SPAN_MAX_MS))
+    {
+        memmove(&m_points[0], &m_points[1], (m_point_count - 1) * sizeof(sync_point_t));
+        m_point_count--;
+    }
+}
+
+bool time_sync_on_sync(uint64_t local_ms, uint64_t epoch_ms)
+{
+    int64_t error_ms;
+
+    if (epoch_ms < (uint64_t)TIME_SYNC_EPOCH_MIN_S * 1000)
+    {
+        m_stats.rejected++;
+        return false;
+    }
+
+    error_ms = (int64_t)(epoch_ms - time_sync_epoch_ms(local_ms));
+    if (!m_stats.synced || (error_ms > TIME_SYNC_STEP_MS) || (error_ms < -TIME_SYNC_STEP_MS))
+    {
+        // The drift is a property of the crystal and survives the step.
+        m_point_count = 0;
+        m_stats.steps++;
+    }
+    m_stats.last_error_ms = m_stats.synced ? (int32_t)error_ms : 0;
+    m_stats.synced        = true;
+    m_stats.syncs++;
+
+    point_add(local_ms, epoch_ms);
+
+    m_stats.fitted = points_fit();
+    base_set();
+    m_stats.points = m_point_count;
+    m_stats.span_s = (uint32_t)((m_points[m_point_count - 1].local_ms - m_points[0].local_ms) / 1000);
+    return true;
+}
+
+void time_sync_stats_get(time_sync_stats_t * p_stats)
+{
+    *p_stats = m_stats;
+}
+
+/* Writes a 32-bit value little endian, returns its size. */
+static uint16_t u32_put(uint32_t value, uint8_t * p_buf)
+{
+    p_buf[0] = (uint8_t)value;
+    p_buf[1] = (uint8_t)(value >> 8);
+    p_buf[2] = (uint8_t)(value >> 16);
+    p_buf[3] = (uint8_t)(value >> 24);
+    return 4;
+}
+
+uint16_t time_sync_encode(uint64_t local_ms, uint8_t * p_buf, uint16_t buf_len)
+{
+    uint16_t len = 0;
+    uint64_t now_ms;
+
+    if ((p_buf == NULL) || (buf_len < TIME_SYNC_ENCODED_LEN))
+    {
+        return 0;
+    }
+    now_ms = time_sync_epoch_ms(local_ms);
+
+    p_buf[len++] = (m_stats.synced ? 0x01 : 0) | (m_stats.fitted ? 0x02 : 0);
+    p_buf[len++] = m_stats.points;
+    len += u32_put((uint32_t)m_stats.drift_ppb, &p_buf[len]);
+    len += u32_put(m_stats.span_s, &p_buf[len]);
+    len += u32_put((uint32_t)m_stats.last_error_ms, &p_buf[len]);
+    len += u32_put(m_stats.syncs, &p_buf[len]);
+    len += u32_put(m_stats.steps, &p_buf[len]);
+    len += u32_put(m_stats.rejected, &p_buf[len]);
+    len += u32_put((uint32_t)now_ms, &p_buf[len]);
+    p_buf[len++] = (uint8_t)(now_ms >> 32);
+    p_buf[len++] = (uint8_t)(now_ms >> 40);
+    return len;
+}
@@ -0,0 +1,66 @@
+#ifndef TIME_SYNC_H__
+#define TIME_SYNC_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Mapping of the local time base to the time of the central, with drift estimation.
+ *
+ * The central writes its time (Unix time in ms) now and then. Each write gives a sync point, the local time
+ * at reception and the central time. The points are kept at least TIME_SYNC_SPACING_MS apart: of the writes
+ * within that time the least delayed one (the one ahead of the prediction the most) is kept, and once all
+ * TIME_SYNC_POINTS are in use the inner point closest to its neighbours is dropped, so the points stay spread
+ * over the whole span. Once TIME_SYNC_FIT_MIN_POINTS points span TIME_SYNC_FIT_MIN_MS a least squares line
+ * through them gives the drift of the local clock. The offset is taken at the newest point, or the one before
+ * it when that was less delayed, as a drift error moves the line the least there. Before the fit the
+ * offset is taken from the last write and the last drift estimate is kept. Writes further than
+ * TIME_SYNC_STEP_MS from the prediction are a step of the central clock and restart the fit.
+ *
+ * The latency between the central taking its time and the write arriving is not measured, its mean ends
+ * up in the offset. Local times are in ms from any clock that does not wrap (on the device app_time). The
+ * module has no SDK dependencies, host/time_sync_check runs it against clocks with simulated errors. */
+
+#define TIME_SYNC_POINTS            8                                   /**< Sync points kept for the fit. */
+#define TIME_SYNC_SPACING_MS        (30 * 60 * 1000)                    /**< Least time between two kept sync points. */
+#define TIME_SYNC_FIT_MIN_MS        (60 * 60 * 1000)                    /**< Time the points must span before the fit is used. */
+#define TIME_SYNC_FIT_MIN_POINTS    3                                   /**< Points needed for the fit, with two the jitter of single writes goes straight into the drift. */
+#define TIME_SYNC_SPAN_MAX_MS       (48 * 60 * 60 * 1000)               /**< Older points are dropped, bounds the fit sums. */
+#define TIME_SYNC_STEP_MS           2000                                /**< Prediction error above which a write is a clock step. */
+#define TIME_SYNC_DRIFT_MAX_PPB     500000                              /**< Fits beyond this drift (500 ppm) are rejected. */
+#define TIME_SYNC_EPOCH_MIN_S       946684800                           /**< 2000-01-01. Synchronized times are Unix times at or above this, earlier writes are rejected. */
+#define TIME_SYNC_ENCODED_LEN       32                                  /**< Size of serialized state (in bytes). */
+
+/* State and counters. */
+typedef struct
+{
+    bool     synced;                    /**< At least one write has been accepted. */
+    bool     fitted;                    /**< Drift and offset come from the fit. */
+    uint8_t  points;                    /**< Sync points kept. */
+    int32_t  drift_ppb;                 /**< Estimated rate error of the local clock (in parts per billion), positive when it runs slow. */
+    uint32_t span_s;                    /**< Time spanned by the sync points. */
+    int32_t  last_error_ms;             /**< Central time minus predicted time at the last write. */
+    uint32_t syncs;                     /**< Accepted writes. */
+    uint32_t steps;                     /**< Writes treated as clock steps, the first one included. */
+    uint32_t rejected;                  /**< Writes with a time before TIME_SYNC_EPOCH_MIN_S. */
+} time_sync_stats_t;
+
+/* Function for forgetting all sync points. */
+void time_sync_init(void);
+
+/* Function for passing a write of the central: its time epoch_ms, received at local time local_ms.
+ * Returns false if the time was rejected. */
+bool time_sync_on_sync(uint64_t local_ms, uint64_t epoch_ms);
+
+/* Returns true once a write has been accepted. */
+bool time_sync_is_synced(void);
+
+/* Returns the central time at local time local_ms, or local_ms itself before the first write. */
+uint64_t time_sync_epoch_ms(uint64_t local_ms);
+
+/* Function for reading the state and counters. */
+void time_sync_stats_get(time_sync_stats_t * p_stats);
+
+/* Function for serializing the state. Returns the number of bytes written, 0 if the buffer is too small. */
+uint16_t time_sync_encode(uint64_t local_ms, uint8_t * p_buf, uint16_t buf_len);
+
+#endif // TIME_SYNC_H__
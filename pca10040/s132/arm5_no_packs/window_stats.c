@@ -0,0 +1,126 @@
+#include "window_stats.h"
+#include <stddef.h>
+#include <string.h>
+
+#define MEAN_SHIFT                  23                                  /**< Fraction bits of the mean, 255 still fits in 31 bits. */
+#define M2_SHIFT                    16                                  /**< Fraction bits of m2. */
+
+
+void window_stats_reset(window_stats_t * p_stats)
+{
+    memset(p_stats, 0, sizeof(window_stats_t));
+}
+
+/* Division rounded to nearest, for a positive divisor. Rounds through the remainder, adding half the
+ * divisor first could overflow. */
+static int32_t div_round(int32_t dividend, int32_t divisor)
+{
+    int32_t quotient  = dividend / divisor;
+    int32_t remainder = dividend - quotient * divisor;
+
+    if (remainder > (divisor - 1) / 2)
+    {
+        quotient++;
+    }
+    else if (-remainder > (divisor - 1) / 2)
+    {
+        quotient--;
+    }
+    return quotient;
+}
+
+void window_stats_add(window_stats_t * p_stats, uint8_t value, uint32_t duration_ms, bool above)
+{
+    int32_t x = (int32_t)value << MEAN_SHIFT;
+    int32_t delta;
+    int32_t delta_new;
+
+    // The count is a signed divisor in the mean update.
+    if (p_stats->count == INT32_MAX)
+    {
+        return;
+    }
+
+    if ((p_stats->count == 0) || (value < p_stats->min))
+    {
+        p_stats->min = value;
+    }
+    if ((p_stats->count == 0) || (value > p_stats->max))
+    {
+        p_stats->max = value;
+    }
+    p_stats->count++;
+
+    // Welford: mean += (x - mean) / n, M2 += (x - mean_old) * (x - mean_new). Both deltas have the same sign,
+    // the rounded step is never larger than delta, so the product is not negative.
+    delta          = x - p_stats->mean;
+    p_stats->mean += div_round(delta, (int32_t)p_stats->count);
+    delta_new      = x - p_stats->mean;
+    p_stats->m2   += (uint64_t)((int64_t)delta * delta_new) >> (2 * MEAN_SHIFT - M2_SHIFT);
+
+    p_stats->duration_ms += duration_ms;
+    if (above)
+    {
+        p_stats->above_ms += duration_ms;
+    }
+}
+
+void window_stats_summary(window_stats_t const * p_stats, window_stats_summary_t * p_summary)
+{
+    p_summary->duration_ms = p_stats->duration_ms;
+    p_summary->count       = p_stats->count;
+    p_summary->min         = p_stats->min;
+    p_summary->max         = p_stats->max;
+    p_summary->mean        = (uint16_t)((p_stats->mean + (1 << (MEAN_SHIFT - 9))) >> (MEAN_SHIFT - 8));
+    p_summary->variance    = 0;
+    p_summary->above_ms    = p_stats->above_ms;
+
+    if (p_stats->count > 0)
+    {
+        uint64_t variance = (p_stats->m2 + p_stats->count / 2) / p_stats->count;
+        variance = (variance + (1 << (M2_SHIFT - 9))) >> (M2_SHIFT - 8);
+        p_summary->variance = (variance > UINT32_MAX) ? UINT32_MAX : (uint32_t)variance;
+    }
+}
+
+/* Writes a 16-bit value little endian, returns its size. */
+static uint16_t u16_put(uint16_t value, uint8_t * p_buf)
+{
+    p_buf[0] = (uint8_t)value;
+    p_buf[1] = (uint8_t)(value >> 8);
+    return 2;
+}
+
+/* Writes a 32-bit value little endian, returns its size. */
+static uint16_t u32_put(uint32_t value, uint8_t * p_buf)
+{
+    p_buf[0] = (uint8_t)value;
+    p_buf[1] = (uint8_t)(value >> 8);
+    p_buf[2] = (uint8_t)(value >> 16);
+    p_buf[3] = (uint8_t)(value >> 24);
+    return 4;
+}
+
+uint16_t window_stats_encode(window_stats_summary_t const * p_summary, uint8_t * p_buf, uint16_t buf_len)
+{
+    uint16_t len = 0;
+    uint32_t duration_s;
+    uint32_t above_100ms;
+
+    if ((p_summary == NULL) || (p_buf == NULL) || (buf_len < WINDOW_STATS_ENCODED_LEN))
+    {
+        return 0;
+    }
+
+    duration_s  = (p_summary->duration_ms + 500) / 1000;
+    above_100ms = (p_summary->above_ms + 50) / 100;
+
+    len += u16_put((duration_s > UINT16_MAX) ? UINT16_MAX : (uint16_t)duration_s, &p_buf[len]);
+    len += u32_put(p_summary->count, &p_buf[len]);
+    p_buf[len++] = p_summary->min;
+    p_buf[len++] = p_summary->max;
+    len += u16_put(p_summary->mean, &p_buf[len]);
+    len += u32_put(p_summary->variance, &p_buf[len]);
+    len += u16_put((above_100ms > UINT16_MAX) ? UINT16_MAX : (uint16_t)above_100ms, &p_buf[len]);
+    return len;
+}
@@ -0,0 +1,57 @@
+#ifndef WINDOW_STATS_H__
+#define WINDOW_STATS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Summary statistics of the values in a time window: count, min, max, mean, variance and time above the
+ * release level.
+ *
+ * Mean and variance are updated with Welford's recurrence in fixed point, O(1) per value and without a
+ * sample buffer: the mean is kept in Q23 and rounded to nearest on every update, the sum of squared
+ * deviations (M2) in Q16 in 64 bits, so windows of millions of values neither overflow nor lose the
+ * variance of a quiet bay. Only 32-bit divisions run per value, the 64-bit one is left to
+ * window_stats_summary(). The module has no SDK dependencies, host/window_stats_check compares it
+ * against a double precision reference. */
+
+#define WINDOW_STATS_ENCODED_LEN    16                                  /**< Size of a serialized summary (in bytes). */
+
+/* Running accumulator. */
+typedef struct
+{
+    uint32_t count;
+    uint8_t  min;
+    uint8_t  max;
+    int32_t  mean;                      /**< Mean of the values (Q23). */
+    uint64_t m2;                        /**< Sum of squared deviations from the mean (Q16). */
+    uint32_t duration_ms;               /**< Time covered by the values. */
+    uint32_t above_ms;                  /**< Part of duration_ms with the value at or above the threshold. */
+} window_stats_t;
+
+/* Summary of a window, as sent to the client. */
+typedef struct
+{
+    uint32_t duration_ms;
+    uint32_t count;
+    uint8_t  min;                       /**< 0 if count is 0, as max. */
+    uint8_t  max;
+    uint16_t mean;                      /**< Mean (Q8). */
+    uint32_t variance;                  /**< Population variance, M2 / count (Q8). */
+    uint32_t above_ms;
+} window_stats_summary_t;
+
+/* Function for starting a new window. */
+void window_stats_reset(window_stats_t * p_stats);
+
+/* Function for adding a value covering duration_ms, above tells whether it counts for above_ms. */
+void window_stats_add(window_stats_t * p_stats, uint8_t value, uint32_t duration_ms, bool above);
+
+/* Function for reading the summary of the window so far. */
+void window_stats_summary(window_stats_t const * p_stats, window_stats_summary_t * p_summary);
+
+/* Function for serializing a summary. Returns the number of bytes written, 0 if the buffer is too small.
+ * Layout (little endian): duration in seconds (16 bits), count (32), min (8), max (8), mean (Q8, 16),
+ * variance (Q8, 32), time above in units of 100 ms (16). */
+uint16_t window_stats_encode(window_stats_summary_t const * p_summary, uint8_t * p_buf, uint16_t buf_len);
+
+#endif // WINDOW_STATS_H__
@@ -0,0 +1,159 @@
+/* Check of the boot load of the configuration record, app_config_record_parse().
+ *
+ * Builds records the way config_flush() writes them, and the way older firmware wrote them, and checks that
+ * the parser takes the valid ones and falls back to the defaults for the rest: a CRC mismatch, a record too
+ * short for its header or its block, versions 0 and above APP_CONFIG_VERSION, a current record of the wrong
+ * length and out of range values. Records of versions 1 to 3 are prefixes of the current block; their fields
+ * must be kept and the fields added later must get the defaults. Prints one line per case and exits with 1
+ * if any fails.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -Isd_sim -I../arm5_no_packs app_config_check.c ../arm5_no_packs/app_config_record.c \
+ *       -o app_config_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "app_config.h"
+#include "crc16.h"
+
+#define APP_CONFIG_V1_LEN           offsetof(app_config_t, adv_floor_interval)  /**< Block size of version 1 records. */
+#define APP_CONFIG_V2_LEN           offsetof(app_config_t, report_modes)        /**< Block size of version 2 records. */
+#define APP_CONFIG_V3_LEN           offsetof(app_config_t, summary_window_s)    /**< Block size of version 3 records. */
+
+static bool                     m_failed;
+
+
+/* Configuration that differs from the defaults in every field. */
+static app_config_t config_custom(void)
+{
+    app_config_t config = m_app_config_default;
+
+    config.adv_interval         = 800;
+    config.adv_timeout          = 30;
+    config.sample_period_ms     = 10;
+    config.samples_in_buffer    = 12;
+    config.value_max            = 200;
+    config.release_level        = 40;
+    config.adv_floor_interval   = 48;
+    config.adv_ceiling_interval = 1600;
+    config.adv_burst_timeout    = 3;
+    config.report_modes         = APP_REPORT_PERIODIC;
+    config.report_deadband      = 5;
+    config.report_period_s      = 120;
+    config.report_heartbeat_s   = 300;
+    config.summary_window_s     = 600;
+    return config;
+}
+
+/* Serializes the first length bytes of p_config as a record of the given version. Returns the record length. */
+static uint32_t record_build(app_config_t const * p_config, uint16_t version, uint16_t length, uint8_t * p_record)
+{
+    app_config_header_t header;
+
+    header.version  = version;
+    header.length   = length;
+    header.crc      = crc16_compute((uint8_t const *)p_config, length, NULL);
+    header.reserved = 0;
+
+    memcpy(p_record, &header, sizeof(header));
+    memcpy(p_record + sizeof(header), p_config, length);
+
+    // FDS stores whole words.
+    return (sizeof(header) + length + 3) & ~3u;
+}
+
+static void check(char const * p_name, bool ok)
+{
+    printf("%-52s %s\n", p_name, ok ? "ok" : "FAIL");
+    m_failed = m_failed || !ok;
+}
+
+/* Parses a record that must be rejected, and checks that the output is left alone. */
+static void check_rejected(char const * p_name, uint8_t const * p_record, uint32_t record_len)
+{
+    app_config_t config = m_app_config_default;
+    bool         parsed = app_config_record_parse(p_record, record_len, &config);
+
+    check(p_name, !parsed && (memcmp(&config, &m_app_config_default, sizeof(config)) == 0));
+}
+
+/* Parses a record of an older version, the first length bytes must come from the record. */
+static void check_upgrade(char const * p_name, uint16_t version, uint16_t length)
+{
+    app_config_record_t record;
+    app_config_t        custom = config_custom();
+    app_config_t        expected = m_app_config_default;
+    app_config_t        config;
+    uint32_t            record_len = record_build(&custom, version, length, (uint8_t *)&record);
+    bool                parsed;
+
+    memcpy(&expected, &custom, length);
+    memset(&config, 0, sizeof(config));
+    parsed = app_config_record_parse((uint8_t const *)&record, record_len, &config);
+
+    check(p_name, parsed && (memcmp(&config, &expected, sizeof(config)) == 0));
+}
+
+int main(void)
+{
+    app_config_record_t record;
+    uint8_t           * p_record = (uint8_t *)&record;
+    app_config_t        custom = config_custom();
+    app_config_t        config;
+    uint32_t            record_len;
+
+    record_len = record_build(&custom, APP_CONFIG_VERSION, sizeof(app_config_t), p_record);
+    memset(&config, 0, sizeof(config));
+    check("current version",
+          app_config_record_parse(p_record, record_len, &config) && (memcmp(&config, &custom, sizeof(config)) == 0));
+
+    check_upgrade("version 1 prefix, later fields get the defaults", 1, APP_CONFIG_V1_LEN);
+    check_upgrade("version 2 prefix, later fields get the defaults", 2, APP_CONFIG_V2_LEN);
+    check_upgrade("version 3 prefix, later fields get the defaults", 3, APP_CONFIG_V3_LEN);
+
+    record_len = record_build(&custom, APP_CONFIG_VERSION, sizeof(app_config_t), p_record);
+    record.config.adv_timeout ^= 0x0001;
+    check_rejected("CRC mismatch in the block", p_record, record_len);
+
+    record_len = record_build(&custom, APP_CONFIG_VERSION, sizeof(app_config_t), p_record);
+    record.header.crc ^= 0x8000;
+    check_rejected("CRC mismatch in the header", p_record, record_len);
+
+    record_len = record_build(&custom, 2, APP_CONFIG_V2_LEN, p_record);
+    record.config.adv_burst_timeout ^= 0x0001;
+    check_rejected("CRC mismatch in a version 2 record", p_record, record_len);
+
+    record_len = record_build(&custom, APP_CONFIG_VERSION, sizeof(app_config_t), p_record);
+    check_rejected("record shorter than the header", p_record, sizeof(app_config_header_t) - 1);
+    check_rejected("record shorter than its block", p_record, record_len - sizeof(uint32_t));
+    check_rejected("empty record", p_record, 0);
+
+    record_len = record_build(&custom, APP_CONFIG_VERSION, APP_CONFIG_V3_LEN, p_record);
+    check_rejected("current version with an older block length", p_record, record_len);
+
+    record_len = record_build(&custom, 0, sizeof(app_config_t), p_record);
+    check_rejected("version 0", p_record, record_len);
+
+    record_len = record_build(&custom, APP_CONFIG_VERSION + 1, sizeof(app_config_t), p_record);
+    check_rejected("version from newer firmware", p_record, record_len);
+
+    custom.release_level = custom.value_max;
+    record_len = record_build(&custom, APP_CONFIG_VERSION, sizeof(app_config_t), p_record);
+    check_rejected("release level not below the maximum value", p_record, record_len);
+
+    custom = config_custom();
+    custom.samples_in_buffer = SAMPLES_IN_BUFFER + 1;
+    record_len = record_build(&custom, 1, APP_CONFIG_V1_LEN, p_record);
+    check_rejected("out of range value in a version 1 record", p_record, record_len);
+
+    custom = config_custom();
+    custom.adv_floor_interval = custom.adv_ceiling_interval + 1;
+    record_len = record_build(&custom, 2, APP_CONFIG_V2_LEN, p_record);
+    check_rejected("burst interval above the ceiling", p_record, record_len);
+
+    return m_failed ? 1 : 0;
+}
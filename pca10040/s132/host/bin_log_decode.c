@@ -0,0 +1,260 @@
+/* Decoder of the bin_log records.
+ *
+ * Reads the raw data of the bin_log RTT channel, for example captured with
+ *   JLinkRTTLogger -Device NRF52832_XXAA -If SWD -Speed 4000 -RTTChannel 1 log.bin
+ * and prints one line per record, with the format string taken from the .bin_log_fmt section of the
+ * firmware ELF file. Time stamps are RTC1 ticks, converted with -p prescaler (APP_TIMER_PRESCALER).
+ *
+ * The format strings take %d %i %u %x %X %o %c with the usual flags and width; %s and %p print the
+ * argument as an address. Data that does not parse as a record is skipped word by word.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 bin_log_decode.c -o bin_log_decode
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#define SECTION_NAME                ".bin_log_fmt"
+#define MAX_ARGS                    4                                   /**< BIN_LOG_MAX_ARGS of the firmware. */
+#define RTC_FREQUENCY               32768
+
+static uint8_t                * mp_strings;                             /**< Contents of the format section. */
+static uint64_t                 m_strings_addr;
+static uint64_t                 m_strings_size;
+
+
+static uint64_t field_get(uint8_t const * p_data, uint32_t size)
+{
+    uint64_t value = 0;
+
+    while (size-- > 0)
+    {
+        value = (value << 8) | p_data[size];
+    }
+    return value;
+}
+
+static uint8_t * file_read(char const * p_path, size_t * p_size)
+{
+    FILE    * p_file = fopen(p_path, "rb");
+    uint8_t * p_data = NULL;
+    size_t    size = 0;
+    size_t    capacity = 0;
+    size_t    n;
+
+    if (p_file == NULL)
+    {
+        perror(p_path);
+        exit(2);
+    }
+    do
+    {
+        if (size == capacity)
+        {
+            capacity = (capacity == 0) ? 65536 : capacity * 2;
+            p_data   = realloc(p_data, capacity);
+            if (p_data == NULL)
+            {
+                perror("realloc");
+                exit(2);
+            }
+        }
+        n     = fread(&p_data[size], 1, capacity - size, p_file);
+        size += n;
+    } while (n > 0);
+    fclose(p_file);
+
+    *p_size = size;
+    return p_data;
+}
+
+/* Finds the format section in a little endian ELF32 or ELF64 file. */
+static bool elf_strings_load(char const * p_path)
+{
+    size_t          size;
+    uint8_t       * p_elf = file_read(p_path, &size);
+    bool            is_64;
+    uint64_t        shoff;
+    uint32_t        shentsize;
+    uint32_t        shnum;
+    uint32_t        shstrndx;
+    uint8_t const * p_shstr;
+    uint32_t        i;
+
+    if ((size < 64) || (memcmp(p_elf, "\x7f" "ELF", 4) != 0) || (p_elf[5] != 1))
+    {
+        fprintf(stderr, "%s: not a little endian ELF file\n", p_path);
+        return false;
+    }
+    is_64 = (p_elf[4] == 2);
+
+    shoff     = is_64 ? field_get(&p_elf[0x28], 8) : field_get(&p_elf[0x20], 4);
+    shentsize = (uint32_t)field_get(&p_elf[is_64 ? 0x3A : 0x2E], 2);
+    shnum     = (uint32_t)field_get(&p_elf[is_64 ? 0x3C : 0x30], 2);
+    shstrndx  = (uint32_t)field_get(&p_elf[is_64 ? 0x3E : 0x32], 2);
+    if ((shoff + (uint64_t)shnum * shentsize > size) || (shstrndx >= shnum))
+    {
+        fprintf(stderr, "%s: bad section table\n", p_path);
+        return false;
+    }
+
+    // Section header fields: name, ..., addr, offset, size.
+#define SH_FIELD(index, off32, off64)   field_get(&p_elf[shoff + (uint64_t)(index) * shentsize + (is_64 ? (off64) : (off32))], is_64 ? 8 : 4)
+    p_shstr = &p_elf[SH_FIELD(shstrndx, 0x10, 0x18)];
+
+    for (i = 0; i < shnum; i++)
+    {
+        uint32_t name = (uint32_t)field_get(&p_elf[shoff + (uint64_t)i * shentsize], 4);
+
+        if (strcmp((char const *)&p_shstr[name], SECTION_NAME) == 0)
+        {
+            uint64_t offset = SH_FIELD(i, 0x10, 0x18);
+
+            m_strings_addr = SH_FIELD(i, 0x0C, 0x10);
+            m_strings_size = SH_FIELD(i, 0x14, 0x20);
+            if (offset + m_strings_size > size)
+            {
+                break;
+            }
+            mp_strings = &p_elf[offset];
+            return true;
+        }
+    }
+#undef SH_FIELD
+
+    fprintf(stderr, "%s: no %s section\n", p_path, SECTION_NAME);
+    return false;
+}
+
+/* Prints a format string with the record arguments. */
+static void record_print(char const * p_fmt, uint32_t nargs, uint32_t const * p_args)
+{
+    char     spec[32];
+    uint32_t arg = 0;
+
+    while (*p_fmt != '\0')
+    {
+        size_t len = 0;
+
+        if (*p_fmt != '%')
+        {
+            putchar(*p_fmt++);
+            continue;
+        }
+        if (p_fmt[1] == '%')
+        {
+            putchar('%');
+            p_fmt += 2;
+            continue;
+        }
+
+        // Copies flags and width, drops length modifiers, all arguments are 32 bits.
+        spec[len++] = *p_fmt++;
+        while ((*p_fmt != '\0') && (strchr("-+ #0123456789.hlzjt", *p_fmt) != NULL) && (len < sizeof(spec) - 3))
+        {
+            if (strchr("hlzjt", *p_fmt) == NULL)
+            {
+                spec[len++] = *p_fmt;
+            }
+            p_fmt++;
+        }
+        if (*p_fmt == '\0')
+        {
+            break;
+        }
+
+        uint32_t value = (arg < nargs) ? p_args[arg] : 0;
+        arg++;
+
+        switch (*p_fmt)
+        {
+            case 'd':
+            case 'i':
+                spec[len++] = 'd';
+                spec[len]   = '\0';
+                printf(spec, (int32_t)value);
+                break;
+
+            case 'u':
+            case 'x':
+            case 'X':
+            case 'o':
+            case 'c':
+                spec[len++] = *p_fmt;
+                spec[len]   = '\0';
+                printf(spec, (unsigned int)value);
+                break;
+
+            default:
+                printf("0x%08x", value);
+                break;
+        }
+        p_fmt++;
+    }
+    putchar('\n');
+}
+
+static void usage(char const * p_name)
+{
+    fprintf(stderr, "usage: %s [-p prescaler] firmware.elf rtt_channel.bin\n", p_name);
+    exit(2);
+}
+
+int main(int argc, char ** argv)
+{
+    uint32_t  prescaler = 0;
+    size_t    size;
+    size_t    pos = 0;
+    uint8_t * p_log;
+    uint32_t  records = 0;
+    uint32_t  skipped = 0;
+    int       opt;
+
+    while ((opt = getopt(argc, argv, "p:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'p': prescaler = (uint32_t)atoi(optarg);   break;
+            default:  usage(argv[0]);
+        }
+    }
+    if ((optind != argc - 2) || !elf_strings_load(argv[optind]))
+    {
+        usage(argv[0]);
+    }
+    p_log = file_read(argv[optind + 1], &size);
+
+    while (pos + 8 <= size)
+    {
+        uint32_t addr  = (uint32_t)field_get(&p_log[pos], 4);
+        uint32_t word1 = (uint32_t)field_get(&p_log[pos + 4], 4);
+        uint32_t nargs = word1 >> 24;
+        uint32_t args[MAX_ARGS];
+        uint32_t i;
+
+        if ((addr < m_strings_addr) || (addr >= m_strings_addr + m_strings_size)
+            || (nargs > MAX_ARGS) || (pos + 8 + 4 * nargs > size))
+        {
+            pos += 4;
+            skipped++;
+            continue;
+        }
+        for (i = 0; i < nargs; i++)
+        {
+            args[i] = (uint32_t)field_get(&p_log[pos + 8 + 4 * i], 4);
+        }
+
+        printf("%12.6f  ", (word1 & 0x00FFFFFF) * (prescaler + 1) / (double)RTC_FREQUENCY);
+        record_print((char const *)&mp_strings[addr - m_strings_addr], nargs, args);
+        pos += 8 + 4 * nargs;
+        records++;
+    }
+
+    fprintf(stderr, "%u records, %u words skipped\n", records, skipped);
+    return 0;
+}
@@ -0,0 +1,474 @@
+/* Detection regression suite for the sensor pipeline.
+ *
+ * Runs sensor_pipeline_process() over a corpus of labelled traces and reports detection accuracy, latency
+ * and cost as JSON on stdout. With -B the metrics are compared against a baseline file and the exit code is
+ * 1 if any of them regressed past its tolerance, so the suite can gate filter and threshold changes.
+ *
+ * Traces are CSV with one "label,sample" pair per line, label 1 while the bay is occupied. The sample is the
+ * last field, so the same files play in sensor_replay. Lines starting with '#' are skipped.
+ *
+ * A reported value at or above release_level counts as occupied. An occupied stretch in the labels is an
+ * event. It is detected when the output turns occupied between the start of the event and -w ms after its
+ * end; the latency is measured from the start. Output stretches matching no event are false events.
+ *
+ * Cost is the best of COST_RUNS timed passes over each trace with a no-op backend, given per sample in TSC
+ * cycles on x86 and in nanoseconds elsewhere. It depends on the host, so give it a relative tolerance in
+ * the baseline.
+ *
+ * Baseline file, one metric per line, all lower-is-better:
+ *   <metric> <value> <tolerance>     tolerance is absolute, or relative with a trailing '%'
+ * Run with -W to write the current metrics as a baseline with default tolerances.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -I../arm5_no_packs detect_regress.c ../arm5_no_packs/sensor_pipeline.c \
+ *       ../arm5_no_packs/window_stats.c -o detect_regress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include "app_config.h"
+#include "sensor_pipeline.h"
+
+#define MAX_EVENTS                  65536                               /**< Detected events kept for the latency percentiles. */
+#define MATCH_WINDOW_MS_DEFAULT     1000                                /**< Time after the end of an event in which a detection still counts. */
+#define COST_RUNS                   5                                   /**< Timed passes per trace, the fastest one counts. */
+
+/* Metrics of the report, in report order. */
+typedef enum
+{
+    METRIC_MISSED_EVENTS,
+    METRIC_FALSE_EVENTS,
+    METRIC_LATENCY_P50_MS,
+    METRIC_LATENCY_P90_MS,
+    METRIC_LATENCY_P99_MS,
+    METRIC_LATENCY_MAX_MS,
+    METRIC_COST_PER_SAMPLE,
+    METRIC_COUNT
+} metric_t;
+
+static char const * const m_metric_names[METRIC_COUNT] =
+{
+    "missed_events",
+    "false_events",
+    "latency_p50_ms",
+    "latency_p90_ms",
+    "latency_p99_ms",
+    "latency_max_ms",
+#if defined(__x86_64__) || defined(__i386__)
+    "cycles_per_sample",
+#else
+    "ns_per_sample",
+#endif
+};
+
+/* Tolerances written with -W. */
+static char const * const m_default_tolerances[METRIC_COUNT] = { "0", "0", "0", "0", "0", "0", "50%" };
+
+/* State of the trace being run. */
+typedef struct
+{
+    uint64_t now_ms;                    /**< Time at the end of the current buffer. */
+    bool     label;                     /**< Label of the last sample read. */
+    bool     in_event;                  /**< Inside an event, or its match window. */
+    bool     event_detected;
+    uint64_t event_start_ms;
+    uint64_t event_end_ms;              /**< End of the last event, for the match window. */
+    bool     output;                    /**< Last reported value was occupied. */
+    uint32_t events;
+    uint32_t detected;
+    uint32_t missed;
+    uint32_t false_events;
+} trace_state_t;
+
+static app_config_t             m_config = APP_CONFIG_DEFAULTS;         /**< Same defaults as the firmware. */
+static uint32_t                 m_match_window_ms = MATCH_WINDOW_MS_DEFAULT;
+static trace_state_t            m_trace;
+static uint32_t                 m_latencies[MAX_EVENTS];
+static uint32_t                 m_latency_count;
+static uint64_t                 m_cost;
+static uint64_t                 m_samples;
+
+
+static inline uint64_t cost_now(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+/* Closes the current event once its match window has passed. */
+static void event_close_check(void)
+{
+    if (m_trace.in_event && !m_trace.label && (m_trace.now_ms > m_trace.event_end_ms + m_match_window_ms))
+    {
+        m_trace.in_event = false;
+        if (!m_trace.event_detected)
+        {
+            m_trace.missed++;
+        }
+    }
+}
+
+static void label_update(bool label)
+{
+    if (label && !m_trace.label)
+    {
+        if (!m_trace.in_event)
+        {
+            m_trace.events++;
+            m_trace.in_event       = true;
+            m_trace.event_detected = false;
+            m_trace.event_start_ms = m_trace.now_ms;
+        }
+        // A new occupied stretch inside the match window of the last one extends that event.
+    }
+    else if (!label && m_trace.label)
+    {
+        m_trace.event_end_ms = m_trace.now_ms;
+    }
+    m_trace.label = label;
+}
+
+static void value_send(uint8_t value)
+{
+    bool output = (value >= m_config.release_level);
+
+    if (output && !m_trace.output)
+    {
+        if (m_trace.in_event && !m_trace.event_detected)
+        {
+            m_trace.event_detected = true;
+            m_trace.detected++;
+            if (m_latency_count < MAX_EVENTS)
+            {
+                m_latencies[m_latency_count++] = (uint32_t)(m_trace.now_ms - m_trace.event_start_ms);
+            }
+        }
+        else if (!m_trace.in_event)
+        {
+            m_trace.false_events++;
+        }
+    }
+    m_trace.output = output;
+}
+
+static void value_discard(uint8_t value)
+{
+    (void)value;
+}
+
+static const sensor_hal_t m_hal =
+{
+    .value_send = value_send,
+    .value_log  = NULL
+};
+
+/* Backend of the timed passes. */
+static const sensor_hal_t m_cost_hal =
+{
+    .value_send = value_discard,
+    .value_log  = NULL
+};
+
+/* Reads the next labelled sample. Returns false at the end of the trace. */
+static bool sample_read(FILE * p_file, bool * p_label, int16_t * p_sample)
+{
+    char line[128];
+
+    while (fgets(line, sizeof(line), p_file) != NULL)
+    {
+        char * p_field = strrchr(line, ',');
+
+        if ((line[0] == '#') || (p_field == NULL))
+        {
+            continue;
+        }
+        *p_label  = (strtol(line, NULL, 10) != 0);
+        *p_sample = (int16_t)strtol(p_field + 1, NULL, 10);
+        return true;
+    }
+    return false;
+}
+
+/* Times the pipeline over the whole buffers of a trace, keeping the fastest pass. */
+static void trace_cost_measure(int16_t const * p_samples, uint32_t count)
+{
+    uint32_t n = count - (count % m_config.samples_in_buffer);
+    uint64_t best = UINT64_MAX;
+    uint64_t start;
+    uint32_t run;
+    uint32_t i;
+
+    if (n == 0)
+    {
+        return;
+    }
+
+    for (run = 0; run < COST_RUNS; run++)
+    {
+        sensor_pipeline_init(&m_cost_hal, &m_config);
+        start = cost_now();
+        for (i = 0; i < n; i += m_config.samples_in_buffer)
+        {
+            sensor_pipeline_process(&p_samples[i], m_config.samples_in_buffer);
+        }
+        start = cost_now() - start;
+        if (start < best)
+        {
+            best = start;
+        }
+    }
+    m_cost    += best;
+    m_samples += n;
+}
+
+static int trace_run(char const * p_path)
+{
+    int16_t  * p_samples = NULL;
+    uint32_t   capacity = 0;
+    uint32_t   count = 0;
+    uint16_t   in_buffer = 0;
+    bool       label;
+    FILE     * p_file = fopen(p_path, "r");
+
+    if (p_file == NULL)
+    {
+        perror(p_path);
+        return -1;
+    }
+
+    memset(&m_trace, 0, sizeof(m_trace));
+    sensor_pipeline_init(&m_hal, &m_config);
+
+    for (;;)
+    {
+        if (count == capacity)
+        {
+            capacity  = (capacity == 0) ? 65536 : capacity * 2;
+            p_samples = realloc(p_samples, capacity * sizeof(int16_t));
+            if (p_samples == NULL)
+            {
+                perror("realloc");
+                exit(2);
+            }
+        }
+        if (!sample_read(p_file, &label, &p_samples[count]))
+        {
+            break;
+        }
+        count++;
+
+        m_trace.now_ms += m_config.sample_period_ms;
+        label_update(label);
+        event_close_check();
+
+        if (++in_buffer < m_config.samples_in_buffer)
+        {
+            continue;
+        }
+        sensor_pipeline_process(&p_samples[count - in_buffer], in_buffer);
+        in_buffer = 0;
+    }
+    fclose(p_file);
+
+    // An event still open at the end of the trace is missed only if it was not detected.
+    if (m_trace.in_event && !m_trace.event_detected)
+    {
+        m_trace.missed++;
+    }
+
+    trace_cost_measure(p_samples, count);
+    free(p_samples);
+    return 0;
+}
+
+static int compare_u32(void const * p_a, void const * p_b)
+{
+    uint32_t a = *(uint32_t const *)p_a;
+    uint32_t b = *(uint32_t const *)p_b;
+    return (a > b) - (a < b);
+}
+
+/* Nearest-rank percentile of the sorted latencies. */
+static double percentile(uint32_t pct)
+{
+    uint32_t rank;
+
+    if (m_latency_count == 0)
+    {
+        return 0;
+    }
+    rank = (pct * m_latency_count + 99) / 100;
+    return m_latencies[(rank > 0) ? (rank - 1) : 0];
+}
+
+/* Compares the metrics against the baseline. Returns the number of regressions, -1 if the file is unreadable. */
+static int baseline_check(char const * p_path, double const * p_metrics)
+{
+    char   line[128];
+    char   name[64];
+    char   tolerance[32];
+    double value;
+    int    regressions = 0;
+    int    i;
+    FILE * p_file = fopen(p_path, "r");
+
+    if (p_file == NULL)
+    {
+        perror(p_path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), p_file) != NULL)
+    {
+        double limit;
+
+        if ((line[0] == '#') || (sscanf(line, "%63s %lf %31s", name, &value, tolerance) != 3))
+        {
+            continue;
+        }
+        for (i = 0; i < METRIC_COUNT; i++)
+        {
+            if (strcmp(name, m_metric_names[i]) == 0)
+            {
+                break;
+            }
+        }
+        if (i == METRIC_COUNT)
+        {
+            fprintf(stderr, "%s: unknown metric %s\n", p_path, name);
+            continue;
+        }
+
+        limit = value + ((tolerance[strlen(tolerance) - 1] == '%') ? value * atof(tolerance) / 100 : atof(tolerance));
+        if (p_metrics[i] > limit)
+        {
+            fprintf(stderr, "REGRESSION %s: %.2f > %.2f (baseline %.2f, tolerance %s)\n",
+                    name, p_metrics[i], limit, value, tolerance);
+            regressions++;
+        }
+    }
+    fclose(p_file);
+    return regressions;
+}
+
+static int baseline_write(char const * p_path, double const * p_metrics)
+{
+    int    i;
+    FILE * p_file = fopen(p_path, "w");
+
+    if (p_file == NULL)
+    {
+        perror(p_path);
+        return -1;
+    }
+    fprintf(p_file, "# metric value tolerance\n");
+    for (i = 0; i < METRIC_COUNT; i++)
+    {
+        fprintf(p_file, "%s %.2f %s\n", m_metric_names[i], p_metrics[i], m_default_tolerances[i]);
+    }
+    fclose(p_file);
+    return 0;
+}
+
+static void usage(char const * p_name)
+{
+    fprintf(stderr,
+            "usage: %s [-B baseline] [-W baseline] [-w match_window_ms] [-n samples_per_buffer]\n"
+            "       [-p sample_period_ms] [-m value_max] [-r release_level] trace...\n", p_name);
+    exit(2);
+}
+
+int main(int argc, char ** argv)
+{
+    char const * p_baseline = NULL;
+    char const * p_baseline_out = NULL;
+    double       metrics[METRIC_COUNT];
+    uint32_t     events = 0;
+    uint32_t     detected = 0;
+    uint32_t     missed = 0;
+    uint32_t     false_events = 0;
+    int          regressions = 0;
+    int          opt;
+    int          i;
+
+    while ((opt = getopt(argc, argv, "B:W:w:n:p:m:r:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'B': p_baseline = optarg;                                  break;
+            case 'W': p_baseline_out = optarg;                              break;
+            case 'w': m_match_window_ms          = (uint32_t)atoi(optarg);  break;
+            case 'n': m_config.samples_in_buffer = (uint16_t)atoi(optarg);  break;
+            case 'p': m_config.sample_period_ms  = (uint16_t)atoi(optarg);  break;
+            case 'm': m_config.value_max         = (uint8_t)atoi(optarg);   break;
+            case 'r': m_config.release_level     = (uint8_t)atoi(optarg);   break;
+            default:  usage(argv[0]);
+        }
+    }
+    if ((optind >= argc)
+        || (m_config.samples_in_buffer == 0) || (m_config.samples_in_buffer > SAMPLES_IN_BUFFER))
+    {
+        usage(argv[0]);
+    }
+
+    printf("{\n  \"traces\": [\n");
+    for (i = optind; i < argc; i++)
+    {
+        if (trace_run(argv[i]) != 0)
+        {
+            return 2;
+        }
+        printf("    {\"file\": \"%s\", \"duration_ms\": %llu, \"events\": %u, \"detected\": %u, \"missed\": %u, \"false\": %u}%s\n",
+               argv[i], (unsigned long long)m_trace.now_ms, m_trace.events, m_trace.detected,
+               m_trace.missed, m_trace.false_events, (i < argc - 1) ? "," : "");
+        events       += m_trace.events;
+        detected     += m_trace.detected;
+        missed       += m_trace.missed;
+        false_events += m_trace.false_events;
+    }
+
+    qsort(m_latencies, m_latency_count, sizeof(m_latencies[0]), compare_u32);
+
+    metrics[METRIC_MISSED_EVENTS]   = missed;
+    metrics[METRIC_FALSE_EVENTS]    = false_events;
+    metrics[METRIC_LATENCY_P50_MS]  = percentile(50);
+    metrics[METRIC_LATENCY_P90_MS]  = percentile(90);
+    metrics[METRIC_LATENCY_P99_MS]  = percentile(99);
+    metrics[METRIC_LATENCY_MAX_MS]  = (m_latency_count > 0) ? m_latencies[m_latency_count - 1] : 0;
+    metrics[METRIC_COST_PER_SAMPLE] = (m_samples > 0) ? (double)m_cost / m_samples : 0;
+
+    printf("  ],\n  \"config\": {\"samples_in_buffer\": %u, \"sample_period_ms\": %u, \"value_max\": %u, "
+           "\"release_level\": %u, \"match_window_ms\": %u},\n",
+           m_config.samples_in_buffer, m_config.sample_period_ms, m_config.value_max,
+           m_config.release_level, m_match_window_ms);
+    printf("  \"events\": %u,\n  \"detected\": %u,\n", events, detected);
+    for (i = 0; i < METRIC_COUNT; i++)
+    {
+        printf("  \"%s\": %.2f%s\n", m_metric_names[i], metrics[i], (i < METRIC_COUNT - 1) ? "," : "");
+    }
+    printf("}\n");
+
+    if ((p_baseline_out != NULL) && (baseline_write(p_baseline_out, metrics) != 0))
+    {
+        return 2;
+    }
+    if (p_baseline != NULL)
+    {
+        regressions = baseline_check(p_baseline, metrics);
+        if (regressions < 0)
+        {
+            return 2;
+        }
+        fprintf(stderr, "%d regression(s)\n", regressions);
+    }
+    return (regressions == 0) ? 0 : 1;
+}
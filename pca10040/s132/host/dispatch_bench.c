@@ -0,0 +1,409 @@
+/* Cost of dispatching SoftDevice events, replayed from a recorded event stream.
+ *
+ * The BLE events of the stream are passed BENCH_PASSES times to two dispatchers with the handlers of
+ * main.c stood in by stubs: the subscription table of main.c through ble_dispatch(), and the chain that
+ * called all six handlers for every event before it. Each stub walks a switch on the event ID like the
+ * handler it stands for, so the time left is what dispatching costs. Prints per dispatcher the handler
+ * calls and the time per event (host clock), and per table entry its calls and the mean and longest call
+ * from the per-handler accounting of ble_dispatch(). On the host that accounting reads the monotonic clock
+ * twice per call; its cost, measured separately, is printed and taken out of the table time. On the device
+ * it is two reads of the cycle counter.
+ *
+ * A file holds the stream in hex as for evt_replay (evt_replay -w writes one, DIAG_PAGE_EVENTS reads one
+ * from a device). Without a file a streaming session is generated: two links connect, subscribe and update
+ * their parameters, BENCH_TX_EVENTS TX complete events alternate between them, then they disconnect and
+ * advertising times out. Exits with 1 if the stream is malformed or a table entry is called for an event
+ * outside its range or misses one inside it.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -Isd_sim -I../arm5_no_packs dispatch_bench.c ../arm5_no_packs/ble_dispatch.c \
+ *       ../arm5_no_packs/evt_codec.c ../arm5_no_packs/cycle_prof.c -o dispatch_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "ble.h"
+#include "ble_dispatch.h"
+#include "cycle_prof.h"
+#include "evt_codec.h"
+
+#define BENCH_STREAM_SIZE           32768                               /**< Longest stream (in bytes). */
+#define BENCH_MAX_EVENTS            4096                                /**< BLE events kept from the stream. */
+#define BENCH_PASSES                1000                                /**< Replays of the stream per dispatcher. */
+#define BENCH_TX_EVENTS             1000                                /**< TX complete events of the generated session. */
+#define BENCH_CONN_HANDLE_BASE      0x0010
+#define BENCH_CLOCK_PAIRS           1000000                             /**< Clock reads timed to find the accounting cost. */
+#define BENCH_REASON_REMOTE_USER    0x13                                /**< HCI reason of a disconnection by the peer. */
+
+/* Modules of main.c with a BLE event handler, in the order of the old chain. */
+typedef enum
+{
+    MODULE_CONN_STATE,
+    MODULE_CONN_PARAMS,
+    MODULE_MAIN,
+    MODULE_SDC,
+    MODULE_ADVERTISING,
+    MODULE_PEER_MANAGER,
+    MODULE_COUNT
+} module_t;
+
+static uint8_t                  m_stream[BENCH_STREAM_SIZE];
+static uint16_t                 m_stream_len;
+static evt_codec_item_t         m_events[BENCH_MAX_EVENTS];
+static uint32_t                 m_event_count;
+static uint32_t                 m_calls[MODULE_COUNT];
+static volatile uint32_t        m_sink;                                 /**< Work of the stubs, kept by the compiler. */
+
+
+/* Stand-in for a handler: a switch on the event ID, as the real ones walk. */
+static void stub(module_t module, ble_evt_t * p_ble_evt)
+{
+    m_calls[module]++;
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_EVT_TX_COMPLETE:                m_sink += p_ble_evt->evt.common_evt.params.tx_complete.count; break;
+        case BLE_GAP_EVT_CONNECTED:              m_sink += 2; break;
+        case BLE_GAP_EVT_DISCONNECTED:           m_sink += 3; break;
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:      m_sink += 4; break;
+        case BLE_GAP_EVT_CONN_SEC_UPDATE:        m_sink += 5; break;
+        case BLE_GAP_EVT_TIMEOUT:                m_sink += 6; break;
+        case BLE_GATTS_EVT_WRITE:                m_sink += 7; break;
+        case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST: m_sink += 8; break;
+        case BLE_GATTS_EVT_SYS_ATTR_MISSING:     m_sink += 9; break;
+        default:                                 break;
+    }
+}
+
+static void conn_state_on_ble_evt(ble_evt_t * p_ble_evt)   { stub(MODULE_CONN_STATE,   p_ble_evt); }
+static void conn_params_on_ble_evt(ble_evt_t * p_ble_evt)  { stub(MODULE_CONN_PARAMS,  p_ble_evt); }
+static void on_ble_evt(ble_evt_t * p_ble_evt)              { stub(MODULE_MAIN,         p_ble_evt); }
+static void sdc_on_ble_evt(ble_evt_t * p_ble_evt)          { stub(MODULE_SDC,          p_ble_evt); }
+static void adv_on_ble_evt(ble_evt_t * p_ble_evt)          { stub(MODULE_ADVERTISING,  p_ble_evt); }
+static void pm_ble_evt_handler(ble_evt_t * p_ble_evt)      { stub(MODULE_PEER_MANAGER, p_ble_evt); }
+
+/* The subscription table of main.c. */
+static const ble_dispatch_entry_t m_ble_dispatch_table[] =
+{
+    BLE_DISPATCH_ENTRY(BLE_GAP_EVT_BASE,    BLE_GAP_EVT_LAST,    conn_state_on_ble_evt),
+    BLE_DISPATCH_ENTRY(BLE_EVT_BASE,        BLE_GATTS_EVT_LAST,  pm_ble_evt_handler),
+    BLE_DISPATCH_ENTRY(BLE_GAP_EVT_BASE,    BLE_GAP_EVT_LAST,    conn_params_on_ble_evt),
+    BLE_DISPATCH_ENTRY(BLE_GATTS_EVT_BASE,  BLE_GATTS_EVT_LAST,  conn_params_on_ble_evt),
+    BLE_DISPATCH_ENTRY(BLE_EVT_BASE,        BLE_GAP_EVT_LAST,    on_ble_evt),
+    BLE_DISPATCH_ENTRY(BLE_EVT_BASE,        BLE_GAP_EVT_LAST,    sdc_on_ble_evt),
+    BLE_DISPATCH_ENTRY(BLE_GATTS_EVT_BASE,  BLE_GATTS_EVT_LAST,  sdc_on_ble_evt),
+    BLE_DISPATCH_ENTRY(BLE_GAP_EVT_BASE,    BLE_GAP_EVT_LAST,    adv_on_ble_evt),
+};
+
+#define BLE_DISPATCH_TABLE_SIZE     (sizeof(m_ble_dispatch_table) / sizeof(m_ble_dispatch_table[0]))
+
+static ble_dispatch_stats_t     m_ble_dispatch_stats[BLE_DISPATCH_TABLE_SIZE];
+
+static char const * const       m_entry_names[BLE_DISPATCH_TABLE_SIZE] =
+{
+    "conn_state", "peer_manager", "conn_params", "conn_params", "main", "sdc", "sdc", "advertising"
+};
+
+
+/* The dispatcher before the table: every handler sees every event. */
+static void chain_dispatch(ble_evt_t * p_ble_evt)
+{
+    conn_state_on_ble_evt(p_ble_evt);
+    conn_params_on_ble_evt(p_ble_evt);
+    on_ble_evt(p_ble_evt);
+    sdc_on_ble_evt(p_ble_evt);
+    adv_on_ble_evt(p_ble_evt);
+    pm_ble_evt_handler(p_ble_evt);
+}
+
+static uint64_t clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void record_add(ble_evt_t const * p_evt, uint32_t delta_us)
+{
+    uint16_t len = evt_codec_ble_encode(p_evt, delta_us, &m_stream[m_stream_len], sizeof(m_stream) - m_stream_len - 1);
+
+    if (len == 0)
+    {
+        fprintf(stderr, "generated stream longer than %u bytes\n", BENCH_STREAM_SIZE);
+        exit(2);
+    }
+    m_stream_len += len;
+}
+
+/* Generates the streaming session described at the top. */
+static void session_generate(void)
+{
+    uint32_t    evt_buf[EVT_CODEC_EVT_BUF_WORDS];
+    ble_evt_t * p_evt = (ble_evt_t *)evt_buf;
+    uint16_t    link;
+    uint32_t    i;
+
+    m_stream_len = 0;
+    for (link = 0; link < 2; link++)
+    {
+        memset(evt_buf, 0, sizeof(evt_buf));
+        p_evt->header.evt_id                = BLE_GAP_EVT_CONNECTED;
+        p_evt->evt.gap_evt.conn_handle      = BENCH_CONN_HANDLE_BASE + link;
+        record_add(p_evt, 100000);
+
+        memset(evt_buf, 0, sizeof(evt_buf));
+        p_evt->header.evt_id                 = BLE_GATTS_EVT_WRITE;
+        p_evt->evt.gatts_evt.conn_handle     = BENCH_CONN_HANDLE_BASE + link;
+        p_evt->evt.gatts_evt.params.write.len     = 2;
+        p_evt->evt.gatts_evt.params.write.data[0] = 0x01;
+        record_add(p_evt, 50000);
+
+        memset(evt_buf, 0, sizeof(evt_buf));
+        p_evt->header.evt_id                = BLE_GAP_EVT_CONN_PARAM_UPDATE;
+        p_evt->evt.gap_evt.conn_handle      = BENCH_CONN_HANDLE_BASE + link;
+        record_add(p_evt, 1000000);
+    }
+
+    for (i = 0; i < BENCH_TX_EVENTS; i++)
+    {
+        memset(evt_buf, 0, sizeof(evt_buf));
+        p_evt->header.evt_id                                 = BLE_EVT_TX_COMPLETE;
+        p_evt->evt.common_evt.conn_handle                    = BENCH_CONN_HANDLE_BASE + (i % 2);
+        p_evt->evt.common_evt.params.tx_complete.count       = 1 + (i % 3);
+        record_add(p_evt, 7500);
+    }
+
+    for (link = 0; link < 2; link++)
+    {
+        memset(evt_buf, 0, sizeof(evt_buf));
+        p_evt->header.evt_id                           = BLE_GAP_EVT_DISCONNECTED;
+        p_evt->evt.gap_evt.conn_handle                 = BENCH_CONN_HANDLE_BASE + link;
+        p_evt->evt.gap_evt.params.disconnected.reason  = BENCH_REASON_REMOTE_USER;
+        record_add(p_evt, 20000);
+    }
+
+    memset(evt_buf, 0, sizeof(evt_buf));
+    p_evt->header.evt_id               = BLE_GAP_EVT_TIMEOUT;
+    p_evt->evt.gap_evt.conn_handle     = BLE_CONN_HANDLE_INVALID;
+    p_evt->evt.gap_evt.params.timeout.src = BLE_GAP_TIMEOUT_SRC_ADVERTISING;
+    record_add(p_evt, 180000000);
+
+    m_stream[m_stream_len++] = EVT_CODEC_TYPE_END;
+}
+
+/* Reads the hex bytes of a stream file, as evt_replay does. Returns false if it does not fit. */
+static bool stream_load(char const * p_path)
+{
+    FILE * p_file = fopen(p_path, "r");
+    char   line[512];
+    int    hi = -1;
+
+    if (p_file == NULL)
+    {
+        perror(p_path);
+        exit(2);
+    }
+
+    m_stream_len = 0;
+    while (fgets(line, sizeof(line), p_file) != NULL)
+    {
+        char * p = line;
+
+        for (; (*p != '\0') && (*p != '#'); p++)
+        {
+            int nibble;
+
+            if (!isxdigit((unsigned char)*p))
+            {
+                hi = -1;
+                continue;
+            }
+            nibble = isdigit((unsigned char)*p) ? (*p - '0') : (tolower((unsigned char)*p) - 'a' + 10);
+            if (hi < 0)
+            {
+                hi = nibble;
+                continue;
+            }
+            if (m_stream_len == sizeof(m_stream))
+            {
+                fclose(p_file);
+                return false;
+            }
+            m_stream[m_stream_len++] = (uint8_t)((hi << 4) | nibble);
+            hi = -1;
+        }
+    }
+    fclose(p_file);
+    return true;
+}
+
+/* Decodes the BLE events of the stream. Returns false if the stream is malformed. */
+static bool events_decode(void)
+{
+    uint16_t pos = 0;
+
+    m_event_count = 0;
+    while ((m_event_count < BENCH_MAX_EVENTS) && evt_codec_next(m_stream, m_stream_len, &pos, &m_events[m_event_count]))
+    {
+        if (m_events[m_event_count].type == EVT_CODEC_TYPE_BLE)
+        {
+            m_event_count++;
+        }
+    }
+    return (m_event_count == BENCH_MAX_EVENTS) || (pos == m_stream_len) || (m_stream[pos] == EVT_CODEC_TYPE_END);
+}
+
+/* Replays the events BENCH_PASSES times through one of the dispatchers. Returns the time per event (ns). */
+static double replay(bool table)
+{
+    uint64_t start = clock_ns();
+    uint32_t pass;
+    uint32_t i;
+
+    memset(m_calls, 0, sizeof(m_calls));
+    memset(m_ble_dispatch_stats, 0, sizeof(m_ble_dispatch_stats));
+
+    for (pass = 0; pass < BENCH_PASSES; pass++)
+    {
+        for (i = 0; i < m_event_count; i++)
+        {
+            if (table)
+            {
+                ble_dispatch(m_ble_dispatch_table, m_ble_dispatch_stats, BLE_DISPATCH_TABLE_SIZE,
+                             evt_codec_ble_evt(&m_events[i]));
+            }
+            else
+            {
+                chain_dispatch(evt_codec_ble_evt(&m_events[i]));
+            }
+        }
+    }
+    return (double)(clock_ns() - start) / ((double)BENCH_PASSES * m_event_count);
+}
+
+/* Returns the cost of the two clock reads ble_dispatch() adds to each call (ns). */
+static double accounting_cost(void)
+{
+    uint64_t start = clock_ns();
+    uint32_t sum   = 0;
+    uint32_t i;
+
+    for (i = 0; i < BENCH_CLOCK_PAIRS; i++)
+    {
+        uint32_t t = cycle_prof_now();
+        sum += cycle_prof_now() - t;
+    }
+    m_sink += sum;
+    return (double)(clock_ns() - start) / BENCH_CLOCK_PAIRS;
+}
+
+/* Checks the calls of each table entry against the event IDs of the stream. */
+static bool table_check(void)
+{
+    uint32_t expected;
+    uint32_t i;
+    uint32_t e;
+    bool     ok = true;
+
+    for (i = 0; i < BLE_DISPATCH_TABLE_SIZE; i++)
+    {
+        expected = 0;
+        for (e = 0; e < m_event_count; e++)
+        {
+            ble_evt_t * p_evt = evt_codec_ble_evt(&m_events[e]);
+
+            if ((p_evt->header.evt_id >= m_ble_dispatch_table[i].evt_first)
+                && (p_evt->header.evt_id <= m_ble_dispatch_table[i].evt_last))
+            {
+                expected++;
+            }
+        }
+        if (m_ble_dispatch_stats[i].calls != expected * BENCH_PASSES)
+        {
+            printf("entry %u (%s): %u calls, %u expected\n", i, m_entry_names[i], m_ble_dispatch_stats[i].calls,
+                   expected * BENCH_PASSES);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+static uint32_t calls_total(void)
+{
+    uint32_t total = 0;
+    uint32_t i;
+
+    for (i = 0; i < MODULE_COUNT; i++)
+    {
+        total += m_calls[i];
+    }
+    return total;
+}
+
+int main(int argc, char ** argv)
+{
+    double   chain_ns;
+    double   table_ns;
+    double   clock_pair_ns;
+    uint32_t chain_calls;
+    uint32_t table_calls;
+    uint32_t i;
+    bool     ok;
+
+    if (argc > 1)
+    {
+        if (!stream_load(argv[1]))
+        {
+            fprintf(stderr, "%s: stream longer than %u bytes\n", argv[1], BENCH_STREAM_SIZE);
+            return 2;
+        }
+    }
+    else
+    {
+        session_generate();
+    }
+
+    ok = events_decode();
+    if (m_event_count == 0)
+    {
+        printf("no BLE events in the stream\n");
+        return 1;
+    }
+
+    // Warms up the caches and the branch predictors for both.
+    (void)replay(false);
+    (void)replay(true);
+
+    chain_ns      = replay(false);
+    chain_calls   = calls_total() / BENCH_PASSES;
+    table_ns      = replay(true);
+    table_calls   = calls_total() / BENCH_PASSES;
+    clock_pair_ns = accounting_cost();
+    ok            = table_check() && ok;
+
+    printf("stream of %u bytes, %u BLE events, %u passes\n\n", m_stream_len, m_event_count, BENCH_PASSES);
+    printf("dispatcher        handler calls   ns/event\n");
+    printf("chain             %13u %10.1f\n", chain_calls, chain_ns);
+    printf("table             %13u %10.1f\n", table_calls, table_ns);
+    printf("table, no clock   %13u %10.1f   (%.1f ns per clock pair taken out)\n", table_calls,
+           table_ns - clock_pair_ns * table_calls / m_event_count, clock_pair_ns);
+
+    printf("\nentry  handler        range         calls   mean_ns    max_ns\n");
+    for (i = 0; i < BLE_DISPATCH_TABLE_SIZE; i++)
+    {
+        ble_dispatch_stats_t const * p_stats = &m_ble_dispatch_stats[i];
+
+        printf("%5u  %-13s  0x%02x-0x%02x %10u %9.1f %9u\n", i, m_entry_names[i], m_ble_dispatch_table[i].evt_first,
+               m_ble_dispatch_table[i].evt_last, p_stats->calls,
+               (p_stats->calls > 0) ? (double)p_stats->cycles_sum / p_stats->calls : 0.0, p_stats->cycles_max);
+    }
+
+    if (!ok)
+    {
+        printf("\nFAIL\n");
+    }
+    return ok ? 0 : 1;
+}
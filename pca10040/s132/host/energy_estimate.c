@@ -0,0 +1,461 @@
+/* Battery life estimate of a configuration for a traffic trace, with the charge model of the firmware.
+ *
+ * The trace gives what the device does over time: the power states it goes through and the traffic on top
+ * of them. The tool adds up the time in each state and lays the presence checks over it the way power_mgr
+ * runs them: every POWER_MGR_CHECK_INTERVAL_MS from the start of the trace, in the states that leave the
+ * sensor off, each samples_in_buffer * sample_period_ms + POWER_MGR_CHECK_MARGIN_MS long or until a state
+ * powers the sensor. The result goes through energy_model_estimate() with the configuration and the charge
+ * figures, and the charge per consumer, the average current and the battery life are printed. With -l the
+ * tool exits with 1 if the battery life is below the given number of hours, so a configuration change can
+ * be checked against a budget.
+ *
+ * Configuration file, one setting per line, '#' starts a comment. Names are the fields of app_config_t
+ * (checked with app_config_param_is_valid()) and of energy_profile_t, settings not given keep the firmware
+ * defaults:
+ *   sample_period_ms  10
+ *   conn_event_nc     5200
+ *
+ * Trace file, one record per line, time in seconds from the start, '#' starts a comment:
+ *   <time_s> state <deep_idle|advertising|connected_idle|sampling|bulk_transfer>
+ *   <time_s> notify <count>         notifications sent
+ *   <time_s> adv <count>            undirected advertising events, without them they are derived from the
+ *   <time_s> adv_directed <count>   time advertising at adv_interval
+ *   <time_s> flash <words>          flash words written
+ *   <time_s> erase <pages>          flash pages erased
+ *   <time_s> conn_interval <ms>     connection interval in use from here on, the longest one counts
+ *   <time_s> end                    end of the trace, else the last record
+ * The trace starts in POWER_STATE_ADVERTISING, as power_mgr_init() does. Times must not go backwards.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -Isd_sim -I../arm5_no_packs energy_estimate.c ../arm5_no_packs/energy_model.c \
+ *       ../arm5_no_packs/app_config_record.c -o energy_estimate
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "app_config.h"
+#include "power_mgr.h"
+#include "energy_model.h"
+
+#define ESTIMATE_LINE_LEN           256
+
+/* A setting of the configuration file. */
+typedef struct
+{
+    char const * p_name;
+    int          param;                 /**< app_config_param_t of an app_config_t field, -1 for a charge figure. */
+    size_t       offset;
+    size_t       size;
+} setting_t;
+
+#define CONFIG_SETTING(field, param)    { #field, (param), offsetof(app_config_t, field), sizeof(((app_config_t *)0)->field) }
+#define PROFILE_SETTING(field)          { #field, -1, offsetof(energy_profile_t, field), sizeof(uint32_t) }
+
+static const setting_t          m_settings[] =
+{
+    CONFIG_SETTING(adv_interval,         APP_CONFIG_PARAM_ADV_INTERVAL),
+    CONFIG_SETTING(adv_timeout,          APP_CONFIG_PARAM_ADV_TIMEOUT),
+    CONFIG_SETTING(sample_period_ms,     APP_CONFIG_PARAM_SAMPLE_PERIOD),
+    CONFIG_SETTING(samples_in_buffer,    APP_CONFIG_PARAM_SAMPLES),
+    CONFIG_SETTING(value_max,            APP_CONFIG_PARAM_VALUE_MAX),
+    CONFIG_SETTING(release_level,        APP_CONFIG_PARAM_RELEASE_LEVEL),
+    CONFIG_SETTING(adv_floor_interval,   APP_CONFIG_PARAM_ADV_FLOOR),
+    CONFIG_SETTING(adv_ceiling_interval, APP_CONFIG_PARAM_ADV_CEILING),
+    CONFIG_SETTING(adv_burst_timeout,    APP_CONFIG_PARAM_ADV_BURST),
+    CONFIG_SETTING(report_modes,         APP_CONFIG_PARAM_REPORT_MODES),
+    CONFIG_SETTING(report_deadband,      APP_CONFIG_PARAM_REPORT_DEADBAND),
+    CONFIG_SETTING(report_period_s,      APP_CONFIG_PARAM_REPORT_PERIOD),
+    CONFIG_SETTING(report_heartbeat_s,   APP_CONFIG_PARAM_REPORT_HEARTBEAT),
+    CONFIG_SETTING(summary_window_s,     APP_CONFIG_PARAM_SUMMARY_WINDOW),
+    PROFILE_SETTING(adv_event_nc),
+    PROFILE_SETTING(adv_directed_nc),
+    PROFILE_SETTING(conn_event_nc),
+    PROFILE_SETTING(notification_nc),
+    PROFILE_SETTING(saadc_sample_nc),
+    PROFILE_SETTING(hfclk_ua),
+    PROFILE_SETTING(flash_word_nc),
+    PROFILE_SETTING(flash_page_erase_nc),
+    PROFILE_SETTING(sleep_ua),
+    PROFILE_SETTING(sensor_ua),
+    PROFILE_SETTING(battery_mah),
+};
+
+static char const * const       m_state_names[POWER_STATE_COUNT] =
+{
+    "deep_idle", "advertising", "connected_idle", "sampling", "bulk_transfer"
+};
+
+static char const * const       m_item_names[ENERGY_ITEM_COUNT] =
+{
+    "sleep", "advertising", "connection", "saadc", "hfclk", "flash", "sensor"
+};
+
+static app_config_t             m_config = APP_CONFIG_DEFAULTS;         /**< Same defaults as the firmware. */
+static energy_profile_t         m_profile = ENERGY_PROFILE_DEFAULT;
+static energy_activity_t        m_activity;
+
+/* Replay of the trace. */
+static power_state_t            m_state = POWER_STATE_ADVERTISING;
+static uint64_t                 m_now_ms;
+static uint64_t                 m_next_check_ms = POWER_MGR_CHECK_INTERVAL_MS;
+static bool                     m_check_active;
+static uint64_t                 m_check_started_ms;
+static uint64_t                 m_check_end_ms;
+static uint32_t                 m_checks;
+
+
+/* Splits a line into its first fields, cuts the comment. Returns the number of fields. */
+static int fields_split(char * p_line, char ** pp_fields, int max)
+{
+    int    count = 0;
+    char * p_comment = strchr(p_line, '#');
+    char * p_field;
+
+    if (p_comment != NULL)
+    {
+        *p_comment = '\0';
+    }
+    for (p_field = strtok(p_line, " \t\r\n"); p_field != NULL; p_field = strtok(NULL, " \t\r\n"))
+    {
+        if (count == max)
+        {
+            return max + 1;
+        }
+        pp_fields[count++] = p_field;
+    }
+    return count;
+}
+
+static bool number_parse(char const * p_text, unsigned long max, unsigned long * p_value)
+{
+    char * p_end;
+
+    *p_value = strtoul(p_text, &p_end, 0);
+    return (*p_text != '\0') && (*p_end == '\0') && (*p_value <= max);
+}
+
+static void input_error(char const * p_path, uint32_t line, char const * p_what)
+{
+    fprintf(stderr, "%s:%u: %s\n", p_path, line, p_what);
+    exit(2);
+}
+
+static void config_load(char const * p_path)
+{
+    FILE        * p_file = fopen(p_path, "r");
+    char          line[ESTIMATE_LINE_LEN];
+    char        * fields[2];
+    uint32_t      line_no = 0;
+    unsigned long value;
+    size_t        i;
+
+    if (p_file == NULL)
+    {
+        perror(p_path);
+        exit(2);
+    }
+    while (fgets(line, sizeof(line), p_file) != NULL)
+    {
+        int count = fields_split(line, fields, 2);
+
+        line_no++;
+        if (count == 0)
+        {
+            continue;
+        }
+        if (count != 2)
+        {
+            input_error(p_path, line_no, "expected <name> <value>");
+        }
+        for (i = 0; (i < sizeof(m_settings) / sizeof(m_settings[0])) && (strcmp(fields[0], m_settings[i].p_name) != 0); i++)
+        {
+        }
+        if (i == sizeof(m_settings) / sizeof(m_settings[0]))
+        {
+            input_error(p_path, line_no, "unknown setting");
+        }
+
+        if (m_settings[i].param < 0)
+        {
+            if (!number_parse(fields[1], UINT32_MAX, &value))
+            {
+                input_error(p_path, line_no, "bad value");
+            }
+            *(uint32_t *)((uint8_t *)&m_profile + m_settings[i].offset) = (uint32_t)value;
+            continue;
+        }
+        if (!number_parse(fields[1], UINT16_MAX, &value)
+            || !app_config_param_is_valid((app_config_param_t)m_settings[i].param, (uint16_t)value))
+        {
+            input_error(p_path, line_no, "value out of range");
+        }
+        if (m_settings[i].size == sizeof(uint8_t))
+        {
+            *((uint8_t *)&m_config + m_settings[i].offset) = (uint8_t)value;
+        }
+        else
+        {
+            *(uint16_t *)((uint8_t *)&m_config + m_settings[i].offset) = (uint16_t)value;
+        }
+    }
+    fclose(p_file);
+
+    if ((m_config.release_level >= m_config.value_max) || (m_config.adv_floor_interval > m_config.adv_ceiling_interval))
+    {
+        fprintf(stderr, "%s: release_level must be below value_max, adv_floor_interval not above adv_ceiling_interval\n",
+                p_path);
+        exit(2);
+    }
+}
+
+/* States that power the sensor themselves, a presence check never runs in them. */
+static bool state_sensor_power(power_state_t state)
+{
+    return (state == POWER_STATE_CONNECTED_IDLE) || (state == POWER_STATE_SAMPLING) || (state == POWER_STATE_BULK_TRANSFER);
+}
+
+static void check_end(uint64_t now_ms)
+{
+    m_activity.check_ms += now_ms - m_check_started_ms;
+    m_check_active       = false;
+}
+
+/* Moves the replay to time_ms in the current state, with the presence checks due on the way. */
+static void advance(uint64_t time_ms)
+{
+    for (;;)
+    {
+        if (m_check_active && (m_check_end_ms <= m_next_check_ms) && (m_check_end_ms <= time_ms))
+        {
+            check_end(m_check_end_ms);
+        }
+        else if (m_next_check_ms <= time_ms)
+        {
+            // The check timer is repeated, it fires whether or not a check can start.
+            if (!m_check_active && !state_sensor_power(m_state))
+            {
+                m_check_active     = true;
+                m_check_started_ms = m_next_check_ms;
+                m_check_end_ms     = m_next_check_ms
+                                   + (uint64_t)m_config.samples_in_buffer * m_config.sample_period_ms
+                                   + POWER_MGR_CHECK_MARGIN_MS;
+                m_checks++;
+            }
+            m_next_check_ms += POWER_MGR_CHECK_INTERVAL_MS;
+        }
+        else
+        {
+            break;
+        }
+    }
+    m_activity.time_in_state_ms[m_state] += time_ms - m_now_ms;
+    m_now_ms = time_ms;
+}
+
+static void state_enter(power_state_t state)
+{
+    // A running check goes on unless the new state powers the sensor itself.
+    if (m_check_active && state_sensor_power(state))
+    {
+        check_end(m_now_ms);
+    }
+    m_state = state;
+}
+
+static void trace_load(char const * p_path)
+{
+    FILE        * p_file = fopen(p_path, "r");
+    char          line[ESTIMATE_LINE_LEN];
+    char        * fields[3];
+    uint32_t      line_no = 0;
+    unsigned long value = 0;
+    uint64_t      time_ms;
+    double        time_s;
+    char        * p_end;
+    bool          ended = false;
+    int           state;
+
+    if (p_file == NULL)
+    {
+        perror(p_path);
+        exit(2);
+    }
+    while (!ended && (fgets(line, sizeof(line), p_file) != NULL))
+    {
+        int count = fields_split(line, fields, 3);
+
+        line_no++;
+        if (count == 0)
+        {
+            continue;
+        }
+        if (count < 2)
+        {
+            input_error(p_path, line_no, "expected <time_s> <record> [value]");
+        }
+        time_s = strtod(fields[0], &p_end);
+        if ((*p_end != '\0') || (time_s < 0))
+        {
+            input_error(p_path, line_no, "bad time");
+        }
+        time_ms = (uint64_t)(time_s * 1000 + 0.5);
+        if (time_ms < m_now_ms)
+        {
+            input_error(p_path, line_no, "time goes backwards");
+        }
+        advance(time_ms);
+
+        if (strcmp(fields[1], "end") == 0)
+        {
+            if (count != 2)
+            {
+                input_error(p_path, line_no, "end takes no value");
+            }
+            ended = true;
+            continue;
+        }
+        if (count != 3)
+        {
+            input_error(p_path, line_no, "record without a value");
+        }
+        if (strcmp(fields[1], "state") == 0)
+        {
+            for (state = 0; (state < POWER_STATE_COUNT) && (strcmp(fields[2], m_state_names[state]) != 0); state++)
+            {
+            }
+            if (state == POWER_STATE_COUNT)
+            {
+                input_error(p_path, line_no, "unknown state");
+            }
+            state_enter((power_state_t)state);
+            continue;
+        }
+        if (!number_parse(fields[2], UINT32_MAX, &value))
+        {
+            input_error(p_path, line_no, "bad value");
+        }
+        if (strcmp(fields[1], "notify") == 0)
+        {
+            m_activity.notifications += value;
+        }
+        else if (strcmp(fields[1], "adv") == 0)
+        {
+            m_activity.adv_events += value;
+        }
+        else if (strcmp(fields[1], "adv_directed") == 0)
+        {
+            m_activity.adv_directed_events += value;
+        }
+        else if (strcmp(fields[1], "flash") == 0)
+        {
+            m_activity.flash_words += value;
+        }
+        else if (strcmp(fields[1], "erase") == 0)
+        {
+            m_activity.flash_page_erases += value;
+        }
+        else if (strcmp(fields[1], "conn_interval") == 0)
+        {
+            // energy_model takes one interval, the longest one gives the fewest connection events.
+            if ((value == 0) || (value > 4000))
+            {
+                input_error(p_path, line_no, "connection interval out of range");
+            }
+            if (value > m_activity.conn_interval_ms)
+            {
+                m_activity.conn_interval_ms = value;
+            }
+        }
+        else
+        {
+            input_error(p_path, line_no, "unknown record");
+        }
+    }
+    fclose(p_file);
+
+    // A check running at the end counts up to the end.
+    if (m_check_active)
+    {
+        check_end((m_check_end_ms < m_now_ms) ? m_check_end_ms : m_now_ms);
+    }
+}
+
+static void usage(char const * p_name)
+{
+    fprintf(stderr, "usage: %s [-c config] [-l min_battery_life_h] trace\n", p_name);
+    exit(2);
+}
+
+int main(int argc, char ** argv)
+{
+    energy_estimate_t estimate;
+    unsigned long     life_min_h = 0;
+    uint8_t           state;
+    uint8_t           item;
+    int               opt;
+
+    while ((opt = getopt(argc, argv, "c:l:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'c': config_load(optarg); break;
+            case 'l':
+                if (!number_parse(optarg, UINT32_MAX, &life_min_h))
+                {
+                    usage(argv[0]);
+                }
+                break;
+            default:  usage(argv[0]);
+        }
+    }
+    if (optind != argc - 1)
+    {
+        usage(argv[0]);
+    }
+    trace_load(argv[optind]);
+
+    energy_model_estimate(&m_profile, &m_config, &m_activity, &estimate);
+    if (estimate.period_ms == 0)
+    {
+        fprintf(stderr, "%s: trace is empty\n", argv[optind]);
+        return 2;
+    }
+
+    printf("trace %.1f s, adv_interval %u, sample_period_ms %u, samples_in_buffer %u\n\n",
+           estimate.period_ms / 1000.0, m_config.adv_interval, m_config.sample_period_ms, m_config.samples_in_buffer);
+    printf("state              time_s       %%\n");
+    for (state = 0; state < POWER_STATE_COUNT; state++)
+    {
+        printf("%-14s %10.1f  %5.1f%%\n", m_state_names[state], m_activity.time_in_state_ms[state] / 1000.0,
+               100.0 * m_activity.time_in_state_ms[state] / estimate.period_ms);
+    }
+    printf("presence check %10.1f  %5.1f%%  (%u checks)\n", m_activity.check_ms / 1000.0,
+           100.0 * m_activity.check_ms / estimate.period_ms, m_checks);
+
+    printf("\nconsumer        charge_mC       %%\n");
+    for (item = 0; item < ENERGY_ITEM_COUNT; item++)
+    {
+        printf("%-14s %10.1f  %5.1f%%\n", m_item_names[item], estimate.charge_nc[item] / 1e6,
+               (estimate.total_nc == 0) ? 0.0 : 100.0 * estimate.charge_nc[item] / estimate.total_nc);
+    }
+
+    printf("\naverage current %u uA\n", estimate.average_ua);
+    if (estimate.battery_life_h == UINT32_MAX)
+    {
+        printf("battery life unlimited\n");
+        return 0;
+    }
+    printf("battery life %u h (%.1f days) on %u mAh\n", estimate.battery_life_h, estimate.battery_life_h / 24.0,
+           m_profile.battery_mah);
+
+    if ((life_min_h != 0) && (estimate.battery_life_h < life_min_h))
+    {
+        printf("FAIL, below %lu h\n", life_min_h);
+        return 1;
+    }
+    return 0;
+}
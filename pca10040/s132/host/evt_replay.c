@@ -0,0 +1,569 @@
+/* Replay of recorded SoftDevice event streams (evt_record) into the application handlers.
+ *
+ * Feeds each BLE event of the stream to the handlers through ble_dispatch, at the virtual time the stream
+ * gives it, with sd_sim_replay() keeping the simulated SoftDevice in the state the events imply, so the
+ * notifications the handlers send are queued and delivered on the recorded TX complete events. A boot
+ * record starts the handlers over. The replay runs twice and must give the same digest of everything the
+ * peers received and of the final link table, benchmark and advertising state. The time spent in the
+ * handlers is listed by event (host clock).
+ *
+ * The handlers are the services of the firmware, set up and wired as in main.c: the SDC service with the
+ * link benchmark command and advertising control. Sampling is driven by the SAADC, not by events, so values
+ * are not part of a replay. Neither are the CCCD values the peer manager restores for bonded peers, their
+ * notifications start disabled until the peer writes the CCCD again.
+ *
+ * Without a file a scripted session runs on the simulator first while being recorded: connections, CCCD
+ * writes, a benchmark, an interval update, a second link, disconnects and advertising timeouts. Its replays
+ * must match the live run, so the script only drives the peers; a call into the handlers from outside
+ * (as main.c does from timers and buttons) would not be in the stream. -w writes that recording, as the hex the file argument takes.
+ *
+ * A file holds the stream bytes in hex (whitespace separated, # starts a comment), as read from the
+ * DIAG_PAGE_EVENTS chunks one after the other. Attribute handles of a device recording count the GAP and GATT
+ * services in front of the SDC service, -o gives the handle the SDC service has on the device. Exits with 1
+ * if a replay differs or the stream is malformed.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -DBLE_DISPATCH_CYCLE_COUNT=0 -Isd_sim -I../arm5_no_packs evt_replay.c sd_sim/sd_sim.c \
+ *       ../arm5_no_packs/evt_codec.c ../arm5_no_packs/ble_dispatch.c ../arm5_no_packs/ble_sensor_data_custom.c \
+ *       ../arm5_no_packs/link_bench.c ../arm5_no_packs/sdc_frame.c ../arm5_no_packs/adv_ctrl.c -o evt_replay
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <time.h>
+#include "sd_sim.h"
+#include "app_error.h"
+#include "app_time.h"
+#include "ble_sensor_data_custom.h"
+#include "ble_dispatch.h"
+#include "link_bench.h"
+#include "adv_ctrl.h"
+#include "evt_codec.h"
+
+#define REPLAY_STREAM_SIZE          16384                               /**< Longest stream (in bytes). */
+#define REPLAY_CONN_HANDLE_BASE     0x0010                              /**< Link n of the scripted session gets REPLAY_CONN_HANDLE_BASE + n. */
+#define REPLAY_CMD_LINK_BENCH       0x07                                /**< SDC_CMD_LINK_BENCH of main.c. */
+#define REPLAY_EVT_IDS              0x70                                /**< Event IDs profiled, up to the GATTS range. */
+#define FNV_OFFSET                  2166136261u
+#define FNV_PRIME                   16777619u
+
+/* Time spent in the handlers for one event ID. */
+typedef struct
+{
+    uint32_t count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+} profile_t;
+
+/* Outcome of a run, compared between the live session and the replays. */
+typedef struct
+{
+    uint32_t events;
+    uint32_t rejected;                  /**< Events that did not fit the simulator state. */
+    uint32_t sys_events;
+    uint32_t notifications;             /**< Notifications the peers received. */
+    uint32_t digest;                    /**< FNV-1a of the notifications and the final state. */
+} outcome_t;
+
+static ble_sdc_t                m_sdc;
+static uint8_t                  m_stream[REPLAY_STREAM_SIZE];
+static uint16_t                 m_stream_len;
+static bool                     m_recording;
+static uint64_t                 m_last_us;                              /**< Time of the last recorded event. */
+static outcome_t                m_outcome;
+static profile_t                m_profile[REPLAY_EVT_IDS];
+static bool                     m_verbose;
+
+static const adv_ctrl_config_t  m_adv_config =
+{
+    .directed_bursts    = 0,
+    .whitelist_interval = 0,
+    .whitelist_timeout  = 0,
+    .open_interval      = 160,
+    .open_timeout       = 1,
+    .open_step          = NULL,
+    .link_count         = BLE_SDC_MAX_LINKS,
+};
+
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t * p_file_name)
+{
+    fprintf(stderr, "app_error 0x%x at %s:%u\n", error_code, (char const *)p_file_name, line_num);
+    exit(2);
+}
+
+/* Time base of the modules, taken from the simulator. */
+uint64_t app_time_us_get(void)
+{
+    return sd_sim_time_us_get();
+}
+
+uint64_t app_time_ms_get(void)
+{
+    return sd_sim_time_us_get() / 1000;
+}
+
+static uint64_t clock_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static void digest_add(uint8_t const * p_data, uint16_t len)
+{
+    uint16_t i;
+
+    for (i = 0; i < len; i++)
+    {
+        m_outcome.digest = (m_outcome.digest ^ p_data[i]) * FNV_PRIME;
+    }
+}
+
+/* Takes the benchmark command of main.c. */
+static void sdc_data_handler(ble_sdc_t * p_sdc, uint8_t * p_data, uint16_t length)
+{
+    if ((length == 2) && (p_data[0] == REPLAY_CMD_LINK_BENCH))
+    {
+        (void)link_bench_start(p_sdc, p_data[1]);
+    }
+}
+
+static void sdc_evt_handler(ble_sdc_t * p_sdc, ble_sdc_evt_type_t evt_type, uint8_t link)
+{
+    UNUSED_PARAMETER(p_sdc);
+    UNUSED_PARAMETER(evt_type);
+    UNUSED_PARAMETER(link);
+}
+
+static void adv_evt_handler(adv_ctrl_evt_t evt, adv_ctrl_mode_t mode)
+{
+    UNUSED_PARAMETER(evt);
+    UNUSED_PARAMETER(mode);
+}
+
+/* Passes BLE events to the service and the benchmark, as sdc_on_ble_evt() of main.c. The benchmark refills
+ * the TX buffers after the event, as the main loop does. */
+static void sdc_on_ble_evt(ble_evt_t * p_ble_evt)
+{
+    ble_sdc_on_ble_evt(&m_sdc, p_ble_evt);
+    link_bench_on_ble_evt(p_ble_evt);
+}
+
+/* The entries of the dispatch table of main.c that have host builds. */
+static const ble_dispatch_entry_t m_ble_dispatch_table[] =
+{
+    BLE_DISPATCH_ENTRY(BLE_EVT_BASE,        BLE_GAP_EVT_LAST,    sdc_on_ble_evt),
+    BLE_DISPATCH_ENTRY(BLE_GATTS_EVT_BASE,  BLE_GATTS_EVT_LAST,  sdc_on_ble_evt),
+    BLE_DISPATCH_ENTRY(BLE_GAP_EVT_BASE,    BLE_GAP_EVT_LAST,    adv_ctrl_on_ble_evt),
+};
+
+#define BLE_DISPATCH_TABLE_SIZE     (sizeof(m_ble_dispatch_table) / sizeof(m_ble_dispatch_table[0]))
+
+static ble_dispatch_stats_t     m_ble_dispatch_stats[BLE_DISPATCH_TABLE_SIZE];
+
+/* Records the event if the live session runs, then dispatches it and times the handlers. */
+static void ble_evt_dispatch(ble_evt_t * p_ble_evt)
+{
+    uint16_t evt_id = p_ble_evt->header.evt_id;
+    uint64_t start;
+    uint64_t ns;
+    uint64_t now = sd_sim_time_us_get();
+
+    if (m_recording)
+    {
+        m_stream_len += evt_codec_ble_encode(p_ble_evt, (uint32_t)(now - m_last_us),
+                                             &m_stream[m_stream_len], sizeof(m_stream) - m_stream_len);
+        m_last_us     = now;
+    }
+
+    start = clock_ns();
+    ble_dispatch(m_ble_dispatch_table, m_ble_dispatch_stats, BLE_DISPATCH_TABLE_SIZE, p_ble_evt);
+    ns    = clock_ns() - start;
+    link_bench_process();
+
+    m_outcome.events++;
+    if (evt_id < REPLAY_EVT_IDS)
+    {
+        m_profile[evt_id].count++;
+        m_profile[evt_id].sum_ns += ns;
+        m_profile[evt_id].max_ns  = MAX(m_profile[evt_id].max_ns, ns);
+    }
+}
+
+static void peer_rx_handler(uint16_t conn_handle, uint16_t handle, uint8_t const * p_data, uint16_t len)
+{
+    uint8_t header[4];
+
+    (void)uint16_encode(conn_handle, &header[0]);
+    (void)uint16_encode(handle, &header[2]);
+    digest_add(header, sizeof(header));
+    digest_add(p_data, len);
+    m_outcome.notifications++;
+}
+
+/* Sets up the simulator and the handlers, as after a boot. */
+static void app_start(void)
+{
+    sd_sim_config_t config;
+    ble_sdc_init_t  sdc_init;
+
+    config.tx_buffer_count   = SD_SIM_TX_BUFFERS_DEFAULT;
+    config.packets_per_event = SD_SIM_PACKETS_PER_EVENT;
+    config.conn_interval_us  = 7500;
+    config.link_count        = BLE_SDC_MAX_LINKS;
+    sd_sim_seed_set(1);
+    sd_sim_init(&config, ble_evt_dispatch);
+    sd_sim_peer_rx_handler_set(peer_rx_handler);
+
+    memset(&sdc_init, 0, sizeof(sdc_init));
+    sdc_init.data_handler = sdc_data_handler;
+    sdc_init.evt_handler  = sdc_evt_handler;
+    APP_ERROR_CHECK(ble_sdc_init(&m_sdc, &sdc_init));
+    APP_ERROR_CHECK(adv_ctrl_init(&m_adv_config, adv_evt_handler));
+    adv_ctrl_peers_set(NULL, NULL);
+    APP_ERROR_CHECK(adv_ctrl_start(ADV_CTRL_MODE_OPEN));
+}
+
+/* Adds the final state of the handlers to the digest. */
+static void state_digest(void)
+{
+    uint8_t buf[BLE_SDC_MAX_DIAG_LEN];
+    uint8_t link;
+
+    digest_add(buf, ble_sdc_links_encode(&m_sdc, buf, sizeof(buf)));
+    for (link = 0; link < BLE_SDC_MAX_LINKS; link++)
+    {
+        digest_add(buf, link_bench_encode(link, buf, sizeof(buf)));
+    }
+    digest_add(buf, adv_ctrl_encode(buf, sizeof(buf)));
+}
+
+static void cccd_write(uint8_t n, uint16_t value)
+{
+    uint8_t cccd[BLE_CCCD_VALUE_LEN];
+
+    (void)uint16_encode(value, cccd);
+    APP_ERROR_CHECK(sd_sim_peer_write(REPLAY_CONN_HANDLE_BASE + n, m_sdc.rx_handles.cccd_handle, cccd, sizeof(cccd)));
+}
+
+static void bench_command(uint8_t n, uint8_t duration_s)
+{
+    uint8_t cmd[2] = { REPLAY_CMD_LINK_BENCH, duration_s };
+
+    APP_ERROR_CHECK(sd_sim_peer_write(REPLAY_CONN_HANDLE_BASE + n, m_sdc.tx_handles.value_handle, cmd, sizeof(cmd)));
+}
+
+/* Runs the scripted session on the simulator, recording the events. */
+static void session_run(void)
+{
+    memset(&m_outcome, 0, sizeof(m_outcome));
+    m_outcome.digest = FNV_OFFSET;
+    m_stream_len     = evt_codec_value_encode(EVT_CODEC_TYPE_BOOT, 0, 0, m_stream, sizeof(m_stream));
+    m_last_us        = 0;
+    m_recording      = true;
+
+    app_start();
+    sd_sim_run(1500000);                                    // Advertising times out, the disconnects start it again.
+    APP_ERROR_CHECK(sd_sim_connect(REPLAY_CONN_HANDLE_BASE + 0));
+    sd_sim_run(50000);
+    cccd_write(0, BLE_GATT_HVX_NOTIFICATION);
+    bench_command(0, 2);
+    sd_sim_run(1000000);
+    sd_sim_conn_interval_set(REPLAY_CONN_HANDLE_BASE + 0, 30000);
+    sd_sim_run(500000);
+    APP_ERROR_CHECK(sd_sim_connect(REPLAY_CONN_HANDLE_BASE + 1));
+    cccd_write(1, BLE_GATT_HVX_NOTIFICATION);
+    sd_sim_run(1000000);
+    sd_sim_disconnect(REPLAY_CONN_HANDLE_BASE + 0, 0x13);
+    bench_command(1, 1);
+    sd_sim_run(1500000);
+    cccd_write(1, 0);
+    sd_sim_disconnect(REPLAY_CONN_HANDLE_BASE + 1, 0x08);
+
+    // A replay ends with the last event, so does the state compared with it.
+    m_recording = false;
+    state_digest();
+}
+
+static char const * evt_name(uint16_t evt_id)
+{
+    switch (evt_id)
+    {
+        case BLE_EVT_TX_COMPLETE:                return "TX_COMPLETE";
+        case BLE_GAP_EVT_CONNECTED:              return "CONNECTED";
+        case BLE_GAP_EVT_DISCONNECTED:           return "DISCONNECTED";
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:      return "CONN_PARAM_UPDATE";
+        case BLE_GAP_EVT_CONN_SEC_UPDATE:        return "CONN_SEC_UPDATE";
+        case BLE_GAP_EVT_TIMEOUT:                return "TIMEOUT";
+        case BLE_GATTS_EVT_WRITE:                return "WRITE";
+        case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST: return "RW_AUTHORIZE_REQUEST";
+        case BLE_GATTS_EVT_SYS_ATTR_MISSING:     return "SYS_ATTR_MISSING";
+        case BLE_GATTS_EVT_HVC:                  return "HVC";
+        default:                                 return "other";
+    }
+}
+
+/* Moves the attribute handles of a device recording onto the simulated attribute table. */
+static void handles_map(ble_evt_t * p_evt, int32_t offset)
+{
+    ble_gatts_evt_t * p_gatts = &p_evt->evt.gatts_evt;
+
+    if (p_evt->header.evt_id == BLE_GATTS_EVT_WRITE)
+    {
+        p_gatts->params.write.handle = (uint16_t)(p_gatts->params.write.handle - offset);
+    }
+    else if (p_evt->header.evt_id == BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST)
+    {
+        if (p_gatts->params.authorize_request.type == BLE_GATTS_AUTHORIZE_TYPE_WRITE)
+        {
+            p_gatts->params.authorize_request.request.write.handle = (uint16_t)(p_gatts->params.authorize_request.request.write.handle - offset);
+        }
+        else
+        {
+            p_gatts->params.authorize_request.request.read.handle = (uint16_t)(p_gatts->params.authorize_request.request.read.handle - offset);
+        }
+    }
+}
+
+/* Replays the stream. Returns false if it is malformed. */
+static bool replay_run(int32_t handle_offset, bool verbose)
+{
+    evt_codec_item_t item;
+    ble_evt_t      * p_evt = evt_codec_ble_evt(&item);
+    uint16_t         pos = 0;
+    uint64_t         time_us = 0;
+    bool             started = false;
+
+    memset(&m_outcome, 0, sizeof(m_outcome));
+    m_outcome.digest = FNV_OFFSET;
+
+    while (evt_codec_next(m_stream, m_stream_len, &pos, &item))
+    {
+        time_us += item.delta_us;
+
+        switch (item.type)
+        {
+            case EVT_CODEC_TYPE_BOOT:
+                if (verbose)
+                {
+                    printf("%12.3f  boot, reset reason 0x%08x\n", time_us / 1000.0, item.value);
+                }
+                // The device starts over, at time 0 again.
+                time_us = 0;
+                app_start();
+                started = true;
+                break;
+
+            case EVT_CODEC_TYPE_SYS:
+                if (verbose)
+                {
+                    printf("%12.3f  system event %u\n", time_us / 1000.0, item.value);
+                }
+                m_outcome.sys_events++;
+                break;
+
+            case EVT_CODEC_TYPE_BLE:
+                if (!started)
+                {
+                    // The stream starts after a wrap of the ring, set up the handlers as they are after a boot.
+                    app_start();
+                    started = true;
+                }
+                handles_map(p_evt, handle_offset);
+                if (verbose)
+                {
+                    printf("%12.3f  %-20s conn 0x%04x\n", time_us / 1000.0, evt_name(p_evt->header.evt_id),
+                           p_evt->evt.common_evt.conn_handle);
+                }
+                if (sd_sim_replay(p_evt, time_us) != NRF_SUCCESS)
+                {
+                    printf("%12.3f  %s does not fit the replayed state, skipped\n", time_us / 1000.0,
+                           evt_name(p_evt->header.evt_id));
+                    m_outcome.rejected++;
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    state_digest();
+    return (pos == m_stream_len) || (m_stream[pos] == EVT_CODEC_TYPE_END);
+}
+
+/* Reads the hex bytes of a stream file. Returns false if it does not fit. */
+static bool stream_load(char const * p_path)
+{
+    FILE * p_file = fopen(p_path, "r");
+    char   line[512];
+    int    hi = -1;
+
+    if (p_file == NULL)
+    {
+        perror(p_path);
+        exit(2);
+    }
+
+    m_stream_len = 0;
+    while (fgets(line, sizeof(line), p_file) != NULL)
+    {
+        char * p = line;
+
+        for (; (*p != '\0') && (*p != '#'); p++)
+        {
+            int nibble;
+
+            if (!isxdigit((unsigned char)*p))
+            {
+                hi = -1;
+                continue;
+            }
+            nibble = isdigit((unsigned char)*p) ? (*p - '0') : (tolower((unsigned char)*p) - 'a' + 10);
+            if (hi < 0)
+            {
+                hi = nibble;
+                continue;
+            }
+            if (m_stream_len == sizeof(m_stream))
+            {
+                fclose(p_file);
+                return false;
+            }
+            m_stream[m_stream_len++] = (uint8_t)((hi << 4) | nibble);
+            hi = -1;
+        }
+    }
+    fclose(p_file);
+    return true;
+}
+
+static void stream_write(char const * p_path)
+{
+    FILE   * p_file = fopen(p_path, "w");
+    uint16_t i;
+
+    if (p_file == NULL)
+    {
+        perror(p_path);
+        exit(2);
+    }
+    fprintf(p_file, "# evt_record stream, %u bytes\n", m_stream_len);
+    for (i = 0; i < m_stream_len; i++)
+    {
+        fprintf(p_file, "%02x%c", m_stream[i], ((i % 16) == 15) ? '\n' : ' ');
+    }
+    fprintf(p_file, "\n");
+    fclose(p_file);
+}
+
+static void outcome_print(char const * p_name, outcome_t const * p_outcome)
+{
+    printf("%-8s %7u %8u %6u %8u   %08x\n", p_name, p_outcome->events, p_outcome->rejected,
+           p_outcome->sys_events, p_outcome->notifications, p_outcome->digest);
+}
+
+static void profile_print(void)
+{
+    uint16_t evt_id;
+
+    printf("\nhandler time by event (host clock, second replay)\n");
+    printf("event                   count   mean_ns    max_ns\n");
+    for (evt_id = 0; evt_id < REPLAY_EVT_IDS; evt_id++)
+    {
+        if (m_profile[evt_id].count != 0)
+        {
+            printf("%-20s %8u %9.0f %9u\n", evt_name(evt_id), m_profile[evt_id].count,
+                   (double)m_profile[evt_id].sum_ns / m_profile[evt_id].count, (uint32_t)m_profile[evt_id].max_ns);
+        }
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    char const * p_out = NULL;
+    int32_t      offset = 0;
+    bool         live = true;
+    bool         ok;
+    outcome_t    live_outcome;
+    outcome_t    first;
+    int          opt;
+
+    memset(&live_outcome, 0, sizeof(live_outcome));
+
+    while ((opt = getopt(argc, argv, "o:vw:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'o': offset    = atoi(optarg); break;
+            case 'v': m_verbose = true;         break;
+            case 'w': p_out     = optarg;       break;
+            default:
+                fprintf(stderr, "usage: %s [-v] [-w recording] [-o sdc_service_handle] [stream]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    if (optind < argc)
+    {
+        live = false;
+        if (!stream_load(argv[optind]))
+        {
+            fprintf(stderr, "%s: stream longer than %u bytes\n", argv[optind], REPLAY_STREAM_SIZE);
+            return 2;
+        }
+        if (offset != 0)
+        {
+            // The attribute table is the same on every run, the service handle of the first one will do.
+            app_start();
+            offset -= m_sdc.service_handle;
+        }
+    }
+    else
+    {
+        session_run();
+        live_outcome = m_outcome;
+        if (p_out != NULL)
+        {
+            stream_write(p_out);
+        }
+    }
+
+    printf("stream of %u bytes\n\n", m_stream_len);
+    printf("run       events rejected    sys notifs   digest\n");
+    if (live)
+    {
+        outcome_print("live", &live_outcome);
+    }
+
+    ok    = replay_run(offset, m_verbose);
+    first = m_outcome;
+    outcome_print("replay 1", &first);
+
+    memset(m_profile, 0, sizeof(m_profile));
+    ok   &= replay_run(offset, false);
+    outcome_print("replay 2", &m_outcome);
+    profile_print();
+
+    if (!ok)
+    {
+        printf("\nmalformed stream\n");
+    }
+    if (first.digest != m_outcome.digest)
+    {
+        printf("\nreplays differ\n");
+        ok = false;
+    }
+    if (live && ((live_outcome.digest != first.digest) || (first.rejected != 0)))
+    {
+        printf("\nreplay differs from the live run\n");
+        ok = false;
+    }
+
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,282 @@
+/* Host run of the SDC service with several clients connected at once.
+ *
+ * Checks that every link keeps its own CCCD, that ble_sdc_data_send() reaches each subscriber and reports
+ * which ones in its bitmask, that a disconnect leaves the other links notifying, and that a link with a
+ * long connection interval only drops its own copies: the fast link keeps getting every value. Then
+ * measures the fan-out cost for 1 to BLE_SDC_MAX_LINKS subscribers: time per ble_sdc_data_send() (cycle_prof
+ * macros of the firmware, on the monotonic clock here), hvx calls per value and the values delivered and
+ * dropped per link. Exits with 1 if a check fails.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -DBLE_SDC_MAX_LINKS=4 -Isd_sim -I../arm5_no_packs fanout_bench.c sd_sim/sd_sim.c \
+ *       ../arm5_no_packs/ble_sensor_data_custom.c ../arm5_no_packs/cycle_prof.c -o fanout_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sd_sim.h"
+#include "app_error.h"
+#include "ble_sensor_data_custom.h"
+#include "cycle_prof.h"
+
+#define BENCH_CONN_HANDLE_BASE      0x0010                              /**< Link n gets BENCH_CONN_HANDLE_BASE + n. */
+#define BENCH_DURATION_US           10000000                            /**< Virtual time of each run. */
+#define BENCH_SAMPLE_US             5000                                /**< Value period of the mixed interval run. */
+#define BENCH_VALUE_US              100000                              /**< Value period of the fan-out runs. */
+#define BENCH_VALUE_LEN             3                                   /**< Size of a value notification (in bytes). */
+#define BENCH_FAST_INTERVAL_US      7500
+#define BENCH_SLOW_INTERVAL_US      75000
+
+#if (BLE_SDC_MAX_LINKS > SD_SIM_MAX_LINKS) || (BLE_SDC_MAX_LINKS < 2)
+#error "BLE_SDC_MAX_LINKS must be between 2 and SD_SIM_MAX_LINKS"
+#endif
+
+static ble_sdc_t                m_sdc;
+static uint32_t                 m_peer_rx[BLE_SDC_MAX_LINKS];           /**< Notifications received, per connection handle. */
+static uint32_t                 m_enabled_evts;
+static uint32_t                 m_disabled_evts;
+static uint32_t                 m_failures;
+
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t * p_file_name)
+{
+    fprintf(stderr, "app_error 0x%x at %s:%u\n", error_code, (char const *)p_file_name, line_num);
+    exit(2);
+}
+
+static void check(bool condition, char const * p_what)
+{
+    printf("%-56s %s\n", p_what, condition ? "ok" : "FAILED");
+    if (!condition)
+    {
+        m_failures++;
+    }
+}
+
+static void sdc_data_handler(ble_sdc_t * p_sdc, uint8_t * p_data, uint16_t length)
+{
+    UNUSED_PARAMETER(p_sdc);
+    UNUSED_PARAMETER(p_data);
+    UNUSED_PARAMETER(length);
+}
+
+static void sdc_evt_handler(ble_sdc_t * p_sdc, ble_sdc_evt_type_t evt_type, uint8_t link)
+{
+    UNUSED_PARAMETER(p_sdc);
+    UNUSED_PARAMETER(link);
+    if (evt_type == BLE_SDC_EVT_NOTIFICATION_ENABLED)
+    {
+        m_enabled_evts++;
+    }
+    else
+    {
+        m_disabled_evts++;
+    }
+}
+
+static void ble_evt_handler(ble_evt_t * p_ble_evt)
+{
+    ble_sdc_on_ble_evt(&m_sdc, p_ble_evt);
+}
+
+static void peer_rx_handler(uint16_t conn_handle, uint16_t handle, uint8_t const * p_data, uint16_t len)
+{
+    UNUSED_PARAMETER(p_data);
+    UNUSED_PARAMETER(len);
+    if ((handle == m_sdc.rx_handles.value_handle) && (conn_handle >= BENCH_CONN_HANDLE_BASE)
+        && (conn_handle < BENCH_CONN_HANDLE_BASE + BLE_SDC_MAX_LINKS))
+    {
+        m_peer_rx[conn_handle - BENCH_CONN_HANDLE_BASE]++;
+    }
+}
+
+static void setup(uint8_t link_count, uint32_t conn_interval_us)
+{
+    sd_sim_config_t config;
+    ble_sdc_init_t  sdc_init;
+
+    config.tx_buffer_count   = SD_SIM_TX_BUFFERS_DEFAULT;
+    config.packets_per_event = SD_SIM_PACKETS_PER_EVENT;
+    config.conn_interval_us  = conn_interval_us;
+    config.link_count        = link_count;
+    sd_sim_init(&config, ble_evt_handler);
+    sd_sim_peer_rx_handler_set(peer_rx_handler);
+
+    memset(&sdc_init, 0, sizeof(sdc_init));
+    sdc_init.data_handler = sdc_data_handler;
+    sdc_init.evt_handler  = sdc_evt_handler;
+    APP_ERROR_CHECK(ble_sdc_init(&m_sdc, &sdc_init));
+
+    memset(m_peer_rx, 0, sizeof(m_peer_rx));
+    m_enabled_evts  = 0;
+    m_disabled_evts = 0;
+}
+
+static void cccd_write(uint8_t n, uint16_t value)
+{
+    uint8_t cccd[BLE_CCCD_VALUE_LEN];
+
+    (void)uint16_encode(value, cccd);
+    APP_ERROR_CHECK(sd_sim_peer_write(BENCH_CONN_HANDLE_BASE + n, m_sdc.rx_handles.cccd_handle, cccd, sizeof(cccd)));
+}
+
+/* Returns the bit of the link table entry serving peer n in the ble_sdc_data_send() bitmask. */
+static uint8_t link_bit(uint8_t n)
+{
+    uint8_t link = ble_sdc_link_find(&m_sdc, BENCH_CONN_HANDLE_BASE + n);
+
+    return (link == BLE_SDC_LINK_NONE) ? 0 : (uint8_t)(1 << link);
+}
+
+static void links_run(void)
+{
+    uint8_t  payload[BENCH_VALUE_LEN];
+    uint8_t  links;
+    uint8_t  buf[1 + BLE_SDC_MAX_LINKS * BLE_SDC_LINK_ENCODED_LEN];
+    uint8_t  bit_1;
+    uint32_t err_code;
+
+    setup(BLE_SDC_MAX_LINKS, 20000);
+    memset(payload, 0, sizeof(payload));
+
+    check(sd_sim_connect(BENCH_CONN_HANDLE_BASE + 0) == NRF_SUCCESS, "first client connects");
+    check(sd_sim_connect(BENCH_CONN_HANDLE_BASE + 1) == NRF_SUCCESS, "second client connects");
+    check((link_bit(0) != 0) && (link_bit(1) != 0) && (link_bit(0) != link_bit(1)), "each client gets its own link entry");
+    bit_1 = link_bit(1);
+
+    cccd_write(0, 0x0001);
+    check(ble_sdc_subscriber_count(&m_sdc) == 1, "CCCD write enables one link only");
+    err_code = ble_sdc_data_send(&m_sdc, payload, sizeof(payload), &links);
+    check((err_code == NRF_SUCCESS) && (links == link_bit(0)), "send reaches the subscribed link only");
+
+    cccd_write(1, 0x0001);
+    err_code = ble_sdc_data_send(&m_sdc, payload, sizeof(payload), &links);
+    check((err_code == NRF_SUCCESS) && (links == (link_bit(0) | bit_1)), "send reaches both subscribers");
+    sd_sim_run(20000);
+    check((m_peer_rx[0] == 2) && (m_peer_rx[1] == 1), "peers receive their copies");
+
+    check(ble_sdc_links_encode(&m_sdc, buf, sizeof(buf)) == 1 + 2 * BLE_SDC_LINK_ENCODED_LEN, "link table lists both links");
+    check(ble_sdc_links_encode(&m_sdc, buf, 1 + BLE_SDC_LINK_ENCODED_LEN) == 0, "link table does not fit a short buffer");
+
+    sd_sim_disconnect(BENCH_CONN_HANDLE_BASE + 0, 0x13);
+    check((m_disabled_evts == 1) && (ble_sdc_subscriber_count(&m_sdc) == 1), "disconnect disables its own link only");
+    err_code = ble_sdc_data_send(&m_sdc, payload, sizeof(payload), &links);
+    check((err_code == NRF_SUCCESS) && (links == bit_1), "other link keeps notifying after a disconnect");
+
+    cccd_write(1, 0x0000);
+    err_code = ble_sdc_data_send(&m_sdc, payload, sizeof(payload), &links);
+    check((err_code == NRF_ERROR_INVALID_STATE) && (links == 0), "send without subscribers: INVALID_STATE");
+
+    check(sd_sim_connect(BENCH_CONN_HANDLE_BASE + 0) == NRF_SUCCESS, "reconnect takes the free entry");
+    cccd_write(0, 0x0001);
+    err_code = ble_sdc_data_send(&m_sdc, payload, sizeof(payload), &links);
+    check((err_code == NRF_SUCCESS) && (links == link_bit(0)) && (link_bit(1) == bit_1), "entries stay with their connections");
+    printf("\n");
+}
+
+/* Sends a value every BENCH_SAMPLE_US to a fast and a slow client. */
+static void mixed_run(void)
+{
+    uint8_t        payload[BENCH_VALUE_LEN];
+    uint32_t       values = BENCH_DURATION_US / BENCH_SAMPLE_US;
+    uint32_t       i;
+    ble_sdc_link_t fast;
+    ble_sdc_link_t slow;
+
+    setup(2, BENCH_FAST_INTERVAL_US);
+    memset(payload, 0, sizeof(payload));
+    sd_sim_connect(BENCH_CONN_HANDLE_BASE + 0);
+    sd_sim_connect(BENCH_CONN_HANDLE_BASE + 1);
+    sd_sim_conn_interval_set(BENCH_CONN_HANDLE_BASE + 1, BENCH_SLOW_INTERVAL_US);
+    cccd_write(0, 0x0001);
+    cccd_write(1, 0x0001);
+
+    for (i = 0; i < values; i++)
+    {
+        (void)ble_sdc_data_send(&m_sdc, payload, sizeof(payload), NULL);
+        sd_sim_run(BENCH_SAMPLE_US);
+    }
+    sd_sim_run(BENCH_SLOW_INTERVAL_US);
+
+    fast = m_sdc.links[ble_sdc_link_find(&m_sdc, BENCH_CONN_HANDLE_BASE + 0)];
+    slow = m_sdc.links[ble_sdc_link_find(&m_sdc, BENCH_CONN_HANDLE_BASE + 1)];
+    printf("%u values every %u ms: %.1f ms link sent %u dropped %u, %.1f ms link sent %u dropped %u\n",
+           values, BENCH_SAMPLE_US / 1000,
+           BENCH_FAST_INTERVAL_US / 1000.0, fast.sent, fast.dropped,
+           BENCH_SLOW_INTERVAL_US / 1000.0, slow.sent, slow.dropped);
+    check((fast.sent == values) && (m_peer_rx[0] == values), "fast link gets every value");
+    check((slow.dropped > 0) && (slow.sent + slow.dropped == values), "slow link drops its own copies only");
+    check(m_peer_rx[1] == slow.sent, "slow link delivers what it queued");
+    check(slow.conn_interval_ms == BENCH_SLOW_INTERVAL_US / 1000, "link table follows the interval update");
+    printf("\n");
+}
+
+/* Sends a value every BENCH_VALUE_US to link_count subscribers at 20 ms. */
+static void fanout_run(uint8_t link_count)
+{
+    uint8_t            payload[BENCH_VALUE_LEN];
+    uint32_t           values = BENCH_DURATION_US / BENCH_VALUE_US;
+    uint32_t           sent = 0;
+    uint32_t           dropped = 0;
+    uint32_t           delivered = 0;
+    uint32_t           i;
+    uint8_t            n;
+    cycle_prof_stats_t prof;
+    sd_sim_stats_t     stats;
+
+    setup(link_count, 20000);
+    cycle_prof_reset();
+    memset(payload, 0, sizeof(payload));
+    for (n = 0; n < link_count; n++)
+    {
+        sd_sim_connect(BENCH_CONN_HANDLE_BASE + n);
+        cccd_write(n, 0x0001);
+    }
+
+    for (i = 0; i < values; i++)
+    {
+        CYCLE_PROF_START(CYCLE_PROF_SDC_DATA_SEND);
+        (void)ble_sdc_data_send(&m_sdc, payload, sizeof(payload), NULL);
+        CYCLE_PROF_END(CYCLE_PROF_SDC_DATA_SEND);
+        sd_sim_run(BENCH_VALUE_US);
+    }
+
+    for (n = 0; n < link_count; n++)
+    {
+        sent      += m_sdc.links[n].sent;
+        dropped   += m_sdc.links[n].dropped;
+        delivered += m_peer_rx[n];
+    }
+    cycle_prof_stats_get(CYCLE_PROF_SDC_DATA_SEND, &prof);
+    sd_sim_stats_get(&stats);
+    printf("%5u %10u %10u %12.2f %10.1f %10.1f\n",
+           link_count,
+           (uint32_t)(prof.sum / prof.count),
+           prof.max,
+           (double)stats.hvx_calls / values,
+           (double)delivered / link_count,
+           (double)dropped / link_count);
+
+    if ((sent != values * link_count) || (delivered != sent))
+    {
+        m_failures++;
+    }
+}
+
+int main(void)
+{
+    uint8_t n;
+
+    cycle_prof_init();
+    links_run();
+    mixed_run();
+
+    printf("links  mean_ns     max_ns  hvx/value  rx/link  drop/link\n");
+    for (n = 1; n <= BLE_SDC_MAX_LINKS; n++)
+    {
+        fanout_run(n);
+    }
+
+    return (m_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,125 @@
+/* Check of the serialization of the fault record, fault_record_encode() and fault_record_decode().
+ *
+ * Encodes records with file names of every length up to FAULT_RECORD_FILE_LEN and checks that they decode
+ * to the same record and take FAULT_RECORD_ENCODED_HDR_LEN bytes plus the name. Every truncation of an
+ * encoded record must be rejected, as must an unknown version, the empty record encoded when no fault is
+ * recorded and a file name length above FAULT_RECORD_FILE_LEN. The encoder must refuse a buffer shorter than
+ * FAULT_RECORD_ENCODED_LEN and cut a name length out of range. Prints one line per case and exits with 1 if
+ * any fails.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -Isd_sim -I../arm5_no_packs fault_record_check.c ../arm5_no_packs/fault_record_codec.c \
+ *       -o fault_record_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "fault_record.h"
+
+#define CHECK_FILE_NAME             "../../../components/libraries/fds/fds.c" /**< Longer than FAULT_RECORD_FILE_LEN. */
+
+static bool                     m_failed;
+
+
+static void check(char const * p_name, bool ok)
+{
+    printf("%-52s %s\n", p_name, ok ? "ok" : "FAIL");
+    m_failed = m_failed || !ok;
+}
+
+/* Record with every field set and the last file_len characters of CHECK_FILE_NAME. */
+static fault_record_t record_build(uint8_t file_len)
+{
+    fault_record_t record;
+
+    memset(&record, 0, sizeof(record));
+    record.error_code   = 0x00003004;
+    record.line         = 1234;
+    record.pc           = 0x0001F2A6;
+    record.lr           = 0x0002C3B1;
+    record.uptime_s     = 86400 * 3 + 17;
+    record.reset_reason = 0x00000004;
+    record.fault_count  = 0x1234;
+    record.file_len     = file_len;
+    memcpy(record.file, CHECK_FILE_NAME + strlen(CHECK_FILE_NAME) - file_len, file_len);
+    return record;
+}
+
+/* Compares the fields and the used part of the file name. */
+static bool record_equal(fault_record_t const * p_a, fault_record_t const * p_b)
+{
+    return (p_a->error_code == p_b->error_code) && (p_a->line == p_b->line) && (p_a->pc == p_b->pc)
+           && (p_a->lr == p_b->lr) && (p_a->uptime_s == p_b->uptime_s) && (p_a->reset_reason == p_b->reset_reason)
+           && (p_a->fault_count == p_b->fault_count) && (p_a->file_len == p_b->file_len)
+           && (memcmp(p_a->file, p_b->file, p_a->file_len) == 0);
+}
+
+int main(void)
+{
+    fault_record_t record;
+    fault_record_t decoded;
+    uint8_t        buf[FAULT_RECORD_ENCODED_LEN];
+    uint16_t       len;
+    uint16_t       cut;
+    uint8_t        file_len;
+    bool           ok;
+
+    ok = true;
+    for (file_len = 0; file_len <= FAULT_RECORD_FILE_LEN; file_len++)
+    {
+        record = record_build(file_len);
+        len    = fault_record_encode(&record, buf, sizeof(buf));
+        memset(&decoded, 0xEE, sizeof(decoded));
+        ok = ok && (len == FAULT_RECORD_ENCODED_HDR_LEN + file_len)
+                && fault_record_decode(buf, len, &decoded) && record_equal(&record, &decoded);
+    }
+    check("round trip, file names of 0 to FAULT_RECORD_FILE_LEN", ok);
+
+    record = record_build(FAULT_RECORD_FILE_LEN);
+    len    = fault_record_encode(&record, buf, sizeof(buf));
+    check("little endian fields after version and flags",
+          (buf[2] == 0x04) && (buf[3] == 0x30) && (buf[6] == (1234 & 0xFF)) && (buf[7] == (1234 >> 8)));
+
+    ok = true;
+    for (cut = 0; cut < len; cut++)
+    {
+        ok = ok && !fault_record_decode(buf, cut, &decoded);
+    }
+    check("every truncation rejected", ok);
+
+    record = record_build(3);
+    len    = fault_record_encode(&record, buf, sizeof(buf));
+    ok     = !fault_record_decode(buf, len - 1, &decoded) && fault_record_decode(buf, len, &decoded);
+    check("truncation inside a short file name rejected", ok);
+
+    buf[0] = FAULT_RECORD_VERSION + 1;
+    check("unknown version rejected", !fault_record_decode(buf, len, &decoded));
+
+    len = fault_record_encode(&record, buf, sizeof(buf));
+    buf[FAULT_RECORD_ENCODED_HDR_LEN - 1] = FAULT_RECORD_FILE_LEN + 1;
+    check("file name length above the maximum rejected", !fault_record_decode(buf, sizeof(buf), &decoded));
+
+    len = fault_record_encode(NULL, buf, sizeof(buf));
+    check("no fault: header only, not decoded",
+          (len == FAULT_RECORD_ENCODED_HDR_LEN) && (buf[0] == FAULT_RECORD_VERSION)
+          && !fault_record_decode(buf, len, &decoded));
+
+    check("buffer shorter than FAULT_RECORD_ENCODED_LEN refused",
+          (fault_record_encode(&record, buf, FAULT_RECORD_ENCODED_LEN - 1) == 0)
+          && (fault_record_encode(&record, NULL, FAULT_RECORD_ENCODED_LEN) == 0));
+
+    check("NULL input or output not decoded",
+          !fault_record_decode(NULL, sizeof(buf), &decoded) && !fault_record_decode(buf, sizeof(buf), NULL));
+
+    record          = record_build(FAULT_RECORD_FILE_LEN);
+    record.file_len = FAULT_RECORD_FILE_LEN + 5;
+    len             = fault_record_encode(&record, buf, sizeof(buf));
+    record.file_len = FAULT_RECORD_FILE_LEN;
+    check("file name length out of range cut when encoded",
+          (len == FAULT_RECORD_ENCODED_LEN) && fault_record_decode(buf, len, &decoded)
+          && record_equal(&record, &decoded));
+
+    return m_failed ? 1 : 0;
+}
@@ -0,0 +1,508 @@
+/* Flash scheduler against competing radio activity, on the SoftDevice simulator.
+ *
+ * The flash jobs of the firmware run while the radio serves links and advertising: a history block of
+ * BENCH_BLOCK_WORDS is appended every BENCH_BLOCK_MS, the block BENCH_LIVE_BLOCKS back is deleted, and the
+ * configuration record is replaced every BENCH_CONFIG_MS. Flash fills up with deleted blocks, so garbage
+ * collection runs every few tens of seconds. Flash operations wait for radio idle time that fits them and
+ * take priority over the radio after SD_SIM_FLASH_ATTEMPTS blocked attempts, see sd_sim.h. FDS is modelled
+ * by sd_sim/fds_sim.c. Each scenario is run twice:
+ *   sched   jobs go through flash_sched, handed to FDS when the radio notification signals an idle radio
+ *   direct  the same jobs are handed to FDS as they come, as the firmware did before the scheduler
+ * and prints the jobs completed, failed and refused (FDS queue or flash full when handed over), the jobs
+ * left after the drain time, the mean and worst latency, the jobs submitted on the defer timeout, flash
+ * operations, blocked flash attempts, radio events skipped for flash and garbage collections. In the "other
+ * user" scenarios a second FDS user writes bursts of records, as the peer manager does, filling the FDS queue
+ * just before a block is queued. Without radio activity no radio notification comes to retry the job FDS
+ * refused, only the events of the other user's operations. In the "full flash" scenario no block is deleted,
+ * flash fills with live records that garbage collection can not reclaim.
+ *
+ * Exits with 1 if the scheduler loses, refuses or fails a job, leaves jobs queued after the drain time or
+ * completes one later than the latency bound of the scenario. With full flash the block jobs must fail instead,
+ * after at most FLASH_SCHED_MAX_RETRIES garbage collections each. Each scenario runs in a child process, the modules keep
+ * their state in statics.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -Isd_sim -I../arm5_no_packs flash_sched_bench.c sd_sim/sd_sim.c sd_sim/fds_sim.c \
+ *       ../arm5_no_packs/flash_sched.c ../arm5_no_packs/ble_sensor_data_custom.c -o flash_sched_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "sd_sim.h"
+#include "app_error.h"
+#include "app_timer.h"
+#include "app_time.h"
+#include "app_config.h"
+#include "fds.h"
+#include "fstorage.h"
+#include "flash_sched.h"
+#include "ble_sensor_data_custom.h"
+
+#define BENCH_DURATION_MS           120000
+#define BENCH_DRAIN_MS              5000                                /**< Time after the last job for the queue to empty. */
+#define BENCH_STEP_US               1000
+#define BENCH_BLOCK_MS              500
+#define BENCH_BLOCK_WORDS           64
+#define BENCH_LIVE_BLOCKS           8                                   /**< Blocks kept, older ones are deleted. */
+#define BENCH_CONFIG_MS             7000
+#define BENCH_CONFIG_WORDS          8
+#define BENCH_OTHER_MS              3000                                /**< Interval of the bursts of the other FDS user. */
+#define BENCH_OTHER_BURST           4
+#define BENCH_OTHER_WORDS           16
+#define BENCH_FILE_ID               0x4000
+#define BENCH_BLOCK_KEY             0x0001
+#define BENCH_CONFIG_KEY            0x0002
+#define BENCH_OTHER_FILE_ID         0xC000
+#define BENCH_CONN_HANDLE_BASE      0x10
+#define BENCH_BUFFERS               16                                  /**< Block buffers, one per job in flight. */
+#define BENCH_MAX_JOBS              1024
+#define BENCH_LATENCY_MAX_MS        2000                                /**< The defer timeout, the jobs ahead and a garbage collection fit in it. */
+#define BENCH_LATENCY_IDLE_MS       (150 + (FDS_VIRTUAL_PAGES - 1) * SD_SIM_FLASH_ERASE_US / 1000)  /**< Without radio: the jobs ahead and a garbage collection erasing every data page. */
+
+typedef struct
+{
+    char const * p_name;
+    uint8_t      links;
+    uint32_t     conn_interval_us;
+    bool         streaming;             /**< Notifications fill every connection event. */
+    bool         advertising;           /**< Advertising every 100 ms, with or without links. */
+    bool         other_user;
+    uint32_t     latency_max_ms;        /**< Bound of the scheduler's worst latency. */
+    bool         keep_blocks;           /**< Blocks are never deleted, flash fills up. */
+} scenario_t;
+
+/* Counters of one run, passed from the child process. */
+typedef struct
+{
+    uint32_t queued;
+    uint32_t completed;
+    uint32_t failed;
+    uint32_t refused;
+    uint32_t pending;                   /**< Jobs not completed after the drain time. */
+    uint64_t latency_sum_us;
+    uint32_t latency_max_us;
+    uint32_t deferred;
+    uint32_t gc_runs;
+    sd_sim_stats_t sd;
+} result_t;
+
+static const scenario_t m_scenarios[] =
+{
+    { "advertising 100 ms",        0, 0,      false, true,  false, BENCH_LATENCY_MAX_MS,  false },
+    { "1 link 50 ms, streaming",   1, 50000,  true,  false, false, BENCH_LATENCY_MAX_MS,  false },
+    { "2 links 30 ms, streaming",  2, 30000,  true,  false, false, BENCH_LATENCY_MAX_MS,  false },
+    { "1 link 7.5 ms, streaming",  1, 7500,   true,  false, false, BENCH_LATENCY_MAX_MS,  false },
+    { "1 link 100 ms, other user", 1, 100000, false, true,  true,  BENCH_LATENCY_MAX_MS,  false },
+    { "no radio, other user",      0, 0,      false, false, true,  BENCH_LATENCY_IDLE_MS, false },
+    { "full flash",                1, 50000,  false, false, false, BENCH_LATENCY_MAX_MS,  true  },
+};
+
+static bool                     m_use_sched;
+static bool                     m_keep_blocks;
+static ble_sdc_t                m_sdc;
+static result_t                 m_result;
+static uint32_t                 m_blocks[BENCH_BUFFERS][BENCH_BLOCK_WORDS];
+static fds_record_chunk_t       m_block_chunks[BENCH_BUFFERS];
+static uint8_t                  m_block_next;
+static uint32_t                 m_config[BENCH_CONFIG_WORDS];
+static fds_record_chunk_t       m_config_chunk = { m_config, BENCH_CONFIG_WORDS };
+static uint32_t                 m_other[BENCH_OTHER_WORDS];
+static fds_record_chunk_t       m_other_chunk = { m_other, BENCH_OTHER_WORDS };
+static uint32_t                 m_live[BENCH_LIVE_BLOCKS + 1];          /**< Record IDs of the blocks written, oldest first. */
+static uint8_t                  m_live_count;
+static uint32_t                 m_other_pending;                        /**< Records of the other user to delete. */
+static uint64_t                 m_queued_at[BENCH_MAX_JOBS];            /**< Direct jobs by record ID: time handed to FDS. */
+
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t * p_file_name)
+{
+    fprintf(stderr, "app_error 0x%x at %s:%u\n", error_code, (char const *)p_file_name, line_num);
+    exit(2);
+}
+
+/* Time base of the job latencies, taken from the simulator. */
+uint64_t app_time_ticks_get(void)
+{
+    return sd_sim_time_us_get() * APP_TIMER_CLOCK_FREQ / (1000000ULL * (APP_TIMER_PRESCALER + 1));
+}
+
+static void latency_add(uint64_t queued_at_us)
+{
+    uint32_t latency = (uint32_t)(sd_sim_time_us_get() - queued_at_us);
+
+    m_result.latency_sum_us += latency;
+    m_result.latency_max_us  = MAX(m_result.latency_max_us, latency);
+}
+
+/* Keeps the record ID of a block written and returns the one to delete, 0 if none. */
+static uint32_t block_written(uint32_t record_id)
+{
+    uint32_t old = 0;
+
+    if (m_keep_blocks)
+    {
+        return 0;
+    }
+    m_live[m_live_count++] = record_id;
+    if (m_live_count > BENCH_LIVE_BLOCKS)
+    {
+        old = m_live[0];
+        memmove(&m_live[0], &m_live[1], BENCH_LIVE_BLOCKS * sizeof(m_live[0]));
+        m_live_count--;
+    }
+    return old;
+}
+
+static void sched_handler(flash_sched_evt_t const * p_evt)
+{
+    uint32_t old;
+
+    if (p_evt->result != FDS_SUCCESS)
+    {
+        m_result.failed++;
+        return;
+    }
+    m_result.completed++;
+
+    if ((p_evt->type == FLASH_SCHED_JOB_APPEND) && ((old = block_written(p_evt->record_id)) != 0))
+    {
+        m_result.queued++;
+        if (flash_sched_delete(old, sched_handler, NULL) != NRF_SUCCESS)
+        {
+            m_result.refused++;
+        }
+    }
+}
+
+/* Hands a delete to FDS directly. */
+static void direct_delete(uint32_t record_id)
+{
+    fds_record_desc_t desc;
+
+    m_result.queued++;
+    (void)fds_descriptor_from_rec_id(&desc, record_id);
+    if (fds_record_delete(&desc) != FDS_SUCCESS)
+    {
+        m_result.refused++;
+        return;
+    }
+    m_queued_at[record_id % BENCH_MAX_JOBS] = sd_sim_time_us_get();
+}
+
+/* FDS events of the application records in direct mode, and of the other user. */
+static void fds_evt_handler(fds_evt_t const * const p_evt)
+{
+    fds_record_desc_t desc;
+    uint32_t          record_id = (p_evt->id == FDS_EVT_DEL_RECORD) ? p_evt->del.record_id : p_evt->write.record_id;
+    uint16_t          file_id   = (p_evt->id == FDS_EVT_DEL_RECORD) ? p_evt->del.file_id : p_evt->write.file_id;
+    uint32_t          old;
+
+    if ((p_evt->id != FDS_EVT_WRITE) && (p_evt->id != FDS_EVT_UPDATE) && (p_evt->id != FDS_EVT_DEL_RECORD))
+    {
+        return;
+    }
+
+    if (file_id == BENCH_OTHER_FILE_ID)
+    {
+        if ((p_evt->id == FDS_EVT_WRITE) && (p_evt->result == FDS_SUCCESS))
+        {
+            (void)fds_descriptor_from_rec_id(&desc, record_id);
+            if (fds_record_delete(&desc) != FDS_SUCCESS)
+            {
+                m_other_pending = record_id;
+            }
+        }
+        return;
+    }
+    if (m_use_sched || (file_id != BENCH_FILE_ID))
+    {
+        return;
+    }
+
+    if (p_evt->result != FDS_SUCCESS)
+    {
+        m_result.failed++;
+        return;
+    }
+    m_result.completed++;
+    latency_add(m_queued_at[record_id % BENCH_MAX_JOBS]);
+
+    if ((p_evt->id == FDS_EVT_WRITE) && (p_evt->write.record_key == BENCH_BLOCK_KEY)
+        && ((old = block_written(record_id)) != 0))
+    {
+        direct_delete(old);
+    }
+}
+
+static void sys_evt_dispatch(uint32_t sys_evt)
+{
+    fs_sys_event_handler(sys_evt);
+    flash_sched_on_sys_evt(sys_evt);
+}
+
+static void ble_evt_handler(ble_evt_t * p_ble_evt)
+{
+    ble_sdc_on_ble_evt(&m_sdc, p_ble_evt);
+}
+
+/* Queues a job writing a record, through the scheduler or directly. */
+static void job_write(uint16_t key, fds_record_chunk_t const * p_chunk)
+{
+    fds_record_t      record;
+    fds_record_desc_t desc;
+    fds_find_token_t  token;
+    ret_code_t        err_code;
+
+    m_result.queued++;
+
+    if (m_use_sched)
+    {
+        err_code = flash_sched_write((key == BENCH_BLOCK_KEY) ? FLASH_SCHED_JOB_APPEND : FLASH_SCHED_JOB_REPLACE,
+                                     BENCH_FILE_ID, key, p_chunk, sched_handler, NULL);
+        if (err_code != NRF_SUCCESS)
+        {
+            m_result.refused++;
+        }
+        return;
+    }
+
+    memset(&record, 0, sizeof(record));
+    record.file_id         = BENCH_FILE_ID;
+    record.key             = key;
+    record.data.p_chunks   = p_chunk;
+    record.data.num_chunks = 1;
+
+    memset(&token, 0, sizeof(token));
+    if ((key == BENCH_CONFIG_KEY) && (fds_record_find(BENCH_FILE_ID, key, &desc, &token) == FDS_SUCCESS))
+    {
+        err_code = fds_record_update(&desc, &record);
+    }
+    else
+    {
+        err_code = fds_record_write(&desc, &record);
+    }
+
+    if ((err_code == FDS_ERR_NO_SPACE_IN_FLASH) && (fds_gc() == FDS_SUCCESS))
+    {
+        m_result.gc_runs++;
+    }
+    if (err_code != FDS_SUCCESS)
+    {
+        m_result.refused++;
+        return;
+    }
+    m_queued_at[desc.record_id % BENCH_MAX_JOBS] = sd_sim_time_us_get();
+}
+
+static void other_burst(void)
+{
+    fds_record_t      record;
+    fds_record_desc_t desc;
+    uint8_t           i;
+
+    memset(&record, 0, sizeof(record));
+    record.file_id         = BENCH_OTHER_FILE_ID;
+    record.key             = 0x0001;
+    record.data.p_chunks   = &m_other_chunk;
+    record.data.num_chunks = 1;
+
+    for (i = 0; i < BENCH_OTHER_BURST; i++)
+    {
+        (void)fds_record_write(&desc, &record);
+    }
+}
+
+static void setup(scenario_t const * p_scenario)
+{
+    sd_sim_config_t      config;
+    ble_sdc_init_t       sdc_init;
+    ble_gap_adv_params_t adv_params;
+    uint8_t              cccd[BLE_CCCD_VALUE_LEN] = { 0x01, 0x00 };
+    uint8_t              i;
+
+    config.tx_buffer_count   = SD_SIM_TX_BUFFERS_DEFAULT;
+    config.packets_per_event = SD_SIM_PACKETS_PER_EVENT;
+    config.conn_interval_us  = p_scenario->conn_interval_us;
+    config.link_count        = MAX(p_scenario->links, 1) + (p_scenario->advertising ? 1 : 0);
+    sd_sim_init(&config, ble_evt_handler);
+    sd_sim_sys_evt_handler_set(sys_evt_dispatch);
+    APP_TIMER_INIT(APP_TIMER_PRESCALER, APP_TIMER_OP_QUEUE_SIZE, false);
+
+    memset(&sdc_init, 0, sizeof(sdc_init));
+    APP_ERROR_CHECK(ble_sdc_init(&m_sdc, &sdc_init));
+
+    APP_ERROR_CHECK(flash_sched_init());
+    APP_ERROR_CHECK(fds_register(fds_evt_handler));
+    APP_ERROR_CHECK(fds_init());
+    sd_sim_run(100000);
+
+    for (i = 0; i < p_scenario->links; i++)
+    {
+        APP_ERROR_CHECK(sd_sim_connect(BENCH_CONN_HANDLE_BASE + i));
+        APP_ERROR_CHECK(sd_sim_peer_write(BENCH_CONN_HANDLE_BASE + i, m_sdc.rx_handles.cccd_handle, cccd, sizeof(cccd)));
+    }
+    if (p_scenario->advertising)
+    {
+        memset(&adv_params, 0, sizeof(adv_params));
+        adv_params.type     = BLE_GAP_ADV_TYPE_ADV_IND;
+        adv_params.fp       = BLE_GAP_ADV_FP_ANY;
+        adv_params.interval = 160;
+        APP_ERROR_CHECK(sd_ble_gap_adv_start(&adv_params));
+    }
+}
+
+/* Runs a scenario with the scheduler or direct submission, in the calling process. */
+static void scenario_run(scenario_t const * p_scenario)
+{
+    uint8_t             payload[BLE_SDC_MAX_DATA_LEN];
+    uint32_t            ms;
+    uint8_t             i;
+    flash_sched_stats_t stats;
+
+    memset(&m_result, 0, sizeof(m_result));
+    memset(payload, 0xA5, sizeof(payload));
+    m_keep_blocks = p_scenario->keep_blocks;
+    setup(p_scenario);
+
+    for (ms = 0; ms < BENCH_DURATION_MS + BENCH_DRAIN_MS; ms++)
+    {
+        if (p_scenario->other_user && (ms < BENCH_DURATION_MS) && (ms % BENCH_OTHER_MS == 0))
+        {
+            other_burst();
+        }
+        if ((ms < BENCH_DURATION_MS) && (ms % BENCH_BLOCK_MS == 0))
+        {
+            m_block_chunks[m_block_next].p_data       = m_blocks[m_block_next];
+            m_block_chunks[m_block_next].length_words = BENCH_BLOCK_WORDS;
+            job_write(BENCH_BLOCK_KEY, &m_block_chunks[m_block_next]);
+            m_block_next = (m_block_next + 1) % BENCH_BUFFERS;
+        }
+        if ((ms < BENCH_DURATION_MS) && (ms % BENCH_CONFIG_MS == BENCH_CONFIG_MS / 2))
+        {
+            m_config[0] = ms;
+            job_write(BENCH_CONFIG_KEY, &m_config_chunk);
+        }
+        if (m_other_pending != 0)
+        {
+            fds_record_desc_t desc;
+
+            (void)fds_descriptor_from_rec_id(&desc, m_other_pending);
+            if (fds_record_delete(&desc) == FDS_SUCCESS)
+            {
+                m_other_pending = 0;
+            }
+        }
+        if (p_scenario->streaming)
+        {
+            for (i = 0; (i < SD_SIM_TX_BUFFERS_DEFAULT) && (ble_sdc_data_send(&m_sdc, payload, sizeof(payload), NULL) == NRF_SUCCESS); i++)
+            {
+            }
+        }
+        sd_sim_run(BENCH_STEP_US);
+    }
+
+    if (m_use_sched)
+    {
+        flash_sched_stats_get(&stats);
+        m_result.latency_sum_us = stats.latency_sum * 1000000ULL / APP_TIMER_CLOCK_FREQ;
+        m_result.latency_max_us = (uint32_t)((uint64_t)stats.latency_max * 1000000ULL / APP_TIMER_CLOCK_FREQ);
+        m_result.deferred       = stats.deferred_submits;
+        m_result.gc_runs        = stats.gc_runs;
+        m_result.pending        = stats.queue_depth;
+    }
+    else
+    {
+        m_result.pending = m_result.queued - m_result.completed - m_result.failed - m_result.refused;
+    }
+    sd_sim_stats_get(&m_result.sd);
+}
+
+/* Runs a scenario in a child process and returns its counters. */
+static result_t scenario_fork(scenario_t const * p_scenario, bool use_sched)
+{
+    int      fds[2];
+    int      status;
+    pid_t    pid;
+    result_t result;
+
+    memset(&result, 0, sizeof(result));
+    fflush(stdout);
+    if (pipe(fds) != 0)
+    {
+        exit(2);
+    }
+
+    pid = fork();
+    if (pid == 0)
+    {
+        close(fds[0]);
+        m_use_sched = use_sched;
+        scenario_run(p_scenario);
+        exit((write(fds[1], &m_result, sizeof(m_result)) == sizeof(m_result)) ? 0 : 2);
+    }
+
+    close(fds[1]);
+    if ((read(fds[0], &result, sizeof(result)) != sizeof(result)) || (waitpid(pid, &status, 0) != pid)
+        || !WIFEXITED(status) || (WEXITSTATUS(status) != 0))
+    {
+        fprintf(stderr, "%s: run failed\n", p_scenario->p_name);
+        exit(2);
+    }
+    close(fds[0]);
+    return result;
+}
+
+static void result_print(char const * p_mode, result_t const * p_result)
+{
+    printf("  %-6s %6u %6u %5u %7u %4u %8.1f %8.1f %5u %6u %7u %7u %4u\n",
+           p_mode, p_result->queued, p_result->completed, p_result->failed, p_result->refused, p_result->pending,
+           (p_result->completed > 0) ? (double)p_result->latency_sum_us / p_result->completed / 1000 : 0.0,
+           p_result->latency_max_us / 1000.0, p_result->deferred, p_result->sd.flash_ops,
+           p_result->sd.flash_blocked, p_result->sd.radio_events_skipped, p_result->gc_runs);
+}
+
+int main(void)
+{
+    uint8_t  i;
+    uint32_t failures = 0;
+
+    printf("%u s of jobs, %u word blocks every %u ms, erase %u ms, word %u us\n\n",
+           BENCH_DURATION_MS / 1000, BENCH_BLOCK_WORDS, BENCH_BLOCK_MS, SD_SIM_FLASH_ERASE_US / 1000,
+           SD_SIM_FLASH_WORD_US);
+    printf("  %-6s %6s %6s %5s %7s %4s %8s %8s %5s %6s %7s %7s %4s\n", "", "queued", "done", "fail", "refused",
+           "left", "mean ms", "max ms", "defer", "flash", "blocked", "skipped", "gc");
+
+    for (i = 0; i < sizeof(m_scenarios) / sizeof(m_scenarios[0]); i++)
+    {
+        scenario_t const * p_scenario = &m_scenarios[i];
+        result_t           sched      = scenario_fork(p_scenario, true);
+        result_t           direct     = scenario_fork(p_scenario, false);
+        bool               lost       = (sched.completed + sched.failed + sched.refused + sched.pending != sched.queued);
+        bool               ok         = !lost && (sched.pending == 0) && (sched.refused == 0)
+                                        && (sched.latency_max_us <= p_scenario->latency_max_ms * 1000);
+
+        if (p_scenario->keep_blocks)
+        {
+            ok = ok && (sched.failed > 0)
+                 && (sched.gc_runs <= (sched.completed + sched.failed) * FLASH_SCHED_MAX_RETRIES);
+        }
+        else
+        {
+            ok = ok && (sched.failed == 0);
+        }
+
+        printf("%s\n", p_scenario->p_name);
+        result_print("sched", &sched);
+        result_print("direct", &direct);
+        printf("  %s\n", ok ? "ok" : "FAIL");
+        if (!ok)
+        {
+            failures++;
+        }
+    }
+
+    return (failures == 0) ? 0 : 1;
+}
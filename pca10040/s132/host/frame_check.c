@@ -0,0 +1,423 @@
+/* Checks of the SDC framing and a host run of the priority scheduling.
+ *
+ * First checks sdc_frame: frames come out by stream priority and oldest first, as many as fit into a
+ * notification, a frame is never overtaken by a smaller one of a lower priority stream, a full queue uses up
+ * a sequence number, and sdc_frame_next() walks the frames back and rejects truncated ones.
+ *
+ * Then sends a value every 100 ms over the SoftDevice simulator while a history transfer of history_codec
+ * blocks runs on the bulk stream, with the flush of main.c. The peer deframes every notification, matches
+ * the values to their send time and reassembles the history. The run is repeated without history and
+ * without the TX buffers reserved for the live streams, to show what the reserve buys, for a central taking
+ * SD_SIM_PACKETS_PER_EVENT packets per connection event and for one taking 2. -o writes the notifications
+ * of the first run with history as hex lines, for sdc_deframe. Exits with 1 if a check fails.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -Isd_sim -I../arm5_no_packs frame_check.c sd_sim/sd_sim.c ../arm5_no_packs/sdc_frame.c \
+ *       ../arm5_no_packs/ble_sensor_data_custom.c ../arm5_no_packs/history_codec.c -o frame_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sd_sim.h"
+#include "app_error.h"
+#include "ble_sensor_data_custom.h"
+#include "sdc_frame.h"
+#include "history_codec.h"
+
+#define CHECK_CONN_HANDLE           0x0010
+#define CHECK_CONN_INTERVAL_US      30000
+#define CHECK_VALUE_US              100000                              /**< Value period. */
+#define CHECK_DURATION_US           20000000
+#define CHECK_BULK_TX_RESERVE       2                                   /**< As SDC_BULK_TX_RESERVE in main.c. */
+#define CHECK_HISTORY_BLOCKS        24
+#define CHECK_HISTORY_MAX           (CHECK_HISTORY_BLOCKS * HISTORY_BLOCK_SIZE)
+
+static ble_sdc_t                m_sdc;
+static sdc_frame_mux_t          m_mux;
+static uint8_t                  m_bulk_reserve;                         /**< TX buffers kept free of history frames. */
+static FILE                   * m_p_dump;
+
+static uint8_t                  m_history[CHECK_HISTORY_MAX];           /**< Blocks sent, back to back without padding. */
+static uint32_t                 m_history_len;
+static uint32_t                 m_history_pos;                          /**< Next byte to queue, m_history_len + 1 once the end frame is queued. */
+static uint8_t                  m_history_rx[CHECK_HISTORY_MAX];        /**< Bytes received by the peer. */
+static uint32_t                 m_history_rx_len;
+static bool                     m_history_end;
+static uint64_t                 m_history_end_us;
+
+static uint64_t                 m_value_put_us[256];                    /**< Queuing time of the value frames, by sequence number. */
+static uint32_t                 m_value_rx;
+static uint64_t                 m_value_latency_sum;
+static uint32_t                 m_value_latency_max;
+static bool                     m_seq_valid[SDC_STREAM_COUNT];
+static uint8_t                  m_seq_next[SDC_STREAM_COUNT];
+static uint32_t                 m_lost;                                 /**< Frames missing in the sequence numbers. */
+static uint32_t                 m_malformed;
+
+static uint32_t                 m_failures;
+
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t * p_file_name)
+{
+    fprintf(stderr, "app_error 0x%x at %s:%u\n", error_code, (char const *)p_file_name, line_num);
+    exit(2);
+}
+
+static void check(bool condition, char const * p_what)
+{
+    printf("%-60s %s\n", p_what, condition ? "ok" : "FAILED");
+    if (!condition)
+    {
+        m_failures++;
+    }
+}
+
+static void put_n(sdc_stream_t stream, uint8_t len, uint8_t fill)
+{
+    uint8_t payload[SDC_FRAME_MAX_PAYLOAD];
+
+    memset(payload, fill, sizeof(payload));
+    (void)sdc_frame_put(&m_mux, stream, payload, len);
+}
+
+static void codec_run(void)
+{
+    uint8_t            buf[SDC_FRAME_MAX_NOTIF_LEN];
+    uint8_t            payload[SDC_FRAME_MAX_PAYLOAD + 1];
+    uint16_t           len;
+    uint16_t           pos;
+    uint8_t            i;
+    sdc_frame_packed_t packed;
+    sdc_frame_view_t   frame;
+    bool               ok;
+
+    sdc_frame_init(&m_mux);
+    memset(payload, 0, sizeof(payload));
+    check(!sdc_frame_put(&m_mux, SDC_STREAM_VALUE, payload, SDC_FRAME_MAX_PAYLOAD + 1), "payload longer than SDC_FRAME_MAX_PAYLOAD rejected");
+    check(!sdc_frame_put(&m_mux, SDC_STREAM_COUNT, payload, 1), "unknown stream rejected");
+
+    put_n(SDC_STREAM_HISTORY, 6, 0x44);
+    put_n(SDC_STREAM_SUMMARY, 18, 0x33);
+    put_n(SDC_STREAM_VALUE, 3, 0x22);
+    put_n(SDC_STREAM_EVENT, 3, 0x11);
+    len = sdc_frame_pack(&m_mux, buf, sizeof(buf), &packed);
+    check((len == 10) && (buf[0] == ((SDC_STREAM_EVENT << 5) | 3)) && (buf[5] == ((SDC_STREAM_VALUE << 5) | 3)),
+          "event, then value, summary left for the next notification");
+    check((packed.counts[SDC_STREAM_HISTORY] == 0) && (packed.counts[SDC_STREAM_SUMMARY] == 0),
+          "smaller history frame does not overtake the summary");
+    check(sdc_frame_pack(&m_mux, buf, sizeof(buf), &packed) == len, "pack leaves the frames queued");
+
+    sdc_frame_commit(&m_mux, &packed);
+    len = sdc_frame_pack(&m_mux, buf, sizeof(buf), &packed);
+    check((len == 20) && (packed.counts[SDC_STREAM_SUMMARY] == 1), "summary fills a notification alone");
+    sdc_frame_commit(&m_mux, &packed);
+    len = sdc_frame_pack(&m_mux, buf, sizeof(buf), &packed);
+    check((len == 8) && (packed.counts[SDC_STREAM_HISTORY] == 1), "history goes last");
+    sdc_frame_commit(&m_mux, &packed);
+    check(sdc_frame_pack(&m_mux, buf, sizeof(buf), &packed) == 0, "nothing left after commit");
+
+    for (i = 0; i < SDC_FRAME_QUEUE_SIZE; i++)
+    {
+        put_n(SDC_STREAM_VALUE, 3, i);
+    }
+    check(sdc_frame_room(&m_mux, SDC_STREAM_VALUE) == 0, "queue full after SDC_FRAME_QUEUE_SIZE frames");
+    check(!sdc_frame_put(&m_mux, SDC_STREAM_VALUE, payload, 3), "put to a full queue fails");
+    len = sdc_frame_pack(&m_mux, buf, sizeof(buf), &packed);
+    check((len == 20) && (packed.counts[SDC_STREAM_VALUE] == 4), "four values share one notification");
+    sdc_frame_commit(&m_mux, &packed);
+    put_n(SDC_STREAM_VALUE, 3, 0);
+    (void)sdc_frame_pack(&m_mux, buf, sizeof(buf), &packed);
+    check(buf[1] == 1 + 1 + SDC_FRAME_QUEUE_SIZE, "rejected frame leaves a gap in the sequence numbers");
+    sdc_frame_clear(&m_mux);
+
+    put_n(SDC_STREAM_EVENT, 0, 0);
+    put_n(SDC_STREAM_VALUE, 3, 0x22);
+    put_n(SDC_STREAM_HISTORY, 11, 0x44);
+    len = sdc_frame_pack(&m_mux, buf, sizeof(buf), &packed);
+    pos = 0;
+    ok  = sdc_frame_next(buf, len, &pos, &frame) && (frame.stream == SDC_STREAM_EVENT) && (frame.len == 0);
+    ok  = ok && sdc_frame_next(buf, len, &pos, &frame) && (frame.stream == SDC_STREAM_VALUE) && (frame.p_payload[0] == 0x22);
+    ok  = ok && sdc_frame_next(buf, len, &pos, &frame) && (frame.stream == SDC_STREAM_HISTORY) && (frame.len == 11);
+    check(ok && !sdc_frame_next(buf, len, &pos, &frame) && (pos == len), "frames walked back from a notification");
+    pos = 0;
+    ok  = sdc_frame_next(buf, len - 1, &pos, &frame) && sdc_frame_next(buf, len - 1, &pos, &frame);
+    check(ok && !sdc_frame_next(buf, len - 1, &pos, &frame) && (pos == 7), "truncated frame rejected");
+    printf("\n");
+}
+
+/* Builds the history to transfer: blocks of a bay taken and freed every few minutes. */
+static void history_build(void)
+{
+    history_encoder_t enc;
+    uint32_t          t = 1700000000;
+    uint32_t          block;
+    uint32_t          slot;
+    uint16_t          len;
+
+    m_history_len = 0;
+    for (block = 0; block < CHECK_HISTORY_BLOCKS; block++)
+    {
+        history_encoder_start(&enc, (uint16_t)block, t, 10, 0);
+        for (slot = 1; ; slot++)
+        {
+            uint8_t value = ((slot / 17) & 1) ? (uint8_t)(200 + (slot % 5)) : (uint8_t)(slot % 3);
+
+            if ((slot % 97) == 0)
+            {
+                if (!history_encoder_event(&enc, 2))
+                {
+                    break;
+                }
+            }
+            if (!history_encoder_put(&enc, value))
+            {
+                break;
+            }
+        }
+        len = history_encoder_finish(&enc);
+        t   = history_block_end(&enc.block.header);
+        memcpy(&m_history[m_history_len], &enc.block, len);
+        m_history_len += len;
+    }
+}
+
+/* Tops up the history stream, as history_frames_fill() in main.c. */
+static void history_fill(void)
+{
+    while ((m_history_pos <= m_history_len) && (sdc_frame_room(&m_mux, SDC_STREAM_HISTORY) > 0))
+    {
+        uint32_t len = m_history_len - m_history_pos;
+
+        if (len > SDC_FRAME_MAX_PAYLOAD)
+        {
+            len = SDC_FRAME_MAX_PAYLOAD;
+        }
+        (void)sdc_frame_put(&m_mux, SDC_STREAM_HISTORY, &m_history[m_history_pos], (uint8_t)len);
+        m_history_pos += (len == 0) ? 1 : len;
+    }
+}
+
+/* Sends the queued frames, as frames_flush() in main.c. */
+static void flush(void)
+{
+    uint8_t            data[SDC_FRAME_MAX_NOTIF_LEN];
+    uint16_t           len;
+    sdc_frame_packed_t packed;
+
+    for (;;)
+    {
+        len = sdc_frame_pack(&m_mux, data, sizeof(data), &packed);
+        if (len == 0)
+        {
+            return;
+        }
+        if ((packed.counts[SDC_STREAM_EVENT] + packed.counts[SDC_STREAM_VALUE] + packed.counts[SDC_STREAM_SUMMARY] == 0)
+            && (m_sdc.links[0].tx_free <= m_bulk_reserve))
+        {
+            return;
+        }
+        if (ble_sdc_data_send(&m_sdc, data, len, NULL) != NRF_SUCCESS)
+        {
+            return;
+        }
+        sdc_frame_commit(&m_mux, &packed);
+    }
+}
+
+static void ble_evt_handler(ble_evt_t * p_ble_evt)
+{
+    ble_sdc_on_ble_evt(&m_sdc, p_ble_evt);
+
+    // The firmware refills the history in the main loop, which runs right after the event.
+    if (p_ble_evt->header.evt_id == BLE_EVT_TX_COMPLETE)
+    {
+        history_fill();
+        flush();
+    }
+}
+
+static void peer_frame(sdc_frame_view_t const * p_frame)
+{
+    uint64_t now = sd_sim_time_us_get();
+
+    if (m_seq_valid[p_frame->stream] && (p_frame->seq != m_seq_next[p_frame->stream]))
+    {
+        m_lost += (uint8_t)(p_frame->seq - m_seq_next[p_frame->stream]);
+    }
+    m_seq_valid[p_frame->stream] = true;
+    m_seq_next[p_frame->stream]  = p_frame->seq + 1;
+
+    if (p_frame->stream == SDC_STREAM_VALUE)
+    {
+        uint32_t latency = (uint32_t)(now - m_value_put_us[p_frame->seq]);
+
+        m_value_rx++;
+        m_value_latency_sum += latency;
+        if (latency > m_value_latency_max)
+        {
+            m_value_latency_max = latency;
+        }
+    }
+    else if (p_frame->stream == SDC_STREAM_HISTORY)
+    {
+        if (p_frame->len == 0)
+        {
+            m_history_end    = true;
+            m_history_end_us = now;
+        }
+        else if (m_history_rx_len + p_frame->len <= sizeof(m_history_rx))
+        {
+            memcpy(&m_history_rx[m_history_rx_len], p_frame->p_payload, p_frame->len);
+            m_history_rx_len += p_frame->len;
+        }
+    }
+}
+
+static void peer_rx_handler(uint16_t conn_handle, uint16_t handle, uint8_t const * p_data, uint16_t len)
+{
+    sdc_frame_view_t frame;
+    uint16_t         pos = 0;
+    uint16_t         i;
+
+    UNUSED_PARAMETER(conn_handle);
+    if (handle != m_sdc.rx_handles.value_handle)
+    {
+        return;
+    }
+
+    if (m_p_dump != NULL)
+    {
+        for (i = 0; i < len; i++)
+        {
+            fprintf(m_p_dump, (i == 0) ? "%02x" : " %02x", p_data[i]);
+        }
+        fprintf(m_p_dump, "\n");
+    }
+
+    while (sdc_frame_next(p_data, len, &pos, &frame))
+    {
+        peer_frame(&frame);
+    }
+    if (pos != len)
+    {
+        m_malformed++;
+    }
+}
+
+/* Sends values for CHECK_DURATION_US, with a history transfer from the start if bulk is set. */
+static void sim_run(uint8_t packets_per_event, bool bulk, uint8_t bulk_reserve, FILE * p_dump)
+{
+    sd_sim_config_t config;
+    ble_sdc_init_t  sdc_init;
+    uint8_t         cccd[BLE_CCCD_VALUE_LEN] = { 0x01, 0x00 };
+    uint8_t         value[3] = { 0 };
+    uint32_t        values = CHECK_DURATION_US / CHECK_VALUE_US;
+    uint32_t        i;
+    uint8_t         seq;
+
+    config.tx_buffer_count   = SD_SIM_TX_BUFFERS_DEFAULT;
+    config.packets_per_event = packets_per_event;
+    config.conn_interval_us  = CHECK_CONN_INTERVAL_US;
+    config.link_count        = 1;
+    sd_sim_init(&config, ble_evt_handler);
+    sd_sim_peer_rx_handler_set(peer_rx_handler);
+
+    memset(&sdc_init, 0, sizeof(sdc_init));
+    APP_ERROR_CHECK(ble_sdc_init(&m_sdc, &sdc_init));
+    (void)sd_sim_connect(CHECK_CONN_HANDLE);
+    APP_ERROR_CHECK(sd_sim_peer_write(CHECK_CONN_HANDLE, m_sdc.rx_handles.cccd_handle, cccd, sizeof(cccd)));
+
+    sdc_frame_init(&m_mux);
+    memset(m_seq_valid, 0, sizeof(m_seq_valid));
+    m_bulk_reserve       = bulk_reserve;
+    m_p_dump             = p_dump;
+    m_history_pos        = bulk ? 0 : (m_history_len + 1);
+    m_history_rx_len     = 0;
+    m_history_end        = false;
+    m_value_rx           = 0;
+    m_value_latency_sum  = 0;
+    m_value_latency_max  = 0;
+    m_lost               = 0;
+    m_malformed          = 0;
+
+    history_fill();
+    flush();
+    for (i = 0; i < values; i++)
+    {
+        // Off the connection event grid, as the SAADC timer is.
+        sd_sim_run(CHECK_VALUE_US - 7);
+        value[0] = (uint8_t)i;
+        seq      = m_mux.queues[SDC_STREAM_VALUE].next_seq;
+        m_value_put_us[seq] = sd_sim_time_us_get();
+        (void)sdc_frame_put(&m_mux, SDC_STREAM_VALUE, value, sizeof(value));
+        flush();
+    }
+    sd_sim_run(CHECK_VALUE_US);
+    m_p_dump = NULL;
+
+    printf("%10u %-8s %7u %8u %9.1f %9.1f %8u %12.0f\n",
+           packets_per_event,
+           bulk ? "yes" : "no",
+           bulk_reserve,
+           m_value_rx,
+           m_value_rx ? (m_value_latency_sum / m_value_rx) / 1000.0 : 0.0,
+           m_value_latency_max / 1000.0,
+           m_history_rx_len,
+           m_history_end ? (m_history_rx_len / (m_history_end_us / 1e6)) : 0.0);
+
+    if ((m_value_rx != values) || (m_lost != 0) || (m_malformed != 0))
+    {
+        m_failures++;
+    }
+    if (bulk && (!m_history_end || (m_history_rx_len != m_history_len) || memcmp(m_history_rx, m_history, m_history_len)))
+    {
+        m_failures++;
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    FILE * p_dump = NULL;
+    int    opt;
+
+    while ((opt = getopt(argc, argv, "o:")) != -1)
+    {
+        if (opt == 'o')
+        {
+            p_dump = fopen(optarg, "w");
+            if (p_dump == NULL)
+            {
+                perror(optarg);
+                return 2;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-o notifications.txt]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    codec_run();
+    history_build();
+
+    printf("%u values every %u ms, %u history bytes, %.1f ms connection interval\n",
+           CHECK_DURATION_US / CHECK_VALUE_US, CHECK_VALUE_US / 1000, m_history_len, CHECK_CONN_INTERVAL_US / 1000.0);
+    printf("pkts/event history reserve   values   mean_ms    max_ms  history  history_B/s\n");
+    sim_run(SD_SIM_PACKETS_PER_EVENT, false, CHECK_BULK_TX_RESERVE, NULL);
+    sim_run(SD_SIM_PACKETS_PER_EVENT, true, CHECK_BULK_TX_RESERVE, p_dump);
+    sim_run(SD_SIM_PACKETS_PER_EVENT, true, 0, NULL);
+    sim_run(2, false, CHECK_BULK_TX_RESERVE, NULL);
+    sim_run(2, true, CHECK_BULK_TX_RESERVE, NULL);
+    sim_run(2, true, 0, NULL);
+
+    if (p_dump != NULL)
+    {
+        fclose(p_dump);
+    }
+    printf("\n%s\n", (m_failures == 0) ? "all checks passed" : "FAILED");
+
+    return (m_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,656 @@
+/* Decoder of occupancy history dumps, and benchmark of the history format in bytes per day.
+ *
+ * Decoding (default): the file is a dump of the FDS flash area, as read with nrfjprog --readcode. The pages
+ * are walked record by record in the FDS layout of SDK 11 (page tag of two words, record header of three
+ * words: key and length, file ID and CRC, record ID). Deleted records and swap pages are skipped. The history
+ * blocks (HISTORY_LOG_FILE_ID) are sorted by seq and printed item by item. With -r the file holds the blocks
+ * back to back instead, as history_log_read() sends them. Times at or above TIME_SYNC_EPOCH_MIN_S are
+ * printed as UTC.
+ *
+ * Benchmark (-b): raw sample streams go through sensor_pipeline_process() with the default configuration,
+ * and the values are reduced and encoded as history_log_sample() does: the peak of each HISTORY_LOG_PERIOD_S
+ * slot, a new block when one is full. Prints the encoded bytes per day, the blocks per day and the days
+ * HISTORY_LOG_MAX_BLOCKS blocks hold, then decodes every block and exits with 1 if a slot differs.
+ *
+ * The streams are generated (seeded, so runs repeat), BENCH_DAYS days each: a free bay, a commuter bay
+ * occupied every day from 08:00 to 17:30, a busy bay with stays of 10 to 90 minutes, and uniform noise as
+ * the worst case. Traces given as arguments are added, CSV like for sensor_replay (the last field of each
+ * line is a sample, '#' lines are skipped). -w writes the blocks of the last stream as an FDS dump, the
+ * newest HISTORY_LOG_MAX_BLOCKS of them, for the decoder.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -Isd_sim -I../arm5_no_packs history_decode.c ../arm5_no_packs/history_codec.c \
+ *       ../arm5_no_packs/sensor_pipeline.c ../arm5_no_packs/window_stats.c -o history_decode
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include "app_config.h"
+#include "sensor_pipeline.h"
+#include "history_codec.h"
+#include "history_log.h"
+#include "time_sync.h"
+
+#define FDS_PAGE_WORDS              1024                                /**< FDS_PAGE_SIZE, one nRF52 flash page. */
+#define FDS_PAGE_TAG_WORDS          2
+#define FDS_PAGE_TAG_MAGIC          0xDEADC0DE
+#define FDS_PAGE_TAG_SWAP           0xF11E01FF
+#define FDS_PAGE_TAG_DATA           0xF11E01FE
+#define FDS_HEADER_WORDS            3
+#define FDS_RECORD_KEY_DIRTY        0x0000                              /**< Key of deleted records. */
+#define FDS_ERASED_WORD             0xFFFFFFFF
+
+#define BENCH_DAYS                  3
+#define BENCH_DAY_S                 86400
+#define BENCH_FREE_LEVEL            3                                   /**< Raw level of a free bay, as in window_stats_check. */
+#define BENCH_OCCUPIED_LEVEL        180                                 /**< Raw level of an occupied bay. */
+#define BENCH_NOISE                 5                                   /**< Raw noise, levels vary by 0..BENCH_NOISE - 1. */
+#define DUMP_SIZE_MAX               (1024 * 1024)
+
+/* Generated streams. */
+typedef enum
+{
+    STREAM_FREE,
+    STREAM_COMMUTER,
+    STREAM_BUSY,
+    STREAM_NOISE,
+    STREAM_COUNT
+} stream_t;
+
+static char const * const m_stream_names[STREAM_COUNT] = { "free", "commuter", "busy", "noise" };
+
+static app_config_t             m_config = APP_CONFIG_DEFAULTS;         /**< Same defaults as the firmware. */
+static uint64_t                 m_now_ms;                               /**< Virtual time of the current buffer. */
+static uint32_t                 m_rng = 12345;
+
+/* Reduction and encoding as in history_log.c. */
+static history_encoder_t        m_enc;
+static bool                     m_enc_active;
+static uint16_t                 m_next_seq;
+static bool                     m_slot_pending;
+static uint32_t                 m_slot_time;
+static uint8_t                  m_slot_value;
+
+static history_block_t        * m_blocks;                               /**< Closed blocks of the stream. */
+static uint16_t               * m_block_lens;
+static uint32_t                 m_block_count;
+static uint32_t                 m_block_cap;
+static uint8_t                * m_slots;                                /**< Peak of every slot, for the round trip. */
+static uint32_t                 m_slot_cap;
+
+
+static uint32_t rng_next(void)
+{
+    // xorshift32
+    m_rng ^= m_rng << 13;
+    m_rng ^= m_rng >> 17;
+    m_rng ^= m_rng << 5;
+    return m_rng;
+}
+
+static char const * event_name(uint8_t code)
+{
+    switch (code)
+    {
+        case HISTORY_EVENT_BOOT:         return "boot";
+        case HISTORY_EVENT_CONNECTED:    return "connected";
+        case HISTORY_EVENT_DISCONNECTED: return "disconnected";
+        case HISTORY_EVENT_BATTERY_LOW:  return "battery low";
+        default:                         return "unknown";
+    }
+}
+
+static void time_print(uint32_t t)
+{
+    if (t >= TIME_SYNC_EPOCH_MIN_S)
+    {
+        time_t    utc = (time_t)t;
+        struct tm tm;
+        char      text[32];
+
+        (void)gmtime_r(&utc, &tm);
+        (void)strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &tm);
+        printf("    %s", text);
+    }
+    else
+    {
+        printf("    %10u s    ", t);
+    }
+}
+
+static void block_print(history_block_t const * p_block)
+{
+    history_decoder_t decoder;
+    history_item_t    item;
+
+    printf("block seq %u, t_base %u, %u slots of %u s, %u bytes\n",
+           p_block->header.seq, p_block->header.t_base, p_block->header.slot_count, p_block->header.period_s,
+           (unsigned)(sizeof(history_block_header_t) + p_block->header.data_len));
+
+    history_decoder_init(&decoder, p_block);
+    while (history_decoder_next(&decoder, &item))
+    {
+        time_print(item.time);
+        switch (item.type)
+        {
+            case HISTORY_ITEM_SAMPLE:
+                printf("  value %u x%u\n", item.value, item.slots);
+                break;
+
+            case HISTORY_ITEM_GAP:
+                printf("  gap of %u slots\n", item.slots);
+                break;
+
+            case HISTORY_ITEM_EVENT:
+                printf("  event %s\n", event_name(item.value));
+                break;
+        }
+    }
+}
+
+static void block_add(history_block_t const * p_block, uint16_t len)
+{
+    if (m_block_count == m_block_cap)
+    {
+        m_block_cap  = (m_block_cap == 0) ? 64 : (m_block_cap * 2);
+        m_blocks     = realloc(m_blocks, m_block_cap * sizeof(history_block_t));
+        m_block_lens = realloc(m_block_lens, m_block_cap * sizeof(uint16_t));
+        if ((m_blocks == NULL) || (m_block_lens == NULL))
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(2);
+        }
+    }
+    memset(&m_blocks[m_block_count], 0xFF, sizeof(history_block_t));
+    memcpy(&m_blocks[m_block_count], p_block, len);
+    m_block_lens[m_block_count] = len;
+    m_block_count++;
+}
+
+static int block_seq_compare(void const * p_a, void const * p_b)
+{
+    history_block_t const * p_block_a = p_a;
+    history_block_t const * p_block_b = p_b;
+
+    // Serial number order, as seq_is_before() of history_log.c.
+    return (int16_t)(p_block_a->header.seq - p_block_b->header.seq);
+}
+
+/* Collects the history blocks of an FDS dump. Returns false if the dump is not in the FDS layout. */
+static bool fds_dump_parse(uint32_t const * p_words, uint32_t word_count)
+{
+    uint32_t page;
+    uint32_t pages = 0;
+
+    for (page = 0; page + FDS_PAGE_WORDS <= word_count; page += FDS_PAGE_WORDS)
+    {
+        uint32_t const * p_page = &p_words[page];
+        uint32_t         pos    = FDS_PAGE_TAG_WORDS;
+
+        if ((p_page[0] != FDS_PAGE_TAG_MAGIC) || (p_page[1] == FDS_PAGE_TAG_SWAP))
+        {
+            continue;
+        }
+        if (p_page[1] != FDS_PAGE_TAG_DATA)
+        {
+            continue;
+        }
+        pages++;
+
+        while ((pos + FDS_HEADER_WORDS <= FDS_PAGE_WORDS) && (p_page[pos] != FDS_ERASED_WORD))
+        {
+            uint16_t record_key   = (uint16_t)p_page[pos];
+            uint16_t length_words = (uint16_t)(p_page[pos] >> 16);
+            uint16_t file_id      = (uint16_t)p_page[pos + 1];
+            uint32_t data_len     = length_words * sizeof(uint32_t);
+
+            if (pos + FDS_HEADER_WORDS + length_words > FDS_PAGE_WORDS)
+            {
+                fprintf(stderr, "page %u: record at word %u runs past the page\n", page / FDS_PAGE_WORDS, pos);
+                break;
+            }
+            if ((record_key != FDS_RECORD_KEY_DIRTY) && (file_id == HISTORY_LOG_FILE_ID)
+                && (data_len <= sizeof(history_block_t))
+                && history_block_is_valid((history_block_t const *)&p_page[pos + FDS_HEADER_WORDS], data_len))
+            {
+                block_add((history_block_t const *)&p_page[pos + FDS_HEADER_WORDS], (uint16_t)data_len);
+            }
+            pos += FDS_HEADER_WORDS + length_words;
+        }
+    }
+
+    return pages > 0;
+}
+
+/* Collects the blocks of a transfer. Returns false if it is malformed. */
+static bool transfer_parse(uint8_t const * p_data, uint32_t len)
+{
+    uint32_t pos = 0;
+
+    while (pos < len)
+    {
+        history_block_t block;
+        uint32_t        block_len;
+
+        memset(&block, 0, sizeof(block));
+        memcpy(&block, &p_data[pos], ((len - pos) < sizeof(block)) ? (len - pos) : sizeof(block));
+        if (!history_block_is_valid(&block, len - pos))
+        {
+            fprintf(stderr, "no valid block at byte %u\n", pos);
+            return false;
+        }
+        block_len = sizeof(history_block_header_t) + block.header.data_len;
+        block_add(&block, (uint16_t)block_len);
+        pos += block_len;
+    }
+
+    return true;
+}
+
+static int decode_run(char const * p_path, bool transfer)
+{
+    FILE     * p_file = fopen(p_path, "rb");
+    uint8_t  * p_data = malloc(DUMP_SIZE_MAX);
+    uint32_t   len;
+    bool       ok;
+    uint32_t   i;
+
+    if ((p_file == NULL) || (p_data == NULL))
+    {
+        perror(p_path);
+        return 2;
+    }
+    len = (uint32_t)fread(p_data, 1, DUMP_SIZE_MAX, p_file);
+    fclose(p_file);
+
+    ok = transfer ? transfer_parse(p_data, len)
+                  : fds_dump_parse((uint32_t const *)p_data, len / sizeof(uint32_t));
+    free(p_data);
+    if (!ok)
+    {
+        fprintf(stderr, "%s: %s\n", p_path, transfer ? "malformed transfer" : "no FDS data pages");
+        return 1;
+    }
+
+    qsort(m_blocks, m_block_count, sizeof(history_block_t), block_seq_compare);
+    for (i = 0; i < m_block_count; i++)
+    {
+        block_print(&m_blocks[i]);
+    }
+    printf("%u blocks\n", m_block_count);
+
+    return 0;
+}
+
+/* Closes the block being filled, as block_store() of history_log.c. */
+static void block_store(void)
+{
+    uint16_t len;
+
+    if (!m_enc_active)
+    {
+        return;
+    }
+    m_enc_active = false;
+
+    len = history_encoder_finish(&m_enc);
+    block_add(&m_enc.block, len);
+}
+
+static void slot_commit(uint32_t slot_time, uint8_t value)
+{
+    if (m_enc_active)
+    {
+        uint32_t block_end = history_block_end(&m_enc.block.header);
+
+        if ((slot_time >= block_end)
+            && history_encoder_gap(&m_enc, (slot_time - block_end) / HISTORY_LOG_PERIOD_S)
+            && history_encoder_put(&m_enc, value))
+        {
+            return;
+        }
+        block_store();
+    }
+
+    history_encoder_start(&m_enc, m_next_seq++, slot_time, HISTORY_LOG_PERIOD_S, value);
+    m_enc_active = true;
+}
+
+/* Adds a value at the current time, as history_log_sample(). */
+static void value_log(uint8_t value)
+{
+    uint32_t now       = (uint32_t)(m_now_ms / 1000);
+    uint32_t slot_time = now - (now % HISTORY_LOG_PERIOD_S);
+    uint32_t slot      = slot_time / HISTORY_LOG_PERIOD_S;
+
+    if (slot >= m_slot_cap)
+    {
+        m_slot_cap = (slot + 1) * 2;
+        m_slots    = realloc(m_slots, m_slot_cap);
+        if (m_slots == NULL)
+        {
+            fprintf(stderr, "out of memory\n");
+            exit(2);
+        }
+    }
+
+    if (m_slot_pending)
+    {
+        if (slot_time == m_slot_time)
+        {
+            m_slot_value = (value > m_slot_value) ? value : m_slot_value;
+            m_slots[slot] = m_slot_value;
+            return;
+        }
+        slot_commit(m_slot_time, m_slot_value);
+    }
+
+    m_slot_pending = true;
+    m_slot_time    = slot_time;
+    m_slot_value   = value;
+    m_slots[slot]  = value;
+}
+
+static void value_send(uint8_t value)
+{
+    (void)value;
+}
+
+static const sensor_hal_t m_hal =
+{
+    .value_send   = value_send,
+    .value_log    = value_log,
+    .summary_send = NULL
+};
+
+/* Raw sample of a generated stream at time t_ms. */
+static int16_t stream_sample(stream_t stream, uint64_t t_ms)
+{
+    static uint64_t change_ms;
+    static bool     occupied;
+    uint32_t        day_s = (uint32_t)((t_ms / 1000) % BENCH_DAY_S);
+    uint16_t        level = BENCH_FREE_LEVEL;
+
+    switch (stream)
+    {
+        case STREAM_COMMUTER:
+            if ((day_s >= 8 * 3600) && (day_s < 17 * 3600 + 1800))
+            {
+                level = BENCH_OCCUPIED_LEVEL;
+            }
+            break;
+
+        case STREAM_BUSY:
+            if (t_ms == 0)
+            {
+                change_ms = 0;
+                occupied  = true;
+            }
+            if (t_ms >= change_ms)
+            {
+                // Stays of 10 to 90 minutes, free for 5 to 60 minutes between them.
+                occupied   = !occupied;
+                change_ms += occupied ? ((10 + rng_next() % 81) * 60000) : ((5 + rng_next() % 56) * 60000);
+            }
+            level = occupied ? BENCH_OCCUPIED_LEVEL : BENCH_FREE_LEVEL;
+            break;
+
+        case STREAM_NOISE:
+            return (int16_t)(rng_next() % (APP_CONFIG_DEFAULT_VALUE_MAX + 1));
+
+        default:
+            break;
+    }
+
+    return (int16_t)(level + rng_next() % BENCH_NOISE);
+}
+
+/* Reads the next sample of a trace. Returns false at the end of the trace. */
+static bool trace_sample_read(FILE * p_file, int16_t * p_sample)
+{
+    char line[128];
+
+    while (fgets(line, sizeof(line), p_file) != NULL)
+    {
+        char * p_field = strrchr(line, ',');
+
+        if ((line[0] == '#') || (line[0] == '\n') || (line[0] == '\r'))
+        {
+            continue;
+        }
+        *p_sample = (int16_t)strtol((p_field != NULL) ? (p_field + 1) : line, NULL, 10);
+        return true;
+    }
+    return false;
+}
+
+static void stream_reset(void)
+{
+    m_now_ms       = 0;
+    m_enc_active   = false;
+    m_slot_pending = false;
+    m_next_seq     = 0;
+    m_block_count  = 0;
+    memset(m_slots, 0, m_slot_cap);
+    sensor_pipeline_init(&m_hal, &m_config);
+}
+
+/* Decodes the blocks of the stream and compares them with the slots. Returns the number of slots covered. */
+static uint32_t stream_verify(uint32_t * p_mismatches)
+{
+    uint32_t covered = 0;
+    uint32_t i;
+
+    *p_mismatches = 0;
+    for (i = 0; i < m_block_count; i++)
+    {
+        history_decoder_t decoder;
+        history_item_t    item;
+        uint32_t          s;
+
+        history_decoder_init(&decoder, &m_blocks[i]);
+        while (history_decoder_next(&decoder, &item))
+        {
+            if (item.type != HISTORY_ITEM_SAMPLE)
+            {
+                continue;
+            }
+            for (s = 0; s < item.slots; s++)
+            {
+                uint32_t slot = item.time / HISTORY_LOG_PERIOD_S + s;
+
+                if ((slot >= m_slot_cap) || (m_slots[slot] != item.value))
+                {
+                    (*p_mismatches)++;
+                }
+                covered++;
+            }
+        }
+    }
+
+    return covered;
+}
+
+/* Encodes a stream, generated or from a trace, and prints its cost. Returns false if the round trip fails. */
+static bool stream_bench(char const * p_name, stream_t stream, FILE * p_trace)
+{
+    int16_t  buffer[SAMPLES_IN_BUFFER];
+    uint16_t count = 0;
+    uint64_t end_ms = (uint64_t)BENCH_DAYS * BENCH_DAY_S * 1000;
+    uint64_t bytes = 0;
+    uint32_t slots;
+    uint32_t covered;
+    uint32_t mismatches;
+    double   days;
+    uint32_t i;
+
+    stream_reset();
+
+    for (;;)
+    {
+        if (p_trace != NULL)
+        {
+            if (!trace_sample_read(p_trace, &buffer[count]))
+            {
+                break;
+            }
+        }
+        else
+        {
+            if (m_now_ms >= end_ms)
+            {
+                break;
+            }
+            buffer[count] = stream_sample(stream, m_now_ms);
+        }
+
+        if (++count == m_config.samples_in_buffer)
+        {
+            sensor_pipeline_process(buffer, count);
+            count     = 0;
+            m_now_ms += m_config.samples_in_buffer * m_config.sample_period_ms;
+        }
+    }
+
+    if (m_slot_pending)
+    {
+        slot_commit(m_slot_time, m_slot_value);
+    }
+    block_store();
+
+    for (i = 0; i < m_block_count; i++)
+    {
+        bytes += m_block_lens[i];
+    }
+    slots   = (uint32_t)(m_now_ms / 1000 / HISTORY_LOG_PERIOD_S);
+    days    = m_now_ms / 1000.0 / BENCH_DAY_S;
+    covered = stream_verify(&mismatches);
+
+    if (days <= 0)
+    {
+        printf("%-16s empty\n", p_name);
+        return true;
+    }
+    printf("%-16s %6.2f %7u %6u %9.0f %8.2f %10.1f   %s\n", p_name, days, slots, m_block_count, bytes / days,
+           m_block_count / days, HISTORY_LOG_MAX_BLOCKS / (m_block_count / days),
+           ((mismatches == 0) && (covered >= slots)) ? "ok" : "FAIL");
+
+    return (mismatches == 0) && (covered >= slots);
+}
+
+/* Starts an empty FDS data page. */
+static void fds_page_start(uint32_t * p_page)
+{
+    memset(p_page, 0xFF, FDS_PAGE_WORDS * sizeof(uint32_t));
+    p_page[0] = FDS_PAGE_TAG_MAGIC;
+    p_page[1] = FDS_PAGE_TAG_DATA;
+}
+
+/* Writes the newest HISTORY_LOG_MAX_BLOCKS blocks as FDS pages. */
+static void fds_dump_write(char const * p_path)
+{
+    FILE     * p_file = fopen(p_path, "wb");
+    uint32_t   page[FDS_PAGE_WORDS];
+    uint32_t   pos = FDS_PAGE_TAG_WORDS;
+    uint32_t   record_id = 1;
+    uint32_t   i = (m_block_count > HISTORY_LOG_MAX_BLOCKS) ? (m_block_count - HISTORY_LOG_MAX_BLOCKS) : 0;
+
+    if (p_file == NULL)
+    {
+        perror(p_path);
+        exit(2);
+    }
+
+    fds_page_start(page);
+    for (; i < m_block_count; i++)
+    {
+        uint16_t length_words = (uint16_t)((m_block_lens[i] + 3) / 4);
+
+        if (pos + FDS_HEADER_WORDS + length_words > FDS_PAGE_WORDS)
+        {
+            fwrite(page, sizeof(page), 1, p_file);
+            fds_page_start(page);
+            pos = FDS_PAGE_TAG_WORDS;
+        }
+
+        page[pos]     = HISTORY_LOG_RECORD_KEY | ((uint32_t)length_words << 16);
+        page[pos + 1] = HISTORY_LOG_FILE_ID | (0xFFFFu << 16);
+        page[pos + 2] = record_id++;
+        memcpy(&page[pos + FDS_HEADER_WORDS], &m_blocks[i], length_words * sizeof(uint32_t));
+        pos += FDS_HEADER_WORDS + length_words;
+    }
+    fwrite(page, sizeof(page), 1, p_file);
+
+    fclose(p_file);
+}
+
+static void usage(char const * p_name)
+{
+    fprintf(stderr, "usage: %s [-r] dump\n"
+                    "       %s -b [-w dump] [trace ...]\n", p_name, p_name);
+    exit(2);
+}
+
+int main(int argc, char ** argv)
+{
+    char const * p_out = NULL;
+    bool         bench = false;
+    bool         transfer = false;
+    bool         ok = true;
+    int          opt;
+    int          i;
+
+    while ((opt = getopt(argc, argv, "brw:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'b': bench    = true;   break;
+            case 'r': transfer = true;   break;
+            case 'w': p_out    = optarg; break;
+            default:  usage(argv[0]);
+        }
+    }
+
+    if (!bench)
+    {
+        if (optind != argc - 1)
+        {
+            usage(argv[0]);
+        }
+        return decode_run(argv[optind], transfer);
+    }
+
+    printf("%u s slots, %u byte blocks, %u blocks kept\n\n", HISTORY_LOG_PERIOD_S, HISTORY_BLOCK_SIZE, HISTORY_LOG_MAX_BLOCKS);
+    printf("stream             days   slots blocks bytes/day blk/day days_held   round trip\n");
+
+    for (i = 0; i < STREAM_COUNT; i++)
+    {
+        ok &= stream_bench(m_stream_names[i], (stream_t)i, NULL);
+    }
+    for (i = optind; i < argc; i++)
+    {
+        FILE * p_trace = fopen(argv[i], "r");
+
+        if (p_trace == NULL)
+        {
+            perror(argv[i]);
+            return 2;
+        }
+        ok &= stream_bench(argv[i], STREAM_COUNT, p_trace);
+        fclose(p_trace);
+    }
+
+    if (p_out != NULL)
+    {
+        fds_dump_write(p_out);
+    }
+
+    free(m_blocks);
+    free(m_block_lens);
+    free(m_slots);
+    return ok ? 0 : 1;
+}
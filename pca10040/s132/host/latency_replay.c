@@ -0,0 +1,277 @@
+/* Host replay of the sample-to-air latency breakdown.
+ *
+ * Plays a trace through the sensor pipeline and sends the values with the SDC service on the SoftDevice
+ * simulator, stamping them with latency_trace like the firmware does. Buffers complete every
+ * samples_in_buffer * sample_period_ms of virtual time. The main loop picks a buffer up after -d us plus up
+ * to -j us of random jitter (load from other work), filtering takes -f us and the send -s us. With -b the
+ * link also carries that many other notifications per second, competing for the TX buffers.
+ *
+ * The trace is CSV or binary as for sensor_replay. Prints the per-stage breakdown of the latency page.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -Isd_sim -I../arm5_no_packs latency_replay.c sd_sim/sd_sim.c \
+ *       ../arm5_no_packs/ble_sensor_data_custom.c ../arm5_no_packs/sensor_pipeline.c \
+ *       ../arm5_no_packs/window_stats.c ../arm5_no_packs/latency_trace.c -o latency_replay
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sd_sim.h"
+#include "app_error.h"
+#include "app_config.h"
+#include "ble_sensor_data_custom.h"
+#include "sensor_pipeline.h"
+#include "latency_trace.h"
+
+#define REPLAY_CONN_HANDLE          0x0010
+
+static char const * const m_stage_names[LATENCY_STAGE_COUNT] = { "filter", "send", "air", "total" };
+
+static app_config_t             m_config = APP_CONFIG_DEFAULTS;         /**< Same defaults as the firmware. */
+static ble_sdc_t                m_sdc;
+static uint32_t                 m_done_us;                              /**< Stamps of the buffer being processed. */
+static uint32_t                 m_filter_us;
+static uint32_t                 m_send_us = 20;
+static uint32_t                 m_dropped;
+
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t * p_file_name)
+{
+    fprintf(stderr, "app_error 0x%x at %s:%u\n", error_code, (char const *)p_file_name, line_num);
+    exit(2);
+}
+
+static void ble_evt_handler(ble_evt_t * p_ble_evt)
+{
+    ble_sdc_on_ble_evt(&m_sdc, p_ble_evt);
+
+    if (p_ble_evt->header.evt_id == BLE_EVT_TX_COMPLETE)
+    {
+        latency_trace_tx_complete(p_ble_evt->evt.common_evt.params.tx_complete.count, (uint32_t)sd_sim_time_us_get());
+    }
+}
+
+static void value_send(uint8_t value)
+{
+    if (ble_sdc_data_send(&m_sdc, &value, 1, NULL) == NRF_SUCCESS)
+    {
+        latency_trace_sent(m_done_us, m_filter_us, m_filter_us + m_send_us);
+    }
+    else
+    {
+        m_dropped++;
+    }
+}
+
+static const sensor_hal_t m_hal =
+{
+    .value_send = value_send,
+    .value_log  = NULL
+};
+
+/* Advances the simulator to an absolute time. */
+static void sim_run_until(uint64_t time_us)
+{
+    uint64_t now = sd_sim_time_us_get();
+
+    if (time_us > now)
+    {
+        sd_sim_run((uint32_t)(time_us - now));
+    }
+}
+
+/* Reads the next sample. Returns false at the end of the trace. */
+static bool sample_read(FILE * p_file, bool binary, int16_t * p_sample)
+{
+    char line[128];
+
+    if (binary)
+    {
+        uint8_t raw[2];
+        if (fread(raw, 1, sizeof(raw), p_file) != sizeof(raw))
+        {
+            return false;
+        }
+        *p_sample = (int16_t)(raw[0] | (raw[1] << 8));
+        return true;
+    }
+
+    while (fgets(line, sizeof(line), p_file) != NULL)
+    {
+        char * p_field = strrchr(line, ',');
+
+        if ((line[0] == '#') || (line[0] == '\n') || (line[0] == '\r'))
+        {
+            continue;
+        }
+        *p_sample = (int16_t)strtol((p_field != NULL) ? (p_field + 1) : line, NULL, 10);
+        return true;
+    }
+    return false;
+}
+
+/* Upper bound of the histogram bin holding the given percentile, at most the maximum. */
+static uint32_t percentile_us(latency_stage_stats_t const * p_stats, uint32_t pct)
+{
+    uint64_t target = ((uint64_t)p_stats->count * pct + 99) / 100;
+    uint64_t seen = 0;
+    uint32_t bin;
+
+    for (bin = 0; bin < LATENCY_HIST_BINS; bin++)
+    {
+        seen += p_stats->hist[bin];
+        if ((seen >= target) && (seen > 0))
+        {
+            break;
+        }
+    }
+    return ((bin < LATENCY_HIST_BINS - 1) && ((2u << bin) - 1 < p_stats->max)) ? ((2u << bin) - 1) : p_stats->max;
+}
+
+static void report_print(void)
+{
+    latency_stage_stats_t stats;
+    sd_sim_stats_t        sim;
+    uint32_t              stage;
+    uint32_t              bin;
+
+    printf("stage       count    mean_us     p50_us     p90_us     p99_us     max_us\n");
+    for (stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+    {
+        latency_trace_stats_get((latency_stage_t)stage, &stats);
+        printf("%-8s %8u %10llu %10u %10u %10u %10u\n",
+               m_stage_names[stage], stats.count,
+               (unsigned long long)((stats.count > 0) ? stats.sum / stats.count : 0),
+               percentile_us(&stats, 50), percentile_us(&stats, 90), percentile_us(&stats, 99), stats.max);
+    }
+
+    printf("\nlog2 histograms (bin n: [2^n, 2^(n+1)) us)\n");
+    for (stage = 0; stage < LATENCY_STAGE_COUNT; stage++)
+    {
+        latency_trace_stats_get((latency_stage_t)stage, &stats);
+        printf("%-8s", m_stage_names[stage]);
+        for (bin = 0; bin < LATENCY_HIST_BINS; bin++)
+        {
+            printf(" %u", stats.hist[bin]);
+        }
+        printf("\n");
+    }
+
+    sd_sim_stats_get(&sim);
+    printf("\nvalues dropped %u, notifications sent %u, NO_TX_PACKETS %u, FIFO overflows %u\n",
+           m_dropped, sim.notifications_sent, sim.err_no_tx_packets, latency_trace_overflows_get());
+}
+
+static void usage(char const * p_name)
+{
+    fprintf(stderr,
+            "usage: %s [-b] [-c conn_interval_ms] [-t tx_buffers] [-k packets_per_event] [-d delay_us]\n"
+            "       [-j jitter_us] [-f filter_us] [-s send_us] [-l background_per_s] [-n samples_per_buffer]\n"
+            "       [-p sample_period_ms] trace\n", p_name);
+    exit(2);
+}
+
+int main(int argc, char ** argv)
+{
+    sd_sim_config_t sim_config = { SD_SIM_TX_BUFFERS_DEFAULT, SD_SIM_PACKETS_PER_EVENT, 20000, 1 };
+    ble_sdc_init_t  sdc_init;
+    int16_t         buffer[SAMPLES_IN_BUFFER];
+    uint16_t        count = 0;
+    bool            binary = false;
+    uint32_t        delay_us = 100;
+    uint32_t        jitter_us = 0;
+    uint32_t        filter_cost_us = 50;
+    uint32_t        background_per_s = 0;
+    uint64_t        t_done = 0;
+    uint64_t        busy_until = 0;
+    uint64_t        next_background = 0;
+    uint8_t         cccd[2] = { 0x01, 0x00 };
+    uint8_t         filler[BLE_SDC_MAX_DATA_LEN];
+    FILE          * p_file;
+    int             opt;
+
+    while ((opt = getopt(argc, argv, "bc:t:k:d:j:f:s:l:n:p:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'b': binary = true;                                            break;
+            case 'c': sim_config.conn_interval_us  = (uint32_t)(atof(optarg) * 1000); break;
+            case 't': sim_config.tx_buffer_count   = (uint8_t)atoi(optarg);     break;
+            case 'k': sim_config.packets_per_event = (uint8_t)atoi(optarg);     break;
+            case 'd': delay_us         = (uint32_t)atoi(optarg);                break;
+            case 'j': jitter_us        = (uint32_t)atoi(optarg);                break;
+            case 'f': filter_cost_us   = (uint32_t)atoi(optarg);                break;
+            case 's': m_send_us        = (uint32_t)atoi(optarg);                break;
+            case 'l': background_per_s = (uint32_t)atoi(optarg);                break;
+            case 'n': m_config.samples_in_buffer = (uint16_t)atoi(optarg);      break;
+            case 'p': m_config.sample_period_ms  = (uint16_t)atoi(optarg);      break;
+            default:  usage(argv[0]);
+        }
+    }
+    if ((optind != argc - 1) || (sim_config.conn_interval_us == 0)
+        || (m_config.samples_in_buffer == 0) || (m_config.samples_in_buffer > SAMPLES_IN_BUFFER))
+    {
+        usage(argv[0]);
+    }
+
+    p_file = fopen(argv[optind], binary ? "rb" : "r");
+    if (p_file == NULL)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    sd_sim_init(&sim_config, ble_evt_handler);
+    memset(&sdc_init, 0, sizeof(sdc_init));
+    APP_ERROR_CHECK(ble_sdc_init(&m_sdc, &sdc_init));
+    sd_sim_connect(REPLAY_CONN_HANDLE);
+    APP_ERROR_CHECK(sd_sim_peer_write(REPLAY_CONN_HANDLE, m_sdc.rx_handles.cccd_handle, cccd, sizeof(cccd)));
+
+    latency_trace_init();
+    sensor_pipeline_init(&m_hal, &m_config);
+    memset(filler, 0, sizeof(filler));
+    srand(1);
+
+    while (sample_read(p_file, binary, &buffer[count]))
+    {
+        uint64_t start;
+
+        if (++count < m_config.samples_in_buffer)
+        {
+            continue;
+        }
+        t_done += (uint64_t)count * m_config.sample_period_ms * 1000;
+
+        // Other notifications up to the completion of this buffer.
+        while ((background_per_s > 0) && (next_background <= t_done))
+        {
+            sim_run_until(next_background);
+            if (ble_sdc_data_send(&m_sdc, filler, sizeof(filler), NULL) == NRF_SUCCESS)
+            {
+                latency_trace_untracked_sent();
+            }
+            next_background += 1000000 / background_per_s;
+        }
+
+        // The main loop handles buffers in order, after its other work.
+        start = t_done + delay_us + ((jitter_us > 0) ? (uint32_t)rand() % jitter_us : 0);
+        if (start < busy_until)
+        {
+            start = busy_until;
+        }
+        busy_until = start + filter_cost_us + m_send_us;
+
+        sim_run_until(start + filter_cost_us);
+        m_done_us   = (uint32_t)t_done;
+        m_filter_us = (uint32_t)(start + filter_cost_us);
+        sensor_pipeline_process(buffer, count);
+        count = 0;
+    }
+    fclose(p_file);
+
+    sim_run_until(sd_sim_time_us_get() + 10 * sim_config.conn_interval_us);
+    report_print();
+    return 0;
+}
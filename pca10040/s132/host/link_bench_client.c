@@ -0,0 +1,345 @@
+/* Client of the link throughput benchmark, run against the simulated SoftDevice in place of a central.
+ *
+ * Starts link_bench with the control command of the firmware (SDC_CMD_LINK_BENCH), receives the BENCH
+ * frames, checks their sequence numbers for gaps and reads the result back from the diagnostics
+ * characteristic, blob by blob like a central. Sweeps the connection interval and the packets the link takes
+ * per connection event and runs all links at once, then checks stopping early, refusing a start without subscribers and ending on
+ * disconnect. Exits with 1 if a check fails.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -Isd_sim -I../arm5_no_packs link_bench_client.c sd_sim/sd_sim.c \
+ *       ../arm5_no_packs/ble_sensor_data_custom.c ../arm5_no_packs/link_bench.c ../arm5_no_packs/sdc_frame.c \
+ *       -o link_bench_client
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sd_sim.h"
+#include "app_error.h"
+#include "app_time.h"
+#include "ble_sensor_data_custom.h"
+#include "sdc_frame.h"
+#include "link_bench.h"
+
+#define BENCH_CONN_HANDLE_BASE      0x0010                              /**< Link n gets BENCH_CONN_HANDLE_BASE + n. */
+#define BENCH_DURATION_S            5
+#define BENCH_CMD_LINK_BENCH        0x07                                /**< SDC_CMD_LINK_BENCH of main.c. */
+#define BENCH_BLOB_LEN              (GATT_MTU_SIZE_DEFAULT - 1)         /**< Bytes of one read (blob) response. */
+#define BENCH_DRAIN_LIMIT_US        1000000                             /**< Longest wait for the benchmark to end. */
+
+/* What one simulated central received. */
+typedef struct
+{
+    uint32_t frames;
+    uint32_t gaps;                      /**< Sequence numbers skipped, payloads the other links took while this one was full. */
+    uint32_t next_seq;
+    uint64_t latency_sum_us;            /**< Send to receive, summed over the frames. */
+    uint32_t latency_max_us;
+} peer_t;
+
+/* Result read from the diagnostics characteristic. */
+typedef struct
+{
+    uint8_t           state;
+    uint8_t           duration_s;
+    uint32_t          elapsed_ms;
+    uint8_t           payload_len;
+    link_bench_link_t link;
+} result_t;
+
+static ble_sdc_t                m_sdc;
+static peer_t                   m_peers[BLE_SDC_MAX_LINKS];
+static uint8_t                  m_diag_link;                            /**< Link table entry served by the diagnostics page. */
+static uint32_t                 m_failures;
+
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t * p_file_name)
+{
+    fprintf(stderr, "app_error 0x%x at %s:%u\n", error_code, (char const *)p_file_name, line_num);
+    exit(2);
+}
+
+/* Time base of the benchmark, taken from the simulator. */
+uint64_t app_time_us_get(void)
+{
+    return sd_sim_time_us_get();
+}
+
+uint64_t app_time_ms_get(void)
+{
+    return sd_sim_time_us_get() / 1000;
+}
+
+static void check(bool condition, char const * p_what)
+{
+    printf("%-60s %s\n", p_what, condition ? "ok" : "FAILED");
+    if (!condition)
+    {
+        m_failures++;
+    }
+}
+
+/* Takes the benchmark command of main.c. */
+static void sdc_data_handler(ble_sdc_t * p_sdc, uint8_t * p_data, uint16_t length)
+{
+    if ((length == 2) && (p_data[0] == BENCH_CMD_LINK_BENCH))
+    {
+        (void)link_bench_start(p_sdc, p_data[1]);
+    }
+}
+
+/* Serves DIAG_PAGE_BENCH of main.c, without the page byte. */
+static void sdc_diag_handler(ble_sdc_t * p_sdc, uint8_t * p_data, uint16_t * p_length)
+{
+    UNUSED_PARAMETER(p_sdc);
+    *p_length = link_bench_encode(m_diag_link, p_data, *p_length);
+}
+
+static void sdc_evt_handler(ble_sdc_t * p_sdc, ble_sdc_evt_type_t evt_type, uint8_t link)
+{
+    UNUSED_PARAMETER(p_sdc);
+    UNUSED_PARAMETER(evt_type);
+    UNUSED_PARAMETER(link);
+}
+
+/* The main loop of the firmware runs after every event, so the refill follows the dispatch here too. */
+static void ble_evt_handler(ble_evt_t * p_ble_evt)
+{
+    ble_sdc_on_ble_evt(&m_sdc, p_ble_evt);
+    link_bench_on_ble_evt(p_ble_evt);
+    link_bench_process();
+}
+
+static uint32_t u32_get(uint8_t const * p)
+{
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void peer_rx_handler(uint16_t conn_handle, uint16_t handle, uint8_t const * p_data, uint16_t len)
+{
+    peer_t         * p_peer;
+    sdc_frame_view_t frame;
+    uint16_t         pos = 0;
+    uint32_t         seq;
+    uint32_t         latency;
+
+    if ((handle != m_sdc.rx_handles.value_handle) || (conn_handle < BENCH_CONN_HANDLE_BASE)
+        || (conn_handle >= BENCH_CONN_HANDLE_BASE + BLE_SDC_MAX_LINKS))
+    {
+        return;
+    }
+    p_peer = &m_peers[conn_handle - BENCH_CONN_HANDLE_BASE];
+
+    while (sdc_frame_next(p_data, len, &pos, &frame))
+    {
+        if ((frame.stream != SDC_STREAM_BENCH) || (frame.len < 8))
+        {
+            continue;
+        }
+        seq = u32_get(&frame.p_payload[0]);
+        if (seq != p_peer->next_seq)
+        {
+            p_peer->gaps += seq - p_peer->next_seq;
+        }
+        p_peer->next_seq = seq + 1;
+        p_peer->frames++;
+
+        latency = (uint32_t)sd_sim_time_us_get() - u32_get(&frame.p_payload[4]);
+        p_peer->latency_sum_us += latency;
+        p_peer->latency_max_us  = MAX(p_peer->latency_max_us, latency);
+    }
+}
+
+static void setup(uint8_t link_count, uint32_t conn_interval_us, uint8_t packets_per_event)
+{
+    sd_sim_config_t config;
+    ble_sdc_init_t  sdc_init;
+    uint8_t         cccd[BLE_CCCD_VALUE_LEN];
+    uint8_t         n;
+
+    config.tx_buffer_count   = SD_SIM_TX_BUFFERS_DEFAULT;
+    config.packets_per_event = packets_per_event;
+    config.conn_interval_us  = conn_interval_us;
+    config.link_count        = link_count;
+    sd_sim_init(&config, ble_evt_handler);
+    sd_sim_peer_rx_handler_set(peer_rx_handler);
+
+    memset(&sdc_init, 0, sizeof(sdc_init));
+    sdc_init.data_handler = sdc_data_handler;
+    sdc_init.diag_handler = sdc_diag_handler;
+    sdc_init.evt_handler  = sdc_evt_handler;
+    APP_ERROR_CHECK(ble_sdc_init(&m_sdc, &sdc_init));
+
+    memset(m_peers, 0, sizeof(m_peers));
+    (void)uint16_encode(BLE_GATT_HVX_NOTIFICATION, cccd);
+    for (n = 0; n < link_count; n++)
+    {
+        APP_ERROR_CHECK(sd_sim_connect(BENCH_CONN_HANDLE_BASE + n));
+        APP_ERROR_CHECK(sd_sim_peer_write(BENCH_CONN_HANDLE_BASE + n, m_sdc.rx_handles.cccd_handle, cccd, sizeof(cccd)));
+    }
+}
+
+static void bench_command(uint8_t duration_s)
+{
+    uint8_t cmd[2] = { BENCH_CMD_LINK_BENCH, duration_s };
+
+    APP_ERROR_CHECK(sd_sim_peer_write(BENCH_CONN_HANDLE_BASE, m_sdc.tx_handles.value_handle, cmd, sizeof(cmd)));
+}
+
+/* Runs the simulator until the benchmark is over. Returns false if it did not end in time. */
+static bool bench_wait(uint32_t duration_us)
+{
+    uint64_t end = sd_sim_time_us_get() + duration_us + BENCH_DRAIN_LIMIT_US;
+
+    sd_sim_run(duration_us);
+    while (link_bench_state() != LINK_BENCH_STATE_DONE)
+    {
+        if (sd_sim_time_us_get() >= end)
+        {
+            return false;
+        }
+        sd_sim_run(1000);
+    }
+    return true;
+}
+
+/* Reads the result of link table entry link from the diagnostics characteristic, blob by blob. */
+static bool result_read(uint8_t link, result_t * p_result)
+{
+    uint8_t         page[BLE_SDC_MAX_DIAG_LEN];
+    uint16_t        len = 0;
+    uint16_t        blob_len;
+    uint8_t const * p = page;
+    uint8_t         i;
+
+    m_diag_link = link;
+    do
+    {
+        blob_len = sizeof(page) - len;
+        if (sd_sim_peer_read(BENCH_CONN_HANDLE_BASE, m_sdc.diag_handles.value_handle, len, &page[len], &blob_len) != NRF_SUCCESS)
+        {
+            return false;
+        }
+        len += blob_len;
+    } while ((blob_len == BENCH_BLOB_LEN) && (len < sizeof(page)));
+
+    if (len != LINK_BENCH_ENCODED_LEN)
+    {
+        return false;
+    }
+
+    p_result->state               = p[0];
+    p_result->duration_s          = p[1];
+    p_result->elapsed_ms          = u32_get(&p[2]);
+    p_result->payload_len         = p[6];
+    p_result->link.conn_handle    = uint16_decode(&p[7]);
+    p_result->link.sent           = u32_get(&p[9]);
+    p_result->link.acked          = u32_get(&p[13]);
+    p_result->link.stalls         = u32_get(&p[17]);
+    p_result->link.conn_events    = u32_get(&p[21]);
+    p_result->link.max_per_event  = p[25];
+    for (i = 0; i < LINK_BENCH_HIST_BINS; i++)
+    {
+        p_result->link.hist[i] = uint16_decode(&p[26 + 2 * i]);
+    }
+    return true;
+}
+
+/* Benchmarks link_count links at one connection interval and packets per event, prints a row per link. */
+static void sweep_run(uint8_t link_count, uint32_t conn_interval_us, uint8_t packets_per_event)
+{
+    result_t result;
+    peer_t * p_peer;
+    uint8_t  n;
+    uint8_t  i;
+    bool     ok;
+
+    setup(link_count, conn_interval_us, packets_per_event);
+    bench_command(BENCH_DURATION_S);
+    ok = bench_wait(BENCH_DURATION_S * 1000000);
+
+    for (n = 0; n < link_count; n++)
+    {
+        p_peer = &m_peers[n];
+        if (!result_read(ble_sdc_link_find(&m_sdc, BENCH_CONN_HANDLE_BASE + n), &result))
+        {
+            m_failures++;
+            continue;
+        }
+
+        printf("%5u %6.1f %5u %7.1f %8.0f %7u %7u %7.2f %8.1f %8.1f  ",
+               link_count, conn_interval_us / 1000.0, packets_per_event,
+               p_peer->frames * 1000.0 / result.elapsed_ms,
+               (double)p_peer->frames * result.payload_len * 1000.0 / result.elapsed_ms,
+               result.link.stalls,
+               p_peer->gaps,
+               (double)result.link.acked / result.link.conn_events,
+               (double)p_peer->latency_sum_us / p_peer->frames / 1000.0,
+               p_peer->latency_max_us / 1000.0);
+        for (i = 0; i < LINK_BENCH_HIST_BINS; i++)
+        {
+            printf(" %u", result.link.hist[i]);
+        }
+        printf("\n");
+
+        // A single link must see every sequence number, with several a link skips what it stalled on.
+        if (!ok || (result.state != LINK_BENCH_STATE_DONE)
+            || ((link_count == 1) ? (p_peer->gaps != 0) : (p_peer->gaps > result.link.stalls))
+            || (p_peer->frames != result.link.acked) || (result.link.sent != result.link.acked)
+            || (result.link.max_per_event > packets_per_event)
+            || (result.elapsed_ms < BENCH_DURATION_S * 1000) || (result.elapsed_ms > BENCH_DURATION_S * 1000 + BENCH_DRAIN_LIMIT_US / 1000))
+        {
+            printf("  FAILED: state %u, %u frames received, %u acked, %u sent, %u skipped, elapsed %u ms\n",
+                   result.state, p_peer->frames, result.link.acked, result.link.sent, p_peer->gaps, result.elapsed_ms);
+            m_failures++;
+        }
+    }
+}
+
+static void control_run(void)
+{
+    result_t result;
+
+    setup(1, 7500, SD_SIM_PACKETS_PER_EVENT);
+    bench_command(BENCH_DURATION_S);
+    sd_sim_run(1000000);
+    bench_command(0);
+    check(bench_wait(0), "stop command ends the benchmark");
+    check(result_read(0, &result) && (result.elapsed_ms < 1100) && (result.link.sent == m_peers[0].frames),
+          "early stop keeps the result of the elapsed time");
+
+    bench_command(BENCH_DURATION_S);
+    sd_sim_run(1000000);
+    sd_sim_disconnect(BENCH_CONN_HANDLE_BASE, 0x13);
+    check(link_bench_state() == LINK_BENCH_STATE_DONE, "disconnect of the last subscriber ends the benchmark");
+
+    check(link_bench_start(&m_sdc, BENCH_DURATION_S) == NRF_ERROR_INVALID_STATE, "start without subscribers: INVALID_STATE");
+    check(link_bench_start(&m_sdc, LINK_BENCH_MAX_S + 1) == NRF_ERROR_INVALID_PARAM, "start beyond LINK_BENCH_MAX_S: INVALID_PARAM");
+    check(link_bench_encode(0, (uint8_t *)result.link.hist, 4) == 0, "result does not fit a short buffer");
+    printf("\n");
+}
+
+int main(void)
+{
+    static const uint32_t intervals_us[] = { 7500, 15000, 30000, 50000 };
+    static const uint8_t  packets[]      = { SD_SIM_PACKETS_PER_EVENT, 2 };
+    uint8_t               i;
+    uint8_t               j;
+
+    control_run();
+
+    printf("%u s per run, %u byte payloads, histogram: connection events with 1..%u+ packets\n",
+           BENCH_DURATION_S, LINK_BENCH_PAYLOAD_LEN, LINK_BENCH_HIST_BINS);
+    printf("links  ci_ms  p/ev notif/s  bytes/s  stalls skipped pkt/evt  lat_avg  lat_max   histogram\n");
+    for (i = 0; i < sizeof(packets); i++)
+    {
+        for (j = 0; j < sizeof(intervals_us) / sizeof(intervals_us[0]); j++)
+        {
+            sweep_run(1, intervals_us[j], packets[i]);
+        }
+    }
+    sweep_run(BLE_SDC_MAX_LINKS, 7500, SD_SIM_PACKETS_PER_EVENT);
+
+    return (m_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,225 @@
+/* Static RAM budget per module, from a GNU ld map file (-Wl,-Map=...).
+ *
+ * Sums the .data, .bss, COMMON and .noinit input sections placed in RAM by object file and prints them
+ * largest first, followed by the stack and heap reserved by the startup code and the address range of the
+ * static data. With the ARM compiler the same numbers are in the "Image component sizes" table
+ * of the Keil map file (RW Data and ZI Data columns).
+ *
+ *   ram_budget _build/nrf52832_xxaa_s132.map
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 ram_budget.c -o ram_budget
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RAM_BASE                    0x20000000
+#define RAM_END                     0x20010000
+#define MAX_MODULES                 256
+#define LINE_LEN                    1024
+
+typedef struct
+{
+    char     name[128];
+    uint32_t data;                      /**< Initialized data, also takes flash for the initial values. */
+    uint32_t bss;                       /**< Zero initialized and no-init data. */
+} module_t;
+
+static module_t                 m_modules[MAX_MODULES];
+static uint32_t                 m_module_count;
+static uint32_t                 m_stack;
+static uint32_t                 m_heap;
+static uint32_t                 m_ram_start = UINT32_MAX;
+static uint32_t                 m_static_end;
+
+
+static module_t * module_get(char const * p_name)
+{
+    char const * p_base = strrchr(p_name, '/');
+    uint32_t     i;
+
+    // Objects in archives are printed as path/lib.a(object.o), keep the whole archive entry.
+    p_base = ((p_base != NULL) && (strchr(p_base, '(') == NULL) && (strchr(p_name, '(') == NULL)) ? p_base + 1 : p_name;
+
+    for (i = 0; i < m_module_count; i++)
+    {
+        if (strcmp(m_modules[i].name, p_base) == 0)
+        {
+            return &m_modules[i];
+        }
+    }
+    if (m_module_count == MAX_MODULES)
+    {
+        return NULL;
+    }
+    snprintf(m_modules[m_module_count].name, sizeof(m_modules[0].name), "%s", p_base);
+    return &m_modules[m_module_count++];
+}
+
+static bool section_is_data(char const * p_section)
+{
+    return (strncmp(p_section, ".data", 5) == 0);
+}
+
+static bool section_is_bss(char const * p_section)
+{
+    return (strncmp(p_section, ".bss", 4) == 0)
+        || (strncmp(p_section, ".noinit", 7) == 0)
+        || (strcmp(p_section, "COMMON") == 0);
+}
+
+/* Handles one input section line: section, address, size and object file. */
+static void section_add(char const * p_section, uint32_t addr, uint32_t size, char const * p_object)
+{
+    module_t * p_module;
+
+    if ((addr < RAM_BASE) || (addr >= RAM_END) || (size == 0))
+    {
+        return;
+    }
+
+    if (strcmp(p_section, ".stack_dummy") == 0)
+    {
+        m_stack += size;
+        return;
+    }
+    if (strcmp(p_section, ".heap") == 0)
+    {
+        m_heap += size;
+        return;
+    }
+    if (!section_is_data(p_section) && !section_is_bss(p_section))
+    {
+        return;
+    }
+
+    p_module = module_get(p_object);
+    if (p_module == NULL)
+    {
+        return;
+    }
+    if (section_is_data(p_section))
+    {
+        p_module->data += size;
+    }
+    else
+    {
+        p_module->bss += size;
+    }
+
+    if (addr < m_ram_start)
+    {
+        m_ram_start = addr;
+    }
+    if (addr + size > m_static_end)
+    {
+        m_static_end = addr + size;
+    }
+}
+
+static int module_compare(void const * p_a, void const * p_b)
+{
+    module_t const * p_ma = p_a;
+    module_t const * p_mb = p_b;
+
+    return (int)(p_mb->data + p_mb->bss) - (int)(p_ma->data + p_ma->bss);
+}
+
+int main(int argc, char ** argv)
+{
+    FILE   * p_file;
+    char     line[LINE_LEN];
+    char     section[LINE_LEN] = "";
+    char     object[LINE_LEN];
+    bool     in_map = false;
+    uint32_t total_data = 0;
+    uint32_t total_bss  = 0;
+    uint32_t i;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "usage: %s file.map\n", argv[0]);
+        return 2;
+    }
+    p_file = fopen(argv[1], "r");
+    if (p_file == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), p_file) != NULL)
+    {
+        unsigned long long addr;
+        unsigned long long size;
+        char               name[LINE_LEN];
+        int                fields;
+
+        if (!in_map)
+        {
+            in_map = (strncmp(line, "Linker script and memory map", 28) == 0);
+            continue;
+        }
+        // Input sections are indented by one space. Long names are followed by the rest on the next line.
+        if ((line[0] != ' ') || ((line[1] != '.') && (strncmp(&line[1], "COMMON", 6) != 0)
+                                 && (line[1] != ' ' || section[0] == '\0')))
+        {
+            section[0] = '\0';
+            continue;
+        }
+
+        if (line[1] == ' ')
+        {
+            fields = sscanf(line, " %llx %llx %1023[^\r\n]", &addr, &size, object);
+            if (fields == 3)
+            {
+                section_add(section, (uint32_t)addr, (uint32_t)size, object);
+            }
+            section[0] = '\0';
+            continue;
+        }
+
+        fields = sscanf(line, " %1023s %llx %llx %1023[^\r\n]", name, &addr, &size, object);
+        if (fields == 4)
+        {
+            section_add(name, (uint32_t)addr, (uint32_t)size, object);
+            section[0] = '\0';
+        }
+        else if (fields == 1)
+        {
+            strcpy(section, name);
+        }
+        else
+        {
+            section[0] = '\0';
+        }
+    }
+    fclose(p_file);
+
+    if (m_module_count == 0)
+    {
+        fprintf(stderr, "%s: no RAM sections found\n", argv[1]);
+        return 1;
+    }
+
+    qsort(m_modules, m_module_count, sizeof(module_t), module_compare);
+
+    printf("%-40s %8s %8s %8s\n", "module", "data", "bss", "total");
+    for (i = 0; i < m_module_count; i++)
+    {
+        printf("%-40s %8u %8u %8u\n", m_modules[i].name, m_modules[i].data, m_modules[i].bss,
+               m_modules[i].data + m_modules[i].bss);
+        total_data += m_modules[i].data;
+        total_bss  += m_modules[i].bss;
+    }
+    printf("%-40s %8u %8u %8u\n", "static total", total_data, total_bss, total_data + total_bss);
+    printf("%-40s %26u\n", "stack", m_stack);
+    printf("%-40s %26u\n", "heap", m_heap);
+    printf("%-40s %26s0x%08x-0x%08x\n", "static data", "", m_ram_start, m_static_end);
+
+    return 0;
+}
@@ -0,0 +1,334 @@
+/* Moves the application RAM start to the value requested by the SoftDevice.
+ *
+ * The RAM the SoftDevice needs depends on the configuration passed to sd_ble_enable() (links, MTU, vendor
+ * UUIDs, attribute table size) and is only known to the SoftDevice itself. The firmware keeps the value it
+ * returns, read it from the RAM diagnostics page (second word) or from the bin_log warning printed when it
+ * differs from the linked start, then run
+ *   ram_layout -r 0x20001fe8
+ * to rewrite the RAM region of the GCC linker script, the Keil project and its scatter file. The end of RAM
+ * stays where it is, so RAM released by the SoftDevice goes to the application (sample and TX buffers). -n
+ * prints the changes without writing the files.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 ram_layout.c -o ram_layout
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <unistd.h>
+
+#define LD_FILE_DEFAULT             "../armgcc/ble_app_uart_gcc_nrf52.ld"
+#define UV_FILE_DEFAULT             "../arm5_no_packs/ble_app_uart_s132_pca10040.uvprojx"
+#define LD_RAM_KEY                  "RAM (rwx) :"
+#define UV_RAM_KEY                  "<OCR_RVCT9>"
+#define SCT_FILE_DEFAULT            "../arm5_no_packs/ble_app_uart_s132_pca10040.sct"
+#define SCT_RAM_KEY                 "RW_IRAM1"
+#define RAM_BASE                    0x20000000
+#define RAM_ALIGN                   4
+
+static bool                     m_dry_run;
+
+
+static char * file_read(char const * p_path, size_t * p_size)
+{
+    FILE   * p_file = fopen(p_path, "rb");
+    char   * p_data;
+    long     size;
+
+    if (p_file == NULL)
+    {
+        return NULL;
+    }
+    fseek(p_file, 0, SEEK_END);
+    size = ftell(p_file);
+    fseek(p_file, 0, SEEK_SET);
+
+    p_data = malloc(size + 1);
+    if ((p_data == NULL) || (fread(p_data, 1, size, p_file) != (size_t)size))
+    {
+        free(p_data);
+        fclose(p_file);
+        return NULL;
+    }
+    p_data[size] = '\0';
+    fclose(p_file);
+
+    *p_size = size;
+    return p_data;
+}
+
+static bool file_write(char const * p_path, char const * p_data, size_t size)
+{
+    FILE * p_file;
+    bool   ok;
+
+    if (m_dry_run)
+    {
+        return true;
+    }
+    p_file = fopen(p_path, "wb");
+    if (p_file == NULL)
+    {
+        return false;
+    }
+    ok = (fwrite(p_data, 1, size, p_file) == size);
+    return (fclose(p_file) == 0) && ok;
+}
+
+/* Replaces the number at p_pos (as parsed by strtoul) with value in hex. Returns the new buffer. */
+static char * number_replace(char * p_data, size_t * p_size, char * p_pos, uint32_t value)
+{
+    char   * p_end;
+    char     text[16];
+    size_t   old_len;
+    size_t   new_len;
+    size_t   offset = p_pos - p_data;
+    char   * p_new;
+
+    (void)strtoul(p_pos, &p_end, 0);
+    old_len = p_end - p_pos;
+    new_len = snprintf(text, sizeof(text), "0x%x", value);
+
+    p_new = malloc(*p_size - old_len + new_len + 1);
+    if (p_new == NULL)
+    {
+        exit(2);
+    }
+    memcpy(p_new, p_data, offset);
+    memcpy(p_new + offset, text, new_len);
+    memcpy(p_new + offset + new_len, p_data + offset + old_len, *p_size - offset - old_len + 1);
+    free(p_data);
+
+    *p_size = *p_size - old_len + new_len;
+    return p_new;
+}
+
+/* Finds the value following p_key, skipping spaces and any of the characters in p_skip. */
+static char * value_find(char * p_from, char const * p_key, char const * p_skip)
+{
+    char * p_pos = strstr(p_from, p_key);
+
+    if (p_pos == NULL)
+    {
+        return NULL;
+    }
+    p_pos += strlen(p_key);
+    while ((*p_pos == ' ') || (strchr(p_skip, *p_pos) != NULL && *p_pos != '\0'))
+    {
+        p_pos++;
+    }
+    return p_pos;
+}
+
+/* Updates the RAM region of the linker script. Returns the previous origin, 0 on error. */
+static uint32_t ld_update(char const * p_path, uint32_t origin)
+{
+    size_t   size;
+    char   * p_data = file_read(p_path, &size);
+    char   * p_line;
+    char   * p_origin;
+    char   * p_length;
+    uint32_t old_origin;
+    uint32_t old_length;
+    uint32_t end;
+
+    if (p_data == NULL)
+    {
+        fprintf(stderr, "%s: cannot read\n", p_path);
+        return 0;
+    }
+
+    p_line   = strstr(p_data, LD_RAM_KEY);
+    p_origin = (p_line != NULL) ? value_find(p_line, "ORIGIN", "=") : NULL;
+    p_length = (p_line != NULL) ? value_find(p_line, "LENGTH", "=") : NULL;
+    if ((p_origin == NULL) || (p_length == NULL) || (p_length < p_origin))
+    {
+        fprintf(stderr, "%s: no RAM region\n", p_path);
+        free(p_data);
+        return 0;
+    }
+
+    old_origin = strtoul(p_origin, NULL, 0);
+    old_length = strtoul(p_length, NULL, 0);
+    end        = old_origin + old_length;
+    if (origin >= end)
+    {
+        fprintf(stderr, "%s: RAM start 0x%x is past the end of RAM 0x%x\n", p_path, origin, end);
+        free(p_data);
+        return 0;
+    }
+
+    // The length comes after the origin, replace it first to keep p_origin valid.
+    p_length = value_find(strstr(p_data, LD_RAM_KEY), "LENGTH", "=");
+    p_data   = number_replace(p_data, &size, p_length, end - origin);
+    p_origin = value_find(strstr(p_data, LD_RAM_KEY), "ORIGIN", "=");
+    p_data   = number_replace(p_data, &size, p_origin, origin);
+
+    printf("%s: RAM 0x%x+0x%x -> 0x%x+0x%x\n", p_path, old_origin, old_length, origin, end - origin);
+    if (!file_write(p_path, p_data, size))
+    {
+        fprintf(stderr, "%s: cannot write\n", p_path);
+        old_origin = 0;
+    }
+    free(p_data);
+    return old_origin;
+}
+
+/* Updates the IRAM1 area of the Keil targets linked at old_origin. Returns the number of targets changed. */
+static int uv_update(char const * p_path, uint32_t old_origin, uint32_t origin)
+{
+    size_t   size;
+    char   * p_data = file_read(p_path, &size);
+    char   * p_block;
+    char   * p_start;
+    char   * p_size;
+    size_t   offset = 0;
+    uint32_t start;
+    uint32_t end;
+    int      count  = 0;
+
+    if (p_data == NULL)
+    {
+        fprintf(stderr, "%s: cannot read\n", p_path);
+        return -1;
+    }
+
+    while ((p_block = strstr(p_data + offset, UV_RAM_KEY)) != NULL)
+    {
+        offset  = p_block - p_data + strlen(UV_RAM_KEY);
+        p_start = value_find(p_block, "<StartAddress>", "");
+        p_size  = value_find(p_block, "<Size>", "");
+        if ((p_start == NULL) || (p_size == NULL))
+        {
+            break;
+        }
+
+        start = strtoul(p_start, NULL, 0);
+        end   = start + strtoul(p_size, NULL, 0);
+        if ((start != old_origin) || (origin >= end))
+        {
+            // Other targets, such as the one only flashing the SoftDevice.
+            continue;
+        }
+
+        p_data  = number_replace(p_data, &size, p_size, end - origin);
+        p_start = value_find(p_data + offset, "<StartAddress>", "");
+        p_data  = number_replace(p_data, &size, p_start, origin);
+        count++;
+    }
+
+    printf("%s: %d target(s) moved to 0x%x\n", p_path, count, origin);
+    if ((count > 0) && !file_write(p_path, p_data, size))
+    {
+        fprintf(stderr, "%s: cannot write\n", p_path);
+        count = -1;
+    }
+    free(p_data);
+    return count;
+}
+
+/* Updates the RW_IRAM1 region of the scatter file if it is linked at old_origin. Returns false on error. */
+static bool sct_update(char const * p_path, uint32_t old_origin, uint32_t origin)
+{
+    size_t   size;
+    char   * p_data = file_read(p_path, &size);
+    char   * p_start;
+    char   * p_size;
+    char   * p_end;
+    uint32_t start;
+    uint32_t end;
+    bool     ok = true;
+
+    if (p_data == NULL)
+    {
+        fprintf(stderr, "%s: cannot read\n", p_path);
+        return false;
+    }
+
+    p_start = value_find(p_data, SCT_RAM_KEY, "");
+    start   = (p_start != NULL) ? strtoul(p_start, &p_end, 0) : 0;
+    p_size  = (p_start != NULL) ? value_find(p_end, "", "") : NULL;
+    if ((p_size == NULL) || (start == 0))
+    {
+        fprintf(stderr, "%s: no %s region\n", p_path, SCT_RAM_KEY);
+        free(p_data);
+        return false;
+    }
+
+    // The no-init region follows RW_IRAM1 and keeps its place.
+    end = start + strtoul(p_size, NULL, 0);
+    if ((start != old_origin) || (origin >= end))
+    {
+        printf("%s: %s at 0x%x left alone\n", p_path, SCT_RAM_KEY, start);
+        free(p_data);
+        return true;
+    }
+
+    p_data  = number_replace(p_data, &size, p_size, end - origin);
+    p_start = value_find(p_data, SCT_RAM_KEY, "");
+    p_data  = number_replace(p_data, &size, p_start, origin);
+
+    printf("%s: %s moved to 0x%x\n", p_path, SCT_RAM_KEY, origin);
+    if (!file_write(p_path, p_data, size))
+    {
+        fprintf(stderr, "%s: cannot write\n", p_path);
+        ok = false;
+    }
+    free(p_data);
+    return ok;
+}
+
+int main(int argc, char ** argv)
+{
+    char const * p_ld_path  = LD_FILE_DEFAULT;
+    char const * p_uv_path  = UV_FILE_DEFAULT;
+    char const * p_sct_path = SCT_FILE_DEFAULT;
+    uint32_t     origin    = 0;
+    uint32_t     old_origin;
+    int          opt;
+
+    while ((opt = getopt(argc, argv, "r:l:u:s:n")) != -1)
+    {
+        switch (opt)
+        {
+            case 'r': origin     = strtoul(optarg, NULL, 0); break;
+            case 'l': p_ld_path  = optarg;                   break;
+            case 'u': p_uv_path  = optarg;                   break;
+            case 's': p_sct_path = optarg;                   break;
+            case 'n': m_dry_run  = true;                     break;
+            default:
+                fprintf(stderr, "usage: %s -r ram_start [-l linker_script] [-u uvprojx] [-s scatter_file] [-n]\n",
+                        argv[0]);
+                return 2;
+        }
+    }
+
+    if ((origin < RAM_BASE) || ((origin % RAM_ALIGN) != 0))
+    {
+        fprintf(stderr, "RAM start must be a word aligned address from 0x%x\n", RAM_BASE);
+        return 2;
+    }
+
+    old_origin = ld_update(p_ld_path, origin);
+    if (old_origin == 0)
+    {
+        return 1;
+    }
+    if (origin < old_origin)
+    {
+        printf("%u bytes released by the SoftDevice\n", old_origin - origin);
+    }
+    else if (origin > old_origin)
+    {
+        printf("%u bytes more taken by the SoftDevice\n", origin - old_origin);
+    }
+
+    if (uv_update(p_uv_path, old_origin, origin) < 0)
+    {
+        return 1;
+    }
+    return sct_update(p_sct_path, old_origin, origin) ? 0 : 1;
+}
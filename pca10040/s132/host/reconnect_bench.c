@@ -0,0 +1,279 @@
+/* Reconnect latency of the advertising policy, on the SoftDevice simulator.
+ *
+ * A bonded gateway holds the link with notifications enabled. The link is dropped with a supervision
+ * timeout at a random time, and the time until the gateway has notifications flowing again is measured.
+ * The gateway does not write the CCCD again, the service picks it up from the restored system attributes.
+ * A phone scanning nearby connects to any advertising it is allowed to and holds the link for
+ * PHONE_HOLD_MS before giving up, which counts as a hijack. After the open mode times out advertising
+ * restarts after the deep idle time of the power manager, as in the firmware.
+ *
+ * Two policies are compared for gateways scanning continuously and with a low duty cycle:
+ *   legacy   open advertising only, 300 ms interval, 20 s timeout (the former ble_advertising setup)
+ *   reconnect directed burst, then 40 ms with whitelist for 10 s, then open as legacy (adv_ctrl as in main.c)
+ * Exits with 1 if the reconnect policy is not faster than the legacy one or lets the phone take the link
+ * from a continuously scanning gateway.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -Isd_sim -I../arm5_no_packs reconnect_bench.c sd_sim/sd_sim.c ../arm5_no_packs/adv_ctrl.c \
+ *       ../arm5_no_packs/ble_sensor_data_custom.c -o reconnect_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sd_sim.h"
+#include "app_error.h"
+#include "app_time.h"
+#include "adv_ctrl.h"
+#include "ble_sensor_data_custom.h"
+
+#define BENCH_TRIALS                200
+#define BENCH_STEP_US               1000                                /**< Resolution of the latency measurement. */
+#define BENCH_TRIAL_MAX_US          300000000ULL                        /**< Trials not reconnected after this are counted at this value. */
+#define BENCH_DEEP_IDLE_US          60000000ULL                         /**< POWER_MGR_DEEP_IDLE_MS. */
+#define PHONE_HOLD_MS               5000
+#define BLE_HCI_CONNECTION_TIMEOUT  0x08
+
+typedef struct
+{
+    char const      * p_name;
+    adv_ctrl_config_t config;
+} policy_t;
+
+typedef struct
+{
+    char const * p_name;
+    uint32_t     scan_interval_us;
+    uint32_t     scan_window_us;
+} gateway_scan_t;
+
+static const policy_t m_policies[] =
+{
+    { "legacy",    { 0, 0,  0,  480, 20, NULL, 1 } },
+    { "reconnect", { 1, 64, 10, 480, 20, NULL, 1 } },
+};
+
+static const gateway_scan_t m_gateway_scans[] =
+{
+    { "continuous",  100000, 100000 },
+    { "30/300 ms",   300000,  30000 },
+};
+
+static ble_sdc_t                m_sdc;
+static uint8_t                  m_gateway;
+static uint8_t                  m_phone;
+static ble_gap_addr_t           m_gateway_addr = { BLE_GAP_ADDR_TYPE_PUBLIC,        { 0x01, 0x00, 0x00, 0xDA, 0x7E, 0x6A } };
+static ble_gap_addr_t           m_phone_addr   = { BLE_GAP_ADDR_TYPE_RANDOM_STATIC, { 0x02, 0x00, 0x00, 0x00, 0x00, 0xC0 } };
+static ble_gap_addr_t         * m_whitelist_addrs[1] = { &m_gateway_addr };
+static ble_gap_whitelist_t      m_whitelist = { m_whitelist_addrs, 1, NULL, 0 };
+static bool                     m_notifying;
+static bool                     m_idle;
+static uint32_t                 m_failures;
+
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t * p_file_name)
+{
+    fprintf(stderr, "app_error 0x%x at %s:%u\n", error_code, (char const *)p_file_name, line_num);
+    exit(2);
+}
+
+/* Time base of the advertising counters, taken from the simulator. */
+uint64_t app_time_ms_get(void)
+{
+    return sd_sim_time_us_get() / 1000;
+}
+
+static void check(bool condition, char const * p_what)
+{
+    printf("%-60s %s\n", p_what, condition ? "ok" : "FAILED");
+    if (!condition)
+    {
+        m_failures++;
+    }
+}
+
+static void sdc_evt_handler(ble_sdc_t * p_sdc, ble_sdc_evt_type_t evt_type, uint8_t link)
+{
+    UNUSED_PARAMETER(p_sdc);
+    UNUSED_PARAMETER(link);
+    m_notifying = (evt_type == BLE_SDC_EVT_NOTIFICATION_ENABLED);
+}
+
+static void adv_evt_handler(adv_ctrl_evt_t evt, adv_ctrl_mode_t mode)
+{
+    UNUSED_PARAMETER(mode);
+    if (evt == ADV_CTRL_EVT_IDLE)
+    {
+        m_idle = true;
+    }
+}
+
+static void ble_evt_handler(ble_evt_t * p_ble_evt)
+{
+    ble_sdc_on_ble_evt(&m_sdc, p_ble_evt);
+    adv_ctrl_on_ble_evt(p_ble_evt);
+}
+
+static int compare_u32(void const * p_a, void const * p_b)
+{
+    uint32_t a = *(uint32_t const *)p_a;
+    uint32_t b = *(uint32_t const *)p_b;
+
+    return (a > b) - (a < b);
+}
+
+static void setup(policy_t const * p_policy, gateway_scan_t const * p_scan, uint32_t seed)
+{
+    sd_sim_central_t central;
+    ble_sdc_init_t   sdc_init;
+    uint8_t          cccd[BLE_CCCD_VALUE_LEN] = { 0x01, 0x00 };
+
+    sd_sim_seed_set(seed);
+    sd_sim_init(NULL, ble_evt_handler);
+
+    memset(&sdc_init, 0, sizeof(sdc_init));
+    sdc_init.evt_handler = sdc_evt_handler;
+    APP_ERROR_CHECK(ble_sdc_init(&m_sdc, &sdc_init));
+    APP_ERROR_CHECK(adv_ctrl_init(&p_policy->config, adv_evt_handler));
+    adv_ctrl_peers_set(&m_gateway_addr, &m_whitelist);
+
+    memset(&central, 0, sizeof(central));
+    central.addr             = m_gateway_addr;
+    central.bonded           = true;
+    central.scan_interval_us = p_scan->scan_interval_us;
+    central.scan_window_us   = p_scan->scan_window_us;
+    m_gateway                = sd_sim_central_add(&central);
+
+    central.addr             = m_phone_addr;
+    central.bonded           = false;
+    central.scan_interval_us = 300000;
+    central.scan_window_us   = 30000;
+    m_phone                  = sd_sim_central_add(&central);
+
+    // First connection: the gateway bonds and enables notifications.
+    m_notifying = false;
+    m_idle      = false;
+    sd_sim_central_initiate(m_gateway, true);
+    APP_ERROR_CHECK(adv_ctrl_start(ADV_CTRL_MODE_OPEN));
+    while (sd_sim_central_conn_handle(m_gateway) == BLE_CONN_HANDLE_INVALID)
+    {
+        sd_sim_run(BENCH_STEP_US);
+    }
+    APP_ERROR_CHECK(sd_sim_peer_write(sd_sim_central_conn_handle(m_gateway),
+                                      m_sdc.rx_handles.cccd_handle, cccd, sizeof(cccd)));
+    sd_sim_central_initiate(m_phone, true);
+}
+
+/* Drops the link and returns the time until the gateway gets notifications again (in us). */
+static uint64_t trial_run(uint32_t * p_hijacks)
+{
+    uint64_t start;
+    uint64_t now;
+    uint64_t idle_since = 0;
+    uint64_t phone_since = 0;
+
+    sd_sim_run(rand() % 1000000);
+    sd_sim_disconnect(sd_sim_central_conn_handle(m_gateway), BLE_HCI_CONNECTION_TIMEOUT);
+    start = sd_sim_time_us_get();
+
+    for (;;)
+    {
+        sd_sim_run(BENCH_STEP_US);
+        now = sd_sim_time_us_get();
+
+        if ((sd_sim_central_conn_handle(m_gateway) != BLE_CONN_HANDLE_INVALID) && m_notifying)
+        {
+            return now - start;
+        }
+        if (now - start >= BENCH_TRIAL_MAX_US)
+        {
+            return BENCH_TRIAL_MAX_US;
+        }
+
+        if (sd_sim_central_conn_handle(m_phone) != BLE_CONN_HANDLE_INVALID)
+        {
+            if (phone_since == 0)
+            {
+                phone_since = now;
+                (*p_hijacks)++;
+            }
+            else if (now - phone_since >= PHONE_HOLD_MS * 1000ULL)
+            {
+                phone_since = 0;
+                sd_sim_disconnect(sd_sim_central_conn_handle(m_phone), BLE_HCI_CONNECTION_TIMEOUT);
+            }
+        }
+
+        if (m_idle)
+        {
+            if (idle_since == 0)
+            {
+                idle_since = now;
+            }
+            else if (now - idle_since >= BENCH_DEEP_IDLE_US)
+            {
+                m_idle     = false;
+                idle_since = 0;
+                APP_ERROR_CHECK(adv_ctrl_start(ADV_CTRL_MODE_WHITELIST));
+            }
+        }
+    }
+}
+
+/* Runs the trials of one policy and gateway, returns the median latency (in us). */
+static uint32_t policy_run(policy_t const * p_policy, gateway_scan_t const * p_scan, uint32_t * p_hijacks)
+{
+    static uint32_t latencies_us[BENCH_TRIALS];
+    sd_sim_stats_t  stats;
+    uint32_t        adv_events_start;
+    uint32_t        i;
+
+    srand(1);
+    setup(p_policy, p_scan, 12345);
+    sd_sim_stats_get(&stats);
+    adv_events_start = stats.adv_events;
+    *p_hijacks       = 0;
+
+    for (i = 0; i < BENCH_TRIALS; i++)
+    {
+        latencies_us[i] = (uint32_t)trial_run(p_hijacks);
+    }
+    sd_sim_stats_get(&stats);
+
+    qsort(latencies_us, BENCH_TRIALS, sizeof(uint32_t), compare_u32);
+    printf("%-10s %-11s %9.1f %9.1f %9.1f %8u %10.1f\n",
+           p_policy->p_name,
+           p_scan->p_name,
+           latencies_us[BENCH_TRIALS / 2] / 1000.0,
+           latencies_us[(BENCH_TRIALS * 9) / 10] / 1000.0,
+           latencies_us[BENCH_TRIALS - 1] / 1000.0,
+           *p_hijacks,
+           (double)(stats.adv_events - adv_events_start) / BENCH_TRIALS);
+
+    return latencies_us[BENCH_TRIALS / 2];
+}
+
+int main(void)
+{
+    uint32_t median_us[2][2];
+    uint32_t hijacks[2][2];
+    uint32_t p;
+    uint32_t s;
+
+    printf("%u trials, phone scanning 30/300 ms and holding a link for %u ms\n", BENCH_TRIALS, PHONE_HOLD_MS);
+    printf("%-10s %-11s %9s %9s %9s %8s %10s\n", "policy", "gateway", "p50 ms", "p90 ms", "max ms", "hijacks", "adv evts");
+    for (s = 0; s < 2; s++)
+    {
+        for (p = 0; p < 2; p++)
+        {
+            median_us[p][s] = policy_run(&m_policies[p], &m_gateway_scans[s], &hijacks[p][s]);
+        }
+    }
+    printf("\n");
+
+    check(median_us[1][0] < median_us[0][0], "reconnect policy faster, gateway scanning continuously");
+    check(median_us[1][1] < median_us[0][1], "reconnect policy faster, gateway scanning 30/300 ms");
+    check(hijacks[1][0] == 0,                "no hijack, gateway scanning continuously");
+
+    return (m_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+/* Stress test of the single-producer/single-consumer sample queue, sample_queue.c.
+ *
+ * The producer runs in a signal handler raised by a timer every STRESS_TICK_NS, as the SAADC interrupt
+ * preempts the main loop at any instruction. It pushes blocks numbered in sequence and tries the same block
+ * again on the next signal when the queue is full. The consumer is the main loop: in turns of STRESS_PHASE
+ * blocks it pops them as soon as they come, and only once the queue is full and a random time of up to a
+ * tick has passed, so the producer finds the queue full at any point of the pop. It checks that every block
+ * comes out once, in order and with all of its fields written by the same push, and that the depth never
+ * exceeds SAMPLE_QUEUE_SIZE. Runs until STRESS_BLOCKS blocks are through, prints the counts and exits with 1 on
+ * any error, or if the queue was never seen full and empty.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -I../arm5_no_packs sample_queue_stress.c ../arm5_no_packs/sample_queue.c -lrt \
+ *       -o sample_queue_stress
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <time.h>
+#include "sample_queue.h"
+
+#define STRESS_BLOCKS               200000                              /**< Blocks pushed by the producer. */
+#define STRESS_TICK_NS              20000                               /**< Interval of the producer signal. */
+#define STRESS_BUFFERS              64                                  /**< Sample buffers the block numbers point into. */
+#define STRESS_PHASE                256                                 /**< Blocks the consumer pops in each way. */
+#define STRESS_DELAY_LOOPS          40000                               /**< Upper bound of the random delay, about a tick. */
+
+static sample_queue_t           m_queue;
+static int16_t                  m_buffers[STRESS_BUFFERS][1];
+static volatile uint32_t        m_pushed;                               /**< Blocks pushed, the next one to push. */
+static volatile uint32_t        m_full;                                 /**< Signals that found the queue full. */
+static uint32_t                 m_rand = 0x2545F491;                    /**< State of the delay generator. */
+
+
+/* xorshift32, the delays repeat from run to run, not the signal times. */
+static uint32_t rand_next(void)
+{
+    m_rand ^= m_rand << 13;
+    m_rand ^= m_rand >> 17;
+    m_rand ^= m_rand << 5;
+    return m_rand;
+}
+
+/* Producer, the interrupt of the device. */
+static void tick_handler(int sig)
+{
+    uint32_t seq = m_pushed;
+
+    (void)sig;
+    if (seq == STRESS_BLOCKS)
+    {
+        return;
+    }
+    // Every field is derived from seq, a block mixed from two pushes does not check out.
+    if (sample_queue_push(&m_queue, m_buffers[seq % STRESS_BUFFERS], (uint16_t)(seq * 7), seq))
+    {
+        m_pushed = seq + 1;
+    }
+    else
+    {
+        m_full++;
+    }
+}
+
+int main(void)
+{
+    struct sigaction   action;
+    struct sigevent    sev;
+    struct itimerspec  spec;
+    timer_t            timer;
+    sample_block_t     block;
+    uint32_t           seq = 0;
+    uint32_t           errors = 0;
+    uint32_t           empty = 0;
+    uint32_t           depth;
+    bool               wait_full;
+    volatile uint32_t  delay;
+
+    sample_queue_init(&m_queue);
+
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = tick_handler;
+    action.sa_flags   = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_SIGNAL;
+    sev.sigev_signo  = SIGALRM;
+    spec.it_value.tv_sec     = 0;
+    spec.it_value.tv_nsec    = STRESS_TICK_NS;
+    spec.it_interval         = spec.it_value;
+    if ((sigaction(SIGALRM, &action, NULL) != 0) || (timer_create(CLOCK_MONOTONIC, &sev, &timer) != 0)
+        || (timer_settime(timer, 0, &spec, NULL) != 0))
+    {
+        return 2;
+    }
+
+    while (seq < STRESS_BLOCKS)
+    {
+        depth = sample_queue_depth(&m_queue);
+        if (depth > SAMPLE_QUEUE_SIZE)
+        {
+            errors++;
+        }
+        // The last blocks never fill the queue.
+        wait_full = (((seq / STRESS_PHASE) & 1) != 0) && (m_pushed < STRESS_BLOCKS);
+        if (wait_full && (depth < SAMPLE_QUEUE_SIZE))
+        {
+            continue;
+        }
+        if (wait_full)
+        {
+            for (delay = rand_next() % STRESS_DELAY_LOOPS; delay > 0; delay--)
+            {
+            }
+        }
+
+        if (!sample_queue_pop(&m_queue, &block))
+        {
+            empty++;
+            continue;
+        }
+        if ((block.p_samples != m_buffers[seq % STRESS_BUFFERS]) || (block.count != (uint16_t)(seq * 7))
+            || (block.timestamp_us != seq))
+        {
+            if (errors < 10)
+            {
+                fprintf(stderr, "block %u: got %u, %u samples\n", seq, block.timestamp_us, block.count);
+            }
+            errors++;
+        }
+        seq++;
+    }
+    (void)timer_delete(timer);
+
+    if (sample_queue_pop(&m_queue, &block) || (m_queue.depth_max > SAMPLE_QUEUE_SIZE))
+    {
+        errors++;
+    }
+
+    printf("%u blocks, %u signals on a full queue, %u pops on an empty queue, depth max %u\n",
+           seq, m_full, empty, m_queue.depth_max);
+    if ((m_full == 0) || (empty == 0))
+    {
+        printf("queue never seen full and empty\n");
+        errors++;
+    }
+    printf("%s, %u errors\n", (errors == 0) ? "ok" : "FAIL", errors);
+    return (errors == 0) ? 0 : 1;
+}
@@ -0,0 +1,26 @@
+#ifndef APP_ERROR_H__
+#define APP_ERROR_H__
+
+#include <stdint.h>
+
+/* Host replacement for app_error.h. app_error_handler() is implemented by the host program. */
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t * p_file_name);
+
+#define APP_ERROR_HANDLER(ERR_CODE)                                         \
+do                                                                          \
+{                                                                           \
+    app_error_handler((ERR_CODE), __LINE__, (uint8_t const *)__FILE__);     \
+} while (0)
+
+#define APP_ERROR_CHECK(ERR_CODE)                                           \
+do                                                                          \
+{                                                                           \
+    const uint32_t LOCAL_ERR_CODE = (ERR_CODE);                             \
+    if (LOCAL_ERR_CODE != NRF_SUCCESS)                                      \
+    {                                                                       \
+        APP_ERROR_HANDLER(LOCAL_ERR_CODE);                                  \
+    }                                                                       \
+} while (0)
+
+#endif // APP_ERROR_H__
@@ -0,0 +1,52 @@
+#ifndef APP_TIMER_H__
+#define APP_TIMER_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "app_error.h"
+
+/* Host replacement for the SDK app_timer. Timers run in the virtual time of sd_sim, their handlers are called
+ * from sd_sim_run(). */
+
+#define APP_TIMER_CLOCK_FREQ            32768
+#define APP_TIMER_MIN_TIMEOUT_TICKS     5
+
+#define APP_TIMER_TICKS(MS, PRESCALER)  ((uint32_t)(((uint64_t)(MS) * APP_TIMER_CLOCK_FREQ) / (((PRESCALER) + 1) * 1000)))
+
+typedef void (*app_timer_timeout_handler_t)(void * p_context);
+
+typedef enum
+{
+    APP_TIMER_MODE_SINGLE_SHOT,
+    APP_TIMER_MODE_REPEATED
+} app_timer_mode_t;
+
+typedef struct
+{
+    app_timer_timeout_handler_t handler;
+    app_timer_mode_t            mode;
+    bool                        running;
+    uint64_t                    expires_us;     /**< Virtual time of the next timeout. */
+    uint32_t                    interval_us;    /**< Period of repeated timers. */
+    void                      * p_context;
+} app_timer_t;
+
+typedef app_timer_t * app_timer_id_t;
+
+#define APP_TIMER_DEF(timer_id)                                             \
+    static app_timer_t timer_id##_data;                                     \
+    static const app_timer_id_t timer_id = &timer_id##_data
+
+#define APP_TIMER_INIT(PRESCALER, OP_QUEUES_SIZE, SCHEDULER_FUNC)           \
+do                                                                          \
+{                                                                           \
+    APP_ERROR_CHECK(app_timer_init((PRESCALER), (OP_QUEUES_SIZE), NULL, NULL)); \
+} while (0)
+
+uint32_t app_timer_init(uint32_t prescaler, uint8_t op_queues_size, void * p_buffer, void * evt_schedule_func);
+uint32_t app_timer_create(app_timer_id_t const * p_timer_id, app_timer_mode_t mode, app_timer_timeout_handler_t timeout_handler);
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void * p_context);
+uint32_t app_timer_stop(app_timer_id_t timer_id);
+uint32_t app_timer_cnt_get(uint32_t * p_ticks);
+
+#endif // APP_TIMER_H__
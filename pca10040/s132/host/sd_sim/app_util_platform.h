@@ -0,0 +1,18 @@
+#ifndef APP_UTIL_PLATFORM_H__
+#define APP_UTIL_PLATFORM_H__
+
+#include <stdint.h>
+
+/* Host replacement for app_util_platform.h. The host programs run single threaded, sd_sim calls the event
+ * handlers one after the other, so critical regions are plain blocks. */
+
+typedef enum
+{
+    APP_IRQ_PRIORITY_HIGH = 2,
+    APP_IRQ_PRIORITY_LOW  = 3
+} app_irq_priority_t;
+
+#define CRITICAL_REGION_ENTER()     {
+#define CRITICAL_REGION_EXIT()      }
+
+#endif // APP_UTIL_PLATFORM_H__
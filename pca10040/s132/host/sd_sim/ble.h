@@ -0,0 +1,357 @@
+#ifndef BLE_H__
+#define BLE_H__
+
+/* Host replacement for the SoftDevice BLE API (S132 v2), limited to the GAP/GATTS subset used by the
+ * application services. Names, event IDs and error codes follow the SoftDevice headers, the calls are
+ * implemented by sd_sim.c. */
+
+#include <stdint.h>
+#include "sdk_common.h"
+
+#define BLE_CONN_HANDLE_INVALID                 0xFFFF
+#define BLE_GATT_HANDLE_INVALID                 0x0000
+#define GATT_MTU_SIZE_DEFAULT                   23
+
+#define BLE_EVT_BASE                            0x01
+#define BLE_EVT_LAST                            0x0F
+#define BLE_GAP_EVT_BASE                        0x10
+#define BLE_GAP_EVT_LAST                        0x2F
+#define BLE_GATTC_EVT_BASE                      0x30
+#define BLE_GATTC_EVT_LAST                      0x4F
+#define BLE_GATTS_EVT_BASE                      0x50
+#define BLE_GATTS_EVT_LAST                      0x6F
+
+#define NRF_ERROR_STK_BASE_NUM                  0x3000
+#define BLE_ERROR_NOT_ENABLED                   (NRF_ERROR_STK_BASE_NUM + 0x001)
+#define BLE_ERROR_INVALID_CONN_HANDLE           (NRF_ERROR_STK_BASE_NUM + 0x002)
+#define BLE_ERROR_INVALID_ATTR_HANDLE           (NRF_ERROR_STK_BASE_NUM + 0x003)
+#define BLE_ERROR_NO_TX_PACKETS                 (NRF_ERROR_STK_BASE_NUM + 0x004)
+#define BLE_ERROR_GATTS_SYS_ATTR_MISSING        (NRF_ERROR_STK_BASE_NUM + 0x401)
+
+enum
+{
+    BLE_EVT_TX_COMPLETE = BLE_EVT_BASE,
+};
+
+enum
+{
+    BLE_GAP_EVT_CONNECTED = BLE_GAP_EVT_BASE,
+    BLE_GAP_EVT_DISCONNECTED,
+    BLE_GAP_EVT_CONN_PARAM_UPDATE,
+    BLE_GAP_EVT_CONN_SEC_UPDATE = BLE_GAP_EVT_BASE + 10,
+    BLE_GAP_EVT_TIMEOUT,
+};
+
+enum
+{
+    BLE_GATTS_EVT_WRITE = BLE_GATTS_EVT_BASE,
+    BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST,
+    BLE_GATTS_EVT_SYS_ATTR_MISSING,
+    BLE_GATTS_EVT_HVC,
+};
+
+#define BLE_GATTS_SRVC_TYPE_PRIMARY             0x01
+#define BLE_GATTS_VLOC_STACK                    0x01
+#define BLE_GATTS_AUTHORIZE_TYPE_READ           0x01
+#define BLE_GATTS_AUTHORIZE_TYPE_WRITE          0x02
+#define BLE_GATT_HVX_NOTIFICATION               0x01
+#define BLE_GATT_STATUS_SUCCESS                 0x0000
+#define BLE_UUID_TYPE_BLE                       0x01
+#define BLE_UUID_TYPE_VENDOR_BEGIN              0x02
+
+#define BLE_GAP_ROLE_PERIPH                     0x01
+#define BLE_GAP_ADDR_LEN                        6
+#define BLE_GAP_ADDR_TYPE_PUBLIC                0x00
+#define BLE_GAP_ADDR_TYPE_RANDOM_STATIC         0x01
+#define BLE_GAP_WHITELIST_ADDR_MAX_COUNT        8
+#define BLE_GAP_WHITELIST_IRK_MAX_COUNT         8
+#define BLE_GAP_ADV_TYPE_ADV_IND                0x00
+#define BLE_GAP_ADV_TYPE_ADV_DIRECT_IND         0x01
+#define BLE_GAP_ADV_FP_ANY                      0x00
+#define BLE_GAP_ADV_FP_FILTER_CONNREQ           0x02
+#define BLE_GAP_ADV_INTERVAL_MIN                0x0020
+#define BLE_GAP_ADV_INTERVAL_MAX                0x4000
+#define BLE_GAP_TIMEOUT_SRC_ADVERTISING         0x00
+
+typedef struct
+{
+    uint16_t uuid;
+    uint8_t  type;
+} ble_uuid_t;
+
+typedef struct
+{
+    uint8_t uuid128[16];
+} ble_uuid128_t;
+
+typedef struct
+{
+    uint8_t sm : 4;
+    uint8_t lv : 4;
+} ble_gap_conn_sec_mode_t;
+
+#define BLE_GAP_CONN_SEC_MODE_SET_NO_ACCESS(ptr)        do {(ptr)->sm = 0; (ptr)->lv = 0;} while(0)
+#define BLE_GAP_CONN_SEC_MODE_SET_OPEN(ptr)             do {(ptr)->sm = 1; (ptr)->lv = 1;} while(0)
+#define BLE_GAP_CONN_SEC_MODE_SET_ENC_NO_MITM(ptr)      do {(ptr)->sm = 1; (ptr)->lv = 2;} while(0)
+
+typedef struct
+{
+    uint8_t addr_type;
+    uint8_t addr[BLE_GAP_ADDR_LEN];
+} ble_gap_addr_t;
+
+typedef struct
+{
+    uint8_t irk[16];
+} ble_gap_irk_t;
+
+typedef struct
+{
+    ble_gap_addr_t ** pp_addrs;
+    uint8_t           addr_count;
+    ble_gap_irk_t  ** pp_irks;
+    uint8_t           irk_count;
+} ble_gap_whitelist_t;
+
+typedef struct
+{
+    uint8_t ch_37_off : 1;
+    uint8_t ch_38_off : 1;
+    uint8_t ch_39_off : 1;
+} ble_gap_adv_ch_mask_t;
+
+typedef struct
+{
+    uint8_t               type;
+    ble_gap_addr_t      * p_peer_addr;  /**< Peer of directed advertising. */
+    uint8_t               fp;           /**< Filter policy. */
+    ble_gap_whitelist_t * p_whitelist;
+    uint16_t              interval;     /**< In 0.625 ms units, ignored for high duty directed advertising. */
+    uint16_t              timeout;      /**< In seconds, 0 for none. High duty directed advertising always ends after 1.28 s. */
+    ble_gap_adv_ch_mask_t channel_mask;
+} ble_gap_adv_params_t;
+
+typedef struct
+{
+    ble_gap_conn_sec_mode_t sec_mode;
+    uint8_t                 encr_key_size;
+} ble_gap_conn_sec_t;
+
+typedef struct
+{
+    uint16_t min_conn_interval;
+    uint16_t max_conn_interval;
+    uint16_t slave_latency;
+    uint16_t conn_sup_timeout;
+} ble_gap_conn_params_t;
+
+typedef struct
+{
+    uint8_t broadcast      : 1;
+    uint8_t read           : 1;
+    uint8_t write_wo_resp  : 1;
+    uint8_t write          : 1;
+    uint8_t notify         : 1;
+    uint8_t indicate       : 1;
+    uint8_t auth_signed_wr : 1;
+} ble_gatt_char_props_t;
+
+typedef struct
+{
+    ble_gap_conn_sec_mode_t read_perm;
+    ble_gap_conn_sec_mode_t write_perm;
+    uint8_t                 vlen    : 1;
+    uint8_t                 vloc    : 2;
+    uint8_t                 rd_auth : 1;
+    uint8_t                 wr_auth : 1;
+} ble_gatts_attr_md_t;
+
+typedef struct
+{
+    ble_gatt_char_props_t       char_props;
+    uint8_t const             * p_char_user_desc;
+    void const                * p_char_pf;
+    ble_gatts_attr_md_t const * p_user_desc_md;
+    ble_gatts_attr_md_t const * p_cccd_md;
+    ble_gatts_attr_md_t const * p_sccd_md;
+} ble_gatts_char_md_t;
+
+typedef struct
+{
+    ble_uuid_t const          * p_uuid;
+    ble_gatts_attr_md_t const * p_attr_md;
+    uint16_t                    init_len;
+    uint16_t                    init_offs;
+    uint16_t                    max_len;
+    uint8_t                   * p_value;
+} ble_gatts_attr_t;
+
+typedef struct
+{
+    uint16_t value_handle;
+    uint16_t user_desc_handle;
+    uint16_t cccd_handle;
+    uint16_t sccd_handle;
+} ble_gatts_char_handles_t;
+
+typedef struct
+{
+    uint16_t        handle;
+    uint8_t         type;
+    uint16_t        offset;
+    uint16_t      * p_len;
+    uint8_t const * p_data;
+} ble_gatts_hvx_params_t;
+
+typedef struct
+{
+    uint16_t        gatt_status;
+    uint8_t         update : 1;
+    uint16_t        offset;
+    uint16_t        len;
+    uint8_t const * p_data;
+} ble_gatts_authorize_params_t;
+
+typedef struct
+{
+    uint16_t  len;
+    uint16_t  offset;
+    uint8_t * p_value;
+} ble_gatts_value_t;
+
+typedef struct
+{
+    uint8_t type;
+    union
+    {
+        ble_gatts_authorize_params_t read;
+        ble_gatts_authorize_params_t write;
+    } params;
+} ble_gatts_rw_authorize_reply_params_t;
+
+typedef struct
+{
+    uint16_t   handle;
+    ble_uuid_t uuid;
+    uint8_t    op;
+    uint8_t    auth_required;
+    uint16_t   offset;
+    uint16_t   len;
+    uint8_t    data[1];                 /**< Variable length, the event buffer holds the rest. */
+} ble_gatts_evt_write_t;
+
+typedef struct
+{
+    uint16_t   handle;
+    ble_uuid_t uuid;
+    uint16_t   offset;
+} ble_gatts_evt_read_t;
+
+typedef struct
+{
+    uint8_t type;
+    union
+    {
+        ble_gatts_evt_read_t  read;
+        ble_gatts_evt_write_t write;
+    } request;
+} ble_gatts_evt_rw_authorize_request_t;
+
+typedef struct
+{
+    uint16_t conn_handle;
+    union
+    {
+        ble_gatts_evt_write_t                write;
+        ble_gatts_evt_rw_authorize_request_t authorize_request;
+    } params;
+} ble_gatts_evt_t;
+
+typedef struct
+{
+    ble_gap_addr_t        peer_addr;
+    ble_gap_addr_t        own_addr;
+    uint8_t               role;
+    uint8_t               irk_match;
+    uint8_t               irk_match_idx;
+    ble_gap_conn_params_t conn_params;
+} ble_gap_evt_connected_t;
+
+typedef struct
+{
+    uint8_t reason;
+} ble_gap_evt_disconnected_t;
+
+typedef struct
+{
+    ble_gap_conn_params_t conn_params;
+} ble_gap_evt_conn_param_update_t;
+
+typedef struct
+{
+    ble_gap_conn_sec_t conn_sec;
+} ble_gap_evt_conn_sec_update_t;
+
+typedef struct
+{
+    uint8_t src;
+} ble_gap_evt_timeout_t;
+
+typedef struct
+{
+    uint16_t conn_handle;
+    union
+    {
+        ble_gap_evt_connected_t         connected;
+        ble_gap_evt_disconnected_t      disconnected;
+        ble_gap_evt_conn_param_update_t conn_param_update;
+        ble_gap_evt_conn_sec_update_t   conn_sec_update;
+        ble_gap_evt_timeout_t           timeout;
+    } params;
+} ble_gap_evt_t;
+
+typedef struct
+{
+    uint8_t count;
+} ble_evt_tx_complete_t;
+
+typedef struct
+{
+    uint16_t conn_handle;
+    union
+    {
+        ble_evt_tx_complete_t tx_complete;
+    } params;
+} ble_common_evt_t;
+
+typedef struct
+{
+    uint16_t evt_id;
+    uint16_t evt_len;
+} ble_evt_hdr_t;
+
+typedef struct
+{
+    ble_evt_hdr_t header;
+    union
+    {
+        ble_common_evt_t common_evt;
+        ble_gap_evt_t    gap_evt;
+        ble_gatts_evt_t  gatts_evt;
+    } evt;
+} ble_evt_t;
+
+uint32_t sd_ble_uuid_vs_add(ble_uuid128_t const * p_vs_uuid, uint8_t * p_uuid_type);
+uint32_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const * p_uuid, uint16_t * p_handle);
+uint32_t sd_ble_gatts_characteristic_add(uint16_t                   service_handle,
+                                         ble_gatts_char_md_t const * p_char_md,
+                                         ble_gatts_attr_t const    * p_attr_char_value,
+                                         ble_gatts_char_handles_t  * p_handles);
+uint32_t sd_ble_gatts_hvx(uint16_t conn_handle, ble_gatts_hvx_params_t const * p_hvx_params);
+uint32_t sd_ble_gatts_rw_authorize_reply(uint16_t conn_handle, ble_gatts_rw_authorize_reply_params_t const * p_rw_authorize_reply_params);
+uint32_t sd_ble_tx_packet_count_get(uint16_t conn_handle, uint8_t * p_count);
+uint32_t sd_ble_gatts_value_get(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t * p_value);
+uint32_t sd_ble_gap_adv_start(ble_gap_adv_params_t const * p_adv_params);
+uint32_t sd_ble_gap_adv_stop(void);
+
+#endif // BLE_H__
@@ -0,0 +1,16 @@
+#ifndef BLE_RADIO_NOTIFICATION_H__
+#define BLE_RADIO_NOTIFICATION_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Host replacement for the SDK radio notification module, implemented by sd_sim.c. The handler is called
+ * with true the given distance before each radio event of sd_sim and with false when the radio goes idle. */
+
+typedef void (*ble_radio_notification_evt_handler_t)(bool radio_active);
+
+uint32_t ble_radio_notification_init(uint32_t                             irq_priority,
+                                     uint8_t                              distance,
+                                     ble_radio_notification_evt_handler_t evt_handler);
+
+#endif // BLE_RADIO_NOTIFICATION_H__
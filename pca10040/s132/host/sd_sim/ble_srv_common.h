@@ -0,0 +1,14 @@
+#ifndef BLE_SRV_COMMON_H__
+#define BLE_SRV_COMMON_H__
+
+#include <stdbool.h>
+#include "ble.h"
+
+/* Host replacement for ble_srv_common.h. */
+
+#define BLE_CCCD_VALUE_LEN          2
+
+/* Returns true if the CCCD value has notifications enabled. Implemented in sd_sim.c. */
+bool ble_srv_is_notification_enabled(uint8_t const * p_encoded_data);
+
+#endif // BLE_SRV_COMMON_H__
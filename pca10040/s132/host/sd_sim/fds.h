@@ -0,0 +1,147 @@
+#ifndef FDS_H__
+#define FDS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "sdk_common.h"
+
+/* Host replacement for the SDK 11 Flash Data Storage module. Types, error codes and the on-flash layout
+ * follow the SDK, the calls are implemented by fds_sim.c on the flash of sd_sim:
+ *
+ * FDS_VIRTUAL_PAGES pages of FDS_VIRTUAL_PAGE_SIZE words, one of them the swap page. Each page starts with
+ * a two word tag, records are a three word header (key and length, file ID and CRC, record ID) followed by
+ * the data. Operations are queued (FDS_OP_QUEUE_SIZE) and carried out one flash operation at a time, each
+ * retried FS_OP_MAX_RETRIES times on NRF_EVT_FLASH_OPERATION_ERROR as fstorage does. A write is the data
+ * followed by the header, an update a write followed by the deletion of the old record, a deletion clears
+ * the key of the record. Garbage collection copies the valid records of each page with deleted ones to the
+ * swap page, erases the page and makes it the new swap page. CRCs are not computed. */
+
+#ifndef FDS_VIRTUAL_PAGES
+#define FDS_VIRTUAL_PAGES           6                                   /**< As the firmware, see config/ble_app_uart_s132_pca10040/fds_config.h. */
+#endif
+#define FDS_VIRTUAL_PAGE_SIZE       1024                                /**< Page size in words. */
+#define FDS_OP_QUEUE_SIZE           4
+#define FDS_MAX_USERS               8
+#define FDS_RECORD_KEY_DIRTY        0x0000                              /**< Key of deleted records. */
+
+enum
+{
+    FDS_SUCCESS = NRF_SUCCESS,
+    FDS_ERR_OPERATION_TIMEOUT,
+    FDS_ERR_NOT_INITIALIZED,
+    FDS_ERR_UNALIGNED_ADDR,
+    FDS_ERR_INVALID_ARG,
+    FDS_ERR_NULL_ARG,
+    FDS_ERR_NO_OPEN_RECORDS,
+    FDS_ERR_NO_SPACE_IN_FLASH,
+    FDS_ERR_NO_SPACE_IN_QUEUES,
+    FDS_ERR_RECORD_TOO_LARGE,
+    FDS_ERR_NOT_FOUND,
+    FDS_ERR_NO_PAGES,
+    FDS_ERR_USER_LIMIT_REACHED,
+    FDS_ERR_CRC_CHECK_FAILED,
+    FDS_ERR_BUSY,
+    FDS_ERR_INTERNAL
+};
+
+typedef struct
+{
+    void const * p_data;
+    uint16_t     length_words;
+} fds_record_chunk_t;
+
+typedef struct
+{
+    uint16_t file_id;
+    uint16_t key;
+    struct
+    {
+        fds_record_chunk_t const * p_chunks;
+        uint16_t                   num_chunks;
+    } data;
+} fds_record_t;
+
+typedef struct
+{
+    uint32_t         record_id;
+    uint32_t const * p_record;
+    uint16_t         gc_run_count;
+    bool             record_is_open;
+} fds_record_desc_t;
+
+typedef struct
+{
+    uint32_t const * p_addr;
+    uint16_t         page;
+} fds_find_token_t;
+
+typedef struct
+{
+    struct
+    {
+        uint16_t record_key;
+        uint16_t length_words;
+    } tl;
+    struct
+    {
+        uint16_t file_id;
+        uint16_t crc16;
+    } ic;
+    uint32_t record_id;
+} fds_header_t;
+
+typedef struct
+{
+    fds_header_t const * p_header;
+    void const         * p_data;
+} fds_flash_record_t;
+
+typedef enum
+{
+    FDS_EVT_INIT,
+    FDS_EVT_WRITE,
+    FDS_EVT_UPDATE,
+    FDS_EVT_DEL_RECORD,
+    FDS_EVT_DEL_FILE,
+    FDS_EVT_GC
+} fds_evt_id_t;
+
+typedef struct
+{
+    fds_evt_id_t id;
+    ret_code_t   result;
+    union
+    {
+        struct
+        {
+            uint32_t record_id;
+            uint16_t file_id;
+            uint16_t record_key;
+            bool     is_record_updated;
+        } write;
+        struct
+        {
+            uint32_t record_id;
+            uint16_t file_id;
+            uint16_t record_key;
+        } del;
+    };
+} fds_evt_t;
+
+typedef void (*fds_cb_t)(fds_evt_t const * const p_evt);
+
+ret_code_t fds_register(fds_cb_t cb);
+ret_code_t fds_init(void);
+ret_code_t fds_record_write(fds_record_desc_t * p_desc, fds_record_t const * p_record);
+ret_code_t fds_record_update(fds_record_desc_t * p_desc, fds_record_t const * p_record);
+ret_code_t fds_record_delete(fds_record_desc_t * p_desc);
+ret_code_t fds_record_find(uint16_t file_id, uint16_t record_key, fds_record_desc_t * p_desc, fds_find_token_t * p_token);
+ret_code_t fds_record_open(fds_record_desc_t * p_desc, fds_flash_record_t * p_flash_record);
+ret_code_t fds_record_close(fds_record_desc_t * p_desc);
+ret_code_t fds_descriptor_from_rec_id(fds_record_desc_t * p_desc, uint32_t record_id);
+ret_code_t fds_gc(void);
+
+/* Returns the words of the data pages not yet written, queued writes not counted. Not part of the SDK. */
+uint32_t fds_sim_free_words(void);
+
+#endif // FDS_H__
@@ -0,0 +1,791 @@
+#include "fds.h"
+#include <string.h>
+#include "nrf_soc.h"
+#include "fstorage.h"
+#include "sd_sim.h"
+
+#define PAGE_TAG_WORDS              2
+#define PAGE_TAG_MAGIC              0xDEADC0DE
+#define PAGE_TAG_SWAP               0xF11E01FF
+#define PAGE_TAG_DATA               0xF11E01FE
+#define HEADER_WORDS                3
+#define MAX_RECORDS                 256
+
+typedef enum
+{
+    RECORD_PENDING,                     /**< Space reserved, the header is not written yet. */
+    RECORD_VALID,
+    RECORD_DIRTY                        /**< Deleted, or a write that failed. Reclaimed by garbage collection. */
+} record_state_t;
+
+/* Record in flash, the index FDS keeps in RAM. Kept in flash order. */
+typedef struct
+{
+    record_state_t state;
+    uint8_t        page;
+    uint16_t       offset;              /**< Word offset of the header in the page. */
+    uint16_t       words;               /**< Header included. */
+    uint16_t       file_id;
+    uint16_t       key;
+    uint32_t       record_id;
+} record_t;
+
+typedef struct
+{
+    fds_evt_id_t               id;
+    uint32_t                   record_id;   /**< Record written or deleted. */
+    uint32_t                   old_id;      /**< Record deleted by an update. */
+    uint16_t                   file_id;
+    uint16_t                   key;
+    fds_record_chunk_t const * p_chunks;
+    uint16_t                   num_chunks;
+    uint32_t                   header[HEADER_WORDS];
+    uint16_t                   step;        /**< Flash operation of the operation in progress. */
+} fds_op_t;
+
+static uint32_t                 m_flash[FDS_VIRTUAL_PAGES][FDS_VIRTUAL_PAGE_SIZE];
+static uint16_t                 m_write_offset[FDS_VIRTUAL_PAGES];      /**< Next free word of each data page, reserved space included. */
+static uint8_t                  m_swap_page = FDS_VIRTUAL_PAGES - 1;
+static record_t                 m_records[MAX_RECORDS];
+static uint16_t                 m_record_count;
+static uint32_t                 m_record_id;                            /**< Last record ID given out. */
+static fds_cb_t                 m_users[FDS_MAX_USERS];
+static uint8_t                  m_user_count;
+static bool                     m_initialized;
+static fds_op_t                 m_ops[FDS_OP_QUEUE_SIZE];               /**< Queued operations, the head one is in progress. */
+static uint8_t                  m_op_head;
+static uint8_t                  m_op_count;
+static bool                     m_op_running;
+static uint8_t                  m_retries;                              /**< Retries of the current flash operation. */
+static uint32_t                 m_word;                                 /**< Source of single word writes. */
+
+/* Flash operation in progress, started again on NRF_EVT_FLASH_OPERATION_ERROR. */
+static struct
+{
+    bool             erase;
+    uint32_t         page;
+    uint32_t       * p_dst;
+    uint32_t const * p_src;
+    uint32_t         words;
+} m_flash_op;
+
+/* Garbage collection in progress. */
+static struct
+{
+    uint8_t  page;                      /**< Page being collected. */
+    uint16_t record;                    /**< Next record of the page to copy. */
+    uint16_t swap_offset;               /**< Next free word of the swap page. */
+    uint8_t  phase;
+} m_gc;
+
+enum
+{
+    GC_PHASE_SELECT,                    /**< Pick the next page with dirty records. */
+    GC_PHASE_COPY,                      /**< Copy the valid records of the page to the swap page. */
+    GC_PHASE_TAG_DATA,                  /**< Turn the swap page into a data page. */
+    GC_PHASE_ERASE,
+    GC_PHASE_TAG_SWAP                   /**< Tag the erased page as the new swap page. */
+};
+
+
+static void flash_op_start(void)
+{
+    uint32_t err_code;
+
+    if (m_flash_op.erase)
+    {
+        err_code = sd_flash_page_erase(m_flash_op.page);
+    }
+    else
+    {
+        err_code = sd_flash_write(m_flash_op.p_dst, m_flash_op.p_src, m_flash_op.words);
+    }
+    APP_ERROR_CHECK(err_code);
+}
+
+static void flash_write(uint32_t * p_dst, uint32_t const * p_src, uint32_t words)
+{
+    m_flash_op.erase = false;
+    m_flash_op.p_dst = p_dst;
+    m_flash_op.p_src = p_src;
+    m_flash_op.words = words;
+    flash_op_start();
+}
+
+static void flash_erase(uint32_t page)
+{
+    m_flash_op.erase = true;
+    m_flash_op.page  = page;
+    flash_op_start();
+}
+
+static void evt_send(fds_evt_t const * p_evt)
+{
+    uint8_t i;
+
+    for (i = 0; i < m_user_count; i++)
+    {
+        m_users[i](p_evt);
+    }
+}
+
+static record_t * record_find_by_id(uint32_t record_id)
+{
+    uint16_t i;
+
+    for (i = 0; i < m_record_count; i++)
+    {
+        if ((m_records[i].record_id == record_id) && (m_records[i].state == RECORD_VALID))
+        {
+            return &m_records[i];
+        }
+    }
+    return NULL;
+}
+
+static uint32_t * record_addr(record_t const * p_record)
+{
+    return &m_flash[p_record->page][p_record->offset];
+}
+
+/* Reserves space for a record of the given size. Returns NULL if no data page has room. */
+static record_t * record_reserve(uint16_t words)
+{
+    record_t * p_record;
+    uint8_t    page;
+
+    if (m_record_count == MAX_RECORDS)
+    {
+        return NULL;
+    }
+    for (page = 0; page < FDS_VIRTUAL_PAGES; page++)
+    {
+        if ((page != m_swap_page) && (m_write_offset[page] + words <= FDS_VIRTUAL_PAGE_SIZE))
+        {
+            p_record = &m_records[m_record_count++];
+            memset(p_record, 0, sizeof(*p_record));
+            p_record->state  = RECORD_PENDING;
+            p_record->page   = page;
+            p_record->offset = m_write_offset[page];
+            p_record->words  = words;
+            m_write_offset[page] += words;
+            return p_record;
+        }
+    }
+    return NULL;
+}
+
+static record_t * record_pending_get(uint32_t record_id)
+{
+    uint16_t i;
+
+    for (i = 0; i < m_record_count; i++)
+    {
+        if ((m_records[i].record_id == record_id) && (m_records[i].state == RECORD_PENDING))
+        {
+            return &m_records[i];
+        }
+    }
+    return NULL;
+}
+
+/* Queues an operation. Returns NULL if the queue is full. */
+static fds_op_t * op_alloc(void)
+{
+    fds_op_t * p_op;
+
+    if (m_op_count == FDS_OP_QUEUE_SIZE)
+    {
+        return NULL;
+    }
+    p_op = &m_ops[(m_op_head + m_op_count) % FDS_OP_QUEUE_SIZE];
+    memset(p_op, 0, sizeof(*p_op));
+    m_op_count++;
+    return p_op;
+}
+
+static void op_process(void);
+
+/* Ends the operation in progress and reports it to the users. */
+static void op_finish(ret_code_t result)
+{
+    fds_op_t  op = m_ops[m_op_head];
+    fds_evt_t evt;
+    record_t * p_record;
+
+    m_op_head    = (m_op_head + 1) % FDS_OP_QUEUE_SIZE;
+    m_op_count--;
+    m_op_running = false;
+
+    memset(&evt, 0, sizeof(evt));
+    evt.id     = op.id;
+    evt.result = result;
+
+    switch (op.id)
+    {
+        case FDS_EVT_INIT:
+            m_initialized = (result == FDS_SUCCESS);
+            break;
+
+        case FDS_EVT_WRITE:
+        case FDS_EVT_UPDATE:
+            p_record = record_pending_get(op.record_id);
+            if ((result != FDS_SUCCESS) && (p_record != NULL))
+            {
+                p_record->state = RECORD_DIRTY;
+            }
+            evt.write.record_id         = op.record_id;
+            evt.write.file_id           = op.file_id;
+            evt.write.record_key        = op.key;
+            evt.write.is_record_updated = (op.id == FDS_EVT_UPDATE) && (result == FDS_SUCCESS);
+            break;
+
+        case FDS_EVT_DEL_RECORD:
+            evt.del.record_id  = op.record_id;
+            evt.del.file_id    = op.file_id;
+            evt.del.record_key = op.key;
+            break;
+
+        default:
+            break;
+    }
+
+    evt_send(&evt);
+    op_process();
+}
+
+/* Marks the record with the given ID dirty in flash and in the index. */
+static bool record_delete_start(uint32_t record_id)
+{
+    record_t * p_record = record_find_by_id(record_id);
+
+    if (p_record == NULL)
+    {
+        return false;
+    }
+    m_word = ((uint32_t)p_record->words - HEADER_WORDS) << 16 | FDS_RECORD_KEY_DIRTY;
+    flash_write(record_addr(p_record), &m_word, 1);
+    return true;
+}
+
+/* Starts the next flash operation of a write or update. Returns false when all are done. */
+static bool write_step_start(fds_op_t * p_op)
+{
+    record_t * p_record = record_pending_get(p_op->record_id);
+    uint32_t * p_dst;
+    uint16_t   offset = HEADER_WORDS;
+    uint16_t   i;
+
+    if (p_op->step < p_op->num_chunks)
+    {
+        for (i = 0; i < p_op->step; i++)
+        {
+            offset += p_op->p_chunks[i].length_words;
+        }
+        p_dst = record_addr(p_record) + offset;
+        flash_write(p_dst, (uint32_t const *)p_op->p_chunks[p_op->step].p_data, p_op->p_chunks[p_op->step].length_words);
+        return true;
+    }
+    if (p_op->step == p_op->num_chunks)
+    {
+        flash_write(record_addr(p_record), p_op->header, HEADER_WORDS);
+        return true;
+    }
+    if (p_op->step == p_op->num_chunks + 1)
+    {
+        // The header is written, the record is valid from here on.
+        p_record->state = RECORD_VALID;
+        if ((p_op->id == FDS_EVT_UPDATE) && record_delete_start(p_op->old_id))
+        {
+            return true;
+        }
+        return false;
+    }
+    if (p_op->id == FDS_EVT_UPDATE)
+    {
+        p_record = record_find_by_id(p_op->old_id);
+        if (p_record != NULL)
+        {
+            p_record->state = RECORD_DIRTY;
+        }
+    }
+    return false;
+}
+
+/* Removes the dirty records of the page being collected from the index and moves the copied ones. */
+static void gc_index_update(void)
+{
+    uint16_t i;
+    uint16_t kept   = 0;
+    uint16_t offset = PAGE_TAG_WORDS;
+
+    for (i = 0; i < m_record_count; i++)
+    {
+        record_t record = m_records[i];
+
+        if (record.page == m_gc.page)
+        {
+            if (record.state == RECORD_DIRTY)
+            {
+                continue;
+            }
+            record.page   = m_swap_page;
+            record.offset = offset;
+            offset       += record.words;
+        }
+        m_records[kept++] = record;
+    }
+    m_record_count = kept;
+}
+
+/* Returns true if the page holds records to reclaim. */
+static bool gc_page_is_dirty(uint8_t page)
+{
+    uint16_t i;
+
+    for (i = 0; i < m_record_count; i++)
+    {
+        if ((m_records[i].page == page) && (m_records[i].state == RECORD_DIRTY))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Starts the next flash operation of the garbage collection. Returns false when it is done. */
+static bool gc_step_start(void)
+{
+    static const uint32_t tag_swap[PAGE_TAG_WORDS] = {PAGE_TAG_MAGIC, PAGE_TAG_SWAP};
+    static const uint32_t tag_data                 = PAGE_TAG_DATA;
+    uint16_t              i;
+
+    for (;;)
+    {
+        switch (m_gc.phase)
+        {
+            case GC_PHASE_SELECT:
+                while ((m_gc.page < FDS_VIRTUAL_PAGES)
+                       && ((m_gc.page == m_swap_page) || !gc_page_is_dirty(m_gc.page)))
+                {
+                    m_gc.page++;
+                }
+                if (m_gc.page == FDS_VIRTUAL_PAGES)
+                {
+                    return false;
+                }
+                m_gc.record      = 0;
+                m_gc.swap_offset = PAGE_TAG_WORDS;
+                m_gc.phase       = GC_PHASE_COPY;
+                break;
+
+            case GC_PHASE_COPY:
+                for (i = m_gc.record; i < m_record_count; i++)
+                {
+                    record_t const * p_record = &m_records[i];
+
+                    if ((p_record->page == m_gc.page) && (p_record->state == RECORD_VALID))
+                    {
+                        flash_write(&m_flash[m_swap_page][m_gc.swap_offset], record_addr(p_record), p_record->words);
+                        m_gc.swap_offset += p_record->words;
+                        m_gc.record       = i + 1;
+                        return true;
+                    }
+                }
+                m_gc.phase = GC_PHASE_TAG_DATA;
+                break;
+
+            case GC_PHASE_TAG_DATA:
+                m_gc.phase = GC_PHASE_ERASE;
+                flash_write(&m_flash[m_swap_page][1], &tag_data, 1);
+                return true;
+
+            case GC_PHASE_ERASE:
+                m_gc.phase = GC_PHASE_TAG_SWAP;
+                flash_erase(m_gc.page);
+                return true;
+
+            case GC_PHASE_TAG_SWAP:
+            default:
+                gc_index_update();
+                m_write_offset[m_swap_page] = m_gc.swap_offset;
+                m_write_offset[m_gc.page]   = PAGE_TAG_WORDS;
+                m_swap_page                 = m_gc.page;
+                m_gc.page++;
+                m_gc.phase                  = GC_PHASE_SELECT;
+                flash_write(m_flash[m_swap_page], tag_swap, PAGE_TAG_WORDS);
+                return true;
+        }
+    }
+}
+
+/* Starts the next flash operation of the initialization, tagging the pages not tagged yet. */
+static bool init_step_start(fds_op_t * p_op)
+{
+    static const uint32_t tag_data[PAGE_TAG_WORDS] = {PAGE_TAG_MAGIC, PAGE_TAG_DATA};
+    static const uint32_t tag_swap[PAGE_TAG_WORDS] = {PAGE_TAG_MAGIC, PAGE_TAG_SWAP};
+
+    while (p_op->step < FDS_VIRTUAL_PAGES)
+    {
+        uint8_t page = (uint8_t)p_op->step;
+
+        if (m_flash[page][0] != PAGE_TAG_MAGIC)
+        {
+            flash_write(m_flash[page], (page == m_swap_page) ? tag_swap : tag_data, PAGE_TAG_WORDS);
+            return true;
+        }
+        p_op->step++;
+    }
+    return false;
+}
+
+/* Starts the current flash operation of the head operation, or finishes it. */
+static void op_step_start(void)
+{
+    fds_op_t * p_op = &m_ops[m_op_head];
+    bool       started;
+
+    switch (p_op->id)
+    {
+        case FDS_EVT_INIT:
+            started = init_step_start(p_op);
+            break;
+
+        case FDS_EVT_WRITE:
+        case FDS_EVT_UPDATE:
+            started = write_step_start(p_op);
+            break;
+
+        case FDS_EVT_DEL_RECORD:
+            if (p_op->step == 0)
+            {
+                started = record_delete_start(p_op->record_id);
+                if (!started)
+                {
+                    op_finish(FDS_ERR_NOT_FOUND);
+                    return;
+                }
+            }
+            else
+            {
+                record_find_by_id(p_op->record_id)->state = RECORD_DIRTY;
+                started = false;
+            }
+            break;
+
+        case FDS_EVT_GC:
+        default:
+            started = gc_step_start();
+            break;
+    }
+
+    if (!started)
+    {
+        op_finish(FDS_SUCCESS);
+    }
+}
+
+/* Starts the head operation if none is in progress. */
+static void op_process(void)
+{
+    if (m_op_running || (m_op_count == 0))
+    {
+        return;
+    }
+    m_op_running = true;
+    m_retries    = 0;
+    if (m_ops[m_op_head].id == FDS_EVT_GC)
+    {
+        memset(&m_gc, 0, sizeof(m_gc));
+    }
+    op_step_start();
+}
+
+void fs_sys_event_handler(uint32_t sys_evt)
+{
+    if (!m_op_running)
+    {
+        return;
+    }
+
+    if (sys_evt == NRF_EVT_FLASH_OPERATION_SUCCESS)
+    {
+        m_retries = 0;
+        m_ops[m_op_head].step++;
+        op_step_start();
+    }
+    else if (sys_evt == NRF_EVT_FLASH_OPERATION_ERROR)
+    {
+        if (m_retries < FS_OP_MAX_RETRIES)
+        {
+            m_retries++;
+            flash_op_start();
+        }
+        else
+        {
+            op_finish(FDS_ERR_OPERATION_TIMEOUT);
+        }
+    }
+}
+
+ret_code_t fds_register(fds_cb_t cb)
+{
+    if (m_user_count == FDS_MAX_USERS)
+    {
+        return FDS_ERR_USER_LIMIT_REACHED;
+    }
+    m_users[m_user_count++] = cb;
+    return FDS_SUCCESS;
+}
+
+ret_code_t fds_init(void)
+{
+    uint8_t    page;
+    fds_op_t * p_op;
+
+    if (m_initialized || (m_op_count > 0))
+    {
+        return FDS_SUCCESS;
+    }
+
+    // The flash starts out erased.
+    memset(m_flash, 0xFF, sizeof(m_flash));
+    sd_sim_flash_set(m_flash[0], FDS_VIRTUAL_PAGES);
+    for (page = 0; page < FDS_VIRTUAL_PAGES; page++)
+    {
+        m_write_offset[page] = PAGE_TAG_WORDS;
+    }
+
+    p_op     = op_alloc();
+    p_op->id = FDS_EVT_INIT;
+    op_process();
+    return FDS_SUCCESS;
+}
+
+/* Queues a write or an update of the record old_id. */
+static ret_code_t write_queue(fds_evt_id_t         id,
+                              fds_record_desc_t  * p_desc,
+                              fds_record_t const * p_record,
+                              uint32_t             old_id)
+{
+    fds_op_t * p_op;
+    record_t * p_new;
+    uint32_t   words = HEADER_WORDS;
+    uint16_t   i;
+
+    if (!m_initialized)
+    {
+        return FDS_ERR_NOT_INITIALIZED;
+    }
+    if (p_record == NULL)
+    {
+        return FDS_ERR_NULL_ARG;
+    }
+    if (p_record->key == FDS_RECORD_KEY_DIRTY)
+    {
+        return FDS_ERR_INVALID_ARG;
+    }
+    for (i = 0; i < p_record->data.num_chunks; i++)
+    {
+        words += p_record->data.p_chunks[i].length_words;
+    }
+    if (words > FDS_VIRTUAL_PAGE_SIZE - PAGE_TAG_WORDS)
+    {
+        return FDS_ERR_RECORD_TOO_LARGE;
+    }
+    if (m_op_count == FDS_OP_QUEUE_SIZE)
+    {
+        return FDS_ERR_NO_SPACE_IN_QUEUES;
+    }
+    p_new = record_reserve((uint16_t)words);
+    if (p_new == NULL)
+    {
+        return FDS_ERR_NO_SPACE_IN_FLASH;
+    }
+
+    p_new->record_id = ++m_record_id;
+    p_new->file_id   = p_record->file_id;
+    p_new->key       = p_record->key;
+
+    p_op             = op_alloc();
+    p_op->id         = id;
+    p_op->record_id  = p_new->record_id;
+    p_op->old_id     = old_id;
+    p_op->file_id    = p_record->file_id;
+    p_op->key        = p_record->key;
+    p_op->p_chunks   = p_record->data.p_chunks;
+    p_op->num_chunks = p_record->data.num_chunks;
+    p_op->header[0]  = (words - HEADER_WORDS) << 16 | p_record->key;
+    p_op->header[1]  = p_record->file_id;
+    p_op->header[2]  = p_new->record_id;
+
+    if (p_desc != NULL)
+    {
+        memset(p_desc, 0, sizeof(*p_desc));
+        p_desc->record_id = p_new->record_id;
+    }
+
+    op_process();
+    return FDS_SUCCESS;
+}
+
+ret_code_t fds_record_write(fds_record_desc_t * p_desc, fds_record_t const * p_record)
+{
+    return write_queue(FDS_EVT_WRITE, p_desc, p_record, 0);
+}
+
+ret_code_t fds_record_update(fds_record_desc_t * p_desc, fds_record_t const * p_record)
+{
+    if (p_desc == NULL)
+    {
+        return FDS_ERR_NULL_ARG;
+    }
+    return write_queue(FDS_EVT_UPDATE, p_desc, p_record, p_desc->record_id);
+}
+
+ret_code_t fds_record_delete(fds_record_desc_t * p_desc)
+{
+    fds_op_t       * p_op;
+    record_t const * p_record;
+
+    if (!m_initialized)
+    {
+        return FDS_ERR_NOT_INITIALIZED;
+    }
+    if (p_desc == NULL)
+    {
+        return FDS_ERR_NULL_ARG;
+    }
+    if (m_op_count == FDS_OP_QUEUE_SIZE)
+    {
+        return FDS_ERR_NO_SPACE_IN_QUEUES;
+    }
+
+    p_op            = op_alloc();
+    p_op->id        = FDS_EVT_DEL_RECORD;
+    p_op->record_id = p_desc->record_id;
+    p_record        = record_find_by_id(p_desc->record_id);
+    if (p_record != NULL)
+    {
+        p_op->file_id = p_record->file_id;
+        p_op->key     = p_record->key;
+    }
+
+    op_process();
+    return FDS_SUCCESS;
+}
+
+ret_code_t fds_record_find(uint16_t file_id, uint16_t record_key, fds_record_desc_t * p_desc, fds_find_token_t * p_token)
+{
+    uint16_t i = 0;
+
+    if (!m_initialized)
+    {
+        return FDS_ERR_NOT_INITIALIZED;
+    }
+    if ((p_desc == NULL) || (p_token == NULL))
+    {
+        return FDS_ERR_NULL_ARG;
+    }
+
+    // The token holds the last record found, the search goes on after it.
+    if (p_token->p_addr != NULL)
+    {
+        while ((i < m_record_count) && (record_addr(&m_records[i]) != p_token->p_addr))
+        {
+            i++;
+        }
+        i++;
+    }
+
+    for (; i < m_record_count; i++)
+    {
+        record_t const * p_record = &m_records[i];
+
+        if ((p_record->state == RECORD_VALID) && (p_record->file_id == file_id) && (p_record->key == record_key))
+        {
+            memset(p_desc, 0, sizeof(*p_desc));
+            p_desc->record_id = p_record->record_id;
+            p_desc->p_record  = record_addr(p_record);
+            p_token->p_addr   = p_desc->p_record;
+            p_token->page     = p_record->page;
+            return FDS_SUCCESS;
+        }
+    }
+    return FDS_ERR_NOT_FOUND;
+}
+
+ret_code_t fds_record_open(fds_record_desc_t * p_desc, fds_flash_record_t * p_flash_record)
+{
+    record_t const * p_record;
+
+    if ((p_desc == NULL) || (p_flash_record == NULL))
+    {
+        return FDS_ERR_NULL_ARG;
+    }
+    p_record = record_find_by_id(p_desc->record_id);
+    if (p_record == NULL)
+    {
+        return FDS_ERR_NOT_FOUND;
+    }
+    p_desc->p_record         = record_addr(p_record);
+    p_desc->record_is_open   = true;
+    p_flash_record->p_header = (fds_header_t const *)p_desc->p_record;
+    p_flash_record->p_data   = p_desc->p_record + HEADER_WORDS;
+    return FDS_SUCCESS;
+}
+
+ret_code_t fds_record_close(fds_record_desc_t * p_desc)
+{
+    if (p_desc == NULL)
+    {
+        return FDS_ERR_NULL_ARG;
+    }
+    p_desc->record_is_open = false;
+    return FDS_SUCCESS;
+}
+
+ret_code_t fds_descriptor_from_rec_id(fds_record_desc_t * p_desc, uint32_t record_id)
+{
+    if (p_desc == NULL)
+    {
+        return FDS_ERR_NULL_ARG;
+    }
+    memset(p_desc, 0, sizeof(*p_desc));
+    p_desc->record_id = record_id;
+    return FDS_SUCCESS;
+}
+
+ret_code_t fds_gc(void)
+{
+    fds_op_t * p_op;
+
+    if (!m_initialized)
+    {
+        return FDS_ERR_NOT_INITIALIZED;
+    }
+    if (m_op_count == FDS_OP_QUEUE_SIZE)
+    {
+        return FDS_ERR_NO_SPACE_IN_QUEUES;
+    }
+
+    p_op     = op_alloc();
+    p_op->id = FDS_EVT_GC;
+    op_process();
+    return FDS_SUCCESS;
+}
+
+uint32_t fds_sim_free_words(void)
+{
+    uint32_t free_words = 0;
+    uint8_t  page;
+
+    for (page = 0; page < FDS_VIRTUAL_PAGES; page++)
+    {
+        if (page != m_swap_page)
+        {
+            free_words += FDS_VIRTUAL_PAGE_SIZE - m_write_offset[page];
+        }
+    }
+    return free_words;
+}
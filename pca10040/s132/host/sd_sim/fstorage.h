@@ -0,0 +1,12 @@
+#ifndef FSTORAGE_H__
+#define FSTORAGE_H__
+
+#include <stdint.h>
+
+/* Host replacement for fstorage.h. The system event handler drives the FDS model of fds_sim.c. */
+
+#define FS_OP_MAX_RETRIES           3                                   /**< Attempts after the first before a flash operation fails. */
+
+void fs_sys_event_handler(uint32_t sys_evt);
+
+#endif // FSTORAGE_H__
@@ -0,0 +1,40 @@
+#ifndef NRF_SOC_H__
+#define NRF_SOC_H__
+
+#include <stdint.h>
+
+/* Host replacement for the SoftDevice SoC API (S132 v2), limited to the flash calls and the system events.
+ * The calls are implemented by sd_sim.c. */
+
+enum NRF_SOC_EVTS
+{
+    NRF_EVT_HFCLKSTARTED,
+    NRF_EVT_POWER_FAILURE_WARNING,
+    NRF_EVT_FLASH_OPERATION_SUCCESS,
+    NRF_EVT_FLASH_OPERATION_ERROR,
+    NRF_EVT_RADIO_BLOCKED,
+    NRF_EVT_RADIO_CANCELED,
+    NRF_EVT_RADIO_SIGNAL_CALLBACK_INVALID_RETURN,
+    NRF_EVT_RADIO_SESSION_IDLE,
+    NRF_EVT_RADIO_SESSION_CLOSED,
+    NRF_EVT_NUMBER_OF_EVTS
+};
+
+enum NRF_RADIO_NOTIFICATION_DISTANCES
+{
+    NRF_RADIO_NOTIFICATION_DISTANCE_NONE = 0,
+    NRF_RADIO_NOTIFICATION_DISTANCE_800US,
+    NRF_RADIO_NOTIFICATION_DISTANCE_1740US,
+    NRF_RADIO_NOTIFICATION_DISTANCE_2680US,
+    NRF_RADIO_NOTIFICATION_DISTANCE_3620US,
+    NRF_RADIO_NOTIFICATION_DISTANCE_4560US,
+    NRF_RADIO_NOTIFICATION_DISTANCE_5500US
+};
+
+/* Writes size words from p_src to p_dst. NRF_EVT_FLASH_OPERATION_SUCCESS or _ERROR follows. */
+uint32_t sd_flash_write(uint32_t * const p_dst, uint32_t const * const p_src, uint32_t size);
+
+/* Erases a page of the flash given to sd_sim_flash_set(). NRF_EVT_FLASH_OPERATION_SUCCESS or _ERROR follows. */
+uint32_t sd_flash_page_erase(uint32_t page_number);
+
+#endif // NRF_SOC_H__
@@ -0,0 +1,1370 @@
+#include "sd_sim.h"
+#include <string.h>
+#include "ble_srv_common.h"
+#include "nrf_soc.h"
+#include "ble_radio_notification.h"
+#include "app_timer.h"
+
+#define EVT_BUF_SIZE                (sizeof(ble_evt_t) + SD_SIM_MAX_ATTR_LEN)
+#define ADV_DELAY_MAX_US            10000                               /**< Random delay added to each undirected advertising interval. */
+#define ADV_HIGH_DUTY_INTERVAL_US   3750
+#define ADV_HIGH_DUTY_DURATION_US   1280000
+#define ADV_UNIT_US                 625
+#define TIME_NEVER                  UINT64_MAX
+
+typedef struct
+{
+    ble_uuid_t            uuid;
+    ble_gatt_char_props_t props;        /**< Properties of the characteristic, for value attributes. */
+    bool                  is_cccd;
+    bool                  rd_auth;
+    uint16_t              max_len;
+    uint16_t              len;
+    uint8_t               value[SD_SIM_MAX_ATTR_LEN];
+    uint16_t              cccd_handle;  /**< CCCD of the characteristic, for value attributes. */
+} sim_attr_t;
+
+static sd_sim_config_t          m_config;
+static sd_sim_evt_handler_t     m_evt_handler;
+static sd_sim_peer_rx_handler_t m_peer_rx_handler;
+static sim_attr_t               m_attrs[SD_SIM_MAX_ATTRS + 1];          /**< Index is the handle, 0 is invalid. */
+static uint16_t                 m_attr_count;
+static uint8_t                  m_vs_uuid_count;
+
+/* Peripheral link. */
+typedef struct
+{
+    uint16_t conn_handle;               /**< BLE_CONN_HANDLE_INVALID for a free link. */
+    uint8_t  central;                   /**< SD_SIM_CENTRAL_NONE for links made with sd_sim_connect(). */
+    uint32_t conn_interval_us;
+    uint64_t next_conn_event_us;
+    uint8_t  cccd[SD_SIM_MAX_ATTRS + 1][BLE_CCCD_VALUE_LEN];   /**< CCCD values of the link, by handle. */
+    struct
+    {
+        uint16_t handle;
+        uint16_t len;
+        uint8_t  data[GATT_MTU_SIZE_DEFAULT - 3];
+    } tx_queue[256];                    /**< Notifications waiting for a connection event, in a ring. */
+    uint8_t  tx_head;
+    uint8_t  tx_count;
+} sim_link_t;
+
+static sim_link_t               m_links[SD_SIM_MAX_LINKS];
+
+static bool                                  m_reply_valid;             /**< The application replied to the last authorization request. */
+static ble_gatts_rw_authorize_reply_params_t m_reply;
+static uint8_t                               m_reply_data[SD_SIM_MAX_ATTR_LEN];
+
+/* Advertising set up by sd_ble_gap_adv_start(). */
+static struct
+{
+    bool                active;
+    ble_gap_adv_params_t params;
+    ble_gap_addr_t      peer_addr;
+    ble_gap_addr_t      whitelist[BLE_GAP_WHITELIST_ADDR_MAX_COUNT];
+    uint8_t             whitelist_count;
+    uint64_t            next_event_us;
+    uint64_t            end_us;         /**< 0 for no timeout. */
+} m_adv;
+
+typedef struct
+{
+    sd_sim_central_t config;
+    bool             initiating;
+    uint32_t         phase_us;          /**< Offset of the scan windows. */
+    uint8_t          cccd[SD_SIM_MAX_ATTRS + 1][BLE_CCCD_VALUE_LEN];   /**< CCCD values kept for a bonded central. */
+} sim_central_t;
+
+static sim_central_t            m_centrals[SD_SIM_MAX_CENTRALS];
+static uint8_t                  m_central_count;
+static uint32_t                 m_random = 1;
+
+/* Radio notification signal and radio time. */
+static struct
+{
+    ble_radio_notification_evt_handler_t handler;
+    uint32_t                             distance_us;
+    bool                                 active;            /**< The last signal raised was active. */
+    uint64_t                             signalled_us;      /**< Radio event the active signal was raised for. */
+    uint64_t                             busy_until_us;     /**< End of the last radio event. */
+} m_radio;
+
+/* Flash operation waiting for radio idle time. */
+static struct
+{
+    bool             pending;
+    bool             erase;
+    uint32_t       * p_dst;
+    uint32_t const * p_src;
+    uint32_t         words;
+    uint32_t         duration_us;
+    uint64_t         started_us;        /**< Time of the sd_flash_*() call. */
+    uint64_t         ready_us;          /**< Earliest time of the next attempt. */
+    uint8_t          attempts;
+} m_flash;
+
+static uint32_t               * m_flash_area;
+static uint32_t                 m_flash_page_count;
+static sd_sim_sys_evt_handler_t m_sys_evt_handler;
+
+static app_timer_t            * m_timers[SD_SIM_MAX_TIMERS];            /**< Timers created, running or not. */
+static uint8_t                  m_timer_count;
+static uint32_t                 m_timer_prescaler;
+
+static sd_sim_stats_t           m_stats;
+static uint32_t                 m_evt_buf[(EVT_BUF_SIZE + 3) / 4];      /**< Event buffer, word aligned like the SoftDevice's. */
+
+
+static ble_evt_t * evt_prepare(uint16_t evt_id)
+{
+    ble_evt_t * p_evt = (ble_evt_t *)m_evt_buf;
+
+    memset(m_evt_buf, 0, sizeof(m_evt_buf));
+    p_evt->header.evt_id  = evt_id;
+    p_evt->header.evt_len = sizeof(ble_evt_t);
+    return p_evt;
+}
+
+static void evt_raise(ble_evt_t * p_evt)
+{
+    if (m_evt_handler != NULL)
+    {
+        m_evt_handler(p_evt);
+    }
+}
+
+static uint16_t attr_add(void)
+{
+    if (m_attr_count >= SD_SIM_MAX_ATTRS)
+    {
+        return BLE_GATT_HANDLE_INVALID;
+    }
+    m_attr_count++;
+    memset(&m_attrs[m_attr_count], 0, sizeof(sim_attr_t));
+    return m_attr_count;
+}
+
+static bool handle_is_valid(uint16_t handle)
+{
+    return (handle != BLE_GATT_HANDLE_INVALID) && (handle <= m_attr_count);
+}
+
+static uint32_t random_get(uint32_t range)
+{
+    m_random = m_random * 1103515245 + 12345;
+    return (range == 0) ? 0 : ((m_random >> 8) % range);
+}
+
+/* Returns the link with the given handle, NULL if there is none. BLE_CONN_HANDLE_INVALID finds a free link. */
+static sim_link_t * link_get(uint16_t conn_handle)
+{
+    uint8_t i;
+
+    for (i = 0; i < m_config.link_count; i++)
+    {
+        if (m_links[i].conn_handle == conn_handle)
+        {
+            return &m_links[i];
+        }
+    }
+    return NULL;
+}
+
+/* Clears the CCCDs of a link, saving them first if its central is bonded. */
+static void cccds_save_and_clear(sim_link_t * p_link)
+{
+    if ((p_link->central != SD_SIM_CENTRAL_NONE) && m_centrals[p_link->central].config.bonded)
+    {
+        memcpy(m_centrals[p_link->central].cccd, p_link->cccd, sizeof(p_link->cccd));
+    }
+    memset(p_link->cccd, 0, sizeof(p_link->cccd));
+}
+
+void sd_sim_init(sd_sim_config_t const * p_config, sd_sim_evt_handler_t evt_handler)
+{
+    uint8_t i;
+
+    if (p_config != NULL)
+    {
+        m_config = *p_config;
+    }
+    else
+    {
+        m_config.tx_buffer_count   = SD_SIM_TX_BUFFERS_DEFAULT;
+        m_config.packets_per_event = SD_SIM_PACKETS_PER_EVENT;
+        m_config.conn_interval_us  = 20000;
+        m_config.link_count        = 1;
+    }
+
+    if (m_config.link_count == 0)
+    {
+        m_config.link_count = 1;
+    }
+    m_config.link_count = MIN(m_config.link_count, SD_SIM_MAX_LINKS);
+
+    m_evt_handler        = evt_handler;
+    m_peer_rx_handler    = NULL;
+    m_attr_count         = 0;
+    m_vs_uuid_count      = 0;
+    m_central_count      = 0;
+    memset(m_links, 0, sizeof(m_links));
+    for (i = 0; i < SD_SIM_MAX_LINKS; i++)
+    {
+        m_links[i].conn_handle = BLE_CONN_HANDLE_INVALID;
+    }
+    memset(&m_adv, 0, sizeof(m_adv));
+    memset(&m_stats, 0, sizeof(m_stats));
+    memset(&m_radio, 0, sizeof(m_radio));
+    memset(&m_flash, 0, sizeof(m_flash));
+    m_flash_area       = NULL;
+    m_flash_page_count = 0;
+    m_sys_evt_handler  = NULL;
+    m_timer_count      = 0;
+}
+
+void sd_sim_peer_rx_handler_set(sd_sim_peer_rx_handler_t handler)
+{
+    m_peer_rx_handler = handler;
+}
+
+void sd_sim_sys_evt_handler_set(sd_sim_sys_evt_handler_t handler)
+{
+    m_sys_evt_handler = handler;
+}
+
+void sd_sim_flash_set(uint32_t * p_flash, uint32_t page_count)
+{
+    m_flash_area       = p_flash;
+    m_flash_page_count = page_count;
+}
+
+/* Sets up a free link and raises the connection events. central is SD_SIM_CENTRAL_NONE for sd_sim_connect(). */
+static void link_establish(sim_link_t * p_link, uint16_t conn_handle, uint8_t central)
+{
+    ble_evt_t * p_evt    = evt_prepare(BLE_GAP_EVT_CONNECTED);
+    uint16_t    interval = (uint16_t)((m_config.conn_interval_us * 4) / 5000);   // 1.25 ms units.
+    bool        bonded   = (central != SD_SIM_CENTRAL_NONE) && m_centrals[central].config.bonded;
+
+    m_adv.active               = false;
+    p_link->conn_handle        = conn_handle;
+    p_link->central            = central;
+    p_link->conn_interval_us   = m_config.conn_interval_us;
+    p_link->next_conn_event_us = m_stats.time_us + m_config.conn_interval_us;
+    p_link->tx_head            = 0;
+    p_link->tx_count           = 0;
+    memset(p_link->cccd, 0, sizeof(p_link->cccd));
+
+    if (bonded)
+    {
+        memcpy(p_link->cccd, m_centrals[central].cccd, sizeof(p_link->cccd));
+    }
+
+    p_evt->evt.gap_evt.conn_handle                                   = conn_handle;
+    p_evt->evt.gap_evt.params.connected.role                          = BLE_GAP_ROLE_PERIPH;
+    p_evt->evt.gap_evt.params.connected.conn_params.min_conn_interval = interval;
+    p_evt->evt.gap_evt.params.connected.conn_params.max_conn_interval = interval;
+    if (central != SD_SIM_CENTRAL_NONE)
+    {
+        p_evt->evt.gap_evt.params.connected.peer_addr = m_centrals[central].config.addr;
+    }
+    evt_raise(p_evt);
+
+    if (bonded && (p_link->conn_handle == conn_handle))
+    {
+        p_evt = evt_prepare(BLE_GAP_EVT_CONN_SEC_UPDATE);
+        p_evt->evt.gap_evt.conn_handle                                   = conn_handle;
+        p_evt->evt.gap_evt.params.conn_sec_update.conn_sec.sec_mode.sm   = 1;
+        p_evt->evt.gap_evt.params.conn_sec_update.conn_sec.sec_mode.lv   = 2;
+        p_evt->evt.gap_evt.params.conn_sec_update.conn_sec.encr_key_size = 16;
+        evt_raise(p_evt);
+    }
+}
+
+uint32_t sd_sim_connect(uint16_t conn_handle)
+{
+    sim_link_t * p_link;
+
+    if ((conn_handle == BLE_CONN_HANDLE_INVALID) || (link_get(conn_handle) != NULL))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    p_link = link_get(BLE_CONN_HANDLE_INVALID);
+    if (p_link == NULL)
+    {
+        return NRF_ERROR_CONN_COUNT;
+    }
+    link_establish(p_link, conn_handle, SD_SIM_CENTRAL_NONE);
+    return NRF_SUCCESS;
+}
+
+void sd_sim_disconnect(uint16_t conn_handle, uint8_t reason)
+{
+    sim_link_t * p_link = link_get(conn_handle);
+    ble_evt_t  * p_evt;
+
+    if ((p_link == NULL) || (conn_handle == BLE_CONN_HANDLE_INVALID))
+    {
+        return;
+    }
+
+    p_evt = evt_prepare(BLE_GAP_EVT_DISCONNECTED);
+    p_evt->evt.gap_evt.conn_handle                = conn_handle;
+    p_evt->evt.gap_evt.params.disconnected.reason = reason;
+
+    p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+    p_link->tx_count    = 0;
+    // CCCDs are reset on disconnect, bonded centrals get theirs back when they reconnect.
+    cccds_save_and_clear(p_link);
+    p_link->central = SD_SIM_CENTRAL_NONE;
+    evt_raise(p_evt);
+}
+
+void sd_sim_conn_interval_set(uint16_t conn_handle, uint32_t conn_interval_us)
+{
+    sim_link_t * p_link = link_get(conn_handle);
+    ble_evt_t  * p_evt;
+    uint16_t     interval = (uint16_t)((conn_interval_us * 4) / 5000);
+
+    if ((p_link == NULL) || (conn_handle == BLE_CONN_HANDLE_INVALID))
+    {
+        return;
+    }
+    p_link->conn_interval_us = conn_interval_us;
+
+    p_evt = evt_prepare(BLE_GAP_EVT_CONN_PARAM_UPDATE);
+    p_evt->evt.gap_evt.conn_handle                                           = conn_handle;
+    p_evt->evt.gap_evt.params.conn_param_update.conn_params.min_conn_interval = interval;
+    p_evt->evt.gap_evt.params.conn_param_update.conn_params.max_conn_interval = interval;
+    evt_raise(p_evt);
+}
+
+uint8_t sd_sim_central_add(sd_sim_central_t const * p_central)
+{
+    sim_central_t * p_sim;
+
+    if ((p_central == NULL) || (m_central_count == SD_SIM_MAX_CENTRALS) || (p_central->scan_interval_us == 0))
+    {
+        return SD_SIM_CENTRAL_NONE;
+    }
+
+    p_sim = &m_centrals[m_central_count];
+    memset(p_sim, 0, sizeof(sim_central_t));
+    p_sim->config   = *p_central;
+    p_sim->phase_us = random_get(p_central->scan_interval_us);
+    return m_central_count++;
+}
+
+void sd_sim_central_initiate(uint8_t index, bool enable)
+{
+    if (index < m_central_count)
+    {
+        m_centrals[index].initiating = enable;
+        // A central starting to scan has no relation to the advertiser's timing.
+        m_centrals[index].phase_us   = random_get(m_centrals[index].config.scan_interval_us);
+    }
+}
+
+uint16_t sd_sim_central_conn_handle(uint8_t index)
+{
+    uint8_t i;
+
+    for (i = 0; i < m_config.link_count; i++)
+    {
+        if ((m_links[i].conn_handle != BLE_CONN_HANDLE_INVALID) && (m_links[i].central == index))
+        {
+            return m_links[i].conn_handle;
+        }
+    }
+    return BLE_CONN_HANDLE_INVALID;
+}
+
+uint8_t sd_sim_link_count(void)
+{
+    uint8_t count = 0;
+    uint8_t i;
+
+    for (i = 0; i < m_config.link_count; i++)
+    {
+        if (m_links[i].conn_handle != BLE_CONN_HANDLE_INVALID)
+        {
+            count++;
+        }
+    }
+    return count;
+}
+
+void sd_sim_seed_set(uint32_t seed)
+{
+    m_random = seed;
+}
+
+uint32_t sd_sim_peer_write(uint16_t conn_handle, uint16_t handle, uint8_t const * p_data, uint16_t len)
+{
+    ble_evt_t  * p_evt;
+    sim_attr_t * p_attr;
+    sim_link_t * p_link = link_get(conn_handle);
+
+    if ((p_link == NULL) || (conn_handle == BLE_CONN_HANDLE_INVALID))
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    if (!handle_is_valid(handle))
+    {
+        return BLE_ERROR_INVALID_ATTR_HANDLE;
+    }
+    p_attr = &m_attrs[handle];
+    if (len > p_attr->max_len)
+    {
+        return NRF_ERROR_DATA_SIZE;
+    }
+
+    if (p_attr->is_cccd)
+    {
+        // CCCD values belong to the link.
+        if (len != BLE_CCCD_VALUE_LEN)
+        {
+            return NRF_ERROR_INVALID_PARAM;
+        }
+        memcpy(p_link->cccd[handle], p_data, len);
+    }
+    else
+    {
+        memcpy(p_attr->value, p_data, len);
+        p_attr->len = len;
+    }
+
+    p_evt = evt_prepare(BLE_GATTS_EVT_WRITE);
+    p_evt->evt.gatts_evt.conn_handle         = conn_handle;
+    p_evt->evt.gatts_evt.params.write.handle = handle;
+    p_evt->evt.gatts_evt.params.write.uuid   = p_attr->uuid;
+    p_evt->evt.gatts_evt.params.write.len    = len;
+    memcpy(p_evt->evt.gatts_evt.params.write.data, p_data, len);
+    evt_raise(p_evt);
+
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_sim_peer_read(uint16_t conn_handle, uint16_t handle, uint16_t offset, uint8_t * p_data, uint16_t * p_len)
+{
+    ble_evt_t  * p_evt;
+    sim_attr_t * p_attr;
+    sim_link_t * p_link = link_get(conn_handle);
+    uint16_t     len;
+
+    if ((p_link == NULL) || (conn_handle == BLE_CONN_HANDLE_INVALID))
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    if (!handle_is_valid(handle))
+    {
+        return BLE_ERROR_INVALID_ATTR_HANDLE;
+    }
+    p_attr = &m_attrs[handle];
+
+    if (p_attr->rd_auth)
+    {
+        m_reply_valid = false;
+
+        p_evt = evt_prepare(BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST);
+        p_evt->evt.gatts_evt.conn_handle                               = conn_handle;
+        p_evt->evt.gatts_evt.params.authorize_request.type             = BLE_GATTS_AUTHORIZE_TYPE_READ;
+        p_evt->evt.gatts_evt.params.authorize_request.request.read.handle = handle;
+        p_evt->evt.gatts_evt.params.authorize_request.request.read.uuid   = p_attr->uuid;
+        p_evt->evt.gatts_evt.params.authorize_request.request.read.offset = offset;
+        evt_raise(p_evt);
+
+        if (!m_reply_valid || (m_reply.params.read.gatt_status != BLE_GATT_STATUS_SUCCESS))
+        {
+            return NRF_ERROR_INVALID_STATE;
+        }
+        if (m_reply.params.read.update)
+        {
+            p_attr->len = MIN(m_reply.params.read.len, p_attr->max_len);
+            memcpy(p_attr->value, m_reply_data, p_attr->len);
+        }
+    }
+
+    if (p_attr->is_cccd)
+    {
+        if (offset > BLE_CCCD_VALUE_LEN)
+        {
+            return NRF_ERROR_INVALID_PARAM;
+        }
+        len = MIN(*p_len, (uint16_t)(BLE_CCCD_VALUE_LEN - offset));
+        memcpy(p_data, &p_link->cccd[handle][offset], len);
+        *p_len = len;
+        return NRF_SUCCESS;
+    }
+
+    if (offset > p_attr->len)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    len = MIN(*p_len, (uint16_t)(p_attr->len - offset));
+    memcpy(p_data, &p_attr->value[offset], len);
+    *p_len = len;
+    return NRF_SUCCESS;
+}
+
+/* Delivers up to max queued notifications of a link to the peer. Returns the number sent. */
+static uint8_t tx_deliver(sim_link_t * p_link, uint8_t max)
+{
+    uint8_t sent = 0;
+
+    while ((p_link->tx_count > 0) && (sent < max))
+    {
+        if (m_peer_rx_handler != NULL)
+        {
+            m_peer_rx_handler(p_link->conn_handle,
+                              p_link->tx_queue[p_link->tx_head].handle,
+                              p_link->tx_queue[p_link->tx_head].data,
+                              p_link->tx_queue[p_link->tx_head].len);
+        }
+        m_stats.notifications_sent++;
+        m_stats.bytes_sent += p_link->tx_queue[p_link->tx_head].len;
+        p_link->tx_head++;
+        p_link->tx_count--;
+        sent++;
+    }
+    return sent;
+}
+
+/* Runs one connection event of a link. */
+static void conn_event_run(sim_link_t * p_link)
+{
+    ble_evt_t * p_evt;
+    uint8_t     sent;
+
+    m_stats.conn_events++;
+    sent = tx_deliver(p_link, m_config.packets_per_event);
+
+    m_radio.busy_until_us = MAX(m_radio.busy_until_us,
+                                m_stats.time_us + SD_SIM_EMPTY_EVENT_US + (uint32_t)sent * SD_SIM_PACKET_US);
+
+    if (sent > 0)
+    {
+        m_stats.tx_complete_evts++;
+        p_evt = evt_prepare(BLE_EVT_TX_COMPLETE);
+        p_evt->evt.common_evt.conn_handle              = p_link->conn_handle;
+        p_evt->evt.common_evt.params.tx_complete.count = sent;
+        evt_raise(p_evt);
+    }
+}
+
+static bool addr_equal(ble_gap_addr_t const * p_a, ble_gap_addr_t const * p_b)
+{
+    return (p_a->addr_type == p_b->addr_type) && (memcmp(p_a->addr, p_b->addr, BLE_GAP_ADDR_LEN) == 0);
+}
+
+/* Returns true if the central may connect to the current advertising. */
+static bool adv_accepts(sim_central_t const * p_central)
+{
+    uint8_t i;
+
+    if (m_adv.params.type == BLE_GAP_ADV_TYPE_ADV_DIRECT_IND)
+    {
+        return addr_equal(&m_adv.peer_addr, &p_central->config.addr);
+    }
+    if (m_adv.params.fp == BLE_GAP_ADV_FP_ANY)
+    {
+        return true;
+    }
+    for (i = 0; i < m_adv.whitelist_count; i++)
+    {
+        if (addr_equal(&m_adv.whitelist[i], &p_central->config.addr))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* Runs one advertising event, connecting a central that is scanning at the time. */
+static void adv_event_run(void)
+{
+    uint8_t      start = (uint8_t)random_get(SD_SIM_MAX_CENTRALS);
+    uint8_t      i;
+    sim_link_t * p_link;
+
+    m_stats.adv_events++;
+    m_radio.busy_until_us = MAX(m_radio.busy_until_us, m_stats.time_us + SD_SIM_ADV_EVENT_US);
+
+    for (i = 0; i < m_central_count; i++)
+    {
+        uint8_t               index     = (uint8_t)((start + i) % m_central_count);
+        sim_central_t const * p_central = &m_centrals[index];
+        uint64_t              scan_pos  = (m_stats.time_us + p_central->phase_us) % p_central->config.scan_interval_us;
+
+        if (p_central->initiating && (scan_pos < p_central->config.scan_window_us) && adv_accepts(p_central)
+            && (sd_sim_central_conn_handle(index) == BLE_CONN_HANDLE_INVALID))
+        {
+            p_link = link_get(BLE_CONN_HANDLE_INVALID);
+            link_establish(p_link, (uint16_t)(p_link - m_links), index);
+            return;
+        }
+    }
+
+    if (m_adv.params.type == BLE_GAP_ADV_TYPE_ADV_DIRECT_IND)
+    {
+        m_adv.next_event_us += ADV_HIGH_DUTY_INTERVAL_US;
+    }
+    else
+    {
+        m_adv.next_event_us += (uint64_t)m_adv.params.interval * ADV_UNIT_US + random_get(ADV_DELAY_MAX_US);
+    }
+}
+
+static void adv_timeout_run(void)
+{
+    ble_evt_t * p_evt = evt_prepare(BLE_GAP_EVT_TIMEOUT);
+
+    m_adv.active = false;
+    m_stats.adv_timeouts++;
+
+    p_evt->evt.gap_evt.conn_handle        = BLE_CONN_HANDLE_INVALID;
+    p_evt->evt.gap_evt.params.timeout.src = BLE_GAP_TIMEOUT_SRC_ADVERTISING;
+    evt_raise(p_evt);
+}
+
+/* Returns the link with the earliest connection event, NULL if no link is up. */
+static sim_link_t * link_next_event(void)
+{
+    sim_link_t * p_next = NULL;
+    uint8_t      i;
+
+    for (i = 0; i < m_config.link_count; i++)
+    {
+        if ((m_links[i].conn_handle != BLE_CONN_HANDLE_INVALID)
+            && ((p_next == NULL) || (m_links[i].next_conn_event_us < p_next->next_conn_event_us)))
+        {
+            p_next = &m_links[i];
+        }
+    }
+    return p_next;
+}
+
+uint32_t sd_sim_replay(ble_evt_t const * p_ble_evt, uint64_t time_us)
+{
+    ble_evt_t                   * p_evt;
+    sim_link_t                  * p_link;
+    ble_gatts_evt_write_t const * p_write;
+    uint16_t                      conn_handle = p_ble_evt->evt.common_evt.conn_handle;
+    uint16_t                      len         = sizeof(ble_evt_t);
+
+    m_stats.time_us = MAX(m_stats.time_us, time_us);
+    p_link          = link_get(conn_handle);
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_CONNECTED:
+            if ((conn_handle == BLE_CONN_HANDLE_INVALID) || (p_link != NULL))
+            {
+                return NRF_ERROR_INVALID_STATE;
+            }
+            p_link = link_get(BLE_CONN_HANDLE_INVALID);
+            if (p_link == NULL)
+            {
+                return NRF_ERROR_INVALID_STATE;
+            }
+            m_adv.active             = false;
+            p_link->conn_handle      = conn_handle;
+            p_link->central          = SD_SIM_CENTRAL_NONE;
+            p_link->conn_interval_us = p_ble_evt->evt.gap_evt.params.connected.conn_params.max_conn_interval * 1250;
+            p_link->tx_head          = 0;
+            p_link->tx_count         = 0;
+            memset(p_link->cccd, 0, sizeof(p_link->cccd));
+            break;
+
+        case BLE_GAP_EVT_TIMEOUT:
+            if (p_ble_evt->evt.gap_evt.params.timeout.src == BLE_GAP_TIMEOUT_SRC_ADVERTISING)
+            {
+                m_adv.active = false;
+            }
+            break;
+
+        default:
+            // The other events belong to a link.
+            if ((p_link == NULL) || (conn_handle == BLE_CONN_HANDLE_INVALID))
+            {
+                return NRF_ERROR_INVALID_STATE;
+            }
+            break;
+    }
+
+    switch (p_ble_evt->header.evt_id)
+    {
+        case BLE_GAP_EVT_DISCONNECTED:
+            p_link->conn_handle = BLE_CONN_HANDLE_INVALID;
+            p_link->tx_count    = 0;
+            memset(p_link->cccd, 0, sizeof(p_link->cccd));
+            break;
+
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+            p_link->conn_interval_us = p_ble_evt->evt.gap_evt.params.conn_param_update.conn_params.max_conn_interval * 1250;
+            break;
+
+        case BLE_GATTS_EVT_WRITE:
+            p_write = &p_ble_evt->evt.gatts_evt.params.write;
+            if (!handle_is_valid(p_write->handle) || (p_write->len > m_attrs[p_write->handle].max_len))
+            {
+                return NRF_ERROR_INVALID_STATE;
+            }
+            if (m_attrs[p_write->handle].is_cccd)
+            {
+                if (p_write->len != BLE_CCCD_VALUE_LEN)
+                {
+                    return NRF_ERROR_INVALID_STATE;
+                }
+                memcpy(p_link->cccd[p_write->handle], p_write->data, p_write->len);
+            }
+            else
+            {
+                memcpy(m_attrs[p_write->handle].value, p_write->data, p_write->len);
+                m_attrs[p_write->handle].len = p_write->len;
+            }
+            len += p_write->len;
+            break;
+
+        case BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST:
+            if (p_ble_evt->evt.gatts_evt.params.authorize_request.type == BLE_GATTS_AUTHORIZE_TYPE_WRITE)
+            {
+                len += MIN(p_ble_evt->evt.gatts_evt.params.authorize_request.request.write.len, SD_SIM_MAX_ATTR_LEN);
+            }
+            break;
+
+        case BLE_EVT_TX_COMPLETE:
+            m_stats.conn_events++;
+            m_stats.tx_complete_evts++;
+            (void)tx_deliver(p_link, p_ble_evt->evt.common_evt.params.tx_complete.count);
+            break;
+
+        default:
+            break;
+    }
+
+    p_evt = evt_prepare(p_ble_evt->header.evt_id);
+    memcpy(p_evt, p_ble_evt, len);
+    evt_raise(p_evt);
+    return NRF_SUCCESS;
+}
+
+/* Returns the time of the next radio notification signal, TIME_NEVER if none is due. t_radio is the time of
+ * the next radio event. */
+static uint64_t radio_signal_time(uint64_t t_radio)
+{
+    uint64_t t_active = TIME_NEVER;
+
+    if (m_radio.handler == NULL)
+    {
+        return TIME_NEVER;
+    }
+    if (t_radio != TIME_NEVER)
+    {
+        t_active = (t_radio > m_radio.distance_us) ? (t_radio - m_radio.distance_us) : 0;
+    }
+
+    if (!m_radio.active)
+    {
+        return (t_active == TIME_NEVER) ? TIME_NEVER : MAX(t_active, m_stats.time_us);
+    }
+
+    // Idle once the signalled event has run, unless the next one is signalled before it ends.
+    if ((m_radio.busy_until_us > m_radio.signalled_us) && (m_radio.busy_until_us <= t_active))
+    {
+        return MAX(m_radio.busy_until_us, m_stats.time_us);
+    }
+    return TIME_NEVER;
+}
+
+static void radio_signal_raise(uint64_t t_radio)
+{
+    m_radio.active       = !m_radio.active;
+    m_radio.signalled_us = t_radio;
+    m_stats.radio_signals++;
+    m_radio.handler(m_radio.active);
+}
+
+/* Skips the connection and advertising events starting before end_us. */
+static void radio_events_skip(uint64_t end_us)
+{
+    uint8_t i;
+
+    for (i = 0; i < m_config.link_count; i++)
+    {
+        while ((m_links[i].conn_handle != BLE_CONN_HANDLE_INVALID) && (m_links[i].next_conn_event_us < end_us))
+        {
+            m_links[i].next_conn_event_us += m_links[i].conn_interval_us;
+            m_stats.radio_events_skipped++;
+        }
+    }
+    while (m_adv.active && (m_adv.next_event_us < end_us))
+    {
+        m_adv.next_event_us += (m_adv.params.type == BLE_GAP_ADV_TYPE_ADV_DIRECT_IND)
+                               ? ADV_HIGH_DUTY_INTERVAL_US : (uint64_t)m_adv.params.interval * ADV_UNIT_US;
+        m_stats.radio_events_skipped++;
+    }
+}
+
+/* Carries out the pending flash operation if it ends before the next radio event, t_radio, or if it has been
+ * blocked SD_SIM_FLASH_ATTEMPTS times. */
+static void flash_attempt(uint64_t t_radio)
+{
+    uint32_t i;
+
+    if ((t_radio != TIME_NEVER) && (m_stats.time_us + m_flash.duration_us > t_radio))
+    {
+        if (m_flash.attempts < SD_SIM_FLASH_ATTEMPTS)
+        {
+            m_stats.flash_blocked++;
+            m_flash.attempts++;
+            m_flash.ready_us = t_radio;
+            return;
+        }
+        radio_events_skip(m_stats.time_us + m_flash.duration_us);
+    }
+
+    m_stats.time_us += m_flash.duration_us;
+    m_stats.flash_ops++;
+    if (m_flash.erase)
+    {
+        memset(m_flash.p_dst, 0xFF, SD_SIM_FLASH_PAGE_SIZE);
+    }
+    else
+    {
+        // Writing can only clear bits.
+        for (i = 0; i < m_flash.words; i++)
+        {
+            m_flash.p_dst[i] &= m_flash.p_src[i];
+        }
+    }
+
+    m_flash.pending        = false;
+    m_stats.flash_wait_us += m_stats.time_us - m_flash.started_us;
+    if (m_sys_evt_handler != NULL)
+    {
+        m_sys_evt_handler(NRF_EVT_FLASH_OPERATION_SUCCESS);
+    }
+}
+
+/* Returns the running timer that expires first, NULL if none runs. */
+static app_timer_t * timer_next(void)
+{
+    app_timer_t * p_next = NULL;
+    uint8_t       i;
+
+    for (i = 0; i < m_timer_count; i++)
+    {
+        if (m_timers[i]->running && ((p_next == NULL) || (m_timers[i]->expires_us < p_next->expires_us)))
+        {
+            p_next = m_timers[i];
+        }
+    }
+    return p_next;
+}
+
+static void timer_run(app_timer_t * p_timer)
+{
+    if (p_timer->mode == APP_TIMER_MODE_REPEATED)
+    {
+        p_timer->expires_us += p_timer->interval_us;
+    }
+    else
+    {
+        p_timer->running = false;
+    }
+    p_timer->handler(p_timer->p_context);
+}
+
+void sd_sim_run(uint32_t duration_us)
+{
+    uint64_t end = m_stats.time_us + duration_us;
+
+    for (;;)
+    {
+        sim_link_t  * p_link   = link_next_event();
+        app_timer_t * p_timer  = timer_next();
+        uint64_t      t_conn   = (p_link != NULL) ? p_link->next_conn_event_us : TIME_NEVER;
+        uint64_t      t_adv    = m_adv.active ? m_adv.next_event_us : TIME_NEVER;
+        uint64_t      t_end    = (m_adv.active && (m_adv.end_us != 0)) ? m_adv.end_us : TIME_NEVER;
+        uint64_t      t_radio  = MIN(t_conn, t_adv);
+        uint64_t      t_signal = radio_signal_time(t_radio);
+        uint64_t      t_timer  = (p_timer != NULL) ? p_timer->expires_us : TIME_NEVER;
+        uint64_t      t_flash  = m_flash.pending ? MAX(m_flash.ready_us, m_radio.busy_until_us) : TIME_NEVER;
+        uint64_t      t_next   = MIN(MIN(MIN(t_signal, t_conn), MIN(t_end, t_adv)), MIN(t_timer, t_flash));
+
+        if (t_next > end)
+        {
+            break;
+        }
+        m_stats.time_us = MAX(m_stats.time_us, t_next);
+
+        // On a tie the radio signal goes first, then radio events, then the CPU side.
+        if (t_next == t_signal)
+        {
+            radio_signal_raise(t_radio);
+        }
+        else if (t_next == t_conn)
+        {
+            p_link->next_conn_event_us += p_link->conn_interval_us;
+            conn_event_run(p_link);
+        }
+        else if (t_next == t_end)
+        {
+            adv_timeout_run();
+        }
+        else if (t_next == t_adv)
+        {
+            adv_event_run();
+        }
+        else if (t_next == t_timer)
+        {
+            timer_run(p_timer);
+        }
+        else
+        {
+            flash_attempt(t_radio);
+        }
+    }
+    m_stats.time_us = MAX(m_stats.time_us, end);
+}
+
+uint64_t sd_sim_time_us_get(void)
+{
+    return m_stats.time_us;
+}
+
+void sd_sim_stats_get(sd_sim_stats_t * p_stats)
+{
+    *p_stats = m_stats;
+}
+
+bool ble_srv_is_notification_enabled(uint8_t const * p_encoded_data)
+{
+    return (uint16_decode(p_encoded_data) & 0x0001) != 0;
+}
+
+uint32_t sd_ble_uuid_vs_add(ble_uuid128_t const * p_vs_uuid, uint8_t * p_uuid_type)
+{
+    if ((p_vs_uuid == NULL) || (p_uuid_type == NULL))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    *p_uuid_type = BLE_UUID_TYPE_VENDOR_BEGIN + m_vs_uuid_count++;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_service_add(uint8_t type, ble_uuid_t const * p_uuid, uint16_t * p_handle)
+{
+    uint16_t handle;
+
+    if ((type != BLE_GATTS_SRVC_TYPE_PRIMARY) || (p_uuid == NULL) || (p_handle == NULL))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    handle = attr_add();
+    if (handle == BLE_GATT_HANDLE_INVALID)
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+    m_attrs[handle].uuid = *p_uuid;
+    *p_handle = handle;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_characteristic_add(uint16_t                   service_handle,
+                                         ble_gatts_char_md_t const * p_char_md,
+                                         ble_gatts_attr_t const    * p_attr_char_value,
+                                         ble_gatts_char_handles_t  * p_handles)
+{
+    uint16_t     decl;
+    uint16_t     value;
+    sim_attr_t * p_attr;
+
+    if (!handle_is_valid(service_handle) || (p_char_md == NULL) || (p_attr_char_value == NULL) || (p_handles == NULL))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if ((p_attr_char_value->max_len > SD_SIM_MAX_ATTR_LEN) || (p_attr_char_value->init_len > p_attr_char_value->max_len))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    memset(p_handles, 0, sizeof(ble_gatts_char_handles_t));
+
+    decl  = attr_add();
+    value = attr_add();
+    if ((decl == BLE_GATT_HANDLE_INVALID) || (value == BLE_GATT_HANDLE_INVALID))
+    {
+        return NRF_ERROR_NO_MEM;
+    }
+
+    p_attr          = &m_attrs[value];
+    p_attr->uuid    = *p_attr_char_value->p_uuid;
+    p_attr->props   = p_char_md->char_props;
+    p_attr->rd_auth = p_attr_char_value->p_attr_md->rd_auth;
+    p_attr->max_len = p_attr_char_value->max_len;
+    p_attr->len     = p_attr_char_value->init_len;
+    if (p_attr_char_value->p_value != NULL)
+    {
+        memcpy(p_attr->value, p_attr_char_value->p_value, p_attr->len);
+    }
+    p_handles->value_handle = value;
+
+    if (p_char_md->char_props.notify || p_char_md->char_props.indicate)
+    {
+        uint16_t cccd = attr_add();
+        if (cccd == BLE_GATT_HANDLE_INVALID)
+        {
+            return NRF_ERROR_NO_MEM;
+        }
+        m_attrs[cccd].is_cccd  = true;
+        m_attrs[cccd].max_len  = BLE_CCCD_VALUE_LEN;
+        m_attrs[cccd].len      = BLE_CCCD_VALUE_LEN;
+        p_attr->cccd_handle    = cccd;
+        p_handles->cccd_handle = cccd;
+    }
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_hvx(uint16_t conn_handle, ble_gatts_hvx_params_t const * p_hvx_params)
+{
+    sim_attr_t * p_attr;
+    sim_link_t * p_link = link_get(conn_handle);
+    uint16_t     len;
+    uint8_t      slot;
+
+    m_stats.hvx_calls++;
+
+    if ((p_link == NULL) || (conn_handle == BLE_CONN_HANDLE_INVALID))
+    {
+        m_stats.err_invalid_conn_handle++;
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+    if ((p_hvx_params == NULL) || !handle_is_valid(p_hvx_params->handle) || (p_hvx_params->type != BLE_GATT_HVX_NOTIFICATION))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    p_attr = &m_attrs[p_hvx_params->handle];
+    if ((p_attr->cccd_handle == 0) || !ble_srv_is_notification_enabled(p_link->cccd[p_attr->cccd_handle]))
+    {
+        m_stats.err_invalid_state++;
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    len = (p_hvx_params->p_len != NULL) ? *p_hvx_params->p_len : p_attr->len;
+    if (len > GATT_MTU_SIZE_DEFAULT - 3)
+    {
+        m_stats.err_data_size++;
+        return NRF_ERROR_DATA_SIZE;
+    }
+    if (p_link->tx_count >= m_config.tx_buffer_count)
+    {
+        m_stats.err_no_tx_packets++;
+        return BLE_ERROR_NO_TX_PACKETS;
+    }
+
+    if (p_hvx_params->p_data != NULL)
+    {
+        memcpy(p_attr->value, p_hvx_params->p_data, len);
+        p_attr->len = len;
+    }
+
+    slot = (uint8_t)(p_link->tx_head + p_link->tx_count);
+    p_link->tx_queue[slot].handle = p_hvx_params->handle;
+    p_link->tx_queue[slot].len    = len;
+    memcpy(p_link->tx_queue[slot].data, p_attr->value, len);
+    p_link->tx_count++;
+    m_stats.hvx_accepted++;
+
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_rw_authorize_reply(uint16_t conn_handle, ble_gatts_rw_authorize_reply_params_t const * p_rw_authorize_reply_params)
+{
+    if ((link_get(conn_handle) == NULL) || (conn_handle == BLE_CONN_HANDLE_INVALID))
+    {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+    if (p_rw_authorize_reply_params == NULL)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    m_reply = *p_rw_authorize_reply_params;
+    if (m_reply.params.read.update && (m_reply.params.read.p_data != NULL))
+    {
+        memcpy(m_reply_data, m_reply.params.read.p_data, MIN(m_reply.params.read.len, SD_SIM_MAX_ATTR_LEN));
+    }
+    m_reply_valid = true;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_tx_packet_count_get(uint16_t conn_handle, uint8_t * p_count)
+{
+    if ((link_get(conn_handle) == NULL) || (conn_handle == BLE_CONN_HANDLE_INVALID))
+    {
+        return BLE_ERROR_INVALID_CONN_HANDLE;
+    }
+    *p_count = m_config.tx_buffer_count;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gatts_value_get(uint16_t conn_handle, uint16_t handle, ble_gatts_value_t * p_value)
+{
+    sim_attr_t    * p_attr;
+    sim_link_t    * p_link = NULL;
+    uint8_t const * p_data;
+    uint16_t        attr_len;
+    uint16_t        len;
+
+    if (!handle_is_valid(handle))
+    {
+        return BLE_ERROR_INVALID_ATTR_HANDLE;
+    }
+    if (p_value == NULL)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    p_attr   = &m_attrs[handle];
+    p_data   = p_attr->value;
+    attr_len = p_attr->len;
+    // CCCD values belong to a connection.
+    if (p_attr->is_cccd)
+    {
+        p_link = link_get(conn_handle);
+        if ((p_link == NULL) || (conn_handle == BLE_CONN_HANDLE_INVALID))
+        {
+            return BLE_ERROR_INVALID_CONN_HANDLE;
+        }
+        p_data   = p_link->cccd[handle];
+        attr_len = BLE_CCCD_VALUE_LEN;
+    }
+    if (p_value->offset > attr_len)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    len = attr_len - p_value->offset;
+    if (p_value->p_value != NULL)
+    {
+        len = MIN(len, p_value->len);
+        memcpy(p_value->p_value, &p_data[p_value->offset], len);
+    }
+    p_value->len = len;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_adv_start(ble_gap_adv_params_t const * p_adv_params)
+{
+    uint8_t i;
+
+    if (p_adv_params == NULL)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (m_adv.active)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    if (link_get(BLE_CONN_HANDLE_INVALID) == NULL)
+    {
+        return NRF_ERROR_CONN_COUNT;
+    }
+
+    if (p_adv_params->type == BLE_GAP_ADV_TYPE_ADV_DIRECT_IND)
+    {
+        if (p_adv_params->p_peer_addr == NULL)
+        {
+            return NRF_ERROR_INVALID_PARAM;
+        }
+        m_adv.peer_addr     = *p_adv_params->p_peer_addr;
+        m_adv.next_event_us = m_stats.time_us;
+        m_adv.end_us        = m_stats.time_us + ADV_HIGH_DUTY_DURATION_US;
+    }
+    else if (p_adv_params->type == BLE_GAP_ADV_TYPE_ADV_IND)
+    {
+        if ((p_adv_params->interval < BLE_GAP_ADV_INTERVAL_MIN) || (p_adv_params->interval > BLE_GAP_ADV_INTERVAL_MAX))
+        {
+            return NRF_ERROR_INVALID_PARAM;
+        }
+        if ((p_adv_params->fp != BLE_GAP_ADV_FP_ANY) && (p_adv_params->p_whitelist == NULL))
+        {
+            return NRF_ERROR_INVALID_PARAM;
+        }
+        m_adv.whitelist_count = 0;
+        if (p_adv_params->fp != BLE_GAP_ADV_FP_ANY)
+        {
+            // Only addresses are matched, IRKs are not resolved.
+            for (i = 0; (i < p_adv_params->p_whitelist->addr_count) && (i < BLE_GAP_WHITELIST_ADDR_MAX_COUNT); i++)
+            {
+                m_adv.whitelist[m_adv.whitelist_count++] = *p_adv_params->p_whitelist->pp_addrs[i];
+            }
+        }
+        m_adv.next_event_us = m_stats.time_us + random_get(ADV_DELAY_MAX_US);
+        m_adv.end_us        = (p_adv_params->timeout != 0) ? (m_stats.time_us + p_adv_params->timeout * 1000000ULL) : 0;
+    }
+    else
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    m_adv.params = *p_adv_params;
+    m_adv.active = true;
+    m_stats.adv_starts++;
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_ble_gap_adv_stop(void)
+{
+    if (!m_adv.active)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+    m_adv.active = false;
+    return NRF_SUCCESS;
+}
+
+/* Queues a flash operation, tried at the next moment the radio is idle. */
+static void flash_queue(bool erase, uint32_t * p_dst, uint32_t const * p_src, uint32_t words)
+{
+    m_flash.pending     = true;
+    m_flash.erase       = erase;
+    m_flash.p_dst       = p_dst;
+    m_flash.p_src       = p_src;
+    m_flash.words       = words;
+    m_flash.duration_us = erase ? SD_SIM_FLASH_ERASE_US : words * SD_SIM_FLASH_WORD_US;
+    m_flash.started_us  = m_stats.time_us;
+    m_flash.ready_us    = m_stats.time_us;
+    m_flash.attempts    = 0;
+}
+
+uint32_t sd_flash_write(uint32_t * const p_dst, uint32_t const * const p_src, uint32_t size)
+{
+    uint32_t * p_end = m_flash_area + m_flash_page_count * (SD_SIM_FLASH_PAGE_SIZE / sizeof(uint32_t));
+
+    if (m_flash.pending)
+    {
+        return NRF_ERROR_BUSY;
+    }
+    if ((m_flash_area == NULL) || (p_src == NULL) || (p_dst < m_flash_area) || (p_dst + size > p_end))
+    {
+        return NRF_ERROR_INVALID_ADDR;
+    }
+    if ((size == 0) || (size > SD_SIM_FLASH_PAGE_SIZE / sizeof(uint32_t)))
+    {
+        return NRF_ERROR_INVALID_LENGTH;
+    }
+
+    flash_queue(false, p_dst, p_src, size);
+    return NRF_SUCCESS;
+}
+
+uint32_t sd_flash_page_erase(uint32_t page_number)
+{
+    if (m_flash.pending)
+    {
+        return NRF_ERROR_BUSY;
+    }
+    if (page_number >= m_flash_page_count)
+    {
+        return NRF_ERROR_INVALID_ADDR;
+    }
+
+    flash_queue(true, m_flash_area + page_number * (SD_SIM_FLASH_PAGE_SIZE / sizeof(uint32_t)), NULL, 0);
+    return NRF_SUCCESS;
+}
+
+uint32_t ble_radio_notification_init(uint32_t                             irq_priority,
+                                     uint8_t                              distance,
+                                     ble_radio_notification_evt_handler_t evt_handler)
+{
+    static const uint32_t distance_us[] = {0, 800, 1740, 2680, 3620, 4560, 5500};
+
+    UNUSED_PARAMETER(irq_priority);
+
+    if (distance >= sizeof(distance_us) / sizeof(distance_us[0]))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+
+    m_radio.handler     = (distance == NRF_RADIO_NOTIFICATION_DISTANCE_NONE) ? NULL : evt_handler;
+    m_radio.distance_us = distance_us[distance];
+    m_radio.active      = false;
+    return NRF_SUCCESS;
+}
+
+/* Converts app_timer ticks to microseconds. */
+static uint64_t timer_ticks_to_us(uint32_t ticks)
+{
+    return (uint64_t)ticks * 1000000 * (m_timer_prescaler + 1) / APP_TIMER_CLOCK_FREQ;
+}
+
+uint32_t app_timer_init(uint32_t prescaler, uint8_t op_queues_size, void * p_buffer, void * evt_schedule_func)
+{
+    UNUSED_PARAMETER(op_queues_size);
+    UNUSED_PARAMETER(p_buffer);
+    UNUSED_PARAMETER(evt_schedule_func);
+
+    m_timer_prescaler = prescaler;
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_create(app_timer_id_t const * p_timer_id, app_timer_mode_t mode, app_timer_timeout_handler_t timeout_handler)
+{
+    app_timer_t * p_timer;
+    uint8_t       i;
+
+    if ((p_timer_id == NULL) || (*p_timer_id == NULL) || (timeout_handler == NULL))
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    p_timer = *p_timer_id;
+
+    for (i = 0; (i < m_timer_count) && (m_timers[i] != p_timer); i++)
+    {
+    }
+    if (i == m_timer_count)
+    {
+        if (m_timer_count == SD_SIM_MAX_TIMERS)
+        {
+            return NRF_ERROR_NO_MEM;
+        }
+        m_timers[m_timer_count++] = p_timer;
+    }
+
+    memset(p_timer, 0, sizeof(*p_timer));
+    p_timer->handler = timeout_handler;
+    p_timer->mode    = mode;
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_start(app_timer_id_t timer_id, uint32_t timeout_ticks, void * p_context)
+{
+    if (timeout_ticks < APP_TIMER_MIN_TIMEOUT_TICKS)
+    {
+        return NRF_ERROR_INVALID_PARAM;
+    }
+    if (timer_id->handler == NULL)
+    {
+        return NRF_ERROR_INVALID_STATE;
+    }
+
+    timer_id->interval_us = (uint32_t)timer_ticks_to_us(timeout_ticks);
+    timer_id->expires_us  = m_stats.time_us + timer_id->interval_us;
+    timer_id->p_context   = p_context;
+    timer_id->running     = true;
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_stop(app_timer_id_t timer_id)
+{
+    timer_id->running = false;
+    return NRF_SUCCESS;
+}
+
+uint32_t app_timer_cnt_get(uint32_t * p_ticks)
+{
+    *p_ticks = (uint32_t)(m_stats.time_us * APP_TIMER_CLOCK_FREQ / (1000000ULL * (m_timer_prescaler + 1))) & 0x00FFFFFF;
+    return NRF_SUCCESS;
+}
@@ -0,0 +1,170 @@
+#ifndef SD_SIM_H__
+#define SD_SIM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "ble.h"
+
+/* SoftDevice simulator for running the application services on the host.
+ *
+ * Implements the sd_ble_* calls declared in ble.h on a simulated GATT table and up to link_count peripheral
+ * links. Time is virtual and only advances in sd_sim_run(). Every connection interval of a link one
+ * connection event takes place: up to packets_per_event notifications queued on the link go on air, its TX
+ * buffers are released and BLE_EVT_TX_COMPLETE reports how many, as the SoftDevice does. Each link has its
+ * own TX buffers, CCCD values and connection events, links do not compete for radio time. The peer side is
+ * driven with sd_sim_peer_*(). Events are passed to the handler given to sd_sim_init(), synchronously.
+ *
+ * Advertising started with sd_ble_gap_adv_start() runs in virtual time as well: undirected events come
+ * every interval plus a random 0-10 ms delay, high duty directed ones every 3.75 ms for 1.28 s. Centrals
+ * added with sd_sim_central_add() scan with their own window and interval and connect to the first
+ * advertising event they receive and are allowed to by the filter policy: directed events only to the
+ * addressed central, whitelisted ones only to centrals in the whitelist. Bonded centrals get the CCCD
+ * values they wrote back on reconnection, as the peer manager restores them, followed by
+ * BLE_GAP_EVT_CONN_SEC_UPDATE when the link is encrypted. Advertising can be started while links are
+ * free, a central takes the connection handle of the link it gets.
+ *
+ * Radio events take radio time: SD_SIM_EMPTY_EVENT_US per connection event plus SD_SIM_PACKET_US per
+ * notification sent, SD_SIM_ADV_EVENT_US per advertising event. The radio notification signal of
+ * ble_radio_notification_init() is raised the given distance before a radio event and cleared when the
+ * radio goes idle; events closer together than the distance share one signal. Flash operations started with
+ * sd_flash_write() and sd_flash_page_erase() compete with the radio for time as in the SoftDevice: an
+ * operation runs at the first moment the radio is idle if it ends before the next radio event, otherwise it
+ * is blocked and tried again after that event. After SD_SIM_FLASH_ATTEMPTS blocked attempts it takes
+ * priority: it runs at the next idle moment and the connection and advertising events in its way are
+ * skipped. NRF_EVT_FLASH_OPERATION_SUCCESS goes to the handler of sd_sim_sys_evt_handler_set(), the
+ * operations do not fail. The CPU is halted while flash is written, events and timeouts due in that time
+ * are raised after it. The
+ * app_timer calls are implemented on virtual time as well. */
+
+#define SD_SIM_MAX_ATTRS            32                                  /**< Attributes in the simulated GATT table. */
+#define SD_SIM_MAX_ATTR_LEN         64                                  /**< Longest attribute value (in bytes). */
+#define SD_SIM_TX_BUFFERS_DEFAULT   7                                   /**< Application TX buffers of S132 v2 with default bandwidth. */
+#define SD_SIM_PACKETS_PER_EVENT    6                                   /**< Packets the link fits into one connection event. */
+#define SD_SIM_MAX_CENTRALS         4                                   /**< Centrals that can be added. */
+#define SD_SIM_CENTRAL_NONE         0xFF                                /**< Returned by sd_sim_central_add() when there is no room. */
+#define SD_SIM_MAX_LINKS            4                                   /**< Upper bound of link_count. */
+#define SD_SIM_EMPTY_EVENT_US       310                                 /**< Radio time of a connection event without data, an empty packet each way. */
+#define SD_SIM_PACKET_US            680                                 /**< Radio time added by a notification, the packet, its acknowledgment and the gaps. */
+#define SD_SIM_ADV_EVENT_US         1500                                /**< Radio time of an advertising event on three channels. */
+#define SD_SIM_FLASH_PAGE_SIZE      4096                                /**< Flash page size (in bytes). */
+#define SD_SIM_FLASH_WORD_US        68                                  /**< Time to write one flash word. */
+#define SD_SIM_FLASH_ERASE_US       85000                               /**< Time to erase a flash page. */
+#define SD_SIM_FLASH_ATTEMPTS       4                                   /**< Blocked attempts after which a flash operation takes priority over the radio. */
+#define SD_SIM_MAX_TIMERS           16                                  /**< Timers that can be created with app_timer_create(). */
+
+typedef void (*sd_sim_evt_handler_t)(ble_evt_t * p_ble_evt);
+
+/* Called for every system event (NRF_EVT_*), as the handler given to softdevice_sys_evt_handler_set(). */
+typedef void (*sd_sim_sys_evt_handler_t)(uint32_t sys_evt);
+
+/* Called for every notification a peer receives. */
+typedef void (*sd_sim_peer_rx_handler_t)(uint16_t conn_handle, uint16_t handle, uint8_t const * p_data, uint16_t len);
+
+typedef struct
+{
+    uint8_t  tx_buffer_count;           /**< Notifications the SoftDevice can hold per link before BLE_ERROR_NO_TX_PACKETS. */
+    uint8_t  packets_per_event;         /**< Notifications sent per connection event. */
+    uint32_t conn_interval_us;          /**< Connection interval of new links. */
+    uint8_t  link_count;                /**< Peripheral links, as periph_conn_count of sd_ble_enable(). 0 is taken as 1. */
+} sd_sim_config_t;
+
+/* Central connecting to the advertising application. */
+typedef struct
+{
+    ble_gap_addr_t addr;
+    bool           bonded;              /**< CCCDs are kept across connections and the link gets encrypted. */
+    uint32_t       scan_interval_us;
+    uint32_t       scan_window_us;      /**< Equal to scan_interval_us for continuous scanning. */
+} sd_sim_central_t;
+
+/* Counters of the simulated SoftDevice. */
+typedef struct
+{
+    uint64_t time_us;                   /**< Virtual time. */
+    uint32_t conn_events;
+    uint32_t hvx_calls;
+    uint32_t hvx_accepted;              /**< Notifications queued for transmission. */
+    uint32_t notifications_sent;        /**< Notifications received by the peers, all links together. */
+    uint32_t bytes_sent;                /**< Payload bytes received by the peers. */
+    uint32_t tx_complete_evts;
+    uint32_t err_no_tx_packets;
+    uint32_t err_invalid_state;         /**< Not connected or notifications not enabled in the CCCD. */
+    uint32_t err_invalid_conn_handle;
+    uint32_t err_data_size;
+    uint32_t adv_starts;
+    uint32_t adv_events;                /**< Advertising events on air. */
+    uint32_t adv_timeouts;
+    uint32_t radio_signals;             /**< Radio notification signals raised, active and idle. */
+    uint32_t flash_ops;                 /**< Flash writes and erases carried out. */
+    uint32_t flash_blocked;             /**< Attempts of flash operations that did not fit before the next radio event. */
+    uint32_t radio_events_skipped;      /**< Connection and advertising events lost to flash operations. */
+    uint64_t flash_wait_us;             /**< Time from sd_flash_*() to the system event, all operations together. */
+} sd_sim_stats_t;
+
+/* Function for resetting the simulator. p_config may be NULL for the defaults. */
+void sd_sim_init(sd_sim_config_t const * p_config, sd_sim_evt_handler_t evt_handler);
+
+/* Function for setting the handler receiving the notifications on the peer side. */
+void sd_sim_peer_rx_handler_set(sd_sim_peer_rx_handler_t handler);
+
+/* Function for setting the handler receiving the system events. */
+void sd_sim_sys_evt_handler_set(sd_sim_sys_evt_handler_t handler);
+
+/* Function for giving the flash that sd_flash_write() and sd_flash_page_erase() work on. Page numbers count
+ * from p_flash. Write destinations are host addresses and must lie in it. */
+void sd_sim_flash_set(uint32_t * p_flash, uint32_t page_count);
+
+/* Function for connecting a simulated peer on a free link. Raises BLE_GAP_EVT_CONNECTED. Returns
+ * NRF_ERROR_CONN_COUNT if all links are up, NRF_ERROR_INVALID_PARAM if the handle is in use. */
+uint32_t sd_sim_connect(uint16_t conn_handle);
+
+/* Function for disconnecting a peer. Queued notifications are dropped. Raises BLE_GAP_EVT_DISCONNECTED. */
+void sd_sim_disconnect(uint16_t conn_handle, uint8_t reason);
+
+/* Function for changing the connection interval of a link. Raises BLE_GAP_EVT_CONN_PARAM_UPDATE. */
+void sd_sim_conn_interval_set(uint16_t conn_handle, uint32_t conn_interval_us);
+
+/* Function for adding a central. Returns its index, SD_SIM_CENTRAL_NONE if there is no room. Centrals do
+ * not connect until sd_sim_central_initiate() is called. */
+uint8_t sd_sim_central_add(sd_sim_central_t const * p_central);
+
+/* Function for making a central scan for the application and connect to it, or stop doing so. */
+void sd_sim_central_initiate(uint8_t index, bool enable);
+
+/* Returns the connection handle of a central, BLE_CONN_HANDLE_INVALID if it is not connected. */
+uint16_t sd_sim_central_conn_handle(uint8_t index);
+
+/* Returns the number of links up. */
+uint8_t sd_sim_link_count(void);
+
+/* Function for seeding the random advertising delays and scan window phases. */
+void sd_sim_seed_set(uint32_t seed);
+
+/* Function for a write of the peer on a link to an attribute. Raises BLE_GATTS_EVT_WRITE. */
+uint32_t sd_sim_peer_write(uint16_t conn_handle, uint16_t handle, uint8_t const * p_data, uint16_t len);
+
+/* Function for a read of the peer on a link of an attribute. For attributes with read authorization this
+ * raises BLE_GATTS_EVT_RW_AUTHORIZE_REQUEST and returns what the application replied with. *p_len holds the
+ * buffer size on entry. */
+uint32_t sd_sim_peer_read(uint16_t conn_handle, uint16_t handle, uint16_t offset, uint8_t * p_data, uint16_t * p_len);
+
+/* Function for replaying a recorded event at virtual time time_us, or now if that has passed. The simulator
+ * takes on the state the event implies instead of raising events of its own: CONNECTED takes a free link,
+ * DISCONNECTED frees it, CONN_PARAM_UPDATE sets its interval, WRITE stores the value or the CCCD of the link
+ * and TX_COMPLETE delivers that many queued notifications to the peer. Then the event is raised. Connection
+ * events do not run, so sd_sim_run() must not be mixed in. Returns NRF_ERROR_INVALID_STATE without raising
+ * the event if it does not fit the state, such as a connection without a free link. Write data follows the
+ * event as the SoftDevice places it. */
+uint32_t sd_sim_replay(ble_evt_t const * p_ble_evt, uint64_t time_us);
+
+/* Function for advancing virtual time, running the radio events, flash operations and timeouts that fall
+ * into it. */
+void sd_sim_run(uint32_t duration_us);
+
+/* Returns the virtual time. During a connection event it is the time of the event. */
+uint64_t sd_sim_time_us_get(void);
+
+/* Function for reading the counters. */
+void sd_sim_stats_get(sd_sim_stats_t * p_stats);
+
+#endif // SD_SIM_H__
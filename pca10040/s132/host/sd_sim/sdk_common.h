@@ -0,0 +1,81 @@
+#ifndef SDK_COMMON_H__
+#define SDK_COMMON_H__
+
+/* Host replacement for the SDK common header, covering what the SDC service uses. */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include "app_error.h"
+
+typedef uint32_t ret_code_t;
+
+#define NRF_ERROR_BASE_NUM          0x0
+#define NRF_SUCCESS                 (NRF_ERROR_BASE_NUM + 0)
+#define NRF_ERROR_NO_MEM            (NRF_ERROR_BASE_NUM + 4)
+#define NRF_ERROR_NOT_FOUND         (NRF_ERROR_BASE_NUM + 5)
+#define NRF_ERROR_INVALID_PARAM     (NRF_ERROR_BASE_NUM + 7)
+#define NRF_ERROR_INVALID_STATE     (NRF_ERROR_BASE_NUM + 8)
+#define NRF_ERROR_INVALID_LENGTH    (NRF_ERROR_BASE_NUM + 9)
+#define NRF_ERROR_DATA_SIZE         (NRF_ERROR_BASE_NUM + 12)
+#define NRF_ERROR_INVALID_ADDR      (NRF_ERROR_BASE_NUM + 16)
+#define NRF_ERROR_NULL              (NRF_ERROR_BASE_NUM + 14)
+#define NRF_ERROR_BUSY              (NRF_ERROR_BASE_NUM + 17)
+#define NRF_ERROR_CONN_COUNT        (NRF_ERROR_BASE_NUM + 18)
+
+#define UNUSED_PARAMETER(X)         (void)(X)
+
+#ifndef MIN
+#define MIN(a, b)                   (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b)                   (((a) < (b)) ? (b) : (a))
+#endif
+
+#define VERIFY_SUCCESS(err_code)            \
+do                                          \
+{                                           \
+    if ((err_code) != NRF_SUCCESS)          \
+    {                                       \
+        return (err_code);                  \
+    }                                       \
+} while (0)
+
+#define VERIFY_PARAM_NOT_NULL(param)        \
+do                                          \
+{                                           \
+    if ((param) == NULL)                    \
+    {                                       \
+        return NRF_ERROR_NULL;              \
+    }                                       \
+} while (0)
+
+static inline uint8_t uint16_encode(uint16_t value, uint8_t * p_encoded_data)
+{
+    p_encoded_data[0] = (uint8_t)value;
+    p_encoded_data[1] = (uint8_t)(value >> 8);
+    return sizeof(uint16_t);
+}
+
+static inline uint8_t uint32_encode(uint32_t value, uint8_t * p_encoded_data)
+{
+    p_encoded_data[0] = (uint8_t)value;
+    p_encoded_data[1] = (uint8_t)(value >> 8);
+    p_encoded_data[2] = (uint8_t)(value >> 16);
+    p_encoded_data[3] = (uint8_t)(value >> 24);
+    return sizeof(uint32_t);
+}
+
+static inline uint16_t uint16_decode(const uint8_t * p_encoded_data)
+{
+    return (uint16_t)(p_encoded_data[0] | (p_encoded_data[1] << 8));
+}
+
+static inline uint32_t uint32_decode(const uint8_t * p_encoded_data)
+{
+    return (uint32_t)p_encoded_data[0]         | ((uint32_t)p_encoded_data[1] << 8)
+         | ((uint32_t)p_encoded_data[2] << 16) | ((uint32_t)p_encoded_data[3] << 24);
+}
+
+#endif // SDK_COMMON_H__
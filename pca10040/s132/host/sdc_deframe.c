@@ -0,0 +1,328 @@
+/* Reference deframer for the notifications of the SDC service.
+ *
+ * Reads notifications as hex bytes, one per line, from a file or stdin. Lines holding "value:" are taken
+ * from there on, so the output of gatttool --listen can be piped in as is. Prints every frame decoded by
+ * stream, reports gaps in the sequence numbers of each stream and reassembles the history transfer into
+ * blocks, decoded with the history codec of the firmware. Exits with 1 if a notification was malformed.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -Isd_sim -I../arm5_no_packs sdc_deframe.c ../arm5_no_packs/sdc_frame.c \
+ *       ../arm5_no_packs/history_codec.c -o sdc_deframe
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "sdc_frame.h"
+#include "history_codec.h"
+#include "history_log.h"
+
+static char const * const m_stream_names[SDC_STREAM_COUNT] = { "event", "value", "summary", "history", "bench" };
+
+static bool                     m_seq_valid[SDC_STREAM_COUNT];
+static uint8_t                  m_seq_next[SDC_STREAM_COUNT];
+static uint32_t                 m_frames[SDC_STREAM_COUNT];
+static uint32_t                 m_lost[SDC_STREAM_COUNT];
+static uint32_t                 m_malformed;
+
+static history_block_t          m_block;                                /**< History block being reassembled. */
+static uint16_t                 m_block_len;
+static bool                     m_block_broken;                         /**< A frame of the block was lost, skip to the next magic. */
+static uint32_t                 m_blocks;
+
+
+static uint16_t u16_get(uint8_t const * p)
+{
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t u32_get(uint8_t const * p)
+{
+    return p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static char const * event_name(uint8_t code)
+{
+    switch (code)
+    {
+        case HISTORY_EVENT_BOOT:         return "boot";
+        case HISTORY_EVENT_CONNECTED:    return "connected";
+        case HISTORY_EVENT_DISCONNECTED: return "disconnected";
+        case HISTORY_EVENT_BATTERY_LOW:  return "battery low";
+        default:                         return "unknown";
+    }
+}
+
+static void block_print(void)
+{
+    history_decoder_t decoder;
+    history_item_t    item;
+
+    printf("  block seq %u, t_base %u, %u slots of %u s, %u bytes\n",
+           m_block.header.seq, m_block.header.t_base, m_block.header.slot_count, m_block.header.period_s, m_block_len);
+
+    history_decoder_init(&decoder, &m_block);
+    while (history_decoder_next(&decoder, &item))
+    {
+        switch (item.type)
+        {
+            case HISTORY_ITEM_SAMPLE:
+                printf("    %10u  value %u x%u\n", item.time, item.value, item.slots);
+                break;
+
+            case HISTORY_ITEM_GAP:
+                printf("    %10u  gap of %u slots\n", item.time, item.slots);
+                break;
+
+            case HISTORY_ITEM_EVENT:
+                printf("    %10u  event %s\n", item.time, event_name(item.value));
+                break;
+        }
+    }
+    m_blocks++;
+}
+
+/* Appends history bytes to the block being reassembled. Blocks follow each other without padding, the
+ * header tells the length. */
+static void history_put(uint8_t const * p_data, uint8_t len)
+{
+    uint16_t need;
+
+    while (len > 0)
+    {
+        if (m_block_broken)
+        {
+            // Resynchronize on the magic of the next block, which can only start at a frame boundary if the
+            // lost frame ended a block. Otherwise the rest of the transfer is skipped.
+            if ((len < 2) || (u16_get(p_data) != HISTORY_BLOCK_MAGIC))
+            {
+                return;
+            }
+            m_block_broken = false;
+            m_block_len    = 0;
+        }
+
+        need = sizeof(history_block_header_t);
+        if (m_block_len >= sizeof(history_block_header_t))
+        {
+            need += m_block.header.data_len;
+            if ((m_block.header.magic != HISTORY_BLOCK_MAGIC) || (m_block.header.data_len > HISTORY_BLOCK_DATA_SIZE))
+            {
+                printf("  bad block header\n");
+                m_block_broken = true;
+                continue;
+            }
+        }
+
+        need -= m_block_len;
+        if (need > len)
+        {
+            need = len;
+        }
+        memcpy((uint8_t *)&m_block + m_block_len, p_data, need);
+        m_block_len += need;
+        p_data      += need;
+        len         -= need;
+
+        if ((m_block_len >= sizeof(history_block_header_t))
+            && (m_block_len == sizeof(history_block_header_t) + m_block.header.data_len))
+        {
+            if (history_block_is_valid(&m_block, m_block_len))
+            {
+                block_print();
+            }
+            else
+            {
+                printf("  invalid block\n");
+            }
+            m_block_len = 0;
+        }
+    }
+}
+
+static void frame_print(sdc_frame_view_t const * p_frame)
+{
+    uint8_t const * p = p_frame->p_payload;
+
+    printf("%-8s #%3u ", m_stream_names[p_frame->stream], p_frame->seq);
+
+    switch (p_frame->stream)
+    {
+        case SDC_STREAM_EVENT:
+            if (p_frame->len >= 3)
+            {
+                printf("%s, stamp %u\n", event_name(p[0]), u16_get(&p[1]));
+                return;
+            }
+            break;
+
+        case SDC_STREAM_VALUE:
+            if (p_frame->len >= 3)
+            {
+                printf("value %u, stamp %u\n", p[0], u16_get(&p[1]));
+                return;
+            }
+            break;
+
+        case SDC_STREAM_SUMMARY:
+            if (p_frame->len >= 18)
+            {
+                printf("stamp %u, %u s, count %u, min %u, max %u, mean %.2f, variance %.2f, above %.1f s\n",
+                       u16_get(&p[0]), u16_get(&p[2]), u32_get(&p[4]), p[8], p[9],
+                       u16_get(&p[10]) / 256.0, u32_get(&p[12]) / 256.0, u16_get(&p[16]) / 10.0);
+                return;
+            }
+            break;
+
+        case SDC_STREAM_HISTORY:
+            if (p_frame->len == 0)
+            {
+                printf("end of transfer\n");
+                if (m_block_len != 0)
+                {
+                    printf("  incomplete block dropped\n");
+                }
+                m_block_len    = 0;
+                m_block_broken = false;
+            }
+            else
+            {
+                printf("%u bytes\n", p_frame->len);
+                history_put(p, p_frame->len);
+            }
+            return;
+
+        case SDC_STREAM_BENCH:
+            if (p_frame->len >= 8)
+            {
+                printf("seq %u, sent at %u us\n", u32_get(&p[0]), u32_get(&p[4]));
+                return;
+            }
+            break;
+
+        default:
+            break;
+    }
+    printf("%u bytes, too short\n", p_frame->len);
+}
+
+static void frame_handle(sdc_frame_view_t const * p_frame)
+{
+    uint8_t stream = p_frame->stream;
+
+    if (stream >= SDC_STREAM_COUNT)
+    {
+        printf("stream %u #%3u, %u bytes\n", stream, p_frame->seq, p_frame->len);
+        return;
+    }
+
+    if (m_seq_valid[stream] && (p_frame->seq != m_seq_next[stream]))
+    {
+        uint8_t lost = (uint8_t)(p_frame->seq - m_seq_next[stream]);
+
+        printf("%-8s %u frames lost\n", m_stream_names[stream], lost);
+        m_lost[stream] += lost;
+        if (stream == SDC_STREAM_HISTORY)
+        {
+            m_block_broken = true;
+        }
+    }
+    m_seq_valid[stream] = true;
+    m_seq_next[stream]  = p_frame->seq + 1;
+    m_frames[stream]++;
+
+    frame_print(p_frame);
+}
+
+/* Parses the hex bytes of a line. Returns the number of bytes. */
+static uint16_t hex_parse(char const * p_line, uint8_t * p_buf, uint16_t buf_len)
+{
+    char const * p_value = strstr(p_line, "value:");
+    uint16_t     len = 0;
+    int          hi = -1;
+
+    if (p_value != NULL)
+    {
+        p_line = p_value + 6;
+    }
+
+    for (; *p_line != '\0'; p_line++)
+    {
+        int nibble;
+
+        if (!isxdigit((unsigned char)*p_line))
+        {
+            hi = -1;
+            continue;
+        }
+        nibble = isdigit((unsigned char)*p_line) ? (*p_line - '0') : (tolower((unsigned char)*p_line) - 'a' + 10);
+        if (hi < 0)
+        {
+            hi = nibble;
+        }
+        else
+        {
+            if (len < buf_len)
+            {
+                p_buf[len++] = (uint8_t)((hi << 4) | nibble);
+            }
+            hi = -1;
+        }
+    }
+    return len;
+}
+
+int main(int argc, char ** argv)
+{
+    FILE           * p_file = stdin;
+    char             line[512];
+    uint8_t          notif[64];
+    uint16_t         len;
+    uint16_t         pos;
+    sdc_frame_view_t frame;
+    uint8_t          stream;
+
+    if (argc > 1)
+    {
+        p_file = fopen(argv[1], "r");
+        if (p_file == NULL)
+        {
+            perror(argv[1]);
+            return 2;
+        }
+    }
+
+    while (fgets(line, sizeof(line), p_file) != NULL)
+    {
+        if (line[0] == '#')
+        {
+            continue;
+        }
+        len = hex_parse(line, notif, sizeof(notif));
+        if (len == 0)
+        {
+            continue;
+        }
+
+        pos = 0;
+        while (sdc_frame_next(notif, len, &pos, &frame))
+        {
+            frame_handle(&frame);
+        }
+        if (pos != len)
+        {
+            printf("malformed notification, %u of %u bytes left\n", len - pos, len);
+            m_malformed++;
+        }
+    }
+
+    printf("\nstream     frames   lost\n");
+    for (stream = 0; stream < SDC_STREAM_COUNT; stream++)
+    {
+        printf("%-8s %8u %6u\n", m_stream_names[stream], m_frames[stream], m_lost[stream]);
+    }
+    printf("history blocks %u, malformed notifications %u\n", m_blocks, m_malformed);
+
+    return (m_malformed == 0) ? 0 : 1;
+}
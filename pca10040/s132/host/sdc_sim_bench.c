@@ -0,0 +1,259 @@
+/* Host run of the SDC service against the SoftDevice simulator.
+ *
+ * Checks the error paths of ble_sdc_data_send() (not connected, notifications not enabled, too long) and
+ * the diagnostics read through read authorization, then measures notification throughput: a sender keeps
+ * the TX buffers full, refilling them on BLE_EVT_TX_COMPLETE, for each connection interval in the table.
+ * ble_sdc_data_send() is timed with the cycle_prof macros of the firmware, here on the monotonic clock.
+ * Exits with 1 if a check fails.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -Isd_sim -I../arm5_no_packs sdc_sim_bench.c sd_sim/sd_sim.c ../arm5_no_packs/ble_sensor_data_custom.c \
+ *       ../arm5_no_packs/cycle_prof.c -o sdc_sim_bench
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sd_sim.h"
+#include "app_error.h"
+#include "ble_sensor_data_custom.h"
+#include "cycle_prof.h"
+
+#define BENCH_CONN_HANDLE           0x0010
+#define BENCH_DURATION_US           10000000                            /**< Virtual time of each throughput run. */
+#define BENCH_DIAG_PAGE_LEN         40                                  /**< Size of the diagnostics page filled in by diag_handler(). */
+
+static const uint32_t m_conn_intervals_us[] = { 7500, 20000, 50000, 75000 };
+
+static ble_sdc_t                m_sdc;
+static bool                     m_saturate;                             /**< Refill the TX buffers on TX complete. */
+static uint32_t                 m_diag_reads;
+static uint32_t                 m_enabled_evts;
+static uint32_t                 m_disabled_evts;
+static uint32_t                 m_peer_rx;
+static uint32_t                 m_failures;
+
+
+void app_error_handler(uint32_t error_code, uint32_t line_num, const uint8_t * p_file_name)
+{
+    fprintf(stderr, "app_error 0x%x at %s:%u\n", error_code, (char const *)p_file_name, line_num);
+    exit(2);
+}
+
+static void check(bool condition, char const * p_what)
+{
+    printf("%-48s %s\n", p_what, condition ? "ok" : "FAILED");
+    if (!condition)
+    {
+        m_failures++;
+    }
+}
+
+/* Sends until the SoftDevice runs out of TX buffers. */
+static void fill_tx_buffers(void)
+{
+    uint8_t  payload[BLE_SDC_MAX_DATA_LEN];
+    uint32_t err_code;
+
+    memset(payload, 0x5A, sizeof(payload));
+    do
+    {
+        CYCLE_PROF_START(CYCLE_PROF_SDC_DATA_SEND);
+        err_code = ble_sdc_data_send(&m_sdc, payload, sizeof(payload), NULL);
+        CYCLE_PROF_END(CYCLE_PROF_SDC_DATA_SEND);
+    } while (err_code == NRF_SUCCESS);
+}
+
+static void sdc_data_handler(ble_sdc_t * p_sdc, uint8_t * p_data, uint16_t length)
+{
+    UNUSED_PARAMETER(p_sdc);
+    UNUSED_PARAMETER(p_data);
+    UNUSED_PARAMETER(length);
+}
+
+static void sdc_diag_handler(ble_sdc_t * p_sdc, uint8_t * p_data, uint16_t * p_length)
+{
+    UNUSED_PARAMETER(p_sdc);
+    memset(p_data, (uint8_t)m_diag_reads, BENCH_DIAG_PAGE_LEN);
+    *p_length = BENCH_DIAG_PAGE_LEN;
+    m_diag_reads++;
+}
+
+static void sdc_evt_handler(ble_sdc_t * p_sdc, ble_sdc_evt_type_t evt_type, uint8_t link)
+{
+    UNUSED_PARAMETER(p_sdc);
+    UNUSED_PARAMETER(link);
+    if (evt_type == BLE_SDC_EVT_NOTIFICATION_ENABLED)
+    {
+        m_enabled_evts++;
+    }
+    else
+    {
+        m_disabled_evts++;
+    }
+}
+
+static void ble_evt_handler(ble_evt_t * p_ble_evt)
+{
+    ble_sdc_on_ble_evt(&m_sdc, p_ble_evt);
+
+    if ((p_ble_evt->header.evt_id == BLE_EVT_TX_COMPLETE) && m_saturate)
+    {
+        fill_tx_buffers();
+    }
+}
+
+static void peer_rx_handler(uint16_t conn_handle, uint16_t handle, uint8_t const * p_data, uint16_t len)
+{
+    UNUSED_PARAMETER(conn_handle);
+    UNUSED_PARAMETER(p_data);
+    UNUSED_PARAMETER(len);
+    if (handle == m_sdc.rx_handles.value_handle)
+    {
+        m_peer_rx++;
+    }
+}
+
+static void setup(uint32_t conn_interval_us)
+{
+    sd_sim_config_t config;
+    ble_sdc_init_t  sdc_init;
+
+    config.tx_buffer_count   = SD_SIM_TX_BUFFERS_DEFAULT;
+    config.packets_per_event = SD_SIM_PACKETS_PER_EVENT;
+    config.conn_interval_us  = conn_interval_us;
+    config.link_count        = 1;
+    sd_sim_init(&config, ble_evt_handler);
+    sd_sim_peer_rx_handler_set(peer_rx_handler);
+
+    memset(&sdc_init, 0, sizeof(sdc_init));
+    sdc_init.data_handler = sdc_data_handler;
+    sdc_init.diag_handler = sdc_diag_handler;
+    sdc_init.evt_handler  = sdc_evt_handler;
+    APP_ERROR_CHECK(ble_sdc_init(&m_sdc, &sdc_init));
+
+    m_saturate      = false;
+    m_diag_reads    = 0;
+    m_enabled_evts  = 0;
+    m_disabled_evts = 0;
+    m_peer_rx       = 0;
+}
+
+static void cccd_write(uint16_t value)
+{
+    uint8_t cccd[BLE_CCCD_VALUE_LEN];
+
+    (void)uint16_encode(value, cccd);
+    APP_ERROR_CHECK(sd_sim_peer_write(BENCH_CONN_HANDLE, m_sdc.rx_handles.cccd_handle, cccd, sizeof(cccd)));
+}
+
+static void error_paths_run(void)
+{
+    uint8_t        payload[BLE_SDC_MAX_DATA_LEN + 1];
+    uint8_t        page[BLE_SDC_MAX_DIAG_LEN];
+    uint16_t       len;
+    uint32_t       err_code;
+    uint32_t       i;
+    sd_sim_stats_t stats;
+
+    setup(20000);
+    memset(payload, 0, sizeof(payload));
+
+    check(ble_sdc_data_send(&m_sdc, payload, 1, NULL) == NRF_ERROR_INVALID_STATE, "send before connect: INVALID_STATE");
+
+    sd_sim_connect(BENCH_CONN_HANDLE);
+    check(ble_sdc_data_send(&m_sdc, payload, 1, NULL) == NRF_ERROR_INVALID_STATE, "send before CCCD write: INVALID_STATE");
+
+    cccd_write(0x0001);
+    check(m_enabled_evts == 1, "CCCD write raises NOTIFICATION_ENABLED");
+    check(ble_sdc_data_send(&m_sdc, payload, sizeof(payload), NULL) == NRF_ERROR_INVALID_PARAM, "send of MTU - 2 bytes: INVALID_PARAM");
+
+    for (i = 0; i < SD_SIM_TX_BUFFERS_DEFAULT; i++)
+    {
+        err_code = ble_sdc_data_send(&m_sdc, payload, BLE_SDC_MAX_DATA_LEN, NULL);
+        if (err_code != NRF_SUCCESS)
+        {
+            break;
+        }
+    }
+    check(i == SD_SIM_TX_BUFFERS_DEFAULT, "TX buffers accept tx_buffer_count packets");
+    check(ble_sdc_data_send(&m_sdc, payload, 1, NULL) == BLE_ERROR_NO_TX_PACKETS, "send with TX buffers full: NO_TX_PACKETS");
+
+    sd_sim_run(20000);
+    check(m_peer_rx == SD_SIM_PACKETS_PER_EVENT, "one connection event sends packets_per_event");
+    check(ble_sdc_data_send(&m_sdc, payload, 1, NULL) == NRF_SUCCESS, "send after TX complete succeeds");
+
+    len = sizeof(page);
+    err_code = sd_sim_peer_read(BENCH_CONN_HANDLE, m_sdc.diag_handles.value_handle, 0, page, &len);
+    check((err_code == NRF_SUCCESS) && (len == BENCH_DIAG_PAGE_LEN) && (m_diag_reads == 1), "diagnostics read fills in the page");
+
+    len = sizeof(page);
+    err_code = sd_sim_peer_read(BENCH_CONN_HANDLE, m_sdc.diag_handles.value_handle, 22, page, &len);
+    check((err_code == NRF_SUCCESS) && (len == BENCH_DIAG_PAGE_LEN - 22) && (m_diag_reads == 1), "read blob continues from the stored page");
+
+    cccd_write(0x0000);
+    check((m_disabled_evts == 1) && (ble_sdc_data_send(&m_sdc, payload, 1, NULL) == NRF_ERROR_INVALID_STATE),
+          "send after CCCD disable: INVALID_STATE");
+
+    cccd_write(0x0001);
+    sd_sim_disconnect(BENCH_CONN_HANDLE, 0x13);
+    check(m_disabled_evts == 2, "disconnect raises NOTIFICATION_DISABLED");
+    check(ble_sdc_data_send(&m_sdc, payload, 1, NULL) == NRF_ERROR_INVALID_STATE, "send after disconnect: INVALID_STATE");
+
+    sd_sim_stats_get(&stats);
+    printf("hvx calls %u, accepted %u, NO_TX_PACKETS %u\n\n", stats.hvx_calls, stats.hvx_accepted, stats.err_no_tx_packets);
+}
+
+static void throughput_run(uint32_t conn_interval_us)
+{
+    sd_sim_stats_t stats;
+    double         seconds = BENCH_DURATION_US / 1e6;
+
+    setup(conn_interval_us);
+    sd_sim_connect(BENCH_CONN_HANDLE);
+    cccd_write(0x0001);
+
+    m_saturate = true;
+    fill_tx_buffers();
+    sd_sim_run(BENCH_DURATION_US);
+
+    sd_sim_stats_get(&stats);
+    printf("%8.1f %10u %10u %10.0f %10.0f %10u\n",
+           conn_interval_us / 1000.0,
+           stats.conn_events,
+           stats.notifications_sent,
+           stats.notifications_sent / seconds,
+           stats.bytes_sent / seconds,
+           stats.err_no_tx_packets);
+
+    if (stats.notifications_sent != m_peer_rx)
+    {
+        m_failures++;
+    }
+}
+
+int main(void)
+{
+    cycle_prof_stats_t stats;
+    uint32_t           i;
+
+    cycle_prof_init();
+    error_paths_run();
+
+    printf("interval_ms conn_evts    notifs    notifs/s    bytes/s  no_tx_pkts\n");
+    for (i = 0; i < sizeof(m_conn_intervals_us) / sizeof(m_conn_intervals_us[0]); i++)
+    {
+        throughput_run(m_conn_intervals_us[i]);
+    }
+
+    cycle_prof_stats_get(CYCLE_PROF_SDC_DATA_SEND, &stats);
+    printf("\nble_sdc_data_send: %u calls, min %u ns, mean %u ns, max %u ns\nlog2 histogram:",
+           stats.count, stats.min, (uint32_t)(stats.sum / stats.count), stats.max);
+    for (i = 0; i < CYCLE_PROF_HIST_BINS; i++)
+    {
+        printf(" %u", stats.hist[i]);
+    }
+    printf("\n");
+
+    return (m_failures == 0) ? 0 : 1;
+}
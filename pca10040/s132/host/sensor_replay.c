@@ -0,0 +1,199 @@
+/* Linux backend for the sensor pipeline.
+ *
+ * Feeds SAADC buffers from a trace file into sensor_pipeline_process() and prints the reported values, so
+ * the sampling logic can be run and profiled off-target. The report policy is set with -R (APP_REPORT_ flags,
+ * 0 reports every value), -D, -P and -H, and the number of reports per reason is printed at the end. With
+ * -S the statistics summaries of each window are printed as '#' lines between the values. The clock is virtual: each buffer advances it by
+ * samples_in_buffer * sample_period_ms. With -s the replay is paced against the wall clock at the given speed
+ * factor (1 = real time), without -s it runs as fast as possible.
+ *
+ * Trace formats:
+ *   CSV     one sample per line, the last comma separated field is used. Lines starting with '#' are skipped.
+ *   binary  (-b) int16 little endian samples.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -I../arm5_no_packs sensor_replay.c ../arm5_no_packs/sensor_pipeline.c \
+ *       ../arm5_no_packs/window_stats.c -o sensor_replay
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include "app_config.h"
+#include "sensor_pipeline.h"
+
+static app_config_t             m_config = APP_CONFIG_DEFAULTS;         /**< Same defaults as the firmware. */
+static uint64_t                 m_now_ms;                               /**< Virtual time of the current buffer. */
+static bool                     m_quiet;
+static uint32_t                 m_values_sent;
+
+
+static void value_send(uint8_t value)
+{
+    m_values_sent++;
+    if (!m_quiet)
+    {
+        printf("%llu,%u\n", (unsigned long long)m_now_ms, value);
+    }
+}
+
+static void value_log(uint8_t value)
+{
+    (void)value;
+}
+
+static void summary_send(window_stats_summary_t const * p_summary)
+{
+    if (!m_quiet)
+    {
+        printf("# %llu summary: %u s, count %u, min %u, max %u, mean %.2f, variance %.2f, above %.1f s\n",
+               (unsigned long long)m_now_ms, (p_summary->duration_ms + 500) / 1000, p_summary->count,
+               p_summary->min, p_summary->max, p_summary->mean / 256.0, p_summary->variance / 256.0,
+               p_summary->above_ms / 1000.0);
+    }
+}
+
+static const sensor_hal_t m_hal =
+{
+    .value_send   = value_send,
+    .value_log    = value_log,
+    .summary_send = summary_send
+};
+
+/* Reads the next sample. Returns false at the end of the trace. */
+static bool sample_read(FILE * p_file, bool binary, int16_t * p_sample)
+{
+    char line[128];
+
+    if (binary)
+    {
+        uint8_t raw[2];
+        if (fread(raw, 1, sizeof(raw), p_file) != sizeof(raw))
+        {
+            return false;
+        }
+        *p_sample = (int16_t)(raw[0] | (raw[1] << 8));
+        return true;
+    }
+
+    while (fgets(line, sizeof(line), p_file) != NULL)
+    {
+        char * p_field = strrchr(line, ',');
+
+        if ((line[0] == '#') || (line[0] == '\n') || (line[0] == '\r'))
+        {
+            continue;
+        }
+        *p_sample = (int16_t)strtol((p_field != NULL) ? (p_field + 1) : line, NULL, 10);
+        return true;
+    }
+    return false;
+}
+
+static double wall_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(char const * p_name)
+{
+    fprintf(stderr,
+            "usage: %s [-b] [-q] [-s speed] [-n samples_per_buffer] [-p sample_period_ms]\n"
+            "       [-m value_max] [-r release_level] [-R report_modes] [-D report_deadband]\n"
+            "       [-P report_period_s] [-H report_heartbeat_s] [-S summary_window_s] trace\n", p_name);
+    exit(2);
+}
+
+int main(int argc, char ** argv)
+{
+    int16_t                 buffer[SAMPLES_IN_BUFFER];
+    uint16_t                count = 0;
+    bool                    binary = false;
+    double                  speed = 0;
+    double                  start;
+    double                  elapsed;
+    FILE                  * p_file;
+    sensor_pipeline_stats_t stats;
+    int                     opt;
+
+    while ((opt = getopt(argc, argv, "bqs:n:p:m:r:R:D:P:H:S:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'b': binary = true;                                             break;
+            case 'q': m_quiet = true;                                            break;
+            case 's': speed = atof(optarg);                                      break;
+            case 'n': m_config.samples_in_buffer  = (uint16_t)atoi(optarg);      break;
+            case 'p': m_config.sample_period_ms   = (uint16_t)atoi(optarg);      break;
+            case 'm': m_config.value_max          = (uint8_t)atoi(optarg);       break;
+            case 'r': m_config.release_level      = (uint8_t)atoi(optarg);       break;
+            case 'R': m_config.report_modes       = (uint8_t)strtol(optarg, NULL, 0); break;
+            case 'D': m_config.report_deadband    = (uint8_t)atoi(optarg);       break;
+            case 'P': m_config.report_period_s    = (uint16_t)atoi(optarg);      break;
+            case 'H': m_config.report_heartbeat_s = (uint16_t)atoi(optarg);      break;
+            case 'S': m_config.summary_window_s   = (uint16_t)atoi(optarg);      break;
+            default:  usage(argv[0]);
+        }
+    }
+    if ((optind != argc - 1)
+        || (m_config.samples_in_buffer == 0) || (m_config.samples_in_buffer > SAMPLES_IN_BUFFER)
+        || (m_config.report_period_s == 0) || (m_config.report_heartbeat_s == 0))
+    {
+        usage(argv[0]);
+    }
+
+    p_file = fopen(argv[optind], binary ? "rb" : "r");
+    if (p_file == NULL)
+    {
+        perror(argv[optind]);
+        return 1;
+    }
+
+    sensor_pipeline_init(&m_hal, &m_config);
+    start = wall_seconds();
+
+    while (sample_read(p_file, binary, &buffer[count]))
+    {
+        if (++count < m_config.samples_in_buffer)
+        {
+            continue;
+        }
+
+        m_now_ms += (uint64_t)count * m_config.sample_period_ms;
+        if (speed > 0)
+        {
+            double ahead = m_now_ms / (1000.0 * speed) - (wall_seconds() - start);
+            if (ahead > 0)
+            {
+                usleep((useconds_t)(ahead * 1e6));
+            }
+        }
+
+        sensor_pipeline_process(buffer, count);
+        count = 0;
+    }
+    fclose(p_file);
+
+    elapsed = wall_seconds() - start;
+    sensor_pipeline_stats_get(&stats);
+
+    fprintf(stderr, "buffers %u, invalid %u, reported %u, peak holds %u\n",
+            stats.buffers, stats.values_invalid, stats.values_reported, stats.peak_holds);
+    fprintf(stderr, "sent %u (1 per %.1f values): forced %u, threshold %u, change %u, periodic %u, heartbeat %u\n",
+            m_values_sent,
+            (m_values_sent > 0) ? (double)stats.values_reported / m_values_sent : 0,
+            stats.reports[SENSOR_REPORT_FORCED],
+            stats.reports[SENSOR_REPORT_THRESHOLD],
+            stats.reports[SENSOR_REPORT_CHANGE],
+            stats.reports[SENSOR_REPORT_PERIODIC],
+            stats.reports[SENSOR_REPORT_HEARTBEAT]);
+    fprintf(stderr, "summaries %u\n", stats.summaries);
+    fprintf(stderr, "trace time %.1f s, wall time %.3f s (x%.0f)\n",
+            m_now_ms / 1000.0, elapsed, (elapsed > 0) ? (m_now_ms / 1000.0) / elapsed : 0);
+    return 0;
+}
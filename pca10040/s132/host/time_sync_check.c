@@ -0,0 +1,220 @@
+/* Drift correction check of time_sync.
+ *
+ * Simulates a device clock with a crystal error, and optionally a daily temperature swing of it, against
+ * a central writing its time every sync interval. Each write reaches the device after a random latency of
+ * up to one connection interval. The local clock is quantized like app_time: RTC ticks at 32768 Hz, read
+ * in whole ms.
+ *
+ * Every CHECK_INTERVAL_MS once time_sync uses its fit the central time it predicts is compared with the
+ * true one, and with what the last write plus the uncorrected local clock would give. Prints per scenario
+ * mean, standard deviation and range of both errors and the drift estimate at the end. A scenario fails if
+ * an error goes past ERROR_MAX_MS once the fit spans 2 * TIME_SYNC_FIT_MIN_MS, if the drift estimate is off
+ * by more than DRIFT_TOLERANCE_PPM (scaled up for runs shorter than DRIFT_TOLERANCE_RUN_H), or if the
+ * corrected error spreads more than the uncorrected one. The mean delay of the writes ends up in the offset
+ * of both, so it is left out of the comparison. A scenario whose sync interval is too long for a fit within the run is skipped. Exits with 1
+ * if any scenario fails.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -I../arm5_no_packs time_sync_check.c ../arm5_no_packs/time_sync.c -lm -o time_sync_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <math.h>
+#include <unistd.h>
+#include "time_sync.h"
+
+#define EPOCH_START_MS              1700000000000ULL                    /**< Central time at the start of a run. */
+#define DAY_MS                      (24.0 * 60 * 60 * 1000)
+#define CHECK_INTERVAL_MS           10000
+#define ERROR_MAX_MS                100                                 /**< Worst error accepted after the warm-up, the latency of a write included. */
+#define DRIFT_TOLERANCE_PPM         1.0                                 /**< Error of the drift estimate accepted at the end, the daily swing averaged out. */
+#define DRIFT_TOLERANCE_RUN_H       48                                  /**< Run length the tolerance is for, the write jitter weighs more on shorter ones. */
+
+typedef struct
+{
+    char const * p_name;
+    double       error_ppm;             /**< Crystal error, positive when the local clock runs fast. */
+    double       swing_ppm;             /**< Amplitude of the daily swing of the error. */
+    double       sync_interval_s;
+    double       step_at_h;             /**< Time of a step of the central clock, 0 for none. */
+    double       step_s;
+} scenario_t;
+
+static const scenario_t m_scenarios[] =
+{
+    { "exact",            0,   0,  600, 0, 0 },
+    { "+20 ppm",         20,   0,  600, 0, 0 },
+    { "-20 ppm",        -20,   0,  600, 0, 0 },
+    { "+50 ppm",         50,   0,  600, 0, 0 },
+    { "+20 ppm 1 min",   20,   0,   60, 0, 0 },
+    { "+20 ppm 1 h",     20,   0, 3600, 0, 0 },
+    { "+20 ppm 6 h",     20,   0, 21600, 0, 0 },
+    { "+20 ppm swing 5", 20,   5,  600, 0, 0 },
+    { "-250 ppm (RC)", -250,   0,  600, 0, 0 },
+    { "-250 ppm 1 h",  -250,   0, 3600, 0, 0 },
+    { "+20 ppm step",    20,   0,  600, 12, 3600 },
+};
+
+static double                   m_latency_max_ms = 75;                  /**< Longest latency of a write, the connection interval. */
+static double                   m_duration_h     = 48;
+static uint32_t                 m_rng            = 1;
+
+
+static double rng_uniform(void)
+{
+    // xorshift32
+    m_rng ^= m_rng << 13;
+    m_rng ^= m_rng >> 17;
+    m_rng ^= m_rng << 5;
+    return (m_rng >> 8) / 16777216.0;
+}
+
+/* Local time in ms at true time t_ms, as app_time_ms_get() would return it. */
+static uint64_t local_ms(scenario_t const * p_scenario, double t_ms)
+{
+    double w     = 2 * M_PI / DAY_MS;
+    double local = t_ms + 1e-6 * (p_scenario->error_ppm * t_ms + p_scenario->swing_ppm * sin(w * t_ms) / w);
+    double ticks = floor(local * 32.768);
+
+    return (uint64_t)floor(ticks * 1000 / 32768);
+}
+
+/* Central time at true time t_ms. */
+static uint64_t epoch_ms(scenario_t const * p_scenario, double t_ms)
+{
+    double step = ((p_scenario->step_at_h > 0) && (t_ms >= p_scenario->step_at_h * 3600000)) ? p_scenario->step_s * 1000 : 0;
+    return EPOCH_START_MS + (uint64_t)(t_ms + step);
+}
+
+/* Runs a scenario. Returns false if the error went past ERROR_MAX_MS. */
+static bool scenario_run(scenario_t const * p_scenario)
+{
+    double            t_end   = m_duration_h * 3600000;
+    double            t_sync  = 0;
+    double            t_check = 0;
+    uint64_t          last_local = 0;
+    uint64_t          last_epoch = 0;
+    double            err_lo     = INFINITY;
+    double            err_hi     = -INFINITY;
+    double            err_sum    = 0;
+    double            err_sq     = 0;
+    double            raw_lo     = INFINITY;
+    double            raw_hi     = -INFINITY;
+    double            raw_sum    = 0;
+    double            raw_sq     = 0;
+    double            err_max    = 0;
+    double            err_sd;
+    double            raw_sd;
+    double            drift_err;
+    double            drift_tol;
+    bool              ok;
+    uint32_t          checks     = 0;
+    double            fitted_at  = -1;
+    time_sync_stats_t stats;
+
+    time_sync_init();
+
+    while (t_check < t_end)
+    {
+        if (t_sync <= t_check)
+        {
+            // The central takes its time, the write arrives a little later.
+            double arrival = t_sync + rng_uniform() * m_latency_max_ms;
+
+            last_local = local_ms(p_scenario, arrival);
+            last_epoch = epoch_ms(p_scenario, t_sync);
+            (void)time_sync_on_sync(last_local, last_epoch);
+            t_sync += p_scenario->sync_interval_s * 1000;
+            continue;
+        }
+
+        time_sync_stats_get(&stats);
+        if (stats.fitted && (fitted_at < 0))
+        {
+            fitted_at = t_check;
+        }
+        if (stats.fitted)
+        {
+            uint64_t local = local_ms(p_scenario, t_check);
+            double   truth = (double)epoch_ms(p_scenario, t_check);
+            double   err   = (double)time_sync_epoch_ms(local) - truth;
+            double   raw   = (double)(last_epoch + (local - last_local)) - truth;
+
+            // The first fits rest on three points, their drift error is not held against the bound.
+            if (stats.span_s * 1000ULL >= 2ULL * TIME_SYNC_FIT_MIN_MS)
+            {
+                err_max = fmax(err_max, fabs(err));
+            }
+
+            // Right after a step the writes have not caught up yet, as for the uncorrected clock.
+            if ((p_scenario->step_at_h == 0) || (fabs(t_check - p_scenario->step_at_h * 3600000) > p_scenario->sync_interval_s * 1000))
+            {
+                err_lo   = fmin(err_lo, err);
+                err_hi   = fmax(err_hi, err);
+                raw_lo   = fmin(raw_lo, raw);
+                raw_hi   = fmax(raw_hi, raw);
+                err_sum += err;
+                raw_sum += raw;
+                err_sq  += err * err;
+                raw_sq  += raw * raw;
+                checks++;
+            }
+        }
+        t_check += CHECK_INTERVAL_MS;
+    }
+
+    time_sync_stats_get(&stats);
+    if (checks == 0)
+    {
+        printf("%-16s no fit within %.0f h, skipped\n", p_scenario->p_name, m_duration_h);
+        return true;
+    }
+    err_sd    = sqrt(fmax(0, err_sq / checks - (err_sum / checks) * (err_sum / checks)));
+    raw_sd    = sqrt(fmax(0, raw_sq / checks - (raw_sum / checks) * (raw_sum / checks)));
+    drift_err = stats.drift_ppb / 1000.0 + p_scenario->error_ppm;
+    drift_tol = DRIFT_TOLERANCE_PPM * fmax(1, DRIFT_TOLERANCE_RUN_H / m_duration_h);
+    ok        = (err_max <= ERROR_MAX_MS) && (fabs(drift_err) <= drift_tol) && (err_sd <= raw_sd);
+
+    printf("%-16s fit after %4.1f h | corrected %6.1f sd %5.1f [%6.1f, %6.1f] ms | uncorrected %6.1f sd %5.1f [%7.1f, %6.1f] ms | drift %8.3f ppm (true %8.3f) | steps %u  %s\n",
+           p_scenario->p_name, fitted_at / 3600000, err_sum / checks, err_sd, err_lo, err_hi,
+           raw_sum / checks, raw_sd, raw_lo, raw_hi, stats.drift_ppb / 1000.0, -p_scenario->error_ppm, stats.steps,
+           ok ? "ok" : "FAIL");
+    return ok;
+}
+
+static void usage(char const * p_name)
+{
+    fprintf(stderr, "usage: %s [-l latency_max_ms] [-d duration_h] [-s seed]\n", p_name);
+    exit(2);
+}
+
+int main(int argc, char ** argv)
+{
+    bool     ok = true;
+    uint32_t i;
+    int      opt;
+
+    while ((opt = getopt(argc, argv, "l:d:s:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'l': m_latency_max_ms = atof(optarg);            break;
+            case 'd': m_duration_h     = atof(optarg);            break;
+            case 's': m_rng            = (uint32_t)atoi(optarg);  break;
+            default:  usage(argv[0]);
+        }
+    }
+    if ((m_duration_h * 3600000 <= 2 * TIME_SYNC_FIT_MIN_MS) || (m_rng == 0))
+    {
+        usage(argv[0]);
+    }
+
+    for (i = 0; i < sizeof(m_scenarios) / sizeof(m_scenarios[0]); i++)
+    {
+        ok = scenario_run(&m_scenarios[i]) && ok;
+    }
+    return ok ? 0 : 1;
+}
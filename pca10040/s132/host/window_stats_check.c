@@ -0,0 +1,245 @@
+/* Accuracy check of the window_stats fixed-point accumulator.
+ *
+ * Feeds generated streams, and optionally traces, through window_stats_add() and compares every summary
+ * with a two-pass double precision reference of the same values. Prints the worst errors per stream and
+ * exits with 1 if mean or variance are off by more than the tolerances below, or count, min, max or time
+ * above differ at all.
+ *
+ * Generated streams (seeded, so runs repeat): uniform over 0..255, a free bay (level 3 with noise of +-2),
+ * a bay switching between free and occupied every 500 values, and a slow ramp. Each is summarized in
+ * windows of 1, 10, 1000, 100000 and 4000000 values, the last one longer than the longest window the
+ * configuration allows at the fastest sampling (3600 s at 1 value per ms).
+ *
+ * Traces are CSV like for sensor_replay: the last field of each line is a value, '#' lines are skipped.
+ * Their values are clamped to 0..255 and summarized in windows of -w values.
+ *
+ * Build:
+ *   gcc -std=gnu99 -O2 -I../arm5_no_packs window_stats_check.c ../arm5_no_packs/window_stats.c -lm \
+ *       -o window_stats_check
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <unistd.h>
+#include "window_stats.h"
+
+#define MEAN_TOLERANCE              (1.0 / 256)                         /**< Q8 rounding (half an LSB) plus the drift of the fixed-point mean. */
+#define VARIANCE_TOLERANCE          (1.0 / 256)                         /**< Absolute part, Q8 rounding of the variance. */
+#define VARIANCE_TOLERANCE_REL      1e-4                                /**< Relative part, error of M2 through the mean drift. */
+#define THRESHOLD                   25                                  /**< Level counted for time above, the default release_level. */
+#define VALUE_MS                    180                                 /**< Duration of each value. */
+#define MAX_WINDOW                  4000000
+
+/* Worst errors of a stream. */
+typedef struct
+{
+    uint32_t windows;
+    double   mean_err;
+    double   variance_err;              /**< Absolute error. */
+    double   variance_rel;              /**< Error relative to the reference variance, for variances above 1. */
+    uint32_t exact_fails;               /**< Summaries with count, min, max or time above wrong. */
+    bool     failed;
+} result_t;
+
+static uint8_t *                m_values;
+static uint32_t                 m_rng = 12345;
+
+
+static uint32_t rng_next(void)
+{
+    // xorshift32
+    m_rng ^= m_rng << 13;
+    m_rng ^= m_rng >> 17;
+    m_rng ^= m_rng << 5;
+    return m_rng;
+}
+
+/* Compares the summary of values[0..count) with the reference. */
+static void window_check(uint8_t const * p_values, uint32_t count, result_t * p_result)
+{
+    window_stats_t         stats;
+    window_stats_summary_t summary;
+    double                 sum = 0;
+    double                 m2  = 0;
+    double                 mean;
+    double                 variance;
+    double                 err;
+    uint8_t                min = 255;
+    uint8_t                max = 0;
+    uint32_t               above = 0;
+    uint32_t               i;
+
+    window_stats_reset(&stats);
+    for (i = 0; i < count; i++)
+    {
+        window_stats_add(&stats, p_values[i], VALUE_MS, (p_values[i] >= THRESHOLD));
+        sum  += p_values[i];
+        min   = (p_values[i] < min) ? p_values[i] : min;
+        max   = (p_values[i] > max) ? p_values[i] : max;
+        above += (p_values[i] >= THRESHOLD) ? 1 : 0;
+    }
+    mean = sum / count;
+    for (i = 0; i < count; i++)
+    {
+        m2 += (p_values[i] - mean) * (p_values[i] - mean);
+    }
+    variance = m2 / count;
+
+    window_stats_summary(&stats, &summary);
+    p_result->windows++;
+
+    if ((summary.count != count) || (summary.min != min) || (summary.max != max)
+        || (summary.above_ms != above * VALUE_MS) || (summary.duration_ms != count * VALUE_MS))
+    {
+        p_result->exact_fails++;
+        p_result->failed = true;
+    }
+
+    err = fabs(summary.mean / 256.0 - mean);
+    if (err > p_result->mean_err)
+    {
+        p_result->mean_err = err;
+    }
+    if (err > MEAN_TOLERANCE)
+    {
+        p_result->failed = true;
+    }
+
+    err = fabs(summary.variance / 256.0 - variance);
+    if (err > p_result->variance_err)
+    {
+        p_result->variance_err = err;
+    }
+    if ((variance > 1) && (err / variance > p_result->variance_rel))
+    {
+        p_result->variance_rel = err / variance;
+    }
+    if (err > VARIANCE_TOLERANCE + VARIANCE_TOLERANCE_REL * variance)
+    {
+        p_result->failed = true;
+    }
+}
+
+/* Summarizes values[0..count) in windows of window values, the last one may be shorter. */
+static void stream_check(char const * p_name, uint32_t count, uint32_t window, bool * p_failed)
+{
+    result_t result;
+    uint32_t pos;
+
+    memset(&result, 0, sizeof(result));
+    for (pos = 0; pos < count; pos += window)
+    {
+        window_check(&m_values[pos], ((count - pos) < window) ? (count - pos) : window, &result);
+    }
+
+    printf("%-10s window %7u: %6u summaries, mean err %.6f, variance err %.6f (rel %.2e)%s%s\n",
+           p_name, window, result.windows, result.mean_err, result.variance_err, result.variance_rel,
+           (result.exact_fails > 0) ? ", count/min/max/above wrong" : "",
+           result.failed ? "  FAIL" : "");
+    *p_failed = *p_failed || result.failed;
+}
+
+/* Reads the values of a trace into m_values. Returns the number of values. */
+static uint32_t trace_read(char const * p_path)
+{
+    char     line[128];
+    uint32_t count = 0;
+    FILE   * p_file = fopen(p_path, "r");
+
+    if (p_file == NULL)
+    {
+        perror(p_path);
+        exit(2);
+    }
+    while ((count < MAX_WINDOW) && (fgets(line, sizeof(line), p_file) != NULL))
+    {
+        char * p_field = strrchr(line, ',');
+        long   value;
+
+        if ((line[0] == '#') || (line[0] == '\n') || (line[0] == '\r'))
+        {
+            continue;
+        }
+        value = strtol((p_field != NULL) ? (p_field + 1) : line, NULL, 10);
+        m_values[count++] = (uint8_t)((value < 0) ? 0 : ((value > 255) ? 255 : value));
+    }
+    fclose(p_file);
+    return count;
+}
+
+static void usage(char const * p_name)
+{
+    fprintf(stderr, "usage: %s [-w trace_window] [trace...]\n", p_name);
+    exit(2);
+}
+
+int main(int argc, char ** argv)
+{
+    static const uint32_t windows[] = { 1, 10, 1000, 100000, MAX_WINDOW };
+    uint32_t              trace_window = 1000;
+    bool                  failed = false;
+    uint32_t              i;
+    uint32_t              w;
+    int                   opt;
+
+    while ((opt = getopt(argc, argv, "w:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'w': trace_window = (uint32_t)atoi(optarg); break;
+            default:  usage(argv[0]);
+        }
+    }
+    if ((trace_window == 0) || (trace_window > MAX_WINDOW))
+    {
+        usage(argv[0]);
+    }
+
+    m_values = malloc(MAX_WINDOW);
+    if (m_values == NULL)
+    {
+        return 2;
+    }
+
+    for (w = 0; w < sizeof(windows) / sizeof(windows[0]); w++)
+    {
+        for (i = 0; i < MAX_WINDOW; i++)
+        {
+            m_values[i] = (uint8_t)rng_next();
+        }
+        stream_check("uniform", MAX_WINDOW, windows[w], &failed);
+
+        for (i = 0; i < MAX_WINDOW; i++)
+        {
+            m_values[i] = (uint8_t)(1 + rng_next() % 5);
+        }
+        stream_check("free", MAX_WINDOW, windows[w], &failed);
+
+        for (i = 0; i < MAX_WINDOW; i++)
+        {
+            m_values[i] = (uint8_t)((((i / 500) % 2) ? 180 : 3) + rng_next() % 5);
+        }
+        stream_check("switching", MAX_WINDOW, windows[w], &failed);
+
+        for (i = 0; i < MAX_WINDOW; i++)
+        {
+            m_values[i] = (uint8_t)((i / 1000) % 256);
+        }
+        stream_check("ramp", MAX_WINDOW, windows[w], &failed);
+    }
+
+    for (i = optind; i < (uint32_t)argc; i++)
+    {
+        uint32_t count = trace_read(argv[i]);
+        if (count > 0)
+        {
+            stream_check(argv[i], count, trace_window, &failed);
+        }
+    }
+
+    free(m_values);
+    return failed ? 1 : 0;
+}